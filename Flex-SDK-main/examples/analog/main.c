@@ -16,6 +16,10 @@
 // This example will supply power to an Analog sensor,
 // read the current (in uA ) OR voltage (in mV) level at the
 // EXT_ANALOG_IN pin and print the value on the debug console.
+// Rather than waiting a fixed time for the sensor to stabilise, the input is
+// sampled until consecutive readings agree, after which an oversampled and
+// filtered reading is taken. This keeps the sensor powered for as short a time
+// as possible.
 //! [CODE]
 
 #include <stdio.h>
@@ -30,9 +34,13 @@
 #if MEASURE_CURRENT
 #define ANALOG_IN_MODE FLEX_ANALOG_IN_CURRENT
 #define APPLICATION_MODE "current"
+// Readings within 20uA (~0.1% of the 4-20mA span) are considered settled.
+#define SENSOR_SETTLE_TOLERANCE 20
 #else
 #define ANALOG_IN_MODE FLEX_ANALOG_IN_VOLTAGE
 #define APPLICATION_MODE "voltage"
+// Readings within 10mV (0.1% of the 0-10V span) are considered settled.
+#define SENSOR_SETTLE_TOLERANCE 10
 #endif
 
 // The number of sensor readings a day.
@@ -43,8 +51,89 @@
 // The FlexSense board supports an output voltage given by the enum FLEX_PowerOut.
 #define ANALOG_SENSOR_POWER_IN FLEX_POWER_OUT_24V
 
-// Modify this delay to save power based on the sensor stabilisation time
+// The maximum time to wait for the sensor to stabilise. If the readings
+// haven't settled by then, the measurement is taken anyway.
 #define DELAY_SENSOR_STABILISE_MS 1500
+// The interval between readings while waiting for the sensor to stabilise.
+#define SENSOR_SETTLE_INTERVAL_MS 20
+// The number of consecutive readings that must be within the tolerance.
+#define SENSOR_SETTLE_WINDOW 5
+
+// The number of readings averaged for a measurement, of which the
+// SENSOR_OVERSAMPLE_TRIM lowest and highest are discarded as outliers.
+#define SENSOR_OVERSAMPLE_COUNT 8
+#define SENSOR_OVERSAMPLE_TRIM 2
+
+static int ReadAnalogInput(uint32_t *const Reading) {
+#if MEASURE_CURRENT
+  return FLEX_AnalogInputReadCurrent(Reading);
+#else
+  return FLEX_AnalogInputReadVoltage(Reading);
+#endif
+}
+
+// Samples the input until the last SENSOR_SETTLE_WINDOW readings are within
+// SENSOR_SETTLE_TOLERANCE of each other or DELAY_SENSOR_STABILISE_MS elapses.
+// Returns the time taken in milliseconds, or < 0 if reading the input failed.
+static int32_t WaitForSensorToSettle(void) {
+  uint32_t Window[SENSOR_SETTLE_WINDOW] = {0};
+  uint32_t Count = 0;
+  const uint32_t StartTick = FLEX_TickGet();
+
+  while (true) {
+    if (ReadAnalogInput(&Window[Count % SENSOR_SETTLE_WINDOW]) != 0) {
+      return -1;
+    }
+    ++Count;
+
+    const uint32_t Elapsed = FLEX_TickGet() - StartTick;
+    if (Count >= SENSOR_SETTLE_WINDOW) {
+      uint32_t Min = UINT32_MAX;
+      uint32_t Max = 0;
+      for (uint32_t i = 0; i < SENSOR_SETTLE_WINDOW; ++i) {
+        Min = Window[i] < Min ? Window[i] : Min;
+        Max = Window[i] > Max ? Window[i] : Max;
+      }
+      if (Max - Min <= SENSOR_SETTLE_TOLERANCE) {
+        return Elapsed;
+      }
+    }
+
+    if (Elapsed >= DELAY_SENSOR_STABILISE_MS) {
+      printf("Sensor did not settle within %dms.\r\n", DELAY_SENSOR_STABILISE_MS);
+      return Elapsed;
+    }
+    FLEX_DelayMs(SENSOR_SETTLE_INTERVAL_MS);
+  }
+}
+
+// Takes SENSOR_OVERSAMPLE_COUNT readings and returns their trimmed mean, which
+// rejects spikes without the bias of a plain average.
+static int ReadAnalogInputFiltered(uint32_t *const Reading) {
+  uint32_t Samples[SENSOR_OVERSAMPLE_COUNT] = {0};
+  for (uint32_t i = 0; i < SENSOR_OVERSAMPLE_COUNT; ++i) {
+    uint32_t Sample = 0;
+    if (ReadAnalogInput(&Sample) != 0) {
+      return -1;
+    }
+
+    // Insertion sort as the samples arrive.
+    uint32_t j = i;
+    for (; j > 0 && Samples[j - 1] > Sample; --j) {
+      Samples[j] = Samples[j - 1];
+    }
+    Samples[j] = Sample;
+  }
+
+  uint64_t Sum = 0;
+  for (uint32_t i = SENSOR_OVERSAMPLE_TRIM; i < SENSOR_OVERSAMPLE_COUNT - SENSOR_OVERSAMPLE_TRIM;
+       ++i) {
+    Sum += Samples[i];
+  }
+  const uint32_t Count = SENSOR_OVERSAMPLE_COUNT - 2 * SENSOR_OVERSAMPLE_TRIM;
+  *Reading = (Sum + Count / 2) / Count;
+  return 0;
+}
 
 static uint32_t MeasureAnalogInput(void) {
   uint32_t SensorReading = UINT32_MAX;
@@ -59,17 +148,19 @@ static uint32_t MeasureAnalogInput(void) {
     goto fail_1;
   }
 
-  FLEX_DelayMs(DELAY_SENSOR_STABILISE_MS);
+  const int32_t SettleMs = WaitForSensorToSettle();
+  if (SettleMs >= 0) {
+    printf("Sensor settled in %ldms.\r\n", (long)SettleMs);
+  }
 
+  if (SettleMs < 0 || ReadAnalogInputFiltered(&SensorReading) != 0) {
+    SensorReading = UINT32_MAX;
 #if MEASURE_CURRENT
-  if (FLEX_AnalogInputReadCurrent(&SensorReading) != 0) {
     printf("Failed to Read Current.\r\n");
-  }
 #else
-  if (FLEX_AnalogInputReadVoltage(&SensorReading) != 0) {
     printf("Failed to Read Voltage.\r\n");
-  }
 #endif
+  }
 
   // De-initialise the Analog Input for the lowest idle power consumption.
   FLEX_AnalogInputDeinit();
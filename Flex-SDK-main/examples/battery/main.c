@@ -12,20 +12,33 @@
 // limitations under the License.
 
 // An example running on Myriota's "FlexSense" board.
-// This example demonstrates how to use the Battery API's. The "BatterySample" job will sample if
-// the device is externally or battery-powered "FLEX_IsOnExternalPower" and the battery voltage
-// "FLEX_GetBatteryVoltage" and print it on the debug console. "BatterySample" will be scheduled
-// "SAMPLES_PER_DAY" times per day.
+// This example demonstrates how to use the Battery API's with the Myriota Power
+// Policy library. The "BatterySample" job samples if the device is externally
+// or battery-powered "FLEX_IsOnExternalPower" and the battery voltage
+// "FLEX_GetBatteryVoltage", updates the power policy and prints the resulting
+// power level on the debug console. "BatterySample" is scheduled
+// "SAMPLES_PER_DAY" times per day on a healthy battery, less often as the
+// battery runs down, and straight away when the external power state changes.
 //! [CODE]
 
 #include <stdio.h>
 #include "flex.h"
+#include "myriota/power_policy.h"
 
 #define APPLICATION_NAME "Battery API Example"
 
 // Sample frequency
 #define SAMPLES_PER_DAY 4
 
+static MYRIOTA_PowerPolicy power_policy;
+
+static const char *const LevelNames[] = {
+  [MYRIOTA_POWER_LEVEL_CRITICAL] = "critical",
+  [MYRIOTA_POWER_LEVEL_LOW] = "low",
+  [MYRIOTA_POWER_LEVEL_NORMAL] = "normal",
+  [MYRIOTA_POWER_LEVEL_EXTERNAL] = "external",
+};
+
 // Sample if the FlexSense device is externally powered and the battery voltage.
 static time_t BatterySample(void) {
   // Check if the FlexSense is externally powered (via USB or the FlexSense external cable
@@ -41,25 +54,34 @@ static time_t BatterySample(void) {
     printf("Failed to read battery voltage!\n");
   }
 
+  const MYRIOTA_PowerLevel level =
+    MYRIOTA_PowerPolicyUpdate(&power_policy, battery_mv, is_on_external_power);
+
   // Print the results on the debug console.
-  printf("Battery API Sample: Is on external power = %d, Battery mV = %ld\n", is_on_external_power,
-    battery_mv);
+  printf("Battery API Sample: Is on external power = %d, Battery mV = %ld, Power level = %s\n",
+    is_on_external_power, battery_mv, LevelNames[level]);
 
-  return (FLEX_TimeGet() + 24 * 3600 / SAMPLES_PER_DAY);
+  return (FLEX_TimeGet() + MYRIOTA_PowerPolicyIntervalScale(&power_policy,
+                             24 * 3600 / SAMPLES_PER_DAY));
 }
 
 static void on_external_power_handler(const bool *const is_ext_pwr) {
-  char buf[32] = {0};
-  snprintf(buf, sizeof(buf), "External Power: (%d)\n", *is_ext_pwr);
+  const MYRIOTA_PowerLevel level = MYRIOTA_PowerPolicyExternalPowerSet(&power_policy, *is_ext_pwr);
+  printf("External Power: (%d), Power level = %s\n", *is_ext_pwr, LevelNames[level]);
+
+  // Resample straight away, as the battery voltage only reads while on battery power.
+  FLEX_JobSchedule(BatterySample, FLEX_ASAP());
 }
 
 void FLEX_AppInit() {
   printf("%s\n", APPLICATION_NAME);
+
+  const MYRIOTA_PowerPolicyConfig config = MYRIOTA_POWER_POLICY_DEFAULT_CONFIG;
+  MYRIOTA_PowerPolicyInit(&power_policy, config);
+
   FLEX_JobSchedule(BatterySample, FLEX_ASAP());
 
-  // Sample the `is external power` status and the battery voltage if the external power status
-  // changes. If the external power status does not change then the sample will be every
-  // DAYS_BETWEEN_MESSAGES days
+  // Update the power policy and resample if the external power status changes.
   FLEX_OnExternalPowerHandlerSet(on_external_power_handler);
 }
 //! [CODE]
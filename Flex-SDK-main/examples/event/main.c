@@ -12,34 +12,118 @@
 // limitations under the License.
 
 // An example running on Myriota's "FlexSense" board.
-// This example demonstrates the handling of an External Digital IO wakeup
-// event. RunsOnExtDigitalIOWakeup job is scheduled when the
-// External Digital IO is pulled Low.
+// This example logs the transitions of contacts (e.g. door or valve switches)
+// on the External Digital IOs, which are pulled Low when active, using the
+// Myriota Event Log library. Transitions are debounced in software and sent
+// once a day as a summary with per pin counters and duty cycle, followed by
+// the compressed transitions.
 //! [CODE]
 
 #include <stdio.h>
 #include "flex.h"
+#include "myriota/event_log.h"
 
-#define APPLICATION_NAME "External Digital I/O Wake-up Event"
+#define APPLICATION_NAME "External Digital I/O Event Log"
 
-// Note: Change this to set the desired External Digital IO Pin for wakeup.
-const FLEX_DigitalIOPin WakeupPin = FLEX_EXT_DIGITAL_IO_1;
+// Note: Change this to set the desired External Digital IO Pins.
+static const FLEX_DigitalIOPin Pins[] = {FLEX_EXT_DIGITAL_IO_1, FLEX_EXT_DIGITAL_IO_2};
+#define PIN_COUNT (sizeof(Pins) / sizeof(*Pins))
 
-static void RunsOnExtDigitalIOWakeup() {
+// A level must be stable for this long to be logged.
+#define DEBOUNCE_MS 50
+#define DEBOUNCE_POLL_MS 10
+// Give up on a contact which is still chattering after this long.
+#define DEBOUNCE_TIMEOUT_MS 1000
+
+// Wakeups only happen on a falling edge, so inputs are polled while active to
+// catch their release, and occasionally while idle in case an edge was missed.
+#define ACTIVE_POLL_INTERVAL_MINS 1
+#define IDLE_POLL_INTERVAL_HOURS 1
+
+#define LOG_FRAMES_MAX 3
+#define LOG_INTERVAL_HOURS 24
+
+static MYRIOTA_EventLog Log;
+
+// Samples the inputs until they settle, then re-arms the wakeup of inactive
+// inputs. A contact held active can't wake again until it has been released,
+// so it can't keep waking the device.
+// Returns true if any input is active.
+static bool SampleInputs(void) {
+  const uint32_t start = FLEX_TickGet();
+  bool is_settled;
+  do {
+    is_settled = true;
+    const time_t now = FLEX_TimeGet();
+    for (size_t i = 0; i < PIN_COUNT; ++i) {
+      const int level = FLEX_ExtDigitalIOGet(Pins[i]);
+      if (level >= 0 && !MYRIOTA_EventLogSample(&Log, i, level, FLEX_TickGet(), now)) {
+        is_settled = false;
+      }
+    }
+    if (!is_settled) {
+      FLEX_DelayMs(DEBOUNCE_POLL_MS);
+    }
+  } while (!is_settled && FLEX_TickGet() - start < DEBOUNCE_TIMEOUT_MS);
+
+  bool is_active = false;
+  for (size_t i = 0; i < PIN_COUNT; ++i) {
+    if (MYRIOTA_EventLogLevelGet(&Log, i) == FLEX_EXT_DIGITAL_IO_HIGH) {
+      FLEX_ExtDigitalIOWakeupModify(Pins[i], FLEX_EXT_DIGITAL_IO_WAKEUP_ENABLE);
+    } else {
+      is_active = true;
+    }
+  }
+  return is_active;
+}
+
+static time_t PollInputs(void) {
+  if (SampleInputs()) {
+    return FLEX_MinutesFromNow(ACTIVE_POLL_INTERVAL_MINS);
+  }
+  return FLEX_HoursFromNow(IDLE_POLL_INTERVAL_HOURS);
+}
+
+static void RunsOnExtDigitalIOWakeup(void) {
   printf("Woken up by External Digital IO @ %u\n", (unsigned int)FLEX_TimeGet());
+  if (SampleInputs()) {
+    FLEX_JobSchedule(PollInputs, FLEX_MinutesFromNow(ACTIVE_POLL_INTERVAL_MINS));
+  }
+}
 
-  printf("External Digital IO %u level is %s\n", (unsigned int)WakeupPin + 1,
-    ((FLEX_ExtDigitalIOGet(WakeupPin) == FLEX_EXT_DIGITAL_IO_HIGH) ? "high" : "low"));
+static time_t SendLog(void) {
+  static uint8_t sequence_number = 0;
+
+  uint8_t frames[LOG_FRAMES_MAX][MYRIOTA_EVENT_LOG_FRAME_SIZE];
+  const size_t count =
+    MYRIOTA_EventLogEncode(&Log, sequence_number++, FLEX_TimeGet(), frames, LOG_FRAMES_MAX);
+  for (size_t i = 0; i < count; ++i) {
+    if (FLEX_MessageSchedule(frames[i], sizeof(frames[i])) != FLEX_SUCCESS) {
+      printf("Failed to schedule event log\n");
+      break;
+    }
+  }
+  printf("Scheduled event log in %u messages\n", (unsigned int)count);
+
+  return FLEX_HoursFromNow(LOG_INTERVAL_HOURS);
 }
 
 void FLEX_AppInit() {
   printf("%s\n", APPLICATION_NAME);
 
-  // Enabling the Digital IO Wakeup
-  FLEX_ExtDigitalIOWakeupModify(WakeupPin, FLEX_EXT_DIGITAL_IO_WAKEUP_ENABLE);
+  uint8_t levels = 0;
+  for (size_t i = 0; i < PIN_COUNT; ++i) {
+    if (FLEX_ExtDigitalIOGet(Pins[i]) != FLEX_EXT_DIGITAL_IO_LOW) {
+      levels |= 1 << i;
+    }
+  }
+  MYRIOTA_EventLogInit(&Log, PIN_COUNT, levels, DEBOUNCE_MS, FLEX_TimeGet());
 
   // Registering the Wakeup handler
   FLEX_ExtDigitalIOWakeupHandlerModify(RunsOnExtDigitalIOWakeup, FLEX_HANDLER_MODIFY_ADD);
+
+  FLEX_JobSchedule(PollInputs, FLEX_ASAP());
+  FLEX_JobSchedule(SendLog, FLEX_HoursFromNow(LOG_INTERVAL_HOURS));
 }
 
 //! [CODE]
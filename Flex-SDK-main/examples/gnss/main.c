@@ -12,34 +12,127 @@
 // limitations under the License.
 
 // An example running on Myriota's "FlexSense" board.
-// This example, at fixed intervals, will attempt to acquire a GNSS fix to
-// retrieve the current location and time, and print it on the debug console.
+// This example tracks the location of an asset using the Myriota GNSS Track
+// library. The fix interval shortens while the asset is moving and backs off
+// while it is stationary, and a motion sensor on External Digital IO 1 (pulled
+// low on motion) triggers a fix straight away. While stationary the last fix
+// is reused rather than powering up the GNSS receiver. Locations are sent as
+// anchor frames with tracks encoded as small deltas from the last anchor.
+// The fix interval is stretched as the battery runs down, and fixes stop while
+// the battery is critical, using the Myriota Power Policy library.
 //! [CODE]
 
 #include <stdio.h>
 #include "flex.h"
+#include "myriota/gnss_track.h"
+#include "myriota/power_policy.h"
 
 #define APPLICATION_NAME "GNSS Example"
 
-// GNSS FIX Interval
-#define GNSS_FIX_INTERVAL_HOURS 6
+// Note: Change this to set the desired External Digital IO Pin for the motion
+// sensor, or set GNSS_HAS_MOTION_INPUT to false if there isn't one.
+const FLEX_DigitalIOPin MotionPin = FLEX_EXT_DIGITAL_IO_1;
+#define GNSS_HAS_MOTION_INPUT true
+
+// GNSS fix interval while moving and stationary
+#define GNSS_FIX_MIN_INTERVAL_MINS 10
+#define GNSS_FIX_MAX_INTERVAL_HOURS 6
+// Displacement between fixes considered as moving
+#define GNSS_MOTION_THRESHOLD_METERS 50
+// A stationary asset still reports its location this often
+#define GNSS_ANCHOR_INTERVAL_HOURS 24
+
+static MYRIOTA_GnssTrack track;
+static MYRIOTA_PowerPolicy power_policy;
+
+static void PowerPolicyUpdate(void) {
+  bool is_external = false;
+  int32_t battery_mv = 0;
+  if (FLEX_IsOnExternalPower(&is_external) != FLEX_SUCCESS) {
+    return;
+  }
+  if (!is_external && FLEX_GetBatteryVoltage(&battery_mv) != FLEX_SUCCESS) {
+    battery_mv = 0;
+  }
+  MYRIOTA_PowerPolicyUpdate(&power_policy, battery_mv, is_external);
+}
+
+static void SendTrackFrames(void) {
+  uint8_t frame[MYRIOTA_GNSS_TRACK_FRAME_SIZE];
+  while (MYRIOTA_GnssTrackFrameGet(&track, frame)) {
+    if (FLEX_MessageSchedule(frame, sizeof(frame)) != FLEX_SUCCESS) {
+      printf("Failed to schedule track frame\n");
+      return;
+    }
+  }
+}
 
 static time_t LocationAndTime(void) {
+  const time_t now = FLEX_TimeGet();
   time_t time;
   int32_t lat, lon;
 
-  if (FLEX_GNSSFix(&lat, &lon, &time) < 0) {
-    printf("Failed to get a valid GNSS sync!\n");
+  PowerPolicyUpdate();
+  if (!MYRIOTA_PowerPolicyIsAllowed(&power_policy, MYRIOTA_POWER_COST_MEDIUM)) {
+    // The motion wakeup isn't re-armed, as it would only wake the device to skip the fix.
+    printf("Battery critical, skipping fix.\n");
+    return FLEX_TimeGet() +
+           MYRIOTA_PowerPolicyIntervalScale(&power_policy, GNSS_FIX_MAX_INTERVAL_HOURS * 3600);
+  }
 
-  } else {
+  if (MYRIOTA_GnssTrackIsFixNeeded(&track, now)) {
+    if (FLEX_GNSSFix(&lat, &lon, &time) < 0) {
+      printf("Failed to get a valid GNSS sync!\n");
+      return FLEX_TimeGet() +
+             MYRIOTA_PowerPolicyIntervalScale(&power_policy, GNSS_FIX_MIN_INTERVAL_MINS * 60);
+    }
     printf("Lat: %f, Lon: %f, Time: %u.\n", lat * 1e-7, lon * 1e-7, (unsigned int)time);
+  } else {
+    FLEX_LastLocationAndLastFixTime(&lat, &lon, &time);
+    printf("Stationary, reusing fix from %u.\n", (unsigned int)time);
   }
 
-  return FLEX_HoursFromNow(GNSS_FIX_INTERVAL_HOURS);
+  const uint32_t interval = MYRIOTA_GnssTrackUpdate(&track, lat, lon, time, now);
+  SendTrackFrames();
+
+  // Motion wakeups are only enabled for the next wakeup, so re-arm it.
+  if (GNSS_HAS_MOTION_INPUT) {
+    FLEX_ExtDigitalIOWakeupModify(MotionPin, FLEX_EXT_DIGITAL_IO_WAKEUP_ENABLE);
+  }
+
+  return FLEX_TimeGet() + MYRIOTA_PowerPolicyIntervalScale(&power_policy, interval);
+}
+
+static void ExternalPowerChanged(const bool *const is_external) {
+  MYRIOTA_PowerPolicyExternalPowerSet(&power_policy, *is_external);
+}
+
+static void MotionDetected(void) {
+  printf("Motion detected @ %u\n", (unsigned int)FLEX_TimeGet());
+  MYRIOTA_GnssTrackMotionDetected(&track);
+  FLEX_JobSchedule(LocationAndTime, FLEX_ASAP());
 }
 
 void FLEX_AppInit() {
   printf("%s\n", APPLICATION_NAME);
+
+  const MYRIOTA_GnssTrackConfig config = {
+    .min_interval_secs = GNSS_FIX_MIN_INTERVAL_MINS * 60,
+    .max_interval_secs = GNSS_FIX_MAX_INTERVAL_HOURS * 3600,
+    .motion_threshold_m = GNSS_MOTION_THRESHOLD_METERS,
+    .anchor_interval_secs = GNSS_ANCHOR_INTERVAL_HOURS * 3600,
+    .has_motion_input = GNSS_HAS_MOTION_INPUT,
+  };
+  MYRIOTA_GnssTrackInit(&track, config);
+
+  const MYRIOTA_PowerPolicyConfig power_config = MYRIOTA_POWER_POLICY_DEFAULT_CONFIG;
+  MYRIOTA_PowerPolicyInit(&power_policy, power_config);
+  FLEX_OnExternalPowerHandlerSet(ExternalPowerChanged);
+
+  if (GNSS_HAS_MOTION_INPUT) {
+    FLEX_ExtDigitalIOWakeupHandlerModify(MotionDetected, FLEX_HANDLER_MODIFY_ADD);
+  }
+
   FLEX_JobSchedule(LocationAndTime, FLEX_ASAP());
 }
 
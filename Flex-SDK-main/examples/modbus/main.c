@@ -15,18 +15,37 @@
 // board. This example demonstrates how to read the temperature and humidity
 // from the "DFRobot SEN0438" sensor, via the FlexSenses Myriota Modbus
 // library.
+//
+// The sensor is polled regularly but a message is only sent when the
+// temperature or humidity has moved meaningfully since the last message, or
+// when no message has been sent for MAX_SILENCE_SECS. The latest values are
+// always available as diagnostics in the mobile application.
+//
+// The Myriota Power Policy library stretches the poll interval and cuts the
+// read retries (and so the time the sensor is powered) as the battery runs
+// down, and the sensor isn't powered at all while the battery is critical.
+//
+// The poll interval can be changed, and a reading requested, with downlink
+// commands handled by the Myriota Downlink library.
 //! [CODE]
 
 #include <stdio.h>
 #include <string.h>
 
 #include "flex.h"
+#include "myriota/downlink.h"
 #include "myriota/modbus.h"
+#include "myriota/modbus_cache.h"
+#include "myriota/power_policy.h"
+#include "myriota/serial_io.h"
 
 #define APPLICATION_NAME "DFRobot SEN0438 Modbus Driver Application"
-#define MESSAGES_PER_DAY 4
+#define POLL_INTERVAL_MINS 15
+#define MAX_SILENCE_SECS (6 * 3600)
 #define SENSOR_READ_MAX_RETRIES 3
 #define SENSOR_POWER_STABILIZATION_MS 1500
+// Large enough for the longest response expected from the sensor.
+#define SERIAL_RX_BUFFER_SIZE 64
 
 typedef struct {
   uint8_t sequence_number;
@@ -41,18 +60,87 @@ typedef struct {
   FLEX_SerialProtocol protocol;
   uint32_t baud_rate;
   uint32_t rx_timeout_ticks;
+  MYRIOTA_SerialIO io;
+  MYRIOTA_SerialIOFramer framer;
+  uint8_t rx_buffer[SERIAL_RX_BUFFER_SIZE];
 } SerialContext;
 
 typedef struct {
   MYRIOTA_ModbusHandle modbus_handle;
+  MYRIOTA_ModbusCache modbus_cache;
   SerialContext serial_context;
 } ApplicationContext;
 
 static ApplicationContext application_context = {0};
 
+enum { POINT_HUMIDITY, POINT_TEMPERATURE };
+
+// Humidity and temperature are in tenths of a percent and degree respectively,
+// and are read in a single transaction as they are consecutive registers.
+static const MYRIOTA_ModbusCachePoint points[] = {
+  [POINT_HUMIDITY] =
+    {
+      .slave = 0x01,
+      .type = MODBUS_CACHE_REGISTER_HOLDING,
+      .addr = 0x0000,
+      .is_signed = true,
+      .deadband = 50,
+      .max_silence = MAX_SILENCE_SECS,
+    },
+  [POINT_TEMPERATURE] =
+    {
+      .slave = 0x01,
+      .type = MODBUS_CACHE_REGISTER_HOLDING,
+      .addr = 0x0001,
+      .is_signed = true,
+      .deadband = 10,
+      .rate_of_change = 5,
+      .max_silence = MAX_SILENCE_SECS,
+    },
+};
+
+#define DIAG_HUMIDITY FLEX_DIAG_CONF_ID_USER_0
+#define DIAG_TEMPERATURE FLEX_DIAG_CONF_ID_USER_1
+#define CONF_POLL_INTERVAL_MINS FLEX_DIAG_CONF_ID_USER_2
+
+// clang-format off
+FLEX_DIAG_CONF_TABLE_BEGIN()
+  FLEX_DIAG_CONF_TABLE_I32_ADD(DIAG_HUMIDITY, "Humidity", 0, FLEX_DIAG_CONF_TYPE_DIAG),
+  FLEX_DIAG_CONF_TABLE_I32_ADD(DIAG_TEMPERATURE, "Temperature", 0, FLEX_DIAG_CONF_TYPE_DIAG),
+  FLEX_DIAG_CONF_TABLE_U32_ADD(CONF_POLL_INTERVAL_MINS, "Poll Interval Minutes", POLL_INTERVAL_MINS, FLEX_DIAG_CONF_TYPE_CONF),
+FLEX_DIAG_CONF_TABLE_END();
+// clang-format on
+
+// Only the poll interval can be changed with downlink commands.
+static const MYRIOTA_DownlinkConfLimit downlink_limits[] = {
+  {.id = CONF_POLL_INTERVAL_MINS, .min = 5, .max = 24 * 60},
+};
+static MYRIOTA_Downlink downlink;
+// Set by a downlink command to send a message on the next poll.
+static bool is_reading_requested = false;
+
+static ssize_t serial_driver_read(void *const ctx, uint8_t *const buffer, const size_t count) {
+  (void)ctx;
+  return FLEX_SerialRead(buffer, count);
+}
+
 static int serial_init(void *const ctx) {
   SerialContext *const serial = ctx;
-  return FLEX_SerialInit(serial->protocol, serial->baud_rate);
+  const int result = FLEX_SerialInit(serial->protocol, serial->baud_rate);
+  if (result != FLEX_SUCCESS) {
+    return result;
+  }
+
+  const MYRIOTA_SerialIOInterface interface = {
+    .ctx = NULL,
+    .read = serial_driver_read,
+    .tick_get = FLEX_TickGet,
+    .delay_ms = FLEX_DelayMs,
+  };
+  MYRIOTA_SerialIOInit(&serial->io, interface, serial->baud_rate, serial->rx_buffer,
+    sizeof(serial->rx_buffer));
+  serial->framer = MYRIOTA_SerialIOSilenceFramer(serial->baud_rate);
+  return FLEX_SUCCESS;
 }
 
 // De-initialise the Serial interface for the lowest idle power consumption.
@@ -61,31 +149,19 @@ static void serial_deinit(void *const ctx) {
   FLEX_SerialDeinit();
 }
 
+// Sleep until a response ends with the RTU inter-frame silence, rather than
+// polling for the whole timeout.
 static ssize_t serial_read(void *const ctx, uint8_t *const buffer, const size_t count) {
   SerialContext *const serial = ctx;
-
-  uint8_t *curr = buffer;
-  const uint8_t *const end = buffer + count;
-  const uint32_t end_ticks = FLEX_TickGet() + serial->rx_timeout_ticks;
-  while (FLEX_TickGet() <= end_ticks) {
-    if (curr >= end) {
-      return -1;
-    }
-
-    int num_bytes = FLEX_SerialRead(curr, 1);
-    if (num_bytes < 0) {
-      return -1;
-    }
-    if (num_bytes == 1) {
-      ++curr;
-    }
-  }
-
-  return curr - buffer;
+  const ssize_t result =
+    MYRIOTA_SerialIOReadFrame(&serial->io, serial->framer, buffer, count, serial->rx_timeout_ticks);
+  return result < 0 ? -1 : result;
 }
 
 static ssize_t serial_write(void *const ctx, const uint8_t *const buffer, const size_t count) {
-  (void)ctx;
+  SerialContext *const serial = ctx;
+  // Discard anything left over so it isn't mistaken for the response.
+  MYRIOTA_SerialIOFlush(&serial->io);
   const int result = FLEX_SerialWrite(buffer, count);
   if (result != FLEX_SUCCESS) {
     return result;
@@ -93,11 +169,25 @@ static ssize_t serial_write(void *const ctx, const uint8_t *const buffer, const
   return count;
 }
 
-inline uint16_t merge_i16(const uint8_t hi, const uint8_t low) {
-  return (int16_t)((uint16_t)hi << 8 | (uint16_t)low);
+static MYRIOTA_PowerPolicy power_policy;
+
+static void power_policy_update(void) {
+  bool is_external = false;
+  int32_t battery_mv = 0;
+  if (FLEX_IsOnExternalPower(&is_external) != FLEX_SUCCESS) {
+    return;
+  }
+  if (!is_external && FLEX_GetBatteryVoltage(&battery_mv) != FLEX_SUCCESS) {
+    battery_mv = 0;
+  }
+  MYRIOTA_PowerPolicyUpdate(&power_policy, battery_mv, is_external);
 }
 
-static void read_temperature_and_humidity(int16_t *const temperature, int16_t *const humidity) {
+static void on_external_power(const bool *const is_external) {
+  MYRIOTA_PowerPolicyExternalPowerSet(&power_policy, *is_external);
+}
+
+static void poll_sensor(const time_t now) {
   const MYRIOTA_ModbusHandle handle = application_context.modbus_handle;
 
   // Enable power to the sensor
@@ -111,15 +201,11 @@ static void read_temperature_and_humidity(int16_t *const temperature, int16_t *c
   // NOTE: Enable/disable the Modbus driver in order to conserve power.
   MYRIOTA_ModbusEnable(handle);
 
-  uint8_t bytes[4] = {0};
-  const MYRIOTA_ModbusDeviceAddress slave = 0x01;
-  const MYRIOTA_ModbusDataAddress addr = 0x0000;
-
-  for (uint8_t retries = 0; retries < SENSOR_READ_MAX_RETRIES; ++retries) {
-    result = MYRIOTA_ModbusReadHoldingRegisters(handle, slave, addr, 2, bytes);
+  const uint32_t max_retries = MYRIOTA_PowerPolicyBudgetScale(&power_policy,
+    SENSOR_READ_MAX_RETRIES);
+  for (uint32_t retries = 0; retries < max_retries; ++retries) {
+    result = MYRIOTA_ModbusCachePoll(&application_context.modbus_cache, handle, now);
     if (result == MODBUS_SUCCESS) {
-      *humidity = merge_i16(bytes[0], bytes[1]);
-      *temperature = merge_i16(bytes[2], bytes[3]);
       break;
     }
     printf("Sensor Read Failed: %d\n", result);
@@ -131,12 +217,12 @@ static void read_temperature_and_humidity(int16_t *const temperature, int16_t *c
   FLEX_PowerOutDeinit();
 }
 
-static time_t send_message(void) {
+static void send_message(const time_t now) {
   static uint8_t sequence_number = 0;
 
   Message message = {0};
   message.sequence_number = sequence_number++;
-  message.time = FLEX_TimeGet();
+  message.time = now;
 
   int32_t latitude = 0;
   int32_t longitude = 0;
@@ -144,9 +230,10 @@ static time_t send_message(void) {
   message.latitude = latitude;
   message.longitude = longitude;
 
-  int16_t temperature = 0;
-  int16_t humidity = 0;
-  read_temperature_and_humidity(&temperature, &humidity);
+  int32_t temperature = 0;
+  int32_t humidity = 0;
+  MYRIOTA_ModbusCacheValueGet(&application_context.modbus_cache, POINT_TEMPERATURE, &temperature);
+  MYRIOTA_ModbusCacheValueGet(&application_context.modbus_cache, POINT_HUMIDITY, &humidity);
   message.temperature = temperature;
   message.humidity = humidity;
 
@@ -159,8 +246,74 @@ static time_t send_message(void) {
   printf("  longitude: %ld\n", message.longitude);
   printf("  temperature: %d\n", message.temperature);
   printf("  humidity: %d\n", message.humidity);
+}
+
+static time_t poll_and_report(void) {
+  MYRIOTA_ModbusCache *const cache = &application_context.modbus_cache;
+
+  const time_t now = FLEX_TimeGet();
+  power_policy_update();
+  if (MYRIOTA_PowerPolicyIsAllowed(&power_policy, MYRIOTA_POWER_COST_MEDIUM)) {
+    poll_sensor(now);
+  } else {
+    printf("Battery critical, sensor not polled\n");
+  }
+
+  // Publish the latest values so they can be queried from the mobile
+  // application without waiting for a message.
+  int32_t value = 0;
+  if (MYRIOTA_ModbusCacheValueGet(cache, POINT_HUMIDITY, &value) == MODBUS_CACHE_SUCCESS) {
+    FLEX_DiagConfValueWrite(DIAG_HUMIDITY, &value);
+  }
+  if (MYRIOTA_ModbusCacheValueGet(cache, POINT_TEMPERATURE, &value) == MODBUS_CACHE_SUCCESS) {
+    FLEX_DiagConfValueWrite(DIAG_TEMPERATURE, &value);
+  }
+
+  const uint32_t due = MYRIOTA_ModbusCacheEvaluate(cache, now);
+  if (due != 0 || is_reading_requested) {
+    printf("Report due (points 0x%02lx)\n", (unsigned long)due);
+    is_reading_requested = false;
+    send_message(now);
+    MYRIOTA_ModbusCacheMarkReported(cache, now);
+  }
+
+  uint8_t ack[MYRIOTA_DOWNLINK_ACK_FRAME_SIZE];
+  if (MYRIOTA_DownlinkAckGet(&downlink, ack)) {
+    FLEX_MessageSchedule(ack, sizeof(ack));
+  }
+
+  uint32_t poll_interval_mins = POLL_INTERVAL_MINS;
+  FLEX_DiagConfValueRead(CONF_POLL_INTERVAL_MINS, &poll_interval_mins);
+  return FLEX_TimeGet() + MYRIOTA_PowerPolicyIntervalScale(&power_policy, poll_interval_mins * 60);
+}
 
-  return (FLEX_TimeGet() + 24 * 3600 / MESSAGES_PER_DAY);
+static int downlink_conf_read(void *const ctx, const uint8_t id, uint32_t *const value) {
+  (void)ctx;
+  return FLEX_DiagConfValueRead(id, value);
+}
+
+static int downlink_conf_write(void *const ctx, const uint8_t id, const uint32_t value) {
+  (void)ctx;
+  return FLEX_DiagConfValueWrite(id, &value);
+}
+
+static int downlink_trigger(void *const ctx, const uint8_t action) {
+  (void)ctx;
+  if (action != MYRIOTA_DOWNLINK_ACTION_READING) {
+    return -1;
+  }
+  is_reading_requested = true;
+  return 0;
+}
+
+// Commands are acknowledged, and take effect, on an immediate poll.
+static void on_message_received(uint8_t *const message, const int size) {
+  if (message == NULL || size <= 0) {
+    return;
+  }
+  const int result = MYRIOTA_DownlinkProcess(&downlink, message, size);
+  printf("Downlink command received: %d\n", result);
+  FLEX_JobSchedule(poll_and_report, FLEX_ASAP());
 }
 
 void FLEX_AppInit() {
@@ -187,8 +340,24 @@ void FLEX_AppInit() {
     while (true) {
     };
   }
+  MYRIOTA_ModbusCacheInit(&application_context.modbus_cache, points,
+    sizeof(points) / sizeof(*points));
+
+  const MYRIOTA_PowerPolicyConfig power_config = MYRIOTA_POWER_POLICY_DEFAULT_CONFIG;
+  MYRIOTA_PowerPolicyInit(&power_policy, power_config);
+  FLEX_OnExternalPowerHandlerSet(on_external_power);
+
+  const MYRIOTA_DownlinkInterface downlink_interface = {
+    .ctx = NULL,
+    .conf_read = downlink_conf_read,
+    .conf_write = downlink_conf_write,
+    .trigger = downlink_trigger,
+  };
+  MYRIOTA_DownlinkInit(&downlink, downlink_interface, downlink_limits,
+    sizeof(downlink_limits) / sizeof(*downlink_limits));
+  FLEX_MessageReceiveHandlerModify(on_message_received, FLEX_HANDLER_MODIFY_ADD);
 
-  FLEX_JobSchedule(send_message, FLEX_ASAP());
+  FLEX_JobSchedule(poll_and_report, FLEX_ASAP());
 }
 
 //! [CODE]
@@ -13,21 +13,58 @@
 
 // An example running on Myriota's "FlexSense" board
 // This example demonstrates how to configure and use the Pulse Counter APIs.
+// The pulse counter is sampled on a schedule rather than waking on pulses, and
+// the samples are aggregated into a daily profile which is sent in two
+// messages using the Myriota Pulse Profile library.
 //! [CODE]
 
 #include <inttypes.h>
 #include <stdio.h>
 #include "flex.h"
+#include "myriota/pulse_profile.h"
 
 #define APPLICATION_NAME "Pulse Counter Example"
 
-// Number of pulses that will cause a wakeup event.
-#define PULSE_WAKEUP_COUNT 6
+// Number of pulses that will cause a wakeup event. This is set high as the
+// counter is sampled on a schedule, so only the count is needed and waking on
+// pulses would waste power.
+#define PULSE_WAKEUP_COUNT 1000000
 
-static void RunsOnPulseCounterEvent() {
-  printf("Woken up by Pulse Counter @ %u\n", (unsigned int)FLEX_TimeGet());
+// How often the pulse counter is sampled. The minimum and maximum rate and
+// the rate histogram are calculated over this interval.
+#define PULSE_SAMPLE_INTERVAL_MINS 15
 
-  printf("Current pulse counter value: %" PRIu32 "\n", (uint32_t)FLEX_PulseCounterGet());
+static MYRIOTA_PulseProfile profile;
+
+static void SendProfile(void) {
+  static uint8_t sequence_number = 0;
+
+  uint8_t summary[MYRIOTA_PULSE_PROFILE_FRAME_SIZE];
+  uint8_t slots[MYRIOTA_PULSE_PROFILE_FRAME_SIZE];
+  MYRIOTA_PulseProfileSummaryEncode(&profile, sequence_number, summary);
+  MYRIOTA_PulseProfileSlotsEncode(&profile, sequence_number, slots);
+  ++sequence_number;
+
+  if (FLEX_MessageSchedule(summary, sizeof(summary)) != FLEX_SUCCESS ||
+      FLEX_MessageSchedule(slots, sizeof(slots)) != FLEX_SUCCESS) {
+    printf("Failed to schedule pulse profile\n");
+    return;
+  }
+  printf("Scheduled pulse profile %u\n", (unsigned int)sequence_number - 1);
+}
+
+static time_t SamplePulseCounter(void) {
+  const uint64_t count = FLEX_PulseCounterGet();
+  const time_t now = FLEX_TimeGet();
+  MYRIOTA_PulseProfileSample(&profile, count, now);
+  printf("Current pulse counter value: %" PRIu32 "\n", (uint32_t)count);
+
+  if (MYRIOTA_PulseProfileIsComplete(&profile, now)) {
+    SendProfile();
+    MYRIOTA_PulseProfileStart(&profile, count, now);
+  }
+
+  return FLEX_MinutesFromNow(PULSE_SAMPLE_INTERVAL_MINS);
 }
 
 void FLEX_AppInit() {
@@ -38,8 +75,8 @@ void FLEX_AppInit() {
     printf("Failed to initialise pulse counter\n");
   }
 
-  // Enable pulse counter event
-  FLEX_PulseCounterHandlerModify(RunsOnPulseCounterEvent, FLEX_HANDLER_MODIFY_ADD);
+  MYRIOTA_PulseProfileStart(&profile, FLEX_PulseCounterGet(), FLEX_TimeGet());
+  FLEX_JobSchedule(SamplePulseCounter, FLEX_MinutesFromNow(PULSE_SAMPLE_INTERVAL_MINS));
 }
 
 //! [CODE]
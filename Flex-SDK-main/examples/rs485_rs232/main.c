@@ -27,6 +27,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "flex.h"
+#include "myriota/serial_io.h"
 
 #define READY_STRING "READY\n"
 #define RECEIVE_TIMEOUT_MS 2000
@@ -39,6 +40,8 @@ const FLEX_DigitalIOPin WakeupPin = FLEX_EXT_DIGITAL_IO_1;
 #define USING_RS232 0
 #define USING_RS485 1
 #define RX_BUFFER_MAX 20
+// Room for a whole line while more data is received.
+#define RX_RING_SIZE 64
 
 #if SERIAL_INTERFACE == USING_RS485
 #define SERIAL_PROTOCOL FLEX_SERIAL_PROTOCOL_RS485
@@ -52,22 +55,19 @@ const FLEX_DigitalIOPin WakeupPin = FLEX_EXT_DIGITAL_IO_1;
 #error "Must supply a valid 'SERIAL_INTERFACE' to the build!"
 #endif
 
-// Read new line terminated string from the Serial interface with timeout
-// Return number of bytes read or -1 on timeout or string is too long
-int ReadStringWithTimeout(uint8_t *Rx, size_t MaxLength) {
-  const uint32_t start = FLEX_TickGet();
-  size_t count = 0;
-  while (FLEX_TickGet() - start < RECEIVE_TIMEOUT_MS) {
-    uint8_t ch;
-    if (FLEX_SerialRead(&ch, 1) == 1) {
-      if (ch == '\n')
-        return count;
-      Rx[count++] = ch;
-      if (count == MaxLength)
-        return -1;
-    }
-  }
-  return -1;
+static uint8_t RxRing[RX_RING_SIZE];
+
+static ssize_t SerialDriverRead(void *const ctx, uint8_t *const buffer, const size_t count) {
+  (void)ctx;
+  return FLEX_SerialRead(buffer, count);
+}
+
+// Read new line terminated string from the Serial interface with timeout,
+// sleeping until data arrives rather than polling.
+// Return number of bytes read or < 0 on timeout or string is too long
+static int ReadStringWithTimeout(MYRIOTA_SerialIO *const io, uint8_t *Rx, size_t MaxLength) {
+  return MYRIOTA_SerialIOReadFrame(io, MYRIOTA_SerialIOLineFramer('\n'), Rx, MaxLength,
+    RECEIVE_TIMEOUT_MS);
 }
 
 static void Comm() {
@@ -75,10 +75,19 @@ static void Comm() {
     printf("Failed to initialise Serial interface\n");
     return;
   }
+  const MYRIOTA_SerialIOInterface interface = {
+    .ctx = NULL,
+    .read = SerialDriverRead,
+    .tick_get = FLEX_TickGet,
+    .delay_ms = FLEX_DelayMs,
+  };
+  MYRIOTA_SerialIO io;
+  MYRIOTA_SerialIOInit(&io, interface, BAUDRATE, RxRing, sizeof(RxRing));
+
   FLEX_SerialWrite((uint8_t *)READY_STRING, strlen(READY_STRING));
 
   uint8_t Rx[RX_BUFFER_MAX] = {0};
-  int len = ReadStringWithTimeout(Rx, RX_BUFFER_MAX);
+  int len = ReadStringWithTimeout(&io, Rx, RX_BUFFER_MAX);
   if (len <= 0) {
     printf("Failed to receive message\n");
   } else {
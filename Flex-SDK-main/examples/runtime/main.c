@@ -0,0 +1,172 @@
+// Copyright (c) 2024, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// An example running on Myriota's "FlexSense" board.
+// This example demonstrates how to combine several sensors in one application
+// with the Myriota Runtime library, rather than hand merging their jobs into
+// the single job scheduled from "FLEX_AppInit". Each sensor is a task with its
+// own interval, and the "RuntimeJob" job runs every task due in the same
+// wakeup. The 4-20mA level sensor and the float switch are both powered from
+// the 24V output, which is turned on once for both of them when their readings
+// coincide.
+//! [CODE]
+
+#include <stdio.h>
+#include "flex.h"
+#include "myriota/runtime.h"
+
+#define APPLICATION_NAME "Runtime Example"
+
+// Note: Modify these according to the application requirements.
+#define TEMPERATURE_INTERVAL_SECS (15 * 60)
+#define LEVEL_INTERVAL_SECS (60 * 60)
+#define SWITCH_INTERVAL_SECS (60 * 60)
+#define REPORTS_PER_DAY 4
+
+// Tasks due within this time of a wakeup run in that wakeup.
+#define COALESCE_SECS 120
+// Reports are sent this long after the hourly readings, in a wakeup of their
+// own, as tasks needing no rail run before the rail groups of a wakeup.
+#define REPORT_DELAY_SECS (COALESCE_SECS + 60)
+
+// Modify this according to the power requirements of the sensors.
+#define SENSOR_RAIL MYRIOTA_RUNTIME_RAIL_24V
+// The time the sensors take to stabilise once powered.
+#define RAIL_SETTLE_MS 500
+
+typedef struct {
+  uint16_t sequence_number;
+  uint32_t time;
+  int16_t temperature_min;  // In 0.1 degrees Celsius.
+  int16_t temperature_max;  // In 0.1 degrees Celsius.
+  uint16_t level;           // The latest level sensor current in uA, or 0 if it failed.
+  uint8_t switch_closed;    // The number of readings the float switch was closed.
+  uint8_t switch_readings;  // The number of float switch readings.
+} __attribute__((packed)) message;
+
+static MYRIOTA_Runtime runtime;
+static MYRIOTA_RuntimeTask temperature_task;
+static MYRIOTA_RuntimeTask level_task;
+static MYRIOTA_RuntimeTask switch_task;
+static MYRIOTA_RuntimeTask report_task;
+
+static message report = {.temperature_min = INT16_MAX, .temperature_max = INT16_MIN};
+
+static const FLEX_PowerOut RailVoltages[] = {
+  [MYRIOTA_RUNTIME_RAIL_5V] = FLEX_POWER_OUT_5V,
+  [MYRIOTA_RUNTIME_RAIL_12V] = FLEX_POWER_OUT_12V,
+  [MYRIOTA_RUNTIME_RAIL_24V] = FLEX_POWER_OUT_24V,
+};
+
+static int RailOn(void *const ctx, const MYRIOTA_RuntimeRail rail) {
+  (void)ctx;
+  if (FLEX_PowerOutInit(RailVoltages[rail]) != 0) {
+    printf("Failed to Init Power Out.\n");
+    return -1;
+  }
+  FLEX_DelayMs(RAIL_SETTLE_MS);
+  return 0;
+}
+
+static void RailOff(void *const ctx) {
+  (void)ctx;
+  // De-initialise the Power Out interface for the lowest idle power consumption.
+  FLEX_PowerOutDeinit();
+}
+
+static time_t TemperatureSample(void *const ctx, const time_t now) {
+  (void)ctx;
+  float temperature = 0;
+  if (FLEX_TemperatureGet(&temperature) == 0) {
+    const int16_t decidegrees = temperature * 10;
+    report.temperature_min =
+      decidegrees < report.temperature_min ? decidegrees : report.temperature_min;
+    report.temperature_max =
+      decidegrees > report.temperature_max ? decidegrees : report.temperature_max;
+    printf("Temperature = %.1f C\n", temperature);
+  }
+  return now + TEMPERATURE_INTERVAL_SECS;
+}
+
+// The 24V output is already on and settled when this task runs.
+static time_t LevelSample(void *const ctx, const time_t now) {
+  (void)ctx;
+  uint32_t current = 0;
+  if (FLEX_AnalogInputInit(FLEX_ANALOG_IN_CURRENT) == 0) {
+    if (FLEX_AnalogInputReadCurrent(&current) != 0) {
+      current = 0;
+    }
+    FLEX_AnalogInputDeinit();
+  }
+  report.level = current > UINT16_MAX ? UINT16_MAX : current;
+  printf("Level = %luuA\n", (unsigned long)current);
+  return now + LEVEL_INTERVAL_SECS;
+}
+
+// The float switch pulls External Digital IO 1 Low when closed.
+static time_t SwitchSample(void *const ctx, const time_t now) {
+  (void)ctx;
+  const int level = FLEX_ExtDigitalIOGet(FLEX_EXT_DIGITAL_IO_1);
+  if (level >= 0 && report.switch_readings < UINT8_MAX) {
+    report.switch_readings++;
+    report.switch_closed += level == FLEX_EXT_DIGITAL_IO_LOW;
+    printf("Float switch %s\n", level == FLEX_EXT_DIGITAL_IO_LOW ? "closed" : "open");
+  }
+  return now + SWITCH_INTERVAL_SECS;
+}
+
+static time_t SendReport(void *const ctx, const time_t now) {
+  (void)ctx;
+  static uint16_t sequence_number = 0;
+  report.sequence_number = sequence_number++;
+  report.time = now;
+  FLEX_MessageSchedule((void *)&report, sizeof(report));
+  printf("Scheduled message: %u %lu\n", report.sequence_number, report.time);
+
+  report.temperature_min = INT16_MAX;
+  report.temperature_max = INT16_MIN;
+  report.switch_closed = 0;
+  report.switch_readings = 0;
+  return now + 24 * 3600 / REPORTS_PER_DAY;
+}
+
+// The only FLEX job, which runs every task that is due.
+static time_t RuntimeJob(void) {
+  const time_t next = MYRIOTA_RuntimeDispatch(&runtime, FLEX_TimeGet());
+  return next == MYRIOTA_RUNTIME_NEVER ? FLEX_Never() : next;
+}
+
+void FLEX_AppInit() {
+  printf("%s\n", APPLICATION_NAME);
+
+  const MYRIOTA_RuntimeInterface interface = {
+    .ctx = NULL,
+    .rail_on = RailOn,
+    .rail_off = RailOff,
+  };
+  MYRIOTA_RuntimeInit(&runtime, interface, COALESCE_SECS);
+
+  // Report once the readings of each cycle have been taken.
+  const time_t now = FLEX_TimeGet();
+  MYRIOTA_RuntimeTaskAdd(&runtime, &temperature_task, TemperatureSample, NULL,
+    MYRIOTA_RUNTIME_RAIL_NONE, now);
+  MYRIOTA_RuntimeTaskAdd(&runtime, &level_task, LevelSample, NULL, SENSOR_RAIL, now);
+  MYRIOTA_RuntimeTaskAdd(&runtime, &switch_task, SwitchSample, NULL, SENSOR_RAIL, now);
+  MYRIOTA_RuntimeTaskAdd(&runtime, &report_task, SendReport, NULL, MYRIOTA_RUNTIME_RAIL_NONE,
+    now + LEVEL_INTERVAL_SECS + REPORT_DELAY_SECS);
+
+  FLEX_JobSchedule(RuntimeJob, FLEX_ASAP());
+}
+
+//! [CODE]
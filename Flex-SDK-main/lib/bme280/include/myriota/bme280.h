@@ -0,0 +1,195 @@
+/// \file bme280.h Myriota BME280
+// Copyright (c) 2024, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MYRIOTA_BME280_H
+#define MYRIOTA_BME280_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/** \defgroup Bme280 BME280 Library
+ * @brief Bosch BME280 temperature, pressure and humidity sensor driver
+ * \{
+ */
+
+/** The default I2C address of the BME280 (SDO pulled high). */
+#define MYRIOTA_BME280_I2C_ADDRESS 0x77
+/** The maximum time for a forced mode measurement with 1x oversampling. */
+#define MYRIOTA_BME280_MEASUREMENT_TIME_MS 10
+
+/** The size of an encoded frame in bytes. */
+#define MYRIOTA_BME280_FRAME_SIZE 20
+/** The first byte of an encoded frame. */
+#define MYRIOTA_BME280_FRAME_TYPE 0x09
+/** The number of readings in an encoded frame. */
+#define MYRIOTA_BME280_READINGS_PER_FRAME 3
+
+/** Error codes for the BME280 driver. */
+typedef enum {
+  BME280_SUCCESS = 0,
+  BME280_ERROR_IO_FAILURE,
+  BME280_ERROR_INVALID_DEVICE_ID,
+  BME280_ERROR_NOT_READY,
+  BME280_ERROR_INVALID_FRAME,
+} MYRIOTA_Bme280Errors;
+
+/**
+ * Read function for the I2C interface used by the BME280 driver.
+ *
+ * \param[in,out] ctx The user defined data context used by the I2C interface.
+ * \param[in] reg The first register to read.
+ * \param[out] buffer The buffer for filling with the register values.
+ * \param[in] count The number of consecutive registers to read.
+ * \return 0 on success else < 0 on error.
+ */
+typedef int (*MYRIOTA_Bme280I2CInterfaceReadFn_t)(void *const ctx, const uint8_t reg,
+  uint8_t *const buffer, const size_t count);
+
+/**
+ * Write function for the I2C interface used by the BME280 driver.
+ *
+ * \param[in,out] ctx The user defined data context used by the I2C interface.
+ * \param[in] reg The register to write.
+ * \param[in] value The value to write to the register.
+ * \return 0 on success else < 0 on error.
+ */
+typedef int (*MYRIOTA_Bme280I2CInterfaceWriteFn_t)(void *const ctx, const uint8_t reg,
+  const uint8_t value);
+
+/** Interface for the I2C bus used by the BME280 driver. */
+typedef struct {
+  /** User defined data context to be used by the I2C interface functions. */
+  void *ctx;
+  /** I2C register read function. */
+  MYRIOTA_Bme280I2CInterfaceReadFn_t read;
+  /** I2C register write function. */
+  MYRIOTA_Bme280I2CInterfaceWriteFn_t write;
+} MYRIOTA_Bme280I2CInterface;
+
+/** A compensated reading. */
+typedef struct {
+  int32_t temperature;  ///< Temperature in 0.01 degrees Celsius.
+  uint32_t pressure;    ///< Pressure in Pa.
+  uint32_t humidity;    ///< Relative humidity in 1/1024 %.
+} MYRIOTA_Bme280Reading;
+
+/** \cond INTERNAL_HIDDEN */
+typedef struct {
+  uint16_t t1;
+  int16_t t2;
+  int16_t t3;
+  uint16_t p1;
+  int16_t p2;
+  int16_t p3;
+  int16_t p4;
+  int16_t p5;
+  int16_t p6;
+  int16_t p7;
+  int16_t p8;
+  int16_t p9;
+  uint8_t h1;
+  int16_t h2;
+  uint8_t h3;
+  int16_t h4;
+  int16_t h5;
+  int8_t h6;
+} MYRIOTA_Bme280Calibration;
+/** \endcond */
+
+/** A BME280 driver instance. */
+typedef struct {
+  /** \cond INTERNAL_HIDDEN */
+  MYRIOTA_Bme280I2CInterface interface;
+  bool has_calibration;
+  MYRIOTA_Bme280Calibration calibration;
+  /** \endcond */
+} MYRIOTA_Bme280;
+
+/**
+ * Initializes the driver and configures the sensor for forced mode with 1x
+ * oversampling of all channels and no filtering.
+ *
+ * \note The sensor can take a few milliseconds to respond after power up, so
+ * the caller should retry on BME280_ERROR_INVALID_DEVICE_ID.
+ *
+ * \param[out] device The driver instance to initialize.
+ * \param[in] interface The I2C interface of the sensor.
+ * \return 0 on success else < 0 on error.
+ */
+int MYRIOTA_Bme280Init(MYRIOTA_Bme280 *const device, const MYRIOTA_Bme280I2CInterface interface);
+
+/**
+ * Triggers a single measurement of all channels. The measurement can be read
+ * after MYRIOTA_BME280_MEASUREMENT_TIME_MS.
+ *
+ * \param[in] device The driver instance.
+ * \return 0 on success else < 0 on error.
+ */
+int MYRIOTA_Bme280Trigger(const MYRIOTA_Bme280 *const device);
+
+/**
+ * Reads and compensates the last measurement.
+ *
+ * All channels are read in a single burst, and the calibration trim is read
+ * the first time and cached in the driver instance.
+ *
+ * \param[in,out] device The driver instance.
+ * \param[out] reading The compensated reading.
+ * \return 0 on success else < 0 on error.
+ */
+int MYRIOTA_Bme280Read(MYRIOTA_Bme280 *const device, MYRIOTA_Bme280Reading *const reading);
+
+/**
+ * Encodes up to MYRIOTA_BME280_READINGS_PER_FRAME readings taken at a regular
+ * interval.
+ *
+ * | Byte | Description                                                   |
+ * | ---- | ------------------------------------------------------------- |
+ * | 0    | MYRIOTA_BME280_FRAME_TYPE                                     |
+ * | 1    | Interval between readings in minutes (u8)                     |
+ * | 2-5  | Time of the first reading (u32)                               |
+ * | 6-19 | 3 x 36 bit readings, least significant bit first              |
+ *
+ * Multi-byte fields are little endian. Each reading is a 12 bit temperature in
+ * 0.05 degrees Celsius above -40, a 14 bit pressure in 8 Pa above 30000 Pa and
+ * a 10 bit relative humidity in 0.1 %, in that order. Unused readings have all
+ * bits set.
+ *
+ * \param[in] readings The readings to encode, oldest first.
+ * \param[in] count The number of readings.
+ * \param[in] time The time of the first reading.
+ * \param[in] interval_mins The interval between readings in minutes.
+ * \param[out] frame The buffer to encode to.
+ */
+void MYRIOTA_Bme280FrameEncode(const MYRIOTA_Bme280Reading *const readings, const size_t count,
+  const time_t time, const uint8_t interval_mins, uint8_t frame[MYRIOTA_BME280_FRAME_SIZE]);
+
+/**
+ * Decodes the readings encoded by MYRIOTA_Bme280FrameEncode.
+ *
+ * \param[in] frame The frame to decode.
+ * \param[out] readings The decoded readings.
+ * \return the number of readings on success else < 0 if the frame isn't a
+ * BME280 frame.
+ */
+int MYRIOTA_Bme280FrameDecode(const uint8_t frame[MYRIOTA_BME280_FRAME_SIZE],
+  MYRIOTA_Bme280Reading readings[MYRIOTA_BME280_READINGS_PER_FRAME]);
+
+/**
+ * \}
+ */
+
+#endif /* MYRIOTA_BME280_H */
@@ -0,0 +1,499 @@
+// Copyright (c) 2024, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "myriota/bme280.h"
+#include <string.h>
+
+#define BME280_ID 0x60
+
+#define BME280_REG_CALIBRATION_TP 0x88
+#define BME280_REG_CALIBRATION_H1 0xA1
+#define BME280_REG_ID 0xD0
+#define BME280_REG_CALIBRATION_H2 0xE1
+#define BME280_REG_CTRL_HUM 0xF2
+#define BME280_REG_CTRL_MEAS 0xF4
+#define BME280_REG_CONFIG 0xF5
+#define BME280_REG_DATA 0xF7
+
+#define BME280_CALIBRATION_TP_SIZE (BME280_REG_CALIBRATION_H1 - BME280_REG_CALIBRATION_TP + 1)
+#define BME280_CALIBRATION_H_SIZE 7
+// Pressure, temperature and humidity from 0xF7 to 0xFE.
+#define BME280_DATA_SIZE 8
+
+// Keep the reserved bits, with no IIR filter, no standby (as it is unused in
+// forced mode) and no 3-wire SPI.
+#define BME280_CONFIG_RESERVED_MASK 0x02
+#define BME280_CONFIG 0x00
+// Keep the reserved bits, with 1x humidity oversampling.
+#define BME280_CTRL_HUM_RESERVED_MASK 0xF8
+#define BME280_CTRL_HUM 0x01
+// 1x temperature and pressure oversampling in forced mode.
+#define BME280_CTRL_MEAS_FORCED 0x25
+
+// The value of a channel that hasn't been measured.
+#define BME280_ADC_SKIPPED 0x80000
+
+#define BME280_FRAME_READING_BITS 36
+#define BME280_FRAME_TEMPERATURE_BITS 12
+#define BME280_FRAME_PRESSURE_BITS 14
+#define BME280_FRAME_HUMIDITY_BITS 10
+#define BME280_FRAME_TEMPERATURE_OFFSET -4000
+#define BME280_FRAME_TEMPERATURE_SCALE 5
+#define BME280_FRAME_PRESSURE_OFFSET 30000
+#define BME280_FRAME_PRESSURE_SCALE 8
+#define BME280_FRAME_HUMIDITY_MAX 1000
+
+static inline uint16_t unpack_u16(const uint8_t *const buffer) {
+  return buffer[0] | buffer[1] << 8;
+}
+
+static inline void pack_u32(uint8_t *const buffer, const uint32_t value) {
+  for (size_t i = 0; i < 4; ++i) {
+    buffer[i] = value >> (8 * i);
+  }
+}
+
+static int read_registers(const MYRIOTA_Bme280 *const device, const uint8_t reg,
+  uint8_t *const buffer, const size_t count) {
+  if (device->interface.read(device->interface.ctx, reg, buffer, count) < 0) {
+    return -BME280_ERROR_IO_FAILURE;
+  }
+  return BME280_SUCCESS;
+}
+
+static int write_register(const MYRIOTA_Bme280 *const device, const uint8_t reg,
+  const uint8_t value) {
+  if (device->interface.write(device->interface.ctx, reg, value) < 0) {
+    return -BME280_ERROR_IO_FAILURE;
+  }
+  return BME280_SUCCESS;
+}
+
+// Writes the bits of a register outside of the reserved mask.
+static int modify_register(const MYRIOTA_Bme280 *const device, const uint8_t reg,
+  const uint8_t reserved_mask, const uint8_t value) {
+  uint8_t current;
+  const int result = read_registers(device, reg, &current, 1);
+  if (result < 0) {
+    return result;
+  }
+  return write_register(device, reg, (current & reserved_mask) | value);
+}
+
+static int read_calibration(MYRIOTA_Bme280 *const device) {
+  uint8_t tp[BME280_CALIBRATION_TP_SIZE];
+  uint8_t h[BME280_CALIBRATION_H_SIZE];
+  int result = read_registers(device, BME280_REG_CALIBRATION_TP, tp, sizeof(tp));
+  if (result < 0) {
+    return result;
+  }
+  result = read_registers(device, BME280_REG_CALIBRATION_H2, h, sizeof(h));
+  if (result < 0) {
+    return result;
+  }
+
+  MYRIOTA_Bme280Calibration *const calibration = &device->calibration;
+  calibration->t1 = unpack_u16(&tp[0]);
+  calibration->t2 = (int16_t)unpack_u16(&tp[2]);
+  calibration->t3 = (int16_t)unpack_u16(&tp[4]);
+  calibration->p1 = unpack_u16(&tp[6]);
+  calibration->p2 = (int16_t)unpack_u16(&tp[8]);
+  calibration->p3 = (int16_t)unpack_u16(&tp[10]);
+  calibration->p4 = (int16_t)unpack_u16(&tp[12]);
+  calibration->p5 = (int16_t)unpack_u16(&tp[14]);
+  calibration->p6 = (int16_t)unpack_u16(&tp[16]);
+  calibration->p7 = (int16_t)unpack_u16(&tp[18]);
+  calibration->p8 = (int16_t)unpack_u16(&tp[20]);
+  calibration->p9 = (int16_t)unpack_u16(&tp[22]);
+  calibration->h1 = tp[BME280_CALIBRATION_TP_SIZE - 1];
+  calibration->h2 = (int16_t)unpack_u16(&h[0]);
+  calibration->h3 = h[2];
+  // H4 and H5 are 12 bit signed values sharing a nibble at 0xE5.
+  calibration->h4 = (int8_t)h[3] * 16 | (h[4] & 0x0F);
+  calibration->h5 = (int8_t)h[5] * 16 | h[4] >> 4;
+  calibration->h6 = (int8_t)h[6];
+  device->has_calibration = true;
+  return BME280_SUCCESS;
+}
+
+// The compensation formulas are the integer implementations from the BME280
+// datasheet, with left shifts of signed values written as multiplications.
+
+static int32_t compensate_temperature(const MYRIOTA_Bme280Calibration *const calibration,
+  const int32_t adc, int32_t *const t_fine) {
+  const int32_t var1 = (((adc >> 3) - (int32_t)calibration->t1 * 2) * calibration->t2) >> 11;
+  const int32_t delta = (adc >> 4) - (int32_t)calibration->t1;
+  const int32_t var2 = (((delta * delta) >> 12) * calibration->t3) >> 14;
+  *t_fine = var1 + var2;
+  return (*t_fine * 5 + 128) >> 8;
+}
+
+static uint32_t compensate_pressure(const MYRIOTA_Bme280Calibration *const calibration,
+  const int32_t adc, const int32_t t_fine) {
+  int64_t var1 = (int64_t)t_fine - 128000;
+  int64_t var2 = var1 * var1 * calibration->p6;
+  var2 = var2 + var1 * calibration->p5 * 131072;
+  var2 = var2 + (int64_t)calibration->p4 * ((int64_t)1 << 35);
+  var1 = ((var1 * var1 * calibration->p3) >> 8) + var1 * calibration->p2 * 4096;
+  var1 = ((((int64_t)1 << 47) + var1) * calibration->p1) >> 33;
+  // Avoid a divide by zero with invalid calibration.
+  if (var1 == 0) {
+    return 0;
+  }
+
+  int64_t pressure = 1048576 - adc;
+  pressure = ((pressure << 31) - var2) * 3125 / var1;
+  var1 = (calibration->p9 * (pressure >> 13) * (pressure >> 13)) >> 25;
+  var2 = (calibration->p8 * pressure) >> 19;
+  pressure = ((pressure + var1 + var2) >> 8) + (int64_t)calibration->p7 * 16;
+  // Round from Q24.8 to Pa.
+  return (uint32_t)((pressure + 128) >> 8);
+}
+
+static uint32_t compensate_humidity(const MYRIOTA_Bme280Calibration *const calibration,
+  const int32_t adc, const int32_t t_fine) {
+  const int32_t var = t_fine - 76800;
+  const int32_t offset =
+    (adc * 16384 - (int32_t)calibration->h4 * 1048576 - calibration->h5 * var + 16384) >> 15;
+  const int32_t scale =
+    (((((var * calibration->h6) >> 10) * (((var * calibration->h3) >> 11) + 32768)) >> 10) +
+        2097152) *
+        calibration->h2 +
+      8192;
+  int32_t humidity = offset * (scale >> 14);
+  humidity = humidity - (((((humidity >> 15) * (humidity >> 15)) >> 7) * calibration->h1) >> 4);
+  if (humidity < 0) {
+    humidity = 0;
+  } else if (humidity > 419430400) {
+    humidity = 419430400;
+  }
+  return (uint32_t)(humidity >> 12);
+}
+
+int MYRIOTA_Bme280Init(MYRIOTA_Bme280 *const device, const MYRIOTA_Bme280I2CInterface interface) {
+  memset(device, 0, sizeof(*device));
+  device->interface = interface;
+
+  uint8_t id;
+  int result = read_registers(device, BME280_REG_ID, &id, 1);
+  if (result < 0) {
+    return result;
+  }
+  if (id != BME280_ID) {
+    return -BME280_ERROR_INVALID_DEVICE_ID;
+  }
+
+  result = modify_register(device, BME280_REG_CONFIG, BME280_CONFIG_RESERVED_MASK, BME280_CONFIG);
+  if (result < 0) {
+    return result;
+  }
+  // Changes to ctrl_hum only take effect after writing ctrl_meas, which is
+  // done when a measurement is triggered.
+  return modify_register(device, BME280_REG_CTRL_HUM, BME280_CTRL_HUM_RESERVED_MASK,
+    BME280_CTRL_HUM);
+}
+
+int MYRIOTA_Bme280Trigger(const MYRIOTA_Bme280 *const device) {
+  return write_register(device, BME280_REG_CTRL_MEAS, BME280_CTRL_MEAS_FORCED);
+}
+
+int MYRIOTA_Bme280Read(MYRIOTA_Bme280 *const device, MYRIOTA_Bme280Reading *const reading) {
+  int result;
+  if (!device->has_calibration) {
+    result = read_calibration(device);
+    if (result < 0) {
+      return result;
+    }
+  }
+
+  uint8_t data[BME280_DATA_SIZE];
+  result = read_registers(device, BME280_REG_DATA, data, sizeof(data));
+  if (result < 0) {
+    return result;
+  }
+
+  const int32_t adc_pressure = (int32_t)data[0] << 12 | data[1] << 4 | data[2] >> 4;
+  const int32_t adc_temperature = (int32_t)data[3] << 12 | data[4] << 4 | data[5] >> 4;
+  const int32_t adc_humidity = data[6] << 8 | data[7];
+  if (adc_temperature == BME280_ADC_SKIPPED) {
+    return -BME280_ERROR_NOT_READY;
+  }
+
+  int32_t t_fine;
+  reading->temperature = compensate_temperature(&device->calibration, adc_temperature, &t_fine);
+  reading->pressure = compensate_pressure(&device->calibration, adc_pressure, t_fine);
+  reading->humidity = compensate_humidity(&device->calibration, adc_humidity, t_fine);
+  return BME280_SUCCESS;
+}
+
+static uint32_t quantise(const int64_t value, const int64_t offset, const int64_t scale,
+  const uint32_t max) {
+  const int64_t quantised = (value - offset + scale / 2) / scale;
+  if (quantised < 0) {
+    return 0;
+  }
+  return quantised > max ? max : quantised;
+}
+
+static void pack_bits(uint8_t *const buffer, size_t offset, uint64_t value, size_t bits) {
+  for (; bits > 0; --bits, ++offset, value >>= 1) {
+    if (value & 1) {
+      buffer[offset / 8] |= 1 << (offset % 8);
+    }
+  }
+}
+
+static uint64_t unpack_bits(const uint8_t *const buffer, const size_t offset, const size_t bits) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < bits; ++i) {
+    value |= (uint64_t)((buffer[(offset + i) / 8] >> ((offset + i) % 8)) & 1) << i;
+  }
+  return value;
+}
+
+void MYRIOTA_Bme280FrameEncode(const MYRIOTA_Bme280Reading *const readings, const size_t count,
+  const time_t time, const uint8_t interval_mins, uint8_t frame[MYRIOTA_BME280_FRAME_SIZE]) {
+  memset(frame, 0, MYRIOTA_BME280_FRAME_SIZE);
+  frame[0] = MYRIOTA_BME280_FRAME_TYPE;
+  frame[1] = interval_mins;
+  pack_u32(&frame[2], (uint32_t)time);
+
+  for (size_t i = 0; i < MYRIOTA_BME280_READINGS_PER_FRAME; ++i) {
+    uint64_t packed = ((uint64_t)1 << BME280_FRAME_READING_BITS) - 1;
+    if (i < count) {
+      // The all ones temperature is reserved for unused readings.
+      const uint32_t temperature = quantise(readings[i].temperature,
+        BME280_FRAME_TEMPERATURE_OFFSET, BME280_FRAME_TEMPERATURE_SCALE,
+        (1 << BME280_FRAME_TEMPERATURE_BITS) - 2);
+      const uint32_t pressure = quantise(readings[i].pressure, BME280_FRAME_PRESSURE_OFFSET,
+        BME280_FRAME_PRESSURE_SCALE, (1 << BME280_FRAME_PRESSURE_BITS) - 1);
+      const uint32_t humidity =
+        quantise((int64_t)readings[i].humidity * 10, 0, 1024, BME280_FRAME_HUMIDITY_MAX);
+      packed = temperature | (uint64_t)pressure << BME280_FRAME_TEMPERATURE_BITS |
+               (uint64_t)humidity << (BME280_FRAME_TEMPERATURE_BITS + BME280_FRAME_PRESSURE_BITS);
+    }
+    pack_bits(&frame[6], i * BME280_FRAME_READING_BITS, packed, BME280_FRAME_READING_BITS);
+  }
+}
+
+int MYRIOTA_Bme280FrameDecode(const uint8_t frame[MYRIOTA_BME280_FRAME_SIZE],
+  MYRIOTA_Bme280Reading readings[MYRIOTA_BME280_READINGS_PER_FRAME]) {
+  if (frame[0] != MYRIOTA_BME280_FRAME_TYPE) {
+    return -BME280_ERROR_INVALID_FRAME;
+  }
+
+  int count = 0;
+  for (size_t i = 0; i < MYRIOTA_BME280_READINGS_PER_FRAME; ++i) {
+    const uint64_t packed =
+      unpack_bits(&frame[6], i * BME280_FRAME_READING_BITS, BME280_FRAME_READING_BITS);
+    const uint32_t temperature = packed & ((1 << BME280_FRAME_TEMPERATURE_BITS) - 1);
+    if (temperature == (1 << BME280_FRAME_TEMPERATURE_BITS) - 1) {
+      break;
+    }
+    const uint32_t pressure =
+      (packed >> BME280_FRAME_TEMPERATURE_BITS) & ((1 << BME280_FRAME_PRESSURE_BITS) - 1);
+    const uint32_t humidity =
+      packed >> (BME280_FRAME_TEMPERATURE_BITS + BME280_FRAME_PRESSURE_BITS);
+    readings[count].temperature =
+      (int32_t)temperature * BME280_FRAME_TEMPERATURE_SCALE + BME280_FRAME_TEMPERATURE_OFFSET;
+    readings[count].pressure =
+      pressure * BME280_FRAME_PRESSURE_SCALE + BME280_FRAME_PRESSURE_OFFSET;
+    readings[count].humidity = humidity * 1024 / 10;
+    ++count;
+  }
+  return count;
+}
+
+#ifdef MYRIOTA_BME280_UNIT_TESTS
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+/*
+ * `cmocka.h` must be included after standard the above library headers.
+ * NOTE: This comment has dual purpose:
+ * 1. Document the ordering requirement.
+ * 2. Prevent `clang-format` from reordering the headers.
+ */
+#include <cmocka.h>
+
+// A register file standing in for the sensor, which counts bus transactions.
+struct test_sensor {
+  uint8_t registers[256];
+  size_t reads;
+  size_t writes;
+};
+
+static struct test_sensor test_sensor;
+
+static int test_read(void *const ctx, const uint8_t reg, uint8_t *const buffer,
+  const size_t count) {
+  struct test_sensor *const sensor = ctx;
+  assert_true(reg + count <= sizeof(sensor->registers));
+  memcpy(buffer, &sensor->registers[reg], count);
+  ++sensor->reads;
+  return 0;
+}
+
+static int test_write(void *const ctx, const uint8_t reg, const uint8_t value) {
+  struct test_sensor *const sensor = ctx;
+  sensor->registers[reg] = value;
+  ++sensor->writes;
+  return 0;
+}
+
+static int test_read_failure(void *const ctx, const uint8_t reg, uint8_t *const buffer,
+  const size_t count) {
+  (void)ctx;
+  (void)reg;
+  (void)buffer;
+  (void)count;
+  return -1;
+}
+
+static const MYRIOTA_Bme280I2CInterface test_interface = {
+  .ctx = &test_sensor,
+  .read = test_read,
+  .write = test_write,
+};
+
+static void test_set_u16(const uint8_t reg, const uint16_t value) {
+  test_sensor.registers[reg] = value & 0xFF;
+  test_sensor.registers[reg + 1] = value >> 8;
+}
+
+static void test_set_adc(const uint8_t reg, const uint32_t value) {
+  test_sensor.registers[reg] = value >> 12;
+  test_sensor.registers[reg + 1] = value >> 4;
+  test_sensor.registers[reg + 2] = value << 4;
+}
+
+// The calibration and ADC values are the worked example from the datasheet,
+// with humidity trim from a real sensor.
+static int setup(void **state) {
+  (void)state;
+  memset(&test_sensor, 0, sizeof(test_sensor));
+  test_sensor.registers[BME280_REG_ID] = BME280_ID;
+  test_sensor.registers[BME280_REG_CONFIG] = 0xFF;
+  test_sensor.registers[BME280_REG_CTRL_HUM] = 0xFF;
+
+  const int16_t tp[] = {27504, 26435, -1000, (int16_t)36477, -10685, 3024, 2855, 140, -7, 15500,
+    -14600, 6000};
+  for (size_t i = 0; i < sizeof(tp) / sizeof(*tp); ++i) {
+    test_set_u16(BME280_REG_CALIBRATION_TP + 2 * i, tp[i]);
+  }
+  test_sensor.registers[BME280_REG_CALIBRATION_H1] = 75;
+  test_set_u16(BME280_REG_CALIBRATION_H2, 362);
+  test_sensor.registers[0xE3] = 0;
+  // H4 = 324 and H5 = 0.
+  test_sensor.registers[0xE4] = 324 >> 4;
+  test_sensor.registers[0xE5] = 324 & 0x0F;
+  test_sensor.registers[0xE6] = 0;
+  test_sensor.registers[0xE7] = 30;
+
+  test_set_adc(0xF7, 415148);
+  test_set_adc(0xFA, 519888);
+  // The humidity ADC value is big endian.
+  test_sensor.registers[0xFD] = 0x6F;
+  test_sensor.registers[0xFE] = 0x8D;
+  return 0;
+}
+
+static void test_init(void **state) {
+  (void)state;
+  MYRIOTA_Bme280 device;
+  assert_int_equal(MYRIOTA_Bme280Init(&device, test_interface), BME280_SUCCESS);
+  // Only the reserved bits are kept.
+  assert_int_equal(test_sensor.registers[BME280_REG_CONFIG], 0x02);
+  assert_int_equal(test_sensor.registers[BME280_REG_CTRL_HUM], 0xF9);
+
+  assert_int_equal(MYRIOTA_Bme280Trigger(&device), BME280_SUCCESS);
+  assert_int_equal(test_sensor.registers[BME280_REG_CTRL_MEAS], 0x25);
+
+  test_sensor.registers[BME280_REG_ID] = 0x58;
+  assert_int_equal(MYRIOTA_Bme280Init(&device, test_interface), -BME280_ERROR_INVALID_DEVICE_ID);
+
+  MYRIOTA_Bme280I2CInterface failing = test_interface;
+  failing.read = test_read_failure;
+  assert_int_equal(MYRIOTA_Bme280Init(&device, failing), -BME280_ERROR_IO_FAILURE);
+}
+
+static void test_read_compensated(void **state) {
+  (void)state;
+  MYRIOTA_Bme280 device;
+  assert_int_equal(MYRIOTA_Bme280Init(&device, test_interface), BME280_SUCCESS);
+
+  MYRIOTA_Bme280Reading reading;
+  test_sensor.reads = 0;
+  assert_int_equal(MYRIOTA_Bme280Read(&device, &reading), BME280_SUCCESS);
+  assert_int_equal(reading.temperature, 2508);
+  // The datasheet gives 100653.27 Pa.
+  assert_int_equal(reading.pressure, 100653);
+  // The floating point formula from the datasheet gives 43.918 %RH.
+  assert_in_range(reading.humidity, 43.9 * 1024, 44.0 * 1024);
+  // Two calibration reads and one data read.
+  assert_int_equal(test_sensor.reads, 3);
+
+  // The calibration is cached, so later readings are a single burst.
+  test_sensor.reads = 0;
+  assert_int_equal(MYRIOTA_Bme280Read(&device, &reading), BME280_SUCCESS);
+  assert_int_equal(test_sensor.reads, 1);
+
+  test_set_adc(0xFA, BME280_ADC_SKIPPED);
+  assert_int_equal(MYRIOTA_Bme280Read(&device, &reading), -BME280_ERROR_NOT_READY);
+}
+
+static void test_frame(void **state) {
+  (void)state;
+  const MYRIOTA_Bme280Reading readings[] = {
+    {.temperature = 2508, .pressure = 100653, .humidity = 47616},
+    {.temperature = -4000, .pressure = 30000, .humidity = 0},
+    {.temperature = 8500, .pressure = 110000, .humidity = 100 * 1024},
+  };
+  uint8_t frame[MYRIOTA_BME280_FRAME_SIZE];
+  MYRIOTA_Bme280FrameEncode(readings, 3, 1700000000, 60, frame);
+  assert_int_equal(frame[0], MYRIOTA_BME280_FRAME_TYPE);
+  assert_int_equal(frame[1], 60);
+  assert_int_equal(frame[2] | frame[3] << 8 | frame[4] << 16 | (uint32_t)frame[5] << 24,
+    1700000000);
+
+  MYRIOTA_Bme280Reading decoded[MYRIOTA_BME280_READINGS_PER_FRAME];
+  assert_int_equal(MYRIOTA_Bme280FrameDecode(frame, decoded), 3);
+  // Within half of the quantisation step.
+  for (size_t i = 0; i < 3; ++i) {
+    assert_in_range(decoded[i].temperature - readings[i].temperature + 3, 0, 6);
+    assert_in_range((int32_t)(decoded[i].pressure - readings[i].pressure) + 4, 0, 8);
+    assert_in_range((int32_t)(decoded[i].humidity - readings[i].humidity) + 52, 0, 104);
+  }
+
+  // Out of range values saturate.
+  const MYRIOTA_Bme280Reading extreme = {.temperature = -5000, .pressure = 200000, .humidity = 0};
+  MYRIOTA_Bme280FrameEncode(&extreme, 1, 0, 0, frame);
+  assert_int_equal(MYRIOTA_Bme280FrameDecode(frame, decoded), 1);
+  assert_int_equal(decoded[0].temperature, -4000);
+  assert_int_equal(decoded[0].pressure, 30000 + 16383 * 8);
+
+  frame[0] = 0;
+  assert_int_equal(MYRIOTA_Bme280FrameDecode(frame, decoded), -BME280_ERROR_INVALID_FRAME);
+}
+
+int main(void) {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test_setup(test_init, setup),
+    cmocka_unit_test_setup(test_read_compensated, setup),
+    cmocka_unit_test_setup(test_frame, setup),
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
+#endif
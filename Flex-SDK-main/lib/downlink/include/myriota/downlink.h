@@ -0,0 +1,162 @@
+/// \file downlink.h Myriota Downlink Commands
+// Copyright (c) 2024, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef MYRIOTA_DOWNLINK_H
+#define MYRIOTA_DOWNLINK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** \defgroup Downlink Downlink Command Library
+ * @brief Compact binary downlink commands for remote reconfiguration
+ * \{
+ */
+
+/** The command byte of a command setting configuration values. */
+#define MYRIOTA_DOWNLINK_COMMAND_CONF_SET 0x01
+/** The command byte of a command triggering an action. */
+#define MYRIOTA_DOWNLINK_COMMAND_TRIGGER 0x02
+/** The maximum number of configuration values set by one command. */
+#define MYRIOTA_DOWNLINK_CONF_MAX 3
+/** The size of an encoded acknowledgement frame in bytes. */
+#define MYRIOTA_DOWNLINK_ACK_FRAME_SIZE 20
+/** The first byte of an encoded acknowledgement frame. */
+#define MYRIOTA_DOWNLINK_ACK_FRAME_TYPE 0x0C
+/** The configuration ID marking an unused entry in an acknowledgement frame. */
+#define MYRIOTA_DOWNLINK_CONF_UNUSED 0xFF
+
+/** Downlink errors. */
+typedef enum {
+  DOWNLINK_SUCCESS = 0,
+  DOWNLINK_ERROR_INVALID_FRAME,
+  DOWNLINK_ERROR_UNKNOWN_COMMAND,
+  DOWNLINK_ERROR_INVALID_CONF,
+  DOWNLINK_ERROR_UNSUPPORTED,
+  DOWNLINK_ERROR_IO_FAILURE,
+  DOWNLINK_ERROR_DUPLICATE,
+} MYRIOTA_DownlinkErrors;
+
+/** Actions which can be triggered on demand. */
+typedef enum {
+  MYRIOTA_DOWNLINK_ACTION_READING = 0,  ///< Take and send a reading.
+  MYRIOTA_DOWNLINK_ACTION_IMAGE = 1,    ///< Start sending an image.
+} MYRIOTA_DownlinkAction;
+
+/** The range a configuration value may be set to. Other IDs can't be set. */
+typedef struct {
+  uint8_t id;    ///< The configuration ID, e.g. FLEX_DIAG_CONF_ID_USER_0.
+  uint32_t min;  ///< The minimum value.
+  uint32_t max;  ///< The maximum value.
+} MYRIOTA_DownlinkConfLimit;
+
+/** Application hooks called to apply commands. */
+typedef struct {
+  /** User defined data context passed to the hooks. */
+  void *ctx;
+  /** Reads a configuration value, e.g. with FLEX_DiagConfValueRead. Returns < 0 on error. */
+  int (*conf_read)(void *const ctx, const uint8_t id, uint32_t *const value);
+  /** Writes a configuration value, e.g. with FLEX_DiagConfValueWrite. Returns < 0 on error. */
+  int (*conf_write)(void *const ctx, const uint8_t id, const uint32_t value);
+  /**
+   * Triggers an action, which should schedule a job rather than do the work
+   * in the receive handler. Returns < 0 if the action isn't supported.
+   */
+  int (*trigger)(void *const ctx, const uint8_t action);
+} MYRIOTA_DownlinkInterface;
+
+/** A downlink command handler instance. */
+typedef struct {
+  /** \cond INTERNAL_HIDDEN */
+  MYRIOTA_DownlinkInterface interface;
+  const MYRIOTA_DownlinkConfLimit *limits;
+  size_t limit_count;
+  bool has_sequence;
+  uint8_t sequence;
+  bool is_ack_pending;
+  uint8_t ack[MYRIOTA_DOWNLINK_ACK_FRAME_SIZE];
+  /** \endcond */
+} MYRIOTA_Downlink;
+
+/**
+ * Initialises a downlink command handler.
+ *
+ * \param[out] downlink The handler to initialise.
+ * \param[in] interface The application hooks.
+ * \param[in] limits The configuration values which may be set, which must
+ * outlive the handler.
+ * \param[in] limit_count The number of limits.
+ */
+void MYRIOTA_DownlinkInit(MYRIOTA_Downlink *const downlink,
+  const MYRIOTA_DownlinkInterface interface, const MYRIOTA_DownlinkConfLimit *const limits,
+  const size_t limit_count);
+
+/**
+ * Processes a received downlink message, e.g. from a FLEX_MessageReceiveHandler.
+ *
+ * | Byte | Description                                                      |
+ * | ---- | ---------------------------------------------------------------- |
+ * | 0    | Command                                                          |
+ * | 1    | Sequence number                                                  |
+ * | 2-   | Command arguments                                                |
+ *
+ * MYRIOTA_DOWNLINK_COMMAND_CONF_SET takes 1 to MYRIOTA_DOWNLINK_CONF_MAX
+ * entries of a configuration ID (u8) and value (u32, little endian). All of
+ * the entries are validated before any are written, and if a write fails the
+ * values already written are restored, so the configuration is updated
+ * atomically.
+ *
+ * MYRIOTA_DOWNLINK_COMMAND_TRIGGER takes an action (u8).
+ *
+ * A command with the same sequence number as the previous command is a
+ * retransmission and isn't applied again, but the acknowledgement of the
+ * previous command is queued again in case it was lost. Every other command
+ * queues an acknowledgement, see MYRIOTA_DownlinkAckGet.
+ *
+ * \param[in,out] downlink The handler.
+ * \param[in] message The received message.
+ * \param[in] size The size of the message.
+ * \return 0 on success else < 0 on error.
+ */
+int MYRIOTA_DownlinkProcess(MYRIOTA_Downlink *const downlink, const uint8_t *const message,
+  const size_t size);
+
+/**
+ * Gets the acknowledgement of the last command, if it hasn't been got yet.
+ *
+ * | Byte | Description                                                      |
+ * | ---- | ---------------------------------------------------------------- |
+ * | 0    | MYRIOTA_DOWNLINK_ACK_FRAME_TYPE                                  |
+ * | 1    | Sequence number of the command                                   |
+ * | 2    | Command                                                          |
+ * | 3    | Result, 0 on success else a MYRIOTA_DownlinkErrors value         |
+ * | 4-18 | 3 x configuration ID (u8) and value (u32) set by the command     |
+ * | 19   | Action of a trigger command, else 0xFF                           |
+ *
+ * Configuration entries are those of a configuration set command, with unused
+ * entries set to MYRIOTA_DOWNLINK_CONF_UNUSED.
+ *
+ * \param[in,out] downlink The handler.
+ * \param[out] frame The buffer to encode the acknowledgement to.
+ * \return true if there was an acknowledgement to send.
+ */
+bool MYRIOTA_DownlinkAckGet(MYRIOTA_Downlink *const downlink,
+  uint8_t frame[MYRIOTA_DOWNLINK_ACK_FRAME_SIZE]);
+
+/**
+ * \}
+ */
+
+#endif /* MYRIOTA_DOWNLINK_H */
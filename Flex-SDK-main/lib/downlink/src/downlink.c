@@ -0,0 +1,368 @@
+// Copyright (c) 2024, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "myriota/downlink.h"
+#include <string.h>
+
+#define DOWNLINK_HEADER_SIZE 2
+#define DOWNLINK_CONF_ENTRY_SIZE 5
+#define DOWNLINK_ACK_CONF_OFFSET 4
+#define DOWNLINK_ACK_ACTION_OFFSET 19
+#define DOWNLINK_ACK_NO_ACTION 0xFF
+
+struct conf_entry {
+  uint8_t id;
+  uint32_t value;
+};
+
+static inline uint32_t unpack_u32(const uint8_t *const buffer) {
+  return buffer[0] | buffer[1] << 8 | buffer[2] << 16 | (uint32_t)buffer[3] << 24;
+}
+
+static inline void pack_u32(uint8_t *const buffer, const uint32_t value) {
+  buffer[0] = value & 0xFF;
+  buffer[1] = (value >> 8) & 0xFF;
+  buffer[2] = (value >> 16) & 0xFF;
+  buffer[3] = value >> 24;
+}
+
+static const MYRIOTA_DownlinkConfLimit *limit_find(const MYRIOTA_Downlink *const downlink,
+  const uint8_t id) {
+  for (size_t i = 0; i < downlink->limit_count; ++i) {
+    if (downlink->limits[i].id == id) {
+      return &downlink->limits[i];
+    }
+  }
+  return NULL;
+}
+
+// Validates every entry before anything is written.
+static int conf_validate(const MYRIOTA_Downlink *const downlink,
+  const struct conf_entry *const entries, const size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    const MYRIOTA_DownlinkConfLimit *const limit = limit_find(downlink, entries[i].id);
+    if (limit == NULL || entries[i].value < limit->min || entries[i].value > limit->max) {
+      return -DOWNLINK_ERROR_INVALID_CONF;
+    }
+    for (size_t j = 0; j < i; ++j) {
+      if (entries[j].id == entries[i].id) {
+        return -DOWNLINK_ERROR_INVALID_CONF;
+      }
+    }
+  }
+  return DOWNLINK_SUCCESS;
+}
+
+static int conf_set(const MYRIOTA_Downlink *const downlink,
+  const struct conf_entry *const entries, const size_t count) {
+  const MYRIOTA_DownlinkInterface *const interface = &downlink->interface;
+  uint32_t previous[MYRIOTA_DOWNLINK_CONF_MAX];
+
+  int result = conf_validate(downlink, entries, count);
+  if (result < 0) {
+    return result;
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    if (interface->conf_read(interface->ctx, entries[i].id, &previous[i]) < 0) {
+      return -DOWNLINK_ERROR_IO_FAILURE;
+    }
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    if (interface->conf_write(interface->ctx, entries[i].id, entries[i].value) < 0) {
+      // Roll back so the application never sees a partial update.
+      while (i-- > 0) {
+        interface->conf_write(interface->ctx, entries[i].id, previous[i]);
+      }
+      return -DOWNLINK_ERROR_IO_FAILURE;
+    }
+  }
+  return DOWNLINK_SUCCESS;
+}
+
+static void ack_encode(MYRIOTA_Downlink *const downlink, const uint8_t command,
+  const uint8_t sequence, const int result, const struct conf_entry *const entries,
+  const size_t count, const uint8_t action) {
+  uint8_t *const frame = downlink->ack;
+  memset(frame, 0, MYRIOTA_DOWNLINK_ACK_FRAME_SIZE);
+  frame[0] = MYRIOTA_DOWNLINK_ACK_FRAME_TYPE;
+  frame[1] = sequence;
+  frame[2] = command;
+  frame[3] = -result;
+  for (size_t i = 0; i < MYRIOTA_DOWNLINK_CONF_MAX; ++i) {
+    uint8_t *const entry = &frame[DOWNLINK_ACK_CONF_OFFSET + i * DOWNLINK_CONF_ENTRY_SIZE];
+    if (i < count) {
+      entry[0] = entries[i].id;
+      pack_u32(&entry[1], entries[i].value);
+    } else {
+      entry[0] = MYRIOTA_DOWNLINK_CONF_UNUSED;
+    }
+  }
+  frame[DOWNLINK_ACK_ACTION_OFFSET] = action;
+  downlink->is_ack_pending = true;
+}
+
+void MYRIOTA_DownlinkInit(MYRIOTA_Downlink *const downlink,
+  const MYRIOTA_DownlinkInterface interface, const MYRIOTA_DownlinkConfLimit *const limits,
+  const size_t limit_count) {
+  memset(downlink, 0, sizeof(*downlink));
+  downlink->interface = interface;
+  downlink->limits = limits;
+  downlink->limit_count = limit_count;
+}
+
+int MYRIOTA_DownlinkProcess(MYRIOTA_Downlink *const downlink, const uint8_t *const message,
+  const size_t size) {
+  if (message == NULL || size < DOWNLINK_HEADER_SIZE) {
+    return -DOWNLINK_ERROR_INVALID_FRAME;
+  }
+
+  const uint8_t command = message[0];
+  const uint8_t sequence = message[1];
+  if (downlink->has_sequence && sequence == downlink->sequence) {
+    // The acknowledgement was probably lost, so send it again.
+    downlink->is_ack_pending = true;
+    return -DOWNLINK_ERROR_DUPLICATE;
+  }
+
+  const uint8_t *const arguments = &message[DOWNLINK_HEADER_SIZE];
+  const size_t arguments_size = size - DOWNLINK_HEADER_SIZE;
+  struct conf_entry entries[MYRIOTA_DOWNLINK_CONF_MAX];
+  size_t count = 0;
+  uint8_t action = DOWNLINK_ACK_NO_ACTION;
+  int result;
+
+  switch (command) {
+    case MYRIOTA_DOWNLINK_COMMAND_CONF_SET:
+      count = arguments_size / DOWNLINK_CONF_ENTRY_SIZE;
+      if (count == 0 || count > MYRIOTA_DOWNLINK_CONF_MAX ||
+          arguments_size % DOWNLINK_CONF_ENTRY_SIZE != 0) {
+        count = 0;
+        result = -DOWNLINK_ERROR_INVALID_FRAME;
+        break;
+      }
+      for (size_t i = 0; i < count; ++i) {
+        entries[i].id = arguments[i * DOWNLINK_CONF_ENTRY_SIZE];
+        entries[i].value = unpack_u32(&arguments[i * DOWNLINK_CONF_ENTRY_SIZE + 1]);
+      }
+      result = conf_set(downlink, entries, count);
+      break;
+    case MYRIOTA_DOWNLINK_COMMAND_TRIGGER:
+      if (arguments_size != 1) {
+        result = -DOWNLINK_ERROR_INVALID_FRAME;
+        break;
+      }
+      action = arguments[0];
+      result = downlink->interface.trigger(downlink->interface.ctx, action) < 0
+                 ? -DOWNLINK_ERROR_UNSUPPORTED
+                 : DOWNLINK_SUCCESS;
+      break;
+    default:
+      result = -DOWNLINK_ERROR_UNKNOWN_COMMAND;
+      break;
+  }
+
+  downlink->has_sequence = true;
+  downlink->sequence = sequence;
+  ack_encode(downlink, command, sequence, result, entries, count, action);
+  return result;
+}
+
+bool MYRIOTA_DownlinkAckGet(MYRIOTA_Downlink *const downlink,
+  uint8_t frame[MYRIOTA_DOWNLINK_ACK_FRAME_SIZE]) {
+  if (!downlink->is_ack_pending) {
+    return false;
+  }
+  memcpy(frame, downlink->ack, MYRIOTA_DOWNLINK_ACK_FRAME_SIZE);
+  downlink->is_ack_pending = false;
+  return true;
+}
+
+#ifdef MYRIOTA_DOWNLINK_UNIT_TESTS
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+/*
+ * `cmocka.h` must be included after standard the above library headers.
+ * NOTE: This comment has dual purpose:
+ * 1. Document the ordering requirement.
+ * 2. Prevent `clang-format` from reordering the headers.
+ */
+#include <cmocka.h>
+
+#define TEST_CONF_COUNT 4
+
+struct test_context {
+  uint32_t conf[TEST_CONF_COUNT];
+  int fail_write_id;
+  int last_action;
+};
+
+static struct test_context test_context;
+static MYRIOTA_Downlink test_downlink;
+
+static const MYRIOTA_DownlinkConfLimit test_limits[] = {
+  {.id = 0, .min = 1, .max = 168},
+  {.id = 1, .min = 1, .max = 20},
+  {.id = 2, .min = 5, .max = 1440},
+};
+
+static int test_conf_read(void *const ctx, const uint8_t id, uint32_t *const value) {
+  const struct test_context *const context = ctx;
+  *value = context->conf[id];
+  return 0;
+}
+
+static int test_conf_write(void *const ctx, const uint8_t id, const uint32_t value) {
+  struct test_context *const context = ctx;
+  if (id == context->fail_write_id) {
+    return -1;
+  }
+  context->conf[id] = value;
+  return 0;
+}
+
+static int test_trigger(void *const ctx, const uint8_t action) {
+  struct test_context *const context = ctx;
+  if (action > MYRIOTA_DOWNLINK_ACTION_IMAGE) {
+    return -1;
+  }
+  context->last_action = action;
+  return 0;
+}
+
+static int setup(void **state) {
+  (void)state;
+  test_context = (struct test_context){.conf = {24, 20, 15, 7}, .fail_write_id = -1,
+    .last_action = -1};
+  const MYRIOTA_DownlinkInterface interface = {
+    .ctx = &test_context,
+    .conf_read = test_conf_read,
+    .conf_write = test_conf_write,
+    .trigger = test_trigger,
+  };
+  MYRIOTA_DownlinkInit(&test_downlink, interface, test_limits,
+    sizeof(test_limits) / sizeof(*test_limits));
+  return 0;
+}
+
+static void test_conf_set(void **state) {
+  (void)state;
+  const uint8_t message[] = {MYRIOTA_DOWNLINK_COMMAND_CONF_SET, 7, 0, 6, 0, 0, 0, 1, 10, 0, 0, 0};
+  assert_int_equal(MYRIOTA_DownlinkProcess(&test_downlink, message, sizeof(message)),
+    DOWNLINK_SUCCESS);
+  assert_int_equal(test_context.conf[0], 6);
+  assert_int_equal(test_context.conf[1], 10);
+
+  uint8_t frame[MYRIOTA_DOWNLINK_ACK_FRAME_SIZE];
+  assert_true(MYRIOTA_DownlinkAckGet(&test_downlink, frame));
+  assert_int_equal(frame[0], MYRIOTA_DOWNLINK_ACK_FRAME_TYPE);
+  assert_int_equal(frame[1], 7);
+  assert_int_equal(frame[2], MYRIOTA_DOWNLINK_COMMAND_CONF_SET);
+  assert_int_equal(frame[3], DOWNLINK_SUCCESS);
+  assert_int_equal(frame[4], 0);
+  assert_int_equal(unpack_u32(&frame[5]), 6);
+  assert_int_equal(frame[9], 1);
+  assert_int_equal(unpack_u32(&frame[10]), 10);
+  assert_int_equal(frame[14], MYRIOTA_DOWNLINK_CONF_UNUSED);
+  assert_int_equal(frame[19], DOWNLINK_ACK_NO_ACTION);
+  assert_false(MYRIOTA_DownlinkAckGet(&test_downlink, frame));
+
+  // A retransmission isn't applied again, but its acknowledgement is resent.
+  test_context.conf[0] = 24;
+  assert_int_equal(MYRIOTA_DownlinkProcess(&test_downlink, message, sizeof(message)),
+    -DOWNLINK_ERROR_DUPLICATE);
+  assert_int_equal(test_context.conf[0], 24);
+  uint8_t resent[MYRIOTA_DOWNLINK_ACK_FRAME_SIZE];
+  assert_true(MYRIOTA_DownlinkAckGet(&test_downlink, resent));
+  assert_memory_equal(resent, frame, sizeof(frame));
+  assert_false(MYRIOTA_DownlinkAckGet(&test_downlink, frame));
+}
+
+static void test_conf_atomic(void **state) {
+  (void)state;
+  // The second entry is out of range, so neither is written.
+  const uint8_t invalid[] = {MYRIOTA_DOWNLINK_COMMAND_CONF_SET, 1, 0, 6, 0, 0, 0, 1, 21, 0, 0, 0};
+  assert_int_equal(MYRIOTA_DownlinkProcess(&test_downlink, invalid, sizeof(invalid)),
+    -DOWNLINK_ERROR_INVALID_CONF);
+  assert_int_equal(test_context.conf[0], 24);
+
+  // Entries which aren't in the limits (e.g. diagnostics) can't be set.
+  const uint8_t unknown[] = {MYRIOTA_DOWNLINK_COMMAND_CONF_SET, 2, 3, 1, 0, 0, 0};
+  assert_int_equal(MYRIOTA_DownlinkProcess(&test_downlink, unknown, sizeof(unknown)),
+    -DOWNLINK_ERROR_INVALID_CONF);
+  assert_int_equal(test_context.conf[3], 7);
+
+  // A failed write rolls back the entries already written.
+  test_context.fail_write_id = 2;
+  const uint8_t failing[] = {MYRIOTA_DOWNLINK_COMMAND_CONF_SET, 3, 0, 6, 0, 0, 0, 1, 10, 0, 0, 0,
+    2, 60, 0, 0, 0};
+  assert_int_equal(MYRIOTA_DownlinkProcess(&test_downlink, failing, sizeof(failing)),
+    -DOWNLINK_ERROR_IO_FAILURE);
+  assert_int_equal(test_context.conf[0], 24);
+  assert_int_equal(test_context.conf[1], 20);
+
+  uint8_t frame[MYRIOTA_DOWNLINK_ACK_FRAME_SIZE];
+  assert_true(MYRIOTA_DownlinkAckGet(&test_downlink, frame));
+  assert_int_equal(frame[1], 3);
+  assert_int_equal(frame[3], DOWNLINK_ERROR_IO_FAILURE);
+  assert_int_equal(frame[14], 2);
+}
+
+static void test_trigger_action(void **state) {
+  (void)state;
+  const uint8_t image[] = {MYRIOTA_DOWNLINK_COMMAND_TRIGGER, 1, MYRIOTA_DOWNLINK_ACTION_IMAGE};
+  assert_int_equal(MYRIOTA_DownlinkProcess(&test_downlink, image, sizeof(image)),
+    DOWNLINK_SUCCESS);
+  assert_int_equal(test_context.last_action, MYRIOTA_DOWNLINK_ACTION_IMAGE);
+
+  const uint8_t unsupported[] = {MYRIOTA_DOWNLINK_COMMAND_TRIGGER, 2, 9};
+  assert_int_equal(MYRIOTA_DownlinkProcess(&test_downlink, unsupported, sizeof(unsupported)),
+    -DOWNLINK_ERROR_UNSUPPORTED);
+
+  uint8_t frame[MYRIOTA_DOWNLINK_ACK_FRAME_SIZE];
+  assert_true(MYRIOTA_DownlinkAckGet(&test_downlink, frame));
+  assert_int_equal(frame[3], DOWNLINK_ERROR_UNSUPPORTED);
+  assert_int_equal(frame[4], MYRIOTA_DOWNLINK_CONF_UNUSED);
+  assert_int_equal(frame[19], 9);
+}
+
+static void test_invalid_frames(void **state) {
+  (void)state;
+  const uint8_t short_message[] = {MYRIOTA_DOWNLINK_COMMAND_CONF_SET};
+  assert_int_equal(MYRIOTA_DownlinkProcess(&test_downlink, short_message, sizeof(short_message)),
+    -DOWNLINK_ERROR_INVALID_FRAME);
+
+  const uint8_t truncated[] = {MYRIOTA_DOWNLINK_COMMAND_CONF_SET, 1, 0, 6, 0};
+  assert_int_equal(MYRIOTA_DownlinkProcess(&test_downlink, truncated, sizeof(truncated)),
+    -DOWNLINK_ERROR_INVALID_FRAME);
+
+  const uint8_t unknown[] = {0x7F, 2};
+  assert_int_equal(MYRIOTA_DownlinkProcess(&test_downlink, unknown, sizeof(unknown)),
+    -DOWNLINK_ERROR_UNKNOWN_COMMAND);
+  assert_int_equal(test_context.conf[0], 24);
+}
+
+int main(void) {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test_setup(test_conf_set, setup),
+    cmocka_unit_test_setup(test_conf_atomic, setup),
+    cmocka_unit_test_setup(test_trigger_action, setup),
+    cmocka_unit_test_setup(test_invalid_frames, setup),
+  };
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
+#endif
@@ -0,0 +1,172 @@
+/// \file event_log.h Myriota Event Log
+// Copyright (c) 2024, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MYRIOTA_EVENT_LOG_H
+#define MYRIOTA_EVENT_LOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/** \defgroup EventLog Event Log Library
+ * @brief Debounced digital input transitions with compact uplink encoding
+ * \{
+ */
+
+/** The maximum number of pins in a log. */
+#define MYRIOTA_EVENT_LOG_PINS_MAX 3
+/** The number of transitions held until they are encoded. */
+#define MYRIOTA_EVENT_LOG_RING_SIZE 32
+/** The size of an encoded frame in bytes. */
+#define MYRIOTA_EVENT_LOG_FRAME_SIZE 20
+
+/** The first byte of an encoded summary frame. */
+#define MYRIOTA_EVENT_LOG_SUMMARY_FRAME_TYPE 0x0A
+/** The first byte of an encoded transitions frame. */
+#define MYRIOTA_EVENT_LOG_TRANSITIONS_FRAME_TYPE 0x0B
+
+/** A transition of a pin to a new level. */
+typedef struct {
+  uint32_t time;  ///< The time of the transition.
+  uint8_t pin;    ///< The pin index.
+  uint8_t level;  ///< The new level, 0 for low else 1.
+} MYRIOTA_EventLogTransition;
+
+/** \cond INTERNAL_HIDDEN */
+typedef struct {
+  uint8_t level;
+  uint8_t candidate;
+  bool is_pending;
+  uint32_t candidate_tick;
+  time_t last_change;
+  uint16_t transitions;
+  uint32_t active_secs;
+} MYRIOTA_EventLogPin;
+/** \endcond */
+
+/** An event log instance. */
+typedef struct {
+  /** \cond INTERNAL_HIDDEN */
+  uint32_t debounce_ms;
+  size_t pin_count;
+  MYRIOTA_EventLogPin pins[MYRIOTA_EVENT_LOG_PINS_MAX];
+  time_t window_start;
+  bool is_dropped;
+  MYRIOTA_EventLogTransition ring[MYRIOTA_EVENT_LOG_RING_SIZE];
+  size_t head;
+  size_t count;
+  /** \endcond */
+} MYRIOTA_EventLog;
+
+/**
+ * Initializes an event log and starts its first window.
+ *
+ * \param[out] log The log to initialize.
+ * \param[in] pin_count The number of pins, up to MYRIOTA_EVENT_LOG_PINS_MAX.
+ * \param[in] levels The current level of each pin, bit n for pin n.
+ * \param[in] debounce_ms The time a level must be stable for to be recorded.
+ * \param[in] now The current time in seconds.
+ */
+void MYRIOTA_EventLogInit(MYRIOTA_EventLog *const log, const size_t pin_count,
+  const uint8_t levels, const uint32_t debounce_ms, const time_t now);
+
+/**
+ * Adds a raw sample of a pin, recording a transition once the new level has
+ * been stable for the debounce time.
+ *
+ * Sampling should continue until this returns true, which it won't do before
+ * the debounce time has passed since the first sample.
+ *
+ * \param[in,out] log The log.
+ * \param[in] pin The pin index.
+ * \param[in] level The sampled level, 0 for low else 1.
+ * \param[in] tick_ms The current tick in milliseconds.
+ * \param[in] now The current time in seconds.
+ * \return true if the pin has settled.
+ */
+bool MYRIOTA_EventLogSample(MYRIOTA_EventLog *const log, const size_t pin, const uint8_t level,
+  const uint32_t tick_ms, const time_t now);
+
+/**
+ * Gets the last recorded level of a pin.
+ *
+ * \param[in] log The log.
+ * \param[in] pin The pin index.
+ * \return the level, 0 for low else 1.
+ */
+uint8_t MYRIOTA_EventLogLevelGet(const MYRIOTA_EventLog *const log, const size_t pin);
+
+/**
+ * Encodes the current window as a summary frame followed by transitions
+ * frames, then starts a new window.
+ *
+ * Summary frame:
+ *
+ * | Byte  | Description                                                    |
+ * | ----- | -------------------------------------------------------------- |
+ * | 0     | MYRIOTA_EVENT_LOG_SUMMARY_FRAME_TYPE                           |
+ * | 1     | Sequence number                                                |
+ * | 2-5   | Window start time (u32)                                        |
+ * | 6-8   | Window duration in seconds (u24)                               |
+ * | 9-17  | Per pin transition count (u16) and time low (u8, in 250ths)    |
+ * | 18    | Pin levels (bit n for pin n), bit 7 if transitions dropped     |
+ * | 19    | The number of transitions frames                               |
+ *
+ * Transitions frame:
+ *
+ * | Byte | Description                                                     |
+ * | ---- | --------------------------------------------------------------- |
+ * | 0    | MYRIOTA_EVENT_LOG_TRANSITIONS_FRAME_TYPE                        |
+ * | 1    | Sequence number                                                 |
+ * | 2    | Frame index                                                     |
+ * | 3-5  | Time of the first transition from the window start (u24)       |
+ * | 6-19 | Tokens, padded with 0xFF                                        |
+ *
+ * Multi-byte fields are little endian. Each token is an unsigned LEB128
+ * varint of (delta << 3 | pin << 1 | level), where delta is the seconds since
+ * the previous transition in the frame. A pin of 3 is a run, where delta is
+ * the number of times the previous two transitions repeat with the same
+ * intervals, e.g. a valve cycling on a schedule.
+ *
+ * \param[in,out] log The log.
+ * \param[in] sequence The sequence number shared by the frames.
+ * \param[in] now The current time in seconds.
+ * \param[out] frames The buffer to encode to.
+ * \param[in] max_frames The number of frames in the buffer, at least 1.
+ * Transitions which don't fit are dropped.
+ * \return the number of frames encoded.
+ */
+size_t MYRIOTA_EventLogEncode(MYRIOTA_EventLog *const log, const uint8_t sequence,
+  const time_t now, uint8_t frames[][MYRIOTA_EVENT_LOG_FRAME_SIZE], const size_t max_frames);
+
+/**
+ * Decodes the transitions encoded in a transitions frame.
+ *
+ * \param[in] frame The transitions frame.
+ * \param[in] window_start The window start time from the summary frame.
+ * \param[out] transitions The decoded transitions.
+ * \param[in] max_transitions The size of the transitions buffer.
+ * \return the number of transitions on success else < 0 if the frame isn't a
+ * transitions frame or the transitions don't fit.
+ */
+int MYRIOTA_EventLogTransitionsDecode(const uint8_t frame[MYRIOTA_EVENT_LOG_FRAME_SIZE],
+  const time_t window_start, MYRIOTA_EventLogTransition *const transitions,
+  const size_t max_transitions);
+
+/**
+ * \}
+ */
+
+#endif /* MYRIOTA_EVENT_LOG_H */
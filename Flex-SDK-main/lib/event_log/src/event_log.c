@@ -0,0 +1,509 @@
+// Copyright (c) 2024, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "myriota/event_log.h"
+#include <string.h>
+
+#define EVENT_LOG_TOKENS_OFFSET 6
+#define EVENT_LOG_TOKEN_PIN_SHIFT 1
+#define EVENT_LOG_TOKEN_DELTA_SHIFT 3
+#define EVENT_LOG_TOKEN_RUN_PIN 3
+#define EVENT_LOG_PADDING 0xFF
+#define EVENT_LOG_VARINT_MAX_BYTES 5
+#define EVENT_LOG_DUTY_SCALE 250
+#define EVENT_LOG_DROPPED_FLAG 0x80
+#define EVENT_LOG_U24_MAX 0xFFFFFF
+
+// A transition relative to the previous one, as encoded in a token.
+struct token {
+  uint32_t delta;
+  uint8_t pin;
+  uint8_t level;
+};
+
+static inline void pack_u16(uint8_t *const buffer, const uint16_t value) {
+  buffer[0] = value & 0xFF;
+  buffer[1] = value >> 8;
+}
+
+static inline void pack_u24(uint8_t *const buffer, const uint32_t value) {
+  pack_u16(buffer, value & 0xFFFF);
+  buffer[2] = (value >> 16) & 0xFF;
+}
+
+static inline void pack_u32(uint8_t *const buffer, const uint32_t value) {
+  pack_u24(buffer, value);
+  buffer[3] = value >> 24;
+}
+
+static inline uint32_t unpack_u24(const uint8_t *const buffer) {
+  return buffer[0] | buffer[1] << 8 | (uint32_t)buffer[2] << 16;
+}
+
+static inline uint32_t saturate_u24(const uint64_t value) {
+  return value > EVENT_LOG_U24_MAX ? EVENT_LOG_U24_MAX : value;
+}
+
+static size_t varint_size(uint32_t value) {
+  size_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    ++size;
+  }
+  return size;
+}
+
+static size_t varint_pack(uint8_t *const buffer, uint32_t value) {
+  size_t size = 0;
+  while (value >= 0x80) {
+    buffer[size++] = (value & 0x7F) | 0x80;
+    value >>= 7;
+  }
+  buffer[size++] = value;
+  return size;
+}
+
+// Returns the number of bytes unpacked, or 0 if the varint is incomplete.
+static size_t varint_unpack(const uint8_t *const buffer, const size_t size, uint32_t *const value) {
+  *value = 0;
+  for (size_t i = 0; i < size && i < EVENT_LOG_VARINT_MAX_BYTES; ++i) {
+    *value |= (uint32_t)(buffer[i] & 0x7F) << (7 * i);
+    if (!(buffer[i] & 0x80)) {
+      return i + 1;
+    }
+  }
+  return 0;
+}
+
+static inline uint32_t token_value(const struct token token) {
+  return token.delta << EVENT_LOG_TOKEN_DELTA_SHIFT | token.pin << EVENT_LOG_TOKEN_PIN_SHIFT |
+         token.level;
+}
+
+static const MYRIOTA_EventLogTransition *ring_get(const MYRIOTA_EventLog *const log,
+  const size_t index) {
+  return &log->ring[(log->head + index) % MYRIOTA_EVENT_LOG_RING_SIZE];
+}
+
+static void ring_pop(MYRIOTA_EventLog *const log, const size_t count) {
+  log->head = (log->head + count) % MYRIOTA_EVENT_LOG_RING_SIZE;
+  log->count -= count;
+}
+
+static void ring_push(MYRIOTA_EventLog *const log, const MYRIOTA_EventLogTransition transition) {
+  // Keep the newest transitions, as the summary still counts the old ones.
+  if (log->count == MYRIOTA_EVENT_LOG_RING_SIZE) {
+    ring_pop(log, 1);
+    log->is_dropped = true;
+  }
+  log->ring[(log->head + log->count) % MYRIOTA_EVENT_LOG_RING_SIZE] = transition;
+  ++log->count;
+}
+
+static void pin_update(MYRIOTA_EventLogPin *const pin, const time_t now) {
+  if (pin->level == 0 && now > pin->last_change) {
+    pin->active_secs += now - pin->last_change;
+  }
+  pin->last_change = now;
+}
+
+void MYRIOTA_EventLogInit(MYRIOTA_EventLog *const log, const size_t pin_count,
+  const uint8_t levels, const uint32_t debounce_ms, const time_t now) {
+  memset(log, 0, sizeof(*log));
+  log->debounce_ms = debounce_ms;
+  log->pin_count = pin_count < MYRIOTA_EVENT_LOG_PINS_MAX ? pin_count : MYRIOTA_EVENT_LOG_PINS_MAX;
+  log->window_start = now;
+  for (size_t i = 0; i < log->pin_count; ++i) {
+    log->pins[i].level = (levels >> i) & 1;
+    log->pins[i].last_change = now;
+  }
+}
+
+bool MYRIOTA_EventLogSample(MYRIOTA_EventLog *const log, const size_t pin_index,
+  const uint8_t level, const uint32_t tick_ms, const time_t now) {
+  if (pin_index >= log->pin_count) {
+    return true;
+  }
+
+  MYRIOTA_EventLogPin *const pin = &log->pins[pin_index];
+  const uint8_t sampled = level ? 1 : 0;
+  if (!pin->is_pending || sampled != pin->candidate) {
+    pin->is_pending = true;
+    pin->candidate = sampled;
+    pin->candidate_tick = tick_ms;
+  }
+  if (tick_ms - pin->candidate_tick < log->debounce_ms) {
+    return false;
+  }
+
+  pin->is_pending = false;
+  if (pin->candidate != pin->level) {
+    pin_update(pin, now);
+    pin->level = pin->candidate;
+    if (pin->transitions < UINT16_MAX) {
+      ++pin->transitions;
+    }
+    const MYRIOTA_EventLogTransition transition = {
+      .time = now,
+      .pin = pin_index,
+      .level = pin->level,
+    };
+    ring_push(log, transition);
+  }
+  return true;
+}
+
+uint8_t MYRIOTA_EventLogLevelGet(const MYRIOTA_EventLog *const log, const size_t pin) {
+  return pin < log->pin_count ? log->pins[pin].level : 0;
+}
+
+static struct token token_get(const MYRIOTA_EventLogTransition *const transition,
+  const uint32_t previous_time) {
+  const struct token token = {
+    .delta = transition->time - previous_time,
+    .pin = transition->pin,
+    .level = transition->level,
+  };
+  return token;
+}
+
+static bool token_equal(const struct token a, const struct token b) {
+  return a.delta == b.delta && a.pin == b.pin && a.level == b.level;
+}
+
+// Counts how many times the pending transitions repeat the last two tokens.
+static uint32_t run_length(const MYRIOTA_EventLog *const log, const struct token history[2],
+  uint32_t previous_time) {
+  uint32_t count = 0;
+  for (size_t i = 0; i + 1 < log->count; i += 2) {
+    const MYRIOTA_EventLogTransition *const first = ring_get(log, i);
+    const MYRIOTA_EventLogTransition *const second = ring_get(log, i + 1);
+    if (!token_equal(token_get(first, previous_time), history[0]) ||
+        !token_equal(token_get(second, first->time), history[1])) {
+      break;
+    }
+    previous_time = second->time;
+    ++count;
+  }
+  return count;
+}
+
+static void transitions_encode(MYRIOTA_EventLog *const log, const uint8_t sequence,
+  const uint8_t index, uint8_t frame[MYRIOTA_EVENT_LOG_FRAME_SIZE]) {
+  memset(frame, EVENT_LOG_PADDING, MYRIOTA_EVENT_LOG_FRAME_SIZE);
+  frame[0] = MYRIOTA_EVENT_LOG_TRANSITIONS_FRAME_TYPE;
+  frame[1] = sequence;
+  frame[2] = index;
+
+  uint32_t previous_time = ring_get(log, 0)->time;
+  pack_u24(&frame[3], saturate_u24(previous_time > log->window_start
+                                     ? previous_time - (uint32_t)log->window_start
+                                     : 0));
+
+  struct token history[2];
+  size_t history_count = 0;
+  size_t offset = EVENT_LOG_TOKENS_OFFSET;
+  while (log->count > 0) {
+    if (history_count == 2) {
+      const uint32_t count = run_length(log, history, previous_time);
+      const struct token run = {.delta = count, .pin = EVENT_LOG_TOKEN_RUN_PIN, .level = 0};
+      const size_t run_size = varint_size(token_value(run));
+      // Only use a run if it is smaller than the transitions it replaces.
+      if (count > 0 &&
+          run_size < varint_size(token_value(history[0])) + varint_size(token_value(history[1]))) {
+        if (offset + run_size > MYRIOTA_EVENT_LOG_FRAME_SIZE) {
+          break;
+        }
+        offset += varint_pack(&frame[offset], token_value(run));
+        previous_time = ring_get(log, 2 * count - 1)->time;
+        ring_pop(log, 2 * count);
+        continue;
+      }
+    }
+
+    const MYRIOTA_EventLogTransition *const transition = ring_get(log, 0);
+    const struct token token = token_get(transition, previous_time);
+    if (offset + varint_size(token_value(token)) > MYRIOTA_EVENT_LOG_FRAME_SIZE) {
+      break;
+    }
+    offset += varint_pack(&frame[offset], token_value(token));
+    previous_time = transition->time;
+    ring_pop(log, 1);
+
+    if (history_count == 2) {
+      history[0] = history[1];
+      history_count = 1;
+    }
+    history[history_count++] = token;
+  }
+}
+
+size_t MYRIOTA_EventLogEncode(MYRIOTA_EventLog *const log, const uint8_t sequence,
+  const time_t now, uint8_t frames[][MYRIOTA_EVENT_LOG_FRAME_SIZE], const size_t max_frames) {
+  size_t frame_count = 1;
+  while (log->count > 0 && frame_count < max_frames) {
+    transitions_encode(log, sequence, frame_count - 1, frames[frame_count]);
+    ++frame_count;
+  }
+  if (log->count > 0) {
+    ring_pop(log, log->count);
+    log->is_dropped = true;
+  }
+
+  uint8_t *const summary = frames[0];
+  memset(summary, 0, MYRIOTA_EVENT_LOG_FRAME_SIZE);
+  summary[0] = MYRIOTA_EVENT_LOG_SUMMARY_FRAME_TYPE;
+  summary[1] = sequence;
+  pack_u32(&summary[2], (uint32_t)log->window_start);
+  const uint32_t duration = now > log->window_start ? now - log->window_start : 0;
+  pack_u24(&summary[6], saturate_u24(duration));
+
+  uint8_t levels = 0;
+  for (size_t i = 0; i < log->pin_count; ++i) {
+    MYRIOTA_EventLogPin *const pin = &log->pins[i];
+    pin_update(pin, now);
+    uint8_t *const buffer = &summary[9 + 3 * i];
+    pack_u16(&buffer[0], pin->transitions);
+    buffer[2] = duration > 0 ? (uint64_t)pin->active_secs * EVENT_LOG_DUTY_SCALE / duration : 0;
+    levels |= pin->level << i;
+
+    pin->transitions = 0;
+    pin->active_secs = 0;
+  }
+  summary[18] = levels | (log->is_dropped ? EVENT_LOG_DROPPED_FLAG : 0);
+  summary[19] = frame_count - 1;
+
+  log->window_start = now;
+  log->is_dropped = false;
+  return frame_count;
+}
+
+int MYRIOTA_EventLogTransitionsDecode(const uint8_t frame[MYRIOTA_EVENT_LOG_FRAME_SIZE],
+  const time_t window_start, MYRIOTA_EventLogTransition *const transitions,
+  const size_t max_transitions) {
+  if (frame[0] != MYRIOTA_EVENT_LOG_TRANSITIONS_FRAME_TYPE) {
+    return -1;
+  }
+
+  uint32_t time = window_start + unpack_u24(&frame[3]);
+  struct token history[2];
+  size_t history_count = 0;
+  size_t count = 0;
+  size_t offset = EVENT_LOG_TOKENS_OFFSET;
+  while (offset < MYRIOTA_EVENT_LOG_FRAME_SIZE) {
+    uint32_t value;
+    const size_t size =
+      varint_unpack(&frame[offset], MYRIOTA_EVENT_LOG_FRAME_SIZE - offset, &value);
+    if (size == 0) {
+      break;
+    }
+    offset += size;
+
+    const struct token token = {
+      .delta = value >> EVENT_LOG_TOKEN_DELTA_SHIFT,
+      .pin = (value >> EVENT_LOG_TOKEN_PIN_SHIFT) & 0x03,
+      .level = value & 1,
+    };
+    if (token.pin == EVENT_LOG_TOKEN_RUN_PIN) {
+      if (history_count < 2 || count + 2 * (size_t)token.delta > max_transitions) {
+        return -1;
+      }
+      for (uint32_t i = 0; i < token.delta; ++i) {
+        for (size_t j = 0; j < 2; ++j) {
+          time += history[j].delta;
+          transitions[count].time = time;
+          transitions[count].pin = history[j].pin;
+          transitions[count].level = history[j].level;
+          ++count;
+        }
+      }
+      continue;
+    }
+
+    if (count == max_transitions) {
+      return -1;
+    }
+    time += token.delta;
+    transitions[count].time = time;
+    transitions[count].pin = token.pin;
+    transitions[count].level = token.level;
+    ++count;
+
+    if (history_count == 2) {
+      history[0] = history[1];
+      history_count = 1;
+    }
+    history[history_count++] = token;
+  }
+  return count;
+}
+
+#ifdef MYRIOTA_EVENT_LOG_UNIT_TESTS
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+/*
+ * `cmocka.h` must be included after standard the above library headers.
+ * NOTE: This comment has dual purpose:
+ * 1. Document the ordering requirement.
+ * 2. Prevent `clang-format` from reordering the headers.
+ */
+#include <cmocka.h>
+
+#define TEST_START_TIME 1700000000
+#define TEST_DEBOUNCE_MS 50
+
+static MYRIOTA_EventLog test_log;
+
+static int setup(void **state) {
+  (void)state;
+  // Both pins are pulled up, i.e. inactive.
+  MYRIOTA_EventLogInit(&test_log, 2, 0x03, TEST_DEBOUNCE_MS, TEST_START_TIME);
+  return 0;
+}
+
+// Settles a pin at a level at a time, as the wakeup handler would.
+static void test_settle(const size_t pin, const uint8_t level, const time_t now) {
+  uint32_t tick = now * 1000;
+  while (!MYRIOTA_EventLogSample(&test_log, pin, level, tick, now)) {
+    tick += 10;
+  }
+}
+
+static void test_debounce(void **state) {
+  (void)state;
+  // A contact chattering for 40ms then settling low.
+  const uint8_t chatter[] = {0, 1, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0};
+  uint32_t tick = 0;
+  size_t settled_at = 0;
+  for (size_t i = 0; i < sizeof(chatter); ++i, tick += 10) {
+    if (MYRIOTA_EventLogSample(&test_log, 0, chatter[i], tick, TEST_START_TIME + 10)) {
+      settled_at = i;
+      break;
+    }
+  }
+  // Settled 50ms after the last bounce at index 4.
+  assert_int_equal(settled_at, 10);
+  assert_int_equal(MYRIOTA_EventLogLevelGet(&test_log, 0), 0);
+  assert_int_equal(test_log.count, 1);
+
+  // A glitch which returns to the recorded level isn't a transition.
+  assert_false(MYRIOTA_EventLogSample(&test_log, 0, 1, 1000, TEST_START_TIME + 11));
+  assert_false(MYRIOTA_EventLogSample(&test_log, 0, 0, 1010, TEST_START_TIME + 11));
+  assert_true(MYRIOTA_EventLogSample(&test_log, 0, 0, 1060, TEST_START_TIME + 11));
+  assert_int_equal(test_log.count, 1);
+
+  // Unknown pins are ignored.
+  assert_true(MYRIOTA_EventLogSample(&test_log, 2, 0, 0, TEST_START_TIME));
+}
+
+static void test_summary(void **state) {
+  (void)state;
+  // Pin 0 is low for 6 of 24 hours in two periods, pin 1 never changes.
+  test_settle(0, 0, TEST_START_TIME + 3600);
+  test_settle(0, 1, TEST_START_TIME + 3 * 3600);
+  test_settle(0, 0, TEST_START_TIME + 20 * 3600);
+
+  uint8_t frames[2][MYRIOTA_EVENT_LOG_FRAME_SIZE];
+  const time_t end = TEST_START_TIME + 24 * 3600;
+  assert_int_equal(MYRIOTA_EventLogEncode(&test_log, 7, end, frames, 2), 2);
+  const uint8_t *const summary = frames[0];
+  assert_int_equal(summary[0], MYRIOTA_EVENT_LOG_SUMMARY_FRAME_TYPE);
+  assert_int_equal(summary[1], 7);
+  assert_int_equal(unpack_u24(&summary[6]), 24 * 3600);
+  assert_int_equal(summary[9] | summary[10] << 8, 3);
+  assert_int_equal(summary[11], 6 * 250 / 24);
+  assert_int_equal(summary[12] | summary[13] << 8, 0);
+  assert_int_equal(summary[14], 0);
+  // Pin 0 is low and pin 1 is high.
+  assert_int_equal(summary[18], 0x02);
+  assert_int_equal(summary[19], 1);
+
+  MYRIOTA_EventLogTransition transitions[8];
+  assert_int_equal(MYRIOTA_EventLogTransitionsDecode(frames[1], TEST_START_TIME, transitions, 8), 3);
+  assert_int_equal(transitions[0].time, TEST_START_TIME + 3600);
+  assert_int_equal(transitions[0].level, 0);
+  assert_int_equal(transitions[1].time, TEST_START_TIME + 3 * 3600);
+  assert_int_equal(transitions[1].level, 1);
+  assert_int_equal(transitions[2].time, TEST_START_TIME + 20 * 3600);
+
+  // The next window starts where the last ended, with the pin still low.
+  assert_int_equal(MYRIOTA_EventLogEncode(&test_log, 8, end + 3600, frames, 2), 1);
+  assert_int_equal(frames[0][9], 0);
+  assert_int_equal(frames[0][11], 250);
+  assert_int_equal(frames[0][19], 0);
+}
+
+static void test_runs(void **state) {
+  (void)state;
+  // A valve on for 5 minutes every hour, then a door opening.
+  for (int i = 0; i < 12; ++i) {
+    test_settle(0, 0, TEST_START_TIME + i * 3600 + 60);
+    test_settle(0, 1, TEST_START_TIME + i * 3600 + 360);
+  }
+  test_settle(1, 0, TEST_START_TIME + 12 * 3600 + 1);
+
+  uint8_t frames[3][MYRIOTA_EVENT_LOG_FRAME_SIZE];
+  assert_int_equal(MYRIOTA_EventLogEncode(&test_log, 0, TEST_START_TIME + 86400, frames, 3), 2);
+  assert_int_equal(frames[0][18] & 0x80, 0);
+
+  MYRIOTA_EventLogTransition transitions[32];
+  assert_int_equal(
+    MYRIOTA_EventLogTransitionsDecode(frames[1], TEST_START_TIME, transitions, 32), 25);
+  for (int i = 0; i < 12; ++i) {
+    assert_int_equal(transitions[2 * i].time, TEST_START_TIME + i * 3600 + 60);
+    assert_int_equal(transitions[2 * i].level, 0);
+    assert_int_equal(transitions[2 * i + 1].time, TEST_START_TIME + i * 3600 + 360);
+    assert_int_equal(transitions[2 * i + 1].level, 1);
+  }
+  assert_int_equal(transitions[24].pin, 1);
+  assert_int_equal(transitions[24].time, TEST_START_TIME + 12 * 3600 + 1);
+}
+
+static void test_overflow(void **state) {
+  (void)state;
+  // Irregular transitions which don't compress into runs.
+  time_t now = TEST_START_TIME;
+  for (int i = 0; i < 40; ++i) {
+    now += 1000 + i * 37;
+    test_settle(0, i % 2, now);
+  }
+  // The ring keeps the newest transitions.
+  assert_int_equal(test_log.count, MYRIOTA_EVENT_LOG_RING_SIZE);
+
+  uint8_t frames[2][MYRIOTA_EVENT_LOG_FRAME_SIZE];
+  assert_int_equal(MYRIOTA_EventLogEncode(&test_log, 0, now, frames, 2), 2);
+  assert_int_equal(frames[0][9] | frames[0][10] << 8, 40);
+  assert_int_equal(frames[0][18] & 0x80, 0x80);
+  assert_int_equal(test_log.count, 0);
+
+  // Padding must not decode as transitions.
+  MYRIOTA_EventLogTransition transitions[16];
+  const int count =
+    MYRIOTA_EventLogTransitionsDecode(frames[1], TEST_START_TIME, transitions, 16);
+  assert_in_range(count, 1, 7);
+  assert_int_equal(frames[1][2], 0);
+}
+
+int main(void) {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test_setup(test_debounce, setup),
+    cmocka_unit_test_setup(test_summary, setup),
+    cmocka_unit_test_setup(test_runs, setup),
+    cmocka_unit_test_setup(test_overflow, setup),
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
+#endif
@@ -0,0 +1,189 @@
+/// \file gnss_track.h Myriota GNSS Track
+// Copyright (c) 2024, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MYRIOTA_GNSS_TRACK_H
+#define MYRIOTA_GNSS_TRACK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/** \defgroup GnssTrack GNSS Track Library
+ * @brief Motion aware GNSS fix scheduling and compact track encoding
+ * \{
+ */
+
+/** The size of an encoded frame in bytes. */
+#define MYRIOTA_GNSS_TRACK_FRAME_SIZE 20
+/** The first byte of every encoded frame. */
+#define MYRIOTA_GNSS_TRACK_FRAME_TYPE 0x05
+/** Set in the second byte of track frames, clear for anchor frames. */
+#define MYRIOTA_GNSS_TRACK_FRAME_TRACK_FLAG 0x80
+/** The number of points in a track frame. */
+#define MYRIOTA_GNSS_TRACK_POINTS_PER_FRAME 3
+/** The number of frames that can be waiting to be sent. */
+#define MYRIOTA_GNSS_TRACK_FRAMES_MAX 3
+/** The value of the latitude delta marking an unused point in a track frame. */
+#define MYRIOTA_GNSS_TRACK_POINT_UNUSED INT16_MIN
+
+/** Configuration of the GNSS track. */
+typedef struct {
+  uint32_t min_interval_secs;     ///< The fix interval while moving.
+  uint32_t max_interval_secs;     ///< The fix interval while stationary.
+  uint32_t motion_threshold_m;    ///< Displacement between fixes considered as moving.
+  uint32_t anchor_interval_secs;  ///< The maximum time between anchor frames.
+  bool has_motion_input;  ///< Motion is reported, so fixes can be skipped while stationary.
+} MYRIOTA_GnssTrackConfig;
+
+/** \cond INTERNAL_HIDDEN */
+typedef struct {
+  int16_t lat;
+  int16_t lon;
+  uint16_t minutes;
+} MYRIOTA_GnssTrackPoint;
+/** \endcond */
+
+/** A GNSS track instance. */
+typedef struct {
+  /** \cond INTERNAL_HIDDEN */
+  MYRIOTA_GnssTrackConfig config;
+  uint32_t interval_secs;
+  bool is_motion_detected;
+  bool is_moving;
+
+  bool has_fix;
+  int32_t lat;
+  int32_t lon;
+  time_t fix_time;
+
+  bool has_anchor;
+  uint8_t anchor_sequence;
+  int32_t anchor_lat;
+  int32_t anchor_lon;
+  time_t anchor_time;
+
+  MYRIOTA_GnssTrackPoint points[MYRIOTA_GNSS_TRACK_POINTS_PER_FRAME];
+  size_t point_count;
+
+  uint8_t frames[MYRIOTA_GNSS_TRACK_FRAMES_MAX][MYRIOTA_GNSS_TRACK_FRAME_SIZE];
+  size_t frame_count;
+  /** \endcond */
+} MYRIOTA_GnssTrack;
+
+/**
+ * Initializes a GNSS track, starting at the minimum fix interval.
+ *
+ * \param[out] track The track to initialize.
+ * \param[in] config The configuration of the track.
+ */
+void MYRIOTA_GnssTrackInit(MYRIOTA_GnssTrack *const track, const MYRIOTA_GnssTrackConfig config);
+
+/**
+ * Records that motion was detected (e.g. by a motion sensor on a digital
+ * input), so the next fix is taken and the fix interval drops to the minimum.
+ *
+ * \param[in,out] track The track to update.
+ */
+void MYRIOTA_GnssTrackMotionDetected(MYRIOTA_GnssTrack *const track);
+
+/**
+ * Checks whether a new GNSS fix is needed, or whether the asset is stationary
+ * and the last fix can be reused.
+ *
+ * \note Without a motion input a fix is always needed, as displacement is the
+ * only way of detecting that the asset has started moving. With a motion input
+ * fixes are only skipped until the maximum interval has elapsed.
+ *
+ * \param[in] track The track to check.
+ * \param[in] now The current time in seconds.
+ * \return true if a new GNSS fix should be acquired.
+ */
+bool MYRIOTA_GnssTrackIsFixNeeded(const MYRIOTA_GnssTrack *const track, const time_t now);
+
+/**
+ * Adds a location to the track and adapts the fix interval. The interval drops
+ * to the minimum when the asset has moved more than the motion threshold, and
+ * otherwise doubles up to the maximum.
+ *
+ * \param[in,out] track The track to update.
+ * \param[in] lat The latitude in degrees multiplied by 1e7.
+ * \param[in] lon The longitude in degrees multiplied by 1e7.
+ * \param[in] fix_time The time of the fix in seconds.
+ * \param[in] now The current time in seconds.
+ * \return the number of seconds until the next fix.
+ */
+uint32_t MYRIOTA_GnssTrackUpdate(MYRIOTA_GnssTrack *const track, const int32_t lat,
+  const int32_t lon, const time_t fix_time, const time_t now);
+
+/**
+ * Completes the partially filled track frame, if any, so it can be sent.
+ *
+ * \param[in,out] track The track to flush.
+ */
+void MYRIOTA_GnssTrackFlush(MYRIOTA_GnssTrack *const track);
+
+/**
+ * Takes the oldest frame which is ready to be sent.
+ *
+ * Anchor frames hold an absolute location:
+ *
+ * | Byte  | Description                                      |
+ * | ----- | ------------------------------------------------ |
+ * | 0     | MYRIOTA_GNSS_TRACK_FRAME_TYPE                    |
+ * | 1     | Anchor sequence number (7 bits)                  |
+ * | 2-5   | Latitude in degrees multiplied by 1e7 (i32)      |
+ * | 6-9   | Longitude in degrees multiplied by 1e7 (i32)     |
+ * | 10-13 | Time of the fix (u32)                            |
+ * | 14-15 | The current fix interval in minutes (u16)        |
+ * | 16    | 1 if the asset is moving else 0                  |
+ * | 17-19 | Reserved                                         |
+ *
+ * Track frames hold up to three points relative to an anchor:
+ *
+ * | Byte | Description                                                     |
+ * | ---- | --------------------------------------------------------------- |
+ * | 0    | MYRIOTA_GNSS_TRACK_FRAME_TYPE                                   |
+ * | 1    | MYRIOTA_GNSS_TRACK_FRAME_TRACK_FLAG and anchor sequence number  |
+ * | 2-19 | 3 x latitude delta (i16), longitude delta (i16), minutes (u16)  |
+ *
+ * Deltas are in degrees multiplied by 1e5 (roughly 1m) from the anchor and
+ * minutes are from the time of the anchor. Unused points have a latitude
+ * delta of MYRIOTA_GNSS_TRACK_POINT_UNUSED. Multi-byte fields are little
+ * endian.
+ *
+ * \param[in,out] track The track to take the frame from.
+ * \param[out] frame The buffer to copy the frame to.
+ * \return true if a frame was copied, else false if no frames are ready.
+ */
+bool MYRIOTA_GnssTrackFrameGet(MYRIOTA_GnssTrack *const track,
+  uint8_t frame[MYRIOTA_GNSS_TRACK_FRAME_SIZE]);
+
+/**
+ * Approximates the distance between two locations.
+ *
+ * \param[in] lat1 The latitude of the first location in degrees multiplied by 1e7.
+ * \param[in] lon1 The longitude of the first location in degrees multiplied by 1e7.
+ * \param[in] lat2 The latitude of the second location in degrees multiplied by 1e7.
+ * \param[in] lon2 The longitude of the second location in degrees multiplied by 1e7.
+ * \return the distance in meters.
+ */
+uint32_t MYRIOTA_GnssTrackDistance(const int32_t lat1, const int32_t lon1, const int32_t lat2,
+  const int32_t lon2);
+
+/**
+ * \}
+ */
+
+#endif /* MYRIOTA_GNSS_TRACK_H */
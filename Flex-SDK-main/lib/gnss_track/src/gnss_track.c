@@ -0,0 +1,390 @@
+// Copyright (c) 2024, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "myriota/gnss_track.h"
+#include <string.h>
+
+// Locations are in degrees multiplied by 1e7 and track deltas are in degrees
+// multiplied by 1e5.
+#define GNSS_TRACK_DELTA_SCALE 100
+#define GNSS_TRACK_SEQUENCE_MASK 0x7F
+#define GNSS_TRACK_SECS_PER_MINUTE 60
+#define GNSS_TRACK_PI 3.14159265f
+// The length of 1e-7 degrees of latitude, in meters.
+#define GNSS_TRACK_METERS_PER_UNIT 0.0111319491f
+
+static inline void pack_u16(uint8_t *const buffer, const uint16_t value) {
+  buffer[0] = value & 0xFF;
+  buffer[1] = value >> 8;
+}
+
+static inline void pack_u32(uint8_t *const buffer, const uint32_t value) {
+  pack_u16(buffer, value & 0xFFFF);
+  pack_u16(&buffer[2], value >> 16);
+}
+
+// A Taylor series is accurate to within 0.1% for |x| <= pi / 2, which covers
+// all latitudes, and avoids depending on libm.
+static float cos_approx(const float x) {
+  const float x2 = x * x;
+  return 1.0f - x2 / 2.0f + x2 * x2 / 24.0f - x2 * x2 * x2 / 720.0f;
+}
+
+static uint32_t isqrt(const uint64_t value) {
+  uint64_t root = 0;
+  uint64_t bit = (uint64_t)1 << 62;
+  uint64_t remainder = value;
+  while (bit > remainder) {
+    bit >>= 2;
+  }
+  while (bit != 0) {
+    if (remainder >= root + bit) {
+      remainder -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return root;
+}
+
+uint32_t MYRIOTA_GnssTrackDistance(const int32_t lat1, const int32_t lon1, const int32_t lat2,
+  const int32_t lon2) {
+  const float mean_lat = ((float)lat1 + (float)lat2) / 2.0f * 1e-7f * GNSS_TRACK_PI / 180.0f;
+  int64_t dlon = (int64_t)lon2 - lon1;
+  // Take the short way around the anti-meridian.
+  if (dlon > 1800000000) {
+    dlon -= 3600000000LL;
+  } else if (dlon < -1800000000) {
+    dlon += 3600000000LL;
+  }
+  const float y = (float)((int64_t)lat2 - lat1) * GNSS_TRACK_METERS_PER_UNIT;
+  const float x = (float)dlon * GNSS_TRACK_METERS_PER_UNIT * cos_approx(mean_lat);
+  return isqrt((uint64_t)(x * x + y * y));
+}
+
+static void push_frame(MYRIOTA_GnssTrack *const track,
+  const uint8_t frame[MYRIOTA_GNSS_TRACK_FRAME_SIZE]) {
+  // Drop the oldest frame rather than the newest, as the latest location is
+  // the most valuable.
+  if (track->frame_count == MYRIOTA_GNSS_TRACK_FRAMES_MAX) {
+    memmove(track->frames[0], track->frames[1],
+      (MYRIOTA_GNSS_TRACK_FRAMES_MAX - 1) * MYRIOTA_GNSS_TRACK_FRAME_SIZE);
+    --track->frame_count;
+  }
+  memcpy(track->frames[track->frame_count++], frame, MYRIOTA_GNSS_TRACK_FRAME_SIZE);
+}
+
+static void push_anchor(MYRIOTA_GnssTrack *const track, const int32_t lat, const int32_t lon,
+  const time_t fix_time) {
+  MYRIOTA_GnssTrackFlush(track);
+
+  track->has_anchor = true;
+  track->anchor_sequence = (track->anchor_sequence + 1) & GNSS_TRACK_SEQUENCE_MASK;
+  track->anchor_lat = lat;
+  track->anchor_lon = lon;
+  track->anchor_time = fix_time;
+
+  const uint32_t interval_mins = track->interval_secs / GNSS_TRACK_SECS_PER_MINUTE;
+  uint8_t frame[MYRIOTA_GNSS_TRACK_FRAME_SIZE] = {0};
+  frame[0] = MYRIOTA_GNSS_TRACK_FRAME_TYPE;
+  frame[1] = track->anchor_sequence;
+  pack_u32(&frame[2], (uint32_t)lat);
+  pack_u32(&frame[6], (uint32_t)lon);
+  pack_u32(&frame[10], (uint32_t)fix_time);
+  pack_u16(&frame[14], interval_mins > UINT16_MAX ? UINT16_MAX : interval_mins);
+  frame[16] = track->is_moving;
+  push_frame(track, frame);
+}
+
+// Returns false if the location is too far (in distance or time) from the
+// anchor to be encoded as a point.
+static bool push_point(MYRIOTA_GnssTrack *const track, const int32_t lat, const int32_t lon,
+  const time_t fix_time) {
+  const int64_t dlat = ((int64_t)lat - track->anchor_lat) / GNSS_TRACK_DELTA_SCALE;
+  const int64_t dlon = ((int64_t)lon - track->anchor_lon) / GNSS_TRACK_DELTA_SCALE;
+  const int64_t minutes = (fix_time - track->anchor_time) / GNSS_TRACK_SECS_PER_MINUTE;
+  if (dlat <= MYRIOTA_GNSS_TRACK_POINT_UNUSED || dlat > INT16_MAX || dlon < INT16_MIN ||
+      dlon > INT16_MAX || minutes < 0 || minutes > UINT16_MAX) {
+    return false;
+  }
+
+  MYRIOTA_GnssTrackPoint *const point = &track->points[track->point_count++];
+  point->lat = dlat;
+  point->lon = dlon;
+  point->minutes = minutes;
+  if (track->point_count == MYRIOTA_GNSS_TRACK_POINTS_PER_FRAME) {
+    MYRIOTA_GnssTrackFlush(track);
+  }
+  return true;
+}
+
+void MYRIOTA_GnssTrackInit(MYRIOTA_GnssTrack *const track, const MYRIOTA_GnssTrackConfig config) {
+  memset(track, 0, sizeof(*track));
+  track->config = config;
+  track->interval_secs = config.min_interval_secs;
+}
+
+void MYRIOTA_GnssTrackMotionDetected(MYRIOTA_GnssTrack *const track) {
+  track->is_motion_detected = true;
+}
+
+bool MYRIOTA_GnssTrackIsFixNeeded(const MYRIOTA_GnssTrack *const track, const time_t now) {
+  if (!track->has_fix || track->is_motion_detected || track->is_moving ||
+      !track->config.has_motion_input) {
+    return true;
+  }
+  return now - track->fix_time >= (time_t)track->config.max_interval_secs;
+}
+
+uint32_t MYRIOTA_GnssTrackUpdate(MYRIOTA_GnssTrack *const track, const int32_t lat,
+  const int32_t lon, const time_t fix_time, const time_t now) {
+  const bool was_moving = track->is_moving;
+  const bool has_moved = track->has_fix && MYRIOTA_GnssTrackDistance(track->lat, track->lon, lat,
+                                             lon) >= track->config.motion_threshold_m;
+
+  // Back off exponentially while stationary, but check again quickly if the
+  // motion input has fired in case the asset is about to move.
+  if (has_moved || track->is_motion_detected) {
+    track->interval_secs = track->config.min_interval_secs;
+  } else if (track->interval_secs < track->config.max_interval_secs / 2) {
+    track->interval_secs *= 2;
+  } else {
+    track->interval_secs = track->config.max_interval_secs;
+  }
+  track->is_moving = has_moved;
+  track->is_motion_detected = false;
+
+  const bool is_anchor_due =
+    !track->has_anchor || now - track->anchor_time >= (time_t)track->config.anchor_interval_secs;
+  if (is_anchor_due || (has_moved && !push_point(track, lat, lon, fix_time))) {
+    push_anchor(track, lat, lon, fix_time);
+  } else if (was_moving && !has_moved) {
+    // Send the end of the track now rather than waiting for the next move.
+    MYRIOTA_GnssTrackFlush(track);
+  }
+
+  track->has_fix = true;
+  track->lat = lat;
+  track->lon = lon;
+  track->fix_time = fix_time;
+  return track->interval_secs;
+}
+
+void MYRIOTA_GnssTrackFlush(MYRIOTA_GnssTrack *const track) {
+  if (track->point_count == 0) {
+    return;
+  }
+
+  uint8_t frame[MYRIOTA_GNSS_TRACK_FRAME_SIZE] = {0};
+  frame[0] = MYRIOTA_GNSS_TRACK_FRAME_TYPE;
+  frame[1] = MYRIOTA_GNSS_TRACK_FRAME_TRACK_FLAG | track->anchor_sequence;
+  for (size_t i = 0; i < MYRIOTA_GNSS_TRACK_POINTS_PER_FRAME; ++i) {
+    uint8_t *const buffer = &frame[2 + i * 6];
+    if (i < track->point_count) {
+      pack_u16(&buffer[0], (uint16_t)track->points[i].lat);
+      pack_u16(&buffer[2], (uint16_t)track->points[i].lon);
+      pack_u16(&buffer[4], track->points[i].minutes);
+    } else {
+      pack_u16(&buffer[0], (uint16_t)MYRIOTA_GNSS_TRACK_POINT_UNUSED);
+    }
+  }
+  track->point_count = 0;
+  push_frame(track, frame);
+}
+
+bool MYRIOTA_GnssTrackFrameGet(MYRIOTA_GnssTrack *const track,
+  uint8_t frame[MYRIOTA_GNSS_TRACK_FRAME_SIZE]) {
+  if (track->frame_count == 0) {
+    return false;
+  }
+
+  memcpy(frame, track->frames[0], MYRIOTA_GNSS_TRACK_FRAME_SIZE);
+  --track->frame_count;
+  memmove(track->frames[0], track->frames[1], track->frame_count * MYRIOTA_GNSS_TRACK_FRAME_SIZE);
+  return true;
+}
+
+#ifdef MYRIOTA_GNSS_TRACK_UNIT_TESTS
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+/*
+ * `cmocka.h` must be included after standard the above library headers.
+ * NOTE: This comment has dual purpose:
+ * 1. Document the ordering requirement.
+ * 2. Prevent `clang-format` from reordering the headers.
+ */
+#include <cmocka.h>
+
+#define TEST_LAT -349284000
+#define TEST_LON 1386007000
+#define TEST_START_TIME 1700000000
+
+static const MYRIOTA_GnssTrackConfig test_config = {
+  .min_interval_secs = 600,
+  .max_interval_secs = 6 * 3600,
+  .motion_threshold_m = 50,
+  .anchor_interval_secs = 24 * 3600,
+  .has_motion_input = true,
+};
+
+static int16_t unpack_i16(const uint8_t *const buffer) {
+  return (int16_t)(buffer[0] | buffer[1] << 8);
+}
+
+static int32_t unpack_i32(const uint8_t *const buffer) {
+  return (int32_t)(buffer[0] | buffer[1] << 8 | buffer[2] << 16 | (uint32_t)buffer[3] << 24);
+}
+
+static void test_distance(void **state) {
+  (void)state;
+  // 0.001 degrees of latitude is ~111m anywhere.
+  assert_in_range(MYRIOTA_GnssTrackDistance(TEST_LAT, TEST_LON, TEST_LAT + 10000, TEST_LON), 110,
+    112);
+  // 0.001 degrees of longitude is ~91m at 35 degrees south.
+  assert_in_range(MYRIOTA_GnssTrackDistance(TEST_LAT, TEST_LON, TEST_LAT, TEST_LON + 10000), 90,
+    92);
+  // Across the anti-meridian.
+  assert_in_range(MYRIOTA_GnssTrackDistance(0, 1799995000, 0, -1799995000), 110, 112);
+  assert_int_equal(MYRIOTA_GnssTrackDistance(TEST_LAT, TEST_LON, TEST_LAT, TEST_LON), 0);
+}
+
+static void test_stationary_backoff(void **state) {
+  (void)state;
+  MYRIOTA_GnssTrack track;
+  MYRIOTA_GnssTrackInit(&track, test_config);
+  time_t now = TEST_START_TIME;
+  assert_true(MYRIOTA_GnssTrackIsFixNeeded(&track, now));
+
+  // The first fix is an anchor.
+  assert_int_equal(MYRIOTA_GnssTrackUpdate(&track, TEST_LAT, TEST_LON, now, now), 1200);
+  uint8_t frame[MYRIOTA_GNSS_TRACK_FRAME_SIZE];
+  assert_true(MYRIOTA_GnssTrackFrameGet(&track, frame));
+  assert_int_equal(frame[0], MYRIOTA_GNSS_TRACK_FRAME_TYPE);
+  assert_int_equal(frame[1], 1);
+  assert_int_equal(unpack_i32(&frame[2]), TEST_LAT);
+  assert_int_equal(unpack_i32(&frame[6]), TEST_LON);
+  assert_false(MYRIOTA_GnssTrackFrameGet(&track, frame));
+
+  // Jitter below the threshold backs off up to the maximum interval, and
+  // doesn't produce any frames.
+  const uint32_t expected[] = {2400, 4800, 9600, 19200, 21600, 21600};
+  for (size_t i = 0; i < sizeof(expected) / sizeof(*expected); ++i) {
+    now += 600;
+    assert_false(MYRIOTA_GnssTrackIsFixNeeded(&track, now));
+    assert_int_equal(MYRIOTA_GnssTrackUpdate(&track, TEST_LAT + 100, TEST_LON, now, now),
+      expected[i]);
+  }
+  assert_false(MYRIOTA_GnssTrackFrameGet(&track, frame));
+
+  // A fix is needed once the last fix is too old, even without motion.
+  assert_true(MYRIOTA_GnssTrackIsFixNeeded(&track, now + 6 * 3600));
+
+  // Motion drops back to the minimum interval.
+  MYRIOTA_GnssTrackMotionDetected(&track);
+  assert_true(MYRIOTA_GnssTrackIsFixNeeded(&track, now));
+  assert_int_equal(MYRIOTA_GnssTrackUpdate(&track, TEST_LAT + 100, TEST_LON, now, now), 600);
+}
+
+static void test_no_motion_input(void **state) {
+  (void)state;
+  MYRIOTA_GnssTrackConfig config = test_config;
+  config.has_motion_input = false;
+  MYRIOTA_GnssTrack track;
+  MYRIOTA_GnssTrackInit(&track, config);
+  MYRIOTA_GnssTrackUpdate(&track, TEST_LAT, TEST_LON, TEST_START_TIME, TEST_START_TIME);
+  assert_true(MYRIOTA_GnssTrackIsFixNeeded(&track, TEST_START_TIME + 1));
+}
+
+static void test_track_frames(void **state) {
+  (void)state;
+  MYRIOTA_GnssTrack track;
+  MYRIOTA_GnssTrackInit(&track, test_config);
+  time_t now = TEST_START_TIME;
+  MYRIOTA_GnssTrackUpdate(&track, TEST_LAT, TEST_LON, now, now);
+  uint8_t frame[MYRIOTA_GNSS_TRACK_FRAME_SIZE];
+  assert_true(MYRIOTA_GnssTrackFrameGet(&track, frame));
+
+  // Move 0.01 degrees north east every 10 minutes, once motion has started.
+  MYRIOTA_GnssTrackMotionDetected(&track);
+  for (int i = 1; i <= 4; ++i) {
+    now += 600;
+    assert_true(MYRIOTA_GnssTrackIsFixNeeded(&track, now));
+    assert_int_equal(
+      MYRIOTA_GnssTrackUpdate(&track, TEST_LAT + i * 100000, TEST_LON + i * 100000, now, now),
+      600);
+  }
+
+  // The first three points fill a frame.
+  assert_true(MYRIOTA_GnssTrackFrameGet(&track, frame));
+  assert_int_equal(frame[1], MYRIOTA_GNSS_TRACK_FRAME_TRACK_FLAG | 1);
+  for (int i = 0; i < 3; ++i) {
+    assert_int_equal(unpack_i16(&frame[2 + i * 6]), (i + 1) * 1000);
+    assert_int_equal(unpack_i16(&frame[4 + i * 6]), (i + 1) * 1000);
+    assert_int_equal(unpack_i16(&frame[6 + i * 6]), (i + 1) * 10);
+  }
+  assert_false(MYRIOTA_GnssTrackFrameGet(&track, frame));
+
+  // Stopping flushes the last point.
+  now += 600;
+  MYRIOTA_GnssTrackUpdate(&track, TEST_LAT + 400000, TEST_LON + 400000, now, now);
+  assert_true(MYRIOTA_GnssTrackFrameGet(&track, frame));
+  assert_int_equal(unpack_i16(&frame[2]), 4000);
+  assert_int_equal(unpack_i16(&frame[8]), MYRIOTA_GNSS_TRACK_POINT_UNUSED);
+  assert_int_equal(unpack_i16(&frame[14]), MYRIOTA_GNSS_TRACK_POINT_UNUSED);
+}
+
+static void test_reanchor(void **state) {
+  (void)state;
+  MYRIOTA_GnssTrack track;
+  MYRIOTA_GnssTrackInit(&track, test_config);
+  time_t now = TEST_START_TIME;
+  MYRIOTA_GnssTrackUpdate(&track, TEST_LAT, TEST_LON, now, now);
+  uint8_t frame[MYRIOTA_GNSS_TRACK_FRAME_SIZE];
+  assert_true(MYRIOTA_GnssTrackFrameGet(&track, frame));
+
+  // A point, then a jump too far for a delta re-anchors after flushing the
+  // partial track frame.
+  now += 600;
+  MYRIOTA_GnssTrackUpdate(&track, TEST_LAT + 100000, TEST_LON, now, now);
+  now += 600;
+  MYRIOTA_GnssTrackUpdate(&track, TEST_LAT + 5000000, TEST_LON, now, now);
+  assert_true(MYRIOTA_GnssTrackFrameGet(&track, frame));
+  assert_int_equal(frame[1], MYRIOTA_GNSS_TRACK_FRAME_TRACK_FLAG | 1);
+  assert_true(MYRIOTA_GnssTrackFrameGet(&track, frame));
+  assert_int_equal(frame[1], 2);
+  assert_int_equal(unpack_i32(&frame[2]), TEST_LAT + 5000000);
+
+  // Stationary heartbeat anchors once the anchor interval has elapsed.
+  now += test_config.anchor_interval_secs;
+  MYRIOTA_GnssTrackUpdate(&track, TEST_LAT + 5000000, TEST_LON, now, now);
+  assert_true(MYRIOTA_GnssTrackFrameGet(&track, frame));
+  assert_int_equal(frame[1], 3);
+  assert_false(MYRIOTA_GnssTrackFrameGet(&track, frame));
+}
+
+int main(void) {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_distance),
+    cmocka_unit_test(test_stationary_backoff),
+    cmocka_unit_test(test_no_motion_input),
+    cmocka_unit_test(test_track_frames),
+    cmocka_unit_test(test_reanchor),
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
+#endif
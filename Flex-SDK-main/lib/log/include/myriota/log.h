@@ -0,0 +1,194 @@
+/// \file log.h Myriota Tokenised Logging
+// Copyright (c) 2024, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef MYRIOTA_LOG_H
+#define MYRIOTA_LOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** \defgroup Log Tokenised Logging Library
+ * @brief Deferred binary logging with format strings resolved on the host
+ * \{
+ */
+
+/** Logging is compiled out. */
+#define MYRIOTA_LOG_LEVEL_NONE 0
+/** Only errors are logged. */
+#define MYRIOTA_LOG_LEVEL_ERROR 1
+/** Errors and warnings are logged. */
+#define MYRIOTA_LOG_LEVEL_WARN 2
+/** Errors, warnings and information are logged. */
+#define MYRIOTA_LOG_LEVEL_INFO 3
+/** Everything, including debug output such as packet dumps, is logged. */
+#define MYRIOTA_LOG_LEVEL_DEBUG 4
+
+#ifndef MYRIOTA_LOG_LEVEL
+/** The compile time log level, set with the meson `log_level` option. */
+#define MYRIOTA_LOG_LEVEL MYRIOTA_LOG_LEVEL_INFO
+#endif
+
+#ifndef MYRIOTA_LOG_BUFFER_SIZE
+/** The size of the RAM ring holding records until they are flushed. */
+#define MYRIOTA_LOG_BUFFER_SIZE 256
+#endif
+
+/** The maximum size of an encoded record. Longer byte dumps are truncated. */
+#define MYRIOTA_LOG_RECORD_MAX 48
+/** The prefix of a line of flushed records, which the host decoder replaces. */
+#define MYRIOTA_LOG_LINE_PREFIX "~L"
+/** The maximum length of a flushed line, including the terminator. */
+#define MYRIOTA_LOG_LINE_MAX (sizeof(MYRIOTA_LOG_LINE_PREFIX) + 2 * MYRIOTA_LOG_RECORD_MAX + 1)
+/** The name of the ELF section holding format strings, which isn't loaded. */
+#define MYRIOTA_LOG_SECTION ".myriota_log"
+
+/**
+ * Writes a flushed line, e.g. to the debug console.
+ *
+ * \param[in] line The null terminated line, ending with a newline.
+ */
+typedef void (*MYRIOTA_LogOutputFn_t)(const char *const line);
+
+/**
+ * Initialises logging and clears any records which haven't been flushed.
+ *
+ * \param[in] output The function flushed lines are written to.
+ */
+void MYRIOTA_LogInit(const MYRIOTA_LogOutputFn_t output);
+
+/**
+ * Writes a record of integer arguments. Use the MYRIOTA_LOG_* macros rather
+ * than calling this directly.
+ *
+ * \param[in] token The token of the format string.
+ * \param[in] args The arguments, each converted to 32 bits.
+ * \param[in] count The number of arguments.
+ */
+void MYRIOTA_LogWrite(const uint32_t token, const uint32_t *const args, const size_t count);
+
+/**
+ * Writes a record of raw bytes. Use MYRIOTA_LOG_BYTES rather than calling this
+ * directly.
+ *
+ * \param[in] token The token of the format string.
+ * \param[in] data The bytes to log.
+ * \param[in] size The number of bytes, truncated to fit a record.
+ */
+void MYRIOTA_LogWriteBytes(const uint32_t token, const uint8_t *const data, const size_t size);
+
+/**
+ * Writes the buffered records to the output as hex lines, for decoding on the
+ * host. Call from a job when the device isn't busy, e.g. at the end of a job.
+ */
+void MYRIOTA_LogFlush(void);
+
+/**
+ * Gets the number of records dropped because the ring was full since the last
+ * flush.
+ *
+ * \return The number of dropped records.
+ */
+uint32_t MYRIOTA_LogDroppedGet(void);
+
+/** \cond INTERNAL_HIDDEN */
+
+#define MYRIOTA_LOG_STR_(x) #x
+#define MYRIOTA_LOG_XSTR_(x) MYRIOTA_LOG_STR_(x)
+
+// The format string is kept in a section which isn't loaded, so it costs no
+// flash, and its address in that section is the token.
+#define MYRIOTA_LOG_FORMAT_(level, fmt)                                                      \
+  static const char myriota_log_format_[]                                                   \
+    __attribute__((section(MYRIOTA_LOG_SECTION), used, aligned(1))) =                       \
+      MYRIOTA_LOG_XSTR_(level) ":" __FILE__ ":" MYRIOTA_LOG_XSTR_(__LINE__) ":" fmt;
+
+#define MYRIOTA_LOG_TOKEN_() ((uint32_t)(uintptr_t)myriota_log_format_)
+
+#define MYRIOTA_LOG_(level, fmt, ...)                                                   \
+  do {                                                                                  \
+    MYRIOTA_LOG_FORMAT_(level, fmt)                                                     \
+    const uint32_t myriota_log_args_[] = {0, ##__VA_ARGS__};                            \
+    MYRIOTA_LogWrite(MYRIOTA_LOG_TOKEN_(), &myriota_log_args_[1],                       \
+      sizeof(myriota_log_args_) / sizeof(*myriota_log_args_) - 1);                      \
+  } while (0)
+
+#define MYRIOTA_LOG_BYTES_(level, fmt, data, size)               \
+  do {                                                           \
+    MYRIOTA_LOG_FORMAT_(level, fmt)                              \
+    MYRIOTA_LogWriteBytes(MYRIOTA_LOG_TOKEN_(), (data), (size)); \
+  } while (0)
+
+// Arguments of stripped log statements are still referenced, so variables only
+// used for logging don't cause warnings, but no code is generated.
+static inline void MYRIOTA_LogDiscard_(const int unused, ...) {
+  (void)unused;
+}
+
+#define MYRIOTA_LOG_DISCARD_(...)             \
+  do {                                        \
+    if (0) {                                  \
+      MYRIOTA_LogDiscard_(0, ##__VA_ARGS__);  \
+    }                                         \
+  } while (0)
+
+/** \endcond */
+
+/**
+ * Logs an error. The format string is a printf style string literal taking
+ * integer arguments (%d, %i, %u, %x, %X, %c with flags and widths).
+ */
+#if MYRIOTA_LOG_LEVEL >= MYRIOTA_LOG_LEVEL_ERROR
+#define MYRIOTA_LOG_ERROR(fmt, ...) MYRIOTA_LOG_(1, fmt, ##__VA_ARGS__)
+#else
+#define MYRIOTA_LOG_ERROR(fmt, ...) MYRIOTA_LOG_DISCARD_(fmt, ##__VA_ARGS__)
+#endif
+
+/** Logs a warning, see MYRIOTA_LOG_ERROR. */
+#if MYRIOTA_LOG_LEVEL >= MYRIOTA_LOG_LEVEL_WARN
+#define MYRIOTA_LOG_WARN(fmt, ...) MYRIOTA_LOG_(2, fmt, ##__VA_ARGS__)
+#else
+#define MYRIOTA_LOG_WARN(fmt, ...) MYRIOTA_LOG_DISCARD_(fmt, ##__VA_ARGS__)
+#endif
+
+/** Logs information, see MYRIOTA_LOG_ERROR. */
+#if MYRIOTA_LOG_LEVEL >= MYRIOTA_LOG_LEVEL_INFO
+#define MYRIOTA_LOG_INFO(fmt, ...) MYRIOTA_LOG_(3, fmt, ##__VA_ARGS__)
+#else
+#define MYRIOTA_LOG_INFO(fmt, ...) MYRIOTA_LOG_DISCARD_(fmt, ##__VA_ARGS__)
+#endif
+
+/** Logs debug output, see MYRIOTA_LOG_ERROR. */
+#if MYRIOTA_LOG_LEVEL >= MYRIOTA_LOG_LEVEL_DEBUG
+#define MYRIOTA_LOG_DEBUG(fmt, ...) MYRIOTA_LOG_(4, fmt, ##__VA_ARGS__)
+#else
+#define MYRIOTA_LOG_DEBUG(fmt, ...) MYRIOTA_LOG_DISCARD_(fmt, ##__VA_ARGS__)
+#endif
+
+/**
+ * Logs bytes (e.g. a packet) at the debug level. The format string takes the
+ * bytes as a single %H, which the host decoder prints as space separated hex.
+ */
+#if MYRIOTA_LOG_LEVEL >= MYRIOTA_LOG_LEVEL_DEBUG
+#define MYRIOTA_LOG_BYTES(fmt, data, size) MYRIOTA_LOG_BYTES_(4, fmt, data, size)
+#else
+#define MYRIOTA_LOG_BYTES(fmt, data, size) MYRIOTA_LOG_DISCARD_(fmt, data, size)
+#endif
+
+/**
+ * \}
+ */
+
+#endif /* MYRIOTA_LOG_H */
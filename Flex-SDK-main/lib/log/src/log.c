@@ -0,0 +1,264 @@
+// Copyright (c) 2024, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "myriota/log.h"
+#include <string.h>
+
+#define LOG_VARINT_MAX_BYTES 5
+// The token of the record reporting dropped records, which is never a format
+// string as the first byte of the section is reserved.
+#define LOG_DROPPED_TOKEN 0
+
+static const char log_hex[] = "0123456789ABCDEF";
+
+// Records are stored back to back in the ring, each prefixed with its size.
+static struct {
+  MYRIOTA_LogOutputFn_t output;
+  uint8_t ring[MYRIOTA_LOG_BUFFER_SIZE];
+  size_t head;
+  size_t used;
+  uint32_t dropped;
+} log_state;
+
+static size_t varint_pack(uint8_t *const buffer, uint32_t value) {
+  size_t size = 0;
+  while (value >= 0x80) {
+    buffer[size++] = (value & 0x7F) | 0x80;
+    value >>= 7;
+  }
+  buffer[size++] = value;
+  return size;
+}
+
+static void ring_put(const uint8_t *const record, const size_t size) {
+  if (size + 1 > MYRIOTA_LOG_BUFFER_SIZE - log_state.used) {
+    if (log_state.dropped < UINT32_MAX) {
+      ++log_state.dropped;
+    }
+    return;
+  }
+  size_t tail = (log_state.head + log_state.used) % MYRIOTA_LOG_BUFFER_SIZE;
+  log_state.ring[tail] = size;
+  for (size_t i = 0; i < size; ++i) {
+    tail = (tail + 1) % MYRIOTA_LOG_BUFFER_SIZE;
+    log_state.ring[tail] = record[i];
+  }
+  log_state.used += size + 1;
+}
+
+static size_t ring_get(uint8_t record[MYRIOTA_LOG_RECORD_MAX]) {
+  const size_t size = log_state.ring[log_state.head];
+  for (size_t i = 0; i < size; ++i) {
+    record[i] = log_state.ring[(log_state.head + 1 + i) % MYRIOTA_LOG_BUFFER_SIZE];
+  }
+  log_state.head = (log_state.head + size + 1) % MYRIOTA_LOG_BUFFER_SIZE;
+  log_state.used -= size + 1;
+  return size;
+}
+
+static void line_output(const uint8_t *const record, const size_t size) {
+  char line[MYRIOTA_LOG_LINE_MAX];
+  size_t length = sizeof(MYRIOTA_LOG_LINE_PREFIX) - 1;
+  memcpy(line, MYRIOTA_LOG_LINE_PREFIX, length);
+  for (size_t i = 0; i < size; ++i) {
+    line[length++] = log_hex[record[i] >> 4];
+    line[length++] = log_hex[record[i] & 0x0F];
+  }
+  line[length++] = '\n';
+  line[length] = '\0';
+  log_state.output(line);
+}
+
+void MYRIOTA_LogInit(const MYRIOTA_LogOutputFn_t output) {
+  memset(&log_state, 0, sizeof(log_state));
+  log_state.output = output;
+}
+
+void MYRIOTA_LogWrite(const uint32_t token, const uint32_t *const args, const size_t count) {
+  uint8_t record[MYRIOTA_LOG_RECORD_MAX];
+  size_t size = varint_pack(record, token);
+  for (size_t i = 0; i < count; ++i) {
+    if (size + LOG_VARINT_MAX_BYTES > sizeof(record)) {
+      break;
+    }
+    size += varint_pack(&record[size], args[i]);
+  }
+  ring_put(record, size);
+}
+
+void MYRIOTA_LogWriteBytes(const uint32_t token, const uint8_t *const data, const size_t size) {
+  uint8_t record[MYRIOTA_LOG_RECORD_MAX];
+  size_t record_size = varint_pack(record, token);
+  const size_t copy_size =
+    size < sizeof(record) - record_size ? size : sizeof(record) - record_size;
+  memcpy(&record[record_size], data, copy_size);
+  ring_put(record, record_size + copy_size);
+}
+
+void MYRIOTA_LogFlush(void) {
+  if (log_state.output == NULL) {
+    return;
+  }
+  uint8_t record[MYRIOTA_LOG_RECORD_MAX];
+  while (log_state.used > 0) {
+    line_output(record, ring_get(record));
+  }
+  if (log_state.dropped > 0) {
+    size_t size = varint_pack(record, LOG_DROPPED_TOKEN);
+    size += varint_pack(&record[size], log_state.dropped);
+    line_output(record, size);
+    log_state.dropped = 0;
+  }
+}
+
+uint32_t MYRIOTA_LogDroppedGet(void) {
+  return log_state.dropped;
+}
+
+#ifdef MYRIOTA_LOG_UNIT_TESTS
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+/*
+ * `cmocka.h` must be included after standard the above library headers.
+ * NOTE: This comment has dual purpose:
+ * 1. Document the ordering requirement.
+ * 2. Prevent `clang-format` from reordering the headers.
+ */
+#include <cmocka.h>
+
+#define TEST_LINES_MAX 16
+
+static char test_lines[TEST_LINES_MAX][MYRIOTA_LOG_LINE_MAX];
+static char test_last_line[MYRIOTA_LOG_LINE_MAX];
+static size_t test_line_count;
+
+// Keeps the first lines and the last line written.
+static void test_output(const char *const line) {
+  assert_true(strlen(line) < MYRIOTA_LOG_LINE_MAX);
+  if (test_line_count < TEST_LINES_MAX) {
+    strcpy(test_lines[test_line_count], line);
+  }
+  strcpy(test_last_line, line);
+  ++test_line_count;
+}
+
+static int setup(void **state) {
+  (void)state;
+  test_line_count = 0;
+  MYRIOTA_LogInit(test_output);
+  return 0;
+}
+
+// Decodes the record of a flushed line, returning its size.
+static size_t test_record(const char *const line, uint8_t record[MYRIOTA_LOG_RECORD_MAX]) {
+  assert_memory_equal(line, MYRIOTA_LOG_LINE_PREFIX, 2);
+  const size_t length = strlen(line);
+  assert_int_equal(line[length - 1], '\n');
+  const size_t size = (length - 3) / 2;
+  for (size_t i = 0; i < size; ++i) {
+    const char *const hex = &line[2 + 2 * i];
+    record[i] = (strchr(log_hex, hex[0]) - log_hex) << 4 | (strchr(log_hex, hex[1]) - log_hex);
+  }
+  return size;
+}
+
+static void test_write(void **state) {
+  (void)state;
+  MYRIOTA_LogWrite(1, NULL, 0);
+  const uint32_t args[] = {5, 300, (uint32_t)-1};
+  MYRIOTA_LogWrite(2, args, 3);
+  assert_int_equal(test_line_count, 0);
+  MYRIOTA_LogFlush();
+  assert_int_equal(test_line_count, 2);
+  assert_string_equal(test_lines[0], "~L01\n");
+  // Arguments are varints, so negative values take 5 bytes.
+  assert_string_equal(test_lines[1], "~L0205AC02FFFFFFFF0F\n");
+
+  // Flushing empties the ring.
+  MYRIOTA_LogFlush();
+  assert_int_equal(test_line_count, 2);
+}
+
+static void test_bytes(void **state) {
+  (void)state;
+  const uint8_t packet[] = {0x4A, 0x00, 0xFF};
+  MYRIOTA_LogWriteBytes(200, packet, sizeof(packet));
+  uint8_t long_packet[MYRIOTA_LOG_RECORD_MAX * 2];
+  memset(long_packet, 0xAB, sizeof(long_packet));
+  MYRIOTA_LogWriteBytes(3, long_packet, sizeof(long_packet));
+  MYRIOTA_LogFlush();
+  assert_int_equal(test_line_count, 2);
+  assert_string_equal(test_lines[0], "~LC8014A00FF\n");
+
+  // Long dumps are truncated to the record size.
+  uint8_t record[MYRIOTA_LOG_RECORD_MAX];
+  assert_int_equal(test_record(test_lines[1], record), MYRIOTA_LOG_RECORD_MAX);
+  assert_int_equal(record[0], 3);
+  assert_int_equal(record[MYRIOTA_LOG_RECORD_MAX - 1], 0xAB);
+}
+
+static void test_dropped(void **state) {
+  (void)state;
+  // Each record takes 2 bytes of the ring, so the ring fills and the rest drop.
+  const size_t capacity = MYRIOTA_LOG_BUFFER_SIZE / 2;
+  for (size_t i = 0; i < capacity + 3; ++i) {
+    MYRIOTA_LogWrite(1, NULL, 0);
+  }
+  assert_int_equal(MYRIOTA_LogDroppedGet(), 3);
+
+  // The kept records are flushed, followed by the dropped count.
+  MYRIOTA_LogFlush();
+  assert_int_equal(MYRIOTA_LogDroppedGet(), 0);
+  assert_int_equal(test_line_count, capacity + 1);
+  assert_string_equal(test_lines[0], "~L01\n");
+  assert_string_equal(test_last_line, "~L0003\n");
+
+  // The ring can be filled again once flushed.
+  MYRIOTA_LogWrite(2, NULL, 0);
+  MYRIOTA_LogFlush();
+  assert_int_equal(test_line_count, capacity + 2);
+  assert_string_equal(test_last_line, "~L02\n");
+}
+
+static void test_macros(void **state) {
+  (void)state;
+  const int16_t temperature = -12;
+  MYRIOTA_LOG_INFO("temperature %d", temperature);
+  MYRIOTA_LOG_DEBUG("no arguments");
+  const uint8_t packet[] = {0x01, 0x02};
+  MYRIOTA_LOG_BYTES("packet %H", packet, sizeof(packet));
+  MYRIOTA_LogFlush();
+  assert_int_equal(test_line_count, 3);
+
+  uint8_t record[MYRIOTA_LOG_RECORD_MAX];
+  const size_t size = test_record(test_lines[0], record);
+  // The token is followed by the sign extended argument.
+  assert_memory_equal(&record[size - 5], "\xF4\xFF\xFF\xFF\x0F", 5);
+  const size_t bytes_size = test_record(test_lines[2], record);
+  assert_memory_equal(&record[bytes_size - sizeof(packet)], packet, sizeof(packet));
+}
+
+int main(void) {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test_setup(test_write, setup),
+    cmocka_unit_test_setup(test_bytes, setup),
+    cmocka_unit_test_setup(test_dropped, setup),
+    cmocka_unit_test_setup(test_macros, setup),
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
+#endif
@@ -310,6 +310,47 @@ int MYRIOTA_ModbusWriteHoldingRegisters(const MYRIOTA_ModbusHandle handle,
   const MYRIOTA_ModbusDeviceAddress slave, const MYRIOTA_ModbusDataAddress addr, const size_t count,
   const uint8_t *const bytes);
 
+/**
+ * Modify the value of a holding register using a combination of an AND mask
+ * and an OR mask, where result = (current & and_mask) | (or_mask & ~and_mask).
+ *
+ * \note The read-modify-write is performed by the slave in a single
+ * transaction.
+ *
+ * \param[in] handle The handle for the Modbus driver to write to.
+ * \param[in] slave The address of the slave device to write to.
+ * \param[in] addr The address of the holding register to modify.
+ * \param[in] and_mask The AND mask to apply to the holding register.
+ * \param[in] or_mask The OR mask to apply to the holding register.
+ * \return 0 on success else < 0 on error.
+ */
+int MYRIOTA_ModbusMaskWriteHoldingRegister(const MYRIOTA_ModbusHandle handle,
+  const MYRIOTA_ModbusDeviceAddress slave, const MYRIOTA_ModbusDataAddress addr,
+  const uint16_t and_mask, const uint16_t or_mask);
+
+/**
+ * Write values to a list of consecutive holding registers and then read the
+ * values of a list of consecutive holding registers in a single transaction.
+ *
+ * \note The slave performs the write before the read.
+ *
+ * \param[in] handle The handle for the Modbus driver to read from and write to.
+ * \param[in] slave The address of the slave device to read from and write to.
+ * \param[in] read_addr The start address of the holding registers to read from.
+ * \param[in] read_count The number of holding registers to read (1 to 125).
+ * \param[out] read_bytes The buffer to fill with the values of the holding
+ * registers read, where the size of the buffer must = read_count * 2.
+ * \param[in] write_addr The start address of the holding registers to write to.
+ * \param[in] write_count The number of holding registers to write (1 to 121).
+ * \param[in] write_bytes The buffer of values to write to the holding registers,
+ * where the size of the buffer must = write_count * 2.
+ * \return 0 on success else < 0 on error.
+ */
+int MYRIOTA_ModbusReadWriteHoldingRegisters(const MYRIOTA_ModbusHandle handle,
+  const MYRIOTA_ModbusDeviceAddress slave, const MYRIOTA_ModbusDataAddress read_addr,
+  const size_t read_count, uint8_t *const read_bytes, const MYRIOTA_ModbusDataAddress write_addr,
+  const size_t write_count, const uint8_t *const write_bytes);
+
 /**
  * \}
  */
@@ -34,6 +34,10 @@
 #define MODBUS_ADU_MIN_SIZE 4
 // PDU is at maximum the max size of the ADU minus the slave address and the crc16.
 #define MODBUS_PDU_MAX_SIZE (MODBUS_ADU_BUFFER_SIZE - 3)
+// Quantity limits of the read/write multiple registers command, see section 6.17
+// of https://modbus.org/docs/Modbus_Application_Protocol_V1_1b.pdf.
+#define MODBUS_READ_WRITE_READ_COUNT_MAX 0x7D
+#define MODBUS_READ_WRITE_WRITE_COUNT_MAX 0x79
 
 // NOTE: Increase to support being run on system with more then one Modbus interface.
 #ifndef MODBUS_INSTANCE_MAX
@@ -57,8 +61,8 @@ enum modbus_function_code {
   // MODBUS_FUNCTION_CODE_REPORT_SLAVE_ID = 0x11,
   // MODBUS_FUNCTION_CODE_READ_FILE_RECORD = 0x14,
   // MODBUS_FUNCTION_CODE_WRITE_FILE_RECORD = 0x15,
-  // MODBUS_FUNCTION_CODE_MASK_WRITE_REGISTER = 0x16,
-  // MODBUS_FUNCTION_CODE_READ_WRITE_MULTIPLE_REGISTERS = 0x17,
+  MODBUS_FUNCTION_CODE_MASK_WRITE_REGISTER = 0x16,
+  MODBUS_FUNCTION_CODE_READ_WRITE_MULTIPLE_REGISTERS = 0x17,
   // MODBUS_FUNCTION_CODE_READ_FIFO_QUEUE = 0x18,
   // MODBUS_FUNCTION_CODE_ENCAPSULATED_INTERFACE_TRANSPORT = 0x2B,
   MODBUS_FUNCTION_CODE_ERROR_BASE = 0x80,
@@ -162,14 +166,16 @@ static inline bool is_read_function_code(const enum modbus_function_code functio
 
 static inline bool is_read_register(const enum modbus_function_code function_code) {
   return function_code == MODBUS_FUNCTION_CODE_READ_HOLDING_REGISTERS ||
-         function_code == MODBUS_FUNCTION_CODE_READ_INPUT_REGISTERS;
+         function_code == MODBUS_FUNCTION_CODE_READ_INPUT_REGISTERS ||
+         function_code == MODBUS_FUNCTION_CODE_READ_WRITE_MULTIPLE_REGISTERS;
 }
 
 static inline bool is_write_function_code(const enum modbus_function_code function_code) {
   return function_code == MODBUS_FUNCTION_CODE_WRITE_SINGLE_COIL ||
          function_code == MODBUS_FUNCTION_CODE_WRITE_SINGLE_REGISTER ||
          function_code == MODBUS_FUNCTION_CODE_WRITE_MULTIPLE_COILS ||
-         function_code == MODBUS_FUNCTION_CODE_WRITE_MULTIPLE_REGISTERS;
+         function_code == MODBUS_FUNCTION_CODE_WRITE_MULTIPLE_REGISTERS ||
+         function_code == MODBUS_FUNCTION_CODE_MASK_WRITE_REGISTER;
 }
 
 static inline bool is_write_multiple(const enum modbus_function_code function_code) {
@@ -239,12 +245,23 @@ static uint8_t protocol_data_unit_unpack_u8(struct protocol_data_unit_parser *co
   return value;
 }
 
+static inline size_t protocol_data_unit_remaining(
+  const struct protocol_data_unit_parser *const parser) {
+  MODBUS_ASSERT(parser != NULL);
+  return (size_t)(parser->end - parser->ptr);
+}
+
 static int protocol_data_unit_parser(const struct application_data_uint *const adu,
   const MYRIOTA_ModbusDeviceAddress slave_address_out,
   const enum modbus_function_code function_code, struct protocol_data_unit_parser *const parser) {
   MODBUS_ASSERT(adu != NULL);
   MODBUS_ASSERT(parser != NULL);
-  MODBUS_ASSERT(adu->size >= MODBUS_ADU_MIN_SIZE);
+
+  // NOTE: Noise on the bus or a slave timing out mid frame can produce frames
+  // too short to hold a CRC16, which must be rejected rather than asserted on.
+  if (adu->size < MODBUS_ADU_MIN_SIZE || adu->size > MODBUS_ADU_BUFFER_SIZE) {
+    return -MODBUS_ERROR_MALFORMED_RESPONSE;
+  }
 
   // Application Data Unit (ADU)/(Protocol Data Unit (PDU) Packing Diagram
   // | 0     | Slave Address |
@@ -278,9 +295,11 @@ static int protocol_data_unit_parser(const struct application_data_uint *const a
   // | 1 | Function Code with Most Significant Bit set |
   // | 2 | Exception code                              |
   if (parser->function_code != function_code) {
-    if (parser->function_code == get_error_function_code(function_code)) {
+    if (parser->function_code == get_error_function_code(function_code) &&
+        protocol_data_unit_remaining(parser) == 1) {
       const uint8_t exception_code = protocol_data_unit_unpack_u8(parser);
-      return -exception_code;
+      // An exception code of zero would otherwise be reported as success.
+      return exception_code != 0 ? -exception_code : -MODBUS_ERROR_MALFORMED_RESPONSE;
     }
     return -MODBUS_ERROR_MALFORMED_RESPONSE;
   }
@@ -288,6 +307,40 @@ static int protocol_data_unit_parser(const struct application_data_uint *const a
   return MODBUS_SUCCESS;
 }
 
+// Unpacks the `byte count` prefixed data returned by the read commands, where
+// `max_nbytes` is the size of the callers buffer.
+static int protocol_data_unit_unpack_bytes(struct protocol_data_unit_parser *const parser,
+  const size_t max_nbytes, uint8_t *const bytes) {
+  MODBUS_ASSERT(parser != NULL);
+  MODBUS_ASSERT(bytes != NULL);
+
+  if (protocol_data_unit_remaining(parser) < 1) {
+    return -MODBUS_ERROR_MALFORMED_RESPONSE;
+  }
+
+  const uint8_t nbytes = protocol_data_unit_unpack_u8(parser);
+  if (nbytes > max_nbytes) {
+    return -MODBUS_ERROR_OVERFLOW;
+  }
+
+  if (nbytes > protocol_data_unit_remaining(parser)) {
+    return -MODBUS_ERROR_MALFORMED_RESPONSE;
+  }
+
+  memcpy(bytes, parser->ptr, nbytes);
+  parser->ptr += nbytes;
+
+  return MODBUS_SUCCESS;
+}
+
+static int protocol_data_unit_unpack_read_response(struct protocol_data_unit_parser *const parser,
+  const size_t count, uint8_t *const bytes) {
+  MODBUS_ASSERT(parser != NULL);
+  const size_t max_nbytes =
+    is_read_register(parser->function_code) ? count * 2 : (count + 8 - 1) / 8;
+  return protocol_data_unit_unpack_bytes(parser, max_nbytes, bytes);
+}
+
 static int modbus_transmit(struct modbus_instance *const instance) {
   MODBUS_ASSERT(instance != NULL);
   const MYRIOTA_ModbusSerialInterface *const serial = &instance->serial_interface;
@@ -328,6 +381,10 @@ static int modbus_read(const MYRIOTA_ModbusHandle handle,
     return -MODBUS_ERROR_BAD_STATE;
   }
 
+  if (count == 0) {
+    return -MODBUS_ERROR_OVERFLOW;
+  }
+
   // For `read commands` packing descriptions see section 6.1, 6.2, 6.3, 6.4
   // of https://modbus.org/docs/Modbus_Application_Protocol_V1_1b.pdf.
   struct application_data_uint *const adu_tx = &instance->adu_tx;
@@ -348,17 +405,7 @@ static int modbus_read(const MYRIOTA_ModbusHandle handle,
     return parser_result;
   }
 
-  const uint8_t nbytes = protocol_data_unit_unpack_u8(&parser);
-  const bool read_register_overflow = is_read_register(function_code) && (nbytes > count * 2);
-  const bool read_coil_overflow =
-    !is_read_register(function_code) && (nbytes > (count + 8 - 1) / 8);
-  if (read_register_overflow || read_coil_overflow) {
-    return -MODBUS_ERROR_OVERFLOW;
-  }
-
-  memcpy(bytes, parser.ptr, nbytes);
-
-  return MODBUS_SUCCESS;
+  return protocol_data_unit_unpack_read_response(&parser, count, bytes);
 }
 
 static int modbus_write(const MYRIOTA_ModbusHandle handle,
@@ -376,8 +423,13 @@ static int modbus_write(const MYRIOTA_ModbusHandle handle,
     return -MODBUS_ERROR_BAD_STATE;
   }
 
-  // For `write commands` packing descriptions see section 6.5, 6.6, 6.11, 6.12
+  if (is_write_multiple(function_code) && count == 0) {
+    return -MODBUS_ERROR_OVERFLOW;
+  }
+
+  // For `write commands` packing descriptions see section 6.5, 6.6, 6.11, 6.12, 6.16
   // of https://modbus.org/docs/Modbus_Application_Protocol_V1_1b.pdf.
+  // NOTE: The mask write packs the AND mask and the OR mask as two registers.
   struct application_data_uint *const adu_tx = &instance->adu_tx;
   begin_application_data_unit_pack(adu_tx, slave_address, function_code);
   application_data_unit_pack_u16(adu_tx, data_address);
@@ -401,10 +453,70 @@ static int modbus_write(const MYRIOTA_ModbusHandle handle,
     return parser_result;
   }
 
-  // NOTE/TODO: validate echoed response?
+  // The single and mask write responses echo the whole request PDU, while the
+  // multiple write responses only echo the start address and the quantity.
+  const uint8_t *const echo = &adu_tx->buffer[2];
+  const size_t echo_nbytes = is_write_multiple(function_code) ? 4 : adu_tx->size - 4;
+  if (protocol_data_unit_remaining(&parser) != echo_nbytes ||
+      memcmp(parser.ptr, echo, echo_nbytes) != 0) {
+    return -MODBUS_ERROR_MALFORMED_RESPONSE;
+  }
+
   return MODBUS_SUCCESS;
 }
 
+static int modbus_read_write(const MYRIOTA_ModbusHandle handle,
+  const MYRIOTA_ModbusDeviceAddress slave_address, const MYRIOTA_ModbusDataAddress read_address,
+  const size_t read_count, uint8_t *const read_bytes, const MYRIOTA_ModbusDataAddress write_address,
+  const size_t write_count, const uint8_t *const write_bytes) {
+  MODBUS_ASSERT(read_bytes != NULL);
+  MODBUS_ASSERT(write_bytes != NULL);
+
+  struct modbus_instance *instance = get_modbus_instance(handle);
+  if (instance == NULL) {
+    return -MODBUS_ERROR_INVALID_HANDLE;
+  }
+
+  if (!instance->enabled) {
+    return -MODBUS_ERROR_BAD_STATE;
+  }
+
+  if (read_count == 0 || read_count > MODBUS_READ_WRITE_READ_COUNT_MAX || write_count == 0 ||
+      write_count > MODBUS_READ_WRITE_WRITE_COUNT_MAX) {
+    return -MODBUS_ERROR_OVERFLOW;
+  }
+
+  // For the `read/write multiple registers` packing description see section
+  // 6.17 of https://modbus.org/docs/Modbus_Application_Protocol_V1_1b.pdf.
+  // NOTE: The slave performs the write before the read.
+  const enum modbus_function_code function_code =
+    MODBUS_FUNCTION_CODE_READ_WRITE_MULTIPLE_REGISTERS;
+  struct application_data_uint *const adu_tx = &instance->adu_tx;
+  begin_application_data_unit_pack(adu_tx, slave_address, function_code);
+  application_data_unit_pack_u16(adu_tx, read_address);
+  application_data_unit_pack_u16(adu_tx, read_count);
+  application_data_unit_pack_u16(adu_tx, write_address);
+  application_data_unit_pack_u16(adu_tx, write_count);
+  const uint8_t nbytes = write_count * 2;
+  application_data_unit_pack_u8(adu_tx, nbytes);
+  application_data_unit_pack_bytes(adu_tx, write_bytes, nbytes);
+  end_application_data_unit_pack(adu_tx);
+
+  const int transmit_result = modbus_transmit(instance);
+  if (transmit_result != MODBUS_SUCCESS) {
+    return transmit_result;
+  }
+
+  struct protocol_data_unit_parser parser = {0};
+  const int parser_result =
+    protocol_data_unit_parser(&instance->adu_rx, slave_address, function_code, &parser);
+  if (parser_result != MODBUS_SUCCESS) {
+    return parser_result;
+  }
+
+  return protocol_data_unit_unpack_read_response(&parser, read_count, read_bytes);
+}
+
 MYRIOTA_ModbusHandle MYRIOTA_ModbusInit(const MYRIOTA_ModbusInitOptions options) {
   MYRIOTA_ModbusHandle result = -MODBUS_ERROR_INVALID_HANDLE;
   for (size_t i = 0; i < MODBUS_ARRAY_SIZE(modbus_instances); ++i) {
@@ -539,6 +651,22 @@ int MYRIOTA_ModbusWriteHoldingRegisters(const MYRIOTA_ModbusHandle handle,
     bytes);
 }
 
+int MYRIOTA_ModbusMaskWriteHoldingRegister(const MYRIOTA_ModbusHandle handle,
+  const MYRIOTA_ModbusDeviceAddress slave, const MYRIOTA_ModbusDataAddress addr,
+  const uint16_t and_mask, const uint16_t or_mask) {
+  const uint8_t bytes[4] = {hi_u16(and_mask), low_u16(and_mask), hi_u16(or_mask),
+    low_u16(or_mask)};
+  return modbus_write(handle, slave, MODBUS_FUNCTION_CODE_MASK_WRITE_REGISTER, addr, 2, bytes);
+}
+
+int MYRIOTA_ModbusReadWriteHoldingRegisters(const MYRIOTA_ModbusHandle handle,
+  const MYRIOTA_ModbusDeviceAddress slave, const MYRIOTA_ModbusDataAddress read_addr,
+  const size_t read_count, uint8_t *const read_bytes, const MYRIOTA_ModbusDataAddress write_addr,
+  const size_t write_count, const uint8_t *const write_bytes) {
+  return modbus_read_write(handle, slave, read_addr, read_count, read_bytes, write_addr,
+    write_count, write_bytes);
+}
+
 #ifdef MYRIOTA_MODBUS_UNIT_TESTS
 #include <setjmp.h>
 #include <stdarg.h>
@@ -552,13 +680,164 @@ int MYRIOTA_ModbusWriteHoldingRegisters(const MYRIOTA_ModbusHandle handle,
  */
 #include <cmocka.h>
 
-static void test_x(void **state) {
-  (void)state;
+// A loopback serial device which records the last request written and replies
+// with a canned response.
+struct test_serial {
+  uint8_t tx[MODBUS_ADU_BUFFER_SIZE];
+  size_t tx_size;
+  uint8_t rx[MODBUS_ADU_BUFFER_SIZE];
+  size_t rx_size;
+};
+
+static struct test_serial test_serial = {0};
+
+static int test_serial_init(void *const ctx) {
+  (void)ctx;
+  return 0;
+}
+
+static void test_serial_deinit(void *const ctx) {
+  (void)ctx;
+}
+
+static ssize_t test_serial_read(void *const ctx, uint8_t *const buffer, const size_t count) {
+  struct test_serial *const serial = ctx;
+  const size_t nbytes = serial->rx_size < count ? serial->rx_size : count;
+  memcpy(buffer, serial->rx, nbytes);
+  return nbytes;
+}
+
+static ssize_t test_serial_write(void *const ctx, const uint8_t *const buffer,
+  const size_t count) {
+  struct test_serial *const serial = ctx;
+  memcpy(serial->tx, buffer, count);
+  serial->tx_size = count;
+  return count;
+}
+
+// Sets the canned response, appending the crc16 to the given ADU bytes.
+static void test_serial_respond(const uint8_t *const adu, const size_t size) {
+  memcpy(test_serial.rx, adu, size);
+  const uint16_t crc16 = modbus_calulate_crc16(adu, size);
+  test_serial.rx[size] = low_u16(crc16);
+  test_serial.rx[size + 1] = hi_u16(crc16);
+  test_serial.rx_size = size + 2;
+}
+
+static void assert_request_equal(const uint8_t *const adu, const size_t size) {
+  assert_int_equal(test_serial.tx_size, size + 2);
+  assert_memory_equal(test_serial.tx, adu, size);
+  const uint16_t crc16 = modbus_calulate_crc16(adu, size);
+  assert_int_equal(test_serial.tx[size], low_u16(crc16));
+  assert_int_equal(test_serial.tx[size + 1], hi_u16(crc16));
+}
+
+static int setup(void **state) {
+  memset(&test_serial, 0, sizeof(test_serial));
+  const MYRIOTA_ModbusInitOptions options = {
+    .framing_mode = MODBUS_FRAMING_MODE_RTU,
+    .serial_interface =
+      {
+        .ctx = &test_serial,
+        .init = test_serial_init,
+        .deinit = test_serial_deinit,
+        .read = test_serial_read,
+        .write = test_serial_write,
+      },
+  };
+  static MYRIOTA_ModbusHandle handle;
+  handle = MYRIOTA_ModbusInit(options);
+  if (handle == 0 || MYRIOTA_ModbusEnable(handle) != MODBUS_SUCCESS) {
+    return -1;
+  }
+  *state = &handle;
+  return 0;
+}
+
+static int teardown(void **state) {
+  MYRIOTA_ModbusDeinit(*(MYRIOTA_ModbusHandle *)*state);
+  return 0;
+}
+
+// Request and response examples are taken from section 6.16 and 6.17 of
+// https://modbus.org/docs/Modbus_Application_Protocol_V1_1b.pdf.
+static void test_mask_write_holding_register(void **state) {
+  const MYRIOTA_ModbusHandle handle = *(MYRIOTA_ModbusHandle *)*state;
+  const uint8_t request[] = {0x01, 0x16, 0x00, 0x04, 0x00, 0xF2, 0x00, 0x25};
+  test_serial_respond(request, sizeof(request));
+
+  assert_int_equal(MYRIOTA_ModbusMaskWriteHoldingRegister(handle, 0x01, 0x0004, 0x00F2, 0x0025),
+    MODBUS_SUCCESS);
+  assert_request_equal(request, sizeof(request));
+}
+
+static void test_mask_write_holding_register_bad_echo(void **state) {
+  const MYRIOTA_ModbusHandle handle = *(MYRIOTA_ModbusHandle *)*state;
+  const uint8_t response[] = {0x01, 0x16, 0x00, 0x04, 0x00, 0xF2, 0x00, 0x24};
+  test_serial_respond(response, sizeof(response));
+
+  assert_int_equal(MYRIOTA_ModbusMaskWriteHoldingRegister(handle, 0x01, 0x0004, 0x00F2, 0x0025),
+    -MODBUS_ERROR_MALFORMED_RESPONSE);
+}
+
+static void test_read_write_holding_registers(void **state) {
+  const MYRIOTA_ModbusHandle handle = *(MYRIOTA_ModbusHandle *)*state;
+  const uint8_t request[] = {0x01, 0x17, 0x00, 0x03, 0x00, 0x06, 0x00, 0x0E, 0x00, 0x03, 0x06,
+    0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF};
+  const uint8_t response[] = {0x01, 0x17, 0x0C, 0x00, 0xFE, 0x0A, 0xCD, 0x00, 0x01, 0x00, 0x03,
+    0x00, 0x0D, 0x00, 0xFF};
+  test_serial_respond(response, sizeof(response));
+
+  const uint8_t write_bytes[6] = {0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF};
+  uint8_t read_bytes[12] = {0};
+  assert_int_equal(MYRIOTA_ModbusReadWriteHoldingRegisters(handle, 0x01, 0x0003, 6, read_bytes,
+                     0x000E, 3, write_bytes),
+    MODBUS_SUCCESS);
+  assert_request_equal(request, sizeof(request));
+  assert_memory_equal(read_bytes, &response[3], sizeof(read_bytes));
+}
+
+static void test_read_write_holding_registers_exception(void **state) {
+  const MYRIOTA_ModbusHandle handle = *(MYRIOTA_ModbusHandle *)*state;
+  const uint8_t response[] = {0x01, 0x97, MODBUS_ERROR_EXCEPTION_ILLEGAL_DATA_ADDRESS};
+  test_serial_respond(response, sizeof(response));
+
+  const uint8_t write_bytes[2] = {0x12, 0x34};
+  uint8_t read_bytes[2] = {0};
+  assert_int_equal(MYRIOTA_ModbusReadWriteHoldingRegisters(handle, 0x01, 0x0000, 1, read_bytes,
+                     0x0001, 1, write_bytes),
+    -MODBUS_ERROR_EXCEPTION_ILLEGAL_DATA_ADDRESS);
+}
+
+static void test_read_write_holding_registers_overflow(void **state) {
+  const MYRIOTA_ModbusHandle handle = *(MYRIOTA_ModbusHandle *)*state;
+  const uint8_t response[] = {0x01, 0x17, 0x04, 0x00, 0x01, 0x00, 0x02};
+  test_serial_respond(response, sizeof(response));
+
+  const uint8_t write_bytes[2] = {0x12, 0x34};
+  uint8_t read_bytes[2] = {0};
+  assert_int_equal(MYRIOTA_ModbusReadWriteHoldingRegisters(handle, 0x01, 0x0000, 1, read_bytes,
+                     0x0001, 1, write_bytes),
+    -MODBUS_ERROR_OVERFLOW);
+  assert_int_equal(MYRIOTA_ModbusReadWriteHoldingRegisters(handle, 0x01, 0x0000,
+                     MODBUS_READ_WRITE_READ_COUNT_MAX + 1, read_bytes, 0x0001, 1, write_bytes),
+    -MODBUS_ERROR_OVERFLOW);
+  assert_int_equal(MYRIOTA_ModbusReadWriteHoldingRegisters(handle, 0x01, 0x0000, 0, read_bytes,
+                     0x0001, 1, write_bytes),
+    -MODBUS_ERROR_OVERFLOW);
+  assert_int_equal(MYRIOTA_ModbusReadWriteHoldingRegisters(handle, 0x01, 0x0000, 1, read_bytes,
+                     0x0001, 0, write_bytes),
+    -MODBUS_ERROR_OVERFLOW);
 }
 
 int main(void) {
   const struct CMUnitTest tests[] = {
-    cmocka_unit_test(test_x),
+    cmocka_unit_test_setup_teardown(test_mask_write_holding_register, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_mask_write_holding_register_bad_echo, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_read_write_holding_registers, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_read_write_holding_registers_exception, setup,
+      teardown),
+    cmocka_unit_test_setup_teardown(test_read_write_holding_registers_overflow, setup, teardown),
   };
 
   return cmocka_run_group_tests(tests, NULL, NULL);
@@ -0,0 +1,129 @@
+// Copyright (c) 2024, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// libFuzzer target for the Modbus driver's receive path. The first two bytes
+// of the input select the request and its size, and the remaining bytes are
+// served as the slave's response. The request is made through the public API
+// so the parser is reached exactly as it is on a device.
+//
+// Run with: ./modbus_fuzzer -max_len=300
+
+#include <stdint.h>
+#include <string.h>
+
+#include "myriota/modbus.h"
+
+#define FUZZ_SLAVE_ADDRESS 0x01
+#define FUZZ_COUNT_MAX 16
+
+struct fuzz_serial {
+  const uint8_t *data;
+  size_t size;
+};
+
+static int fuzz_serial_init(void *const ctx) {
+  (void)ctx;
+  return 0;
+}
+
+static void fuzz_serial_deinit(void *const ctx) {
+  (void)ctx;
+}
+
+static ssize_t fuzz_serial_read(void *const ctx, uint8_t *const buffer, const size_t count) {
+  const struct fuzz_serial *const serial = ctx;
+  const size_t nbytes = serial->size < count ? serial->size : count;
+  memcpy(buffer, serial->data, nbytes);
+  return nbytes;
+}
+
+static ssize_t fuzz_serial_write(void *const ctx, const uint8_t *const buffer,
+  const size_t count) {
+  (void)ctx;
+  (void)buffer;
+  return count;
+}
+
+static int fuzz_request(const MYRIOTA_ModbusHandle handle, const uint8_t request,
+  const size_t count) {
+  // Buffers are sized exactly so the sanitizers catch any overrun.
+  uint8_t bytes[FUZZ_COUNT_MAX * 2];
+  switch (request % 10) {
+    case 0:
+      return MYRIOTA_ModbusReadCoils(handle, FUZZ_SLAVE_ADDRESS, 0, count,
+        &bytes[sizeof(bytes) - (count + 7) / 8]);
+    case 1:
+      return MYRIOTA_ModbusReadDiscreteInputs(handle, FUZZ_SLAVE_ADDRESS, 0, count,
+        &bytes[sizeof(bytes) - (count + 7) / 8]);
+    case 2:
+      return MYRIOTA_ModbusReadHoldingRegisters(handle, FUZZ_SLAVE_ADDRESS, 0, count,
+        &bytes[sizeof(bytes) - count * 2]);
+    case 3:
+      return MYRIOTA_ModbusReadInputRegisters(handle, FUZZ_SLAVE_ADDRESS, 0, count,
+        &bytes[sizeof(bytes) - count * 2]);
+    case 4:
+      return MYRIOTA_ModbusWriteCoil(handle, FUZZ_SLAVE_ADDRESS, 0, 0x00FF);
+    case 5:
+      return MYRIOTA_ModbusWriteHoldingRegister(handle, FUZZ_SLAVE_ADDRESS, 0, 0x1234);
+    case 6:
+      memset(bytes, 0, sizeof(bytes));
+      return MYRIOTA_ModbusWriteCoils(handle, FUZZ_SLAVE_ADDRESS, 0, count, bytes);
+    case 7:
+      memset(bytes, 0, sizeof(bytes));
+      return MYRIOTA_ModbusWriteHoldingRegisters(handle, FUZZ_SLAVE_ADDRESS, 0, count, bytes);
+    case 8:
+      return MYRIOTA_ModbusMaskWriteHoldingRegister(handle, FUZZ_SLAVE_ADDRESS, 0, 0xF0F0,
+        0x0F0F);
+    default: {
+      const uint8_t write_bytes[2] = {0};
+      return MYRIOTA_ModbusReadWriteHoldingRegisters(handle, FUZZ_SLAVE_ADDRESS, 0, count,
+        &bytes[sizeof(bytes) - count * 2], 0, 1, write_bytes);
+    }
+  }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *const data, const size_t size) {
+  if (size < 2) {
+    return 0;
+  }
+
+  static struct fuzz_serial serial = {0};
+  serial.data = &data[2];
+  serial.size = size - 2;
+
+  static MYRIOTA_ModbusHandle handle = 0;
+  if (handle == 0) {
+    const MYRIOTA_ModbusInitOptions options = {
+      .framing_mode = MODBUS_FRAMING_MODE_RTU,
+      .serial_interface =
+        {
+          .ctx = &serial,
+          .init = fuzz_serial_init,
+          .deinit = fuzz_serial_deinit,
+          .read = fuzz_serial_read,
+          .write = fuzz_serial_write,
+        },
+    };
+    handle = MYRIOTA_ModbusInit(options);
+    MYRIOTA_ModbusEnable(handle);
+  }
+
+  const size_t count = data[1] % FUZZ_COUNT_MAX + 1;
+  const int result = fuzz_request(handle, data[0], count);
+
+  // Every failure must be reported as a negative error code.
+  if (result > 0) {
+    __builtin_trap();
+  }
+  return 0;
+}
@@ -0,0 +1,449 @@
+// Copyright (c) 2024, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "modbus_sim.h"
+#include <string.h>
+
+// An RTU character is a start bit, 8 data bits, a parity bit and a stop bit.
+#define MODBUS_SIM_BITS_PER_CHAR 11
+// Frames are delimited by at least 3.5 character times of silence.
+#define MODBUS_SIM_INTER_FRAME_CHARS 3.5
+
+#define MODBUS_SIM_EXCEPTION_ILLEGAL_FUNCTION 0x01
+#define MODBUS_SIM_EXCEPTION_ILLEGAL_DATA_ADDRESS 0x02
+#define MODBUS_SIM_EXCEPTION_ILLEGAL_DATA_VALUE 0x03
+
+struct frame {
+  uint8_t buffer[MODBUS_SIM_FRAME_MAX];
+  size_t size;
+};
+
+uint16_t modbus_sim_crc16(const uint8_t *const buffer, const size_t size) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < size; ++i) {
+    crc ^= buffer[i];
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = (crc & 0x0001) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+    }
+  }
+  return crc;
+}
+
+static uint64_t frame_time_us(const struct modbus_sim *const sim, const size_t nbytes) {
+  const double chars = nbytes + MODBUS_SIM_INTER_FRAME_CHARS;
+  return (uint64_t)(chars * MODBUS_SIM_BITS_PER_CHAR * 1000000.0 / sim->baud_rate);
+}
+
+static uint16_t get_u16(const uint8_t *const bytes) {
+  return (uint16_t)bytes[0] << 8 | bytes[1];
+}
+
+static void put_u8(struct frame *const frame, const uint8_t value) {
+  if (frame->size < MODBUS_SIM_FRAME_MAX) {
+    frame->buffer[frame->size++] = value;
+  }
+}
+
+static void put_u16(struct frame *const frame, const uint16_t value) {
+  put_u8(frame, value >> 8);
+  put_u8(frame, value & 0xFF);
+}
+
+static void put_crc16(struct frame *const frame) {
+  const uint16_t crc = modbus_sim_crc16(frame->buffer, frame->size);
+  put_u8(frame, crc & 0xFF);
+  put_u8(frame, crc >> 8);
+}
+
+static void put_exception(struct frame *const frame, const uint8_t function_code,
+  const uint8_t exception_code) {
+  frame->size = 1;
+  put_u8(frame, function_code | 0x80);
+  put_u8(frame, exception_code);
+}
+
+static bool in_range(const uint16_t addr, const uint16_t count, const size_t size) {
+  return count > 0 && (size_t)addr + count <= size;
+}
+
+static void read_bits(const bool *const bits, const uint8_t *const pdu, const size_t pdu_size,
+  struct frame *const response) {
+  const uint16_t addr = get_u16(&pdu[1]);
+  const uint16_t count = get_u16(&pdu[3]);
+  if (pdu_size != 5 || count > 2000) {
+    put_exception(response, pdu[0], MODBUS_SIM_EXCEPTION_ILLEGAL_DATA_VALUE);
+    return;
+  }
+  if (!in_range(addr, count, MODBUS_SIM_BIT_COUNT)) {
+    put_exception(response, pdu[0], MODBUS_SIM_EXCEPTION_ILLEGAL_DATA_ADDRESS);
+    return;
+  }
+
+  const uint8_t nbytes = (count + 7) / 8;
+  put_u8(response, nbytes);
+  for (uint8_t byte = 0; byte < nbytes; ++byte) {
+    uint8_t value = 0;
+    for (uint8_t bit = 0; bit < 8 && byte * 8 + bit < count; ++bit) {
+      value |= bits[addr + byte * 8 + bit] << bit;
+    }
+    put_u8(response, value);
+  }
+}
+
+static void read_registers(const uint16_t *const registers, const uint16_t addr,
+  const uint16_t count, struct frame *const response) {
+  put_u8(response, count * 2);
+  for (uint16_t i = 0; i < count; ++i) {
+    put_u16(response, registers[addr + i]);
+  }
+}
+
+static void handle_read_registers(const uint16_t *const registers, const uint8_t *const pdu,
+  const size_t pdu_size, struct frame *const response) {
+  const uint16_t addr = get_u16(&pdu[1]);
+  const uint16_t count = get_u16(&pdu[3]);
+  if (pdu_size != 5 || count > 125) {
+    put_exception(response, pdu[0], MODBUS_SIM_EXCEPTION_ILLEGAL_DATA_VALUE);
+    return;
+  }
+  if (!in_range(addr, count, MODBUS_SIM_REGISTER_COUNT)) {
+    put_exception(response, pdu[0], MODBUS_SIM_EXCEPTION_ILLEGAL_DATA_ADDRESS);
+    return;
+  }
+  read_registers(registers, addr, count, response);
+}
+
+static void handle_write_coil(struct modbus_sim *const sim, const uint8_t *const pdu,
+  const size_t pdu_size, struct frame *const response) {
+  const uint16_t addr = get_u16(&pdu[1]);
+  const uint16_t value = get_u16(&pdu[3]);
+  if (pdu_size != 5 || (value != 0xFF00 && value != 0x0000)) {
+    put_exception(response, pdu[0], MODBUS_SIM_EXCEPTION_ILLEGAL_DATA_VALUE);
+    return;
+  }
+  if (!in_range(addr, 1, MODBUS_SIM_BIT_COUNT)) {
+    put_exception(response, pdu[0], MODBUS_SIM_EXCEPTION_ILLEGAL_DATA_ADDRESS);
+    return;
+  }
+  sim->coils[addr] = value == 0xFF00;
+  memcpy(&response->buffer[response->size], &pdu[1], 4);
+  response->size += 4;
+}
+
+static void handle_write_register(struct modbus_sim *const sim, const uint8_t *const pdu,
+  const size_t pdu_size, struct frame *const response) {
+  const uint16_t addr = get_u16(&pdu[1]);
+  if (pdu_size != 5) {
+    put_exception(response, pdu[0], MODBUS_SIM_EXCEPTION_ILLEGAL_DATA_VALUE);
+    return;
+  }
+  if (!in_range(addr, 1, MODBUS_SIM_REGISTER_COUNT)) {
+    put_exception(response, pdu[0], MODBUS_SIM_EXCEPTION_ILLEGAL_DATA_ADDRESS);
+    return;
+  }
+  sim->holding_registers[addr] = get_u16(&pdu[3]);
+  memcpy(&response->buffer[response->size], &pdu[1], 4);
+  response->size += 4;
+}
+
+static void handle_write_coils(struct modbus_sim *const sim, const uint8_t *const pdu,
+  const size_t pdu_size, struct frame *const response) {
+  const uint16_t addr = get_u16(&pdu[1]);
+  const uint16_t count = get_u16(&pdu[3]);
+  const uint8_t nbytes = pdu[5];
+  if (count == 0 || count > 0x7B0 || nbytes != (count + 7) / 8 || pdu_size != 6u + nbytes) {
+    put_exception(response, pdu[0], MODBUS_SIM_EXCEPTION_ILLEGAL_DATA_VALUE);
+    return;
+  }
+  if (!in_range(addr, count, MODBUS_SIM_BIT_COUNT)) {
+    put_exception(response, pdu[0], MODBUS_SIM_EXCEPTION_ILLEGAL_DATA_ADDRESS);
+    return;
+  }
+  for (uint16_t i = 0; i < count; ++i) {
+    sim->coils[addr + i] = (pdu[6 + i / 8] >> (i % 8)) & 0x1;
+  }
+  memcpy(&response->buffer[response->size], &pdu[1], 4);
+  response->size += 4;
+}
+
+static void write_registers(struct modbus_sim *const sim, const uint16_t addr,
+  const uint16_t count, const uint8_t *const bytes) {
+  for (uint16_t i = 0; i < count; ++i) {
+    sim->holding_registers[addr + i] = get_u16(&bytes[i * 2]);
+  }
+}
+
+static void handle_write_registers(struct modbus_sim *const sim, const uint8_t *const pdu,
+  const size_t pdu_size, struct frame *const response) {
+  const uint16_t addr = get_u16(&pdu[1]);
+  const uint16_t count = get_u16(&pdu[3]);
+  const uint8_t nbytes = pdu[5];
+  if (count == 0 || count > 0x7B || nbytes != count * 2 || pdu_size != 6u + nbytes) {
+    put_exception(response, pdu[0], MODBUS_SIM_EXCEPTION_ILLEGAL_DATA_VALUE);
+    return;
+  }
+  if (!in_range(addr, count, MODBUS_SIM_REGISTER_COUNT)) {
+    put_exception(response, pdu[0], MODBUS_SIM_EXCEPTION_ILLEGAL_DATA_ADDRESS);
+    return;
+  }
+  write_registers(sim, addr, count, &pdu[6]);
+  memcpy(&response->buffer[response->size], &pdu[1], 4);
+  response->size += 4;
+}
+
+static void handle_mask_write_register(struct modbus_sim *const sim, const uint8_t *const pdu,
+  const size_t pdu_size, struct frame *const response) {
+  const uint16_t addr = get_u16(&pdu[1]);
+  if (pdu_size != 7) {
+    put_exception(response, pdu[0], MODBUS_SIM_EXCEPTION_ILLEGAL_DATA_VALUE);
+    return;
+  }
+  if (!in_range(addr, 1, MODBUS_SIM_REGISTER_COUNT)) {
+    put_exception(response, pdu[0], MODBUS_SIM_EXCEPTION_ILLEGAL_DATA_ADDRESS);
+    return;
+  }
+  const uint16_t and_mask = get_u16(&pdu[3]);
+  const uint16_t or_mask = get_u16(&pdu[5]);
+  uint16_t *const reg = &sim->holding_registers[addr];
+  *reg = (*reg & and_mask) | (or_mask & ~and_mask);
+  memcpy(&response->buffer[response->size], &pdu[1], 6);
+  response->size += 6;
+}
+
+static void handle_read_write_registers(struct modbus_sim *const sim, const uint8_t *const pdu,
+  const size_t pdu_size, struct frame *const response) {
+  const uint16_t read_addr = get_u16(&pdu[1]);
+  const uint16_t read_count = get_u16(&pdu[3]);
+  const uint16_t write_addr = get_u16(&pdu[5]);
+  const uint16_t write_count = get_u16(&pdu[7]);
+  const uint8_t nbytes = pdu[9];
+  if (read_count == 0 || read_count > 0x7D || write_count == 0 || write_count > 0x79 ||
+      nbytes != write_count * 2 || pdu_size != 10u + nbytes) {
+    put_exception(response, pdu[0], MODBUS_SIM_EXCEPTION_ILLEGAL_DATA_VALUE);
+    return;
+  }
+  if (!in_range(read_addr, read_count, MODBUS_SIM_REGISTER_COUNT) ||
+      !in_range(write_addr, write_count, MODBUS_SIM_REGISTER_COUNT)) {
+    put_exception(response, pdu[0], MODBUS_SIM_EXCEPTION_ILLEGAL_DATA_ADDRESS);
+    return;
+  }
+  write_registers(sim, write_addr, write_count, &pdu[10]);
+  read_registers(sim->holding_registers, read_addr, read_count, response);
+}
+
+// Minimum PDU sizes (including the function code) of the supported requests.
+static size_t request_min_size(const uint8_t function_code) {
+  switch (function_code) {
+    case 0x01:
+    case 0x02:
+    case 0x03:
+    case 0x04:
+    case 0x05:
+    case 0x06:
+      return 5;
+    case 0x0F:
+    case 0x10:
+      return 6;
+    case 0x16:
+      return 7;
+    case 0x17:
+      return 10;
+    default:
+      return 1;
+  }
+}
+
+// Returns false if the request should be ignored, as a real slave would for a
+// corrupt request or one addressed to another slave.
+static bool process_request(struct modbus_sim *const sim, struct frame *const response) {
+  const uint8_t *const request = sim->request;
+  const size_t size = sim->request_size;
+  if (size < 4 || request[0] != sim->address) {
+    return false;
+  }
+
+  const uint16_t crc = (uint16_t)request[size - 1] << 8 | request[size - 2];
+  if (crc != modbus_sim_crc16(request, size - 2)) {
+    return false;
+  }
+
+  const uint8_t *const pdu = &request[1];
+  const size_t pdu_size = size - 3;
+  response->size = 0;
+  put_u8(response, sim->address);
+  put_u8(response, pdu[0]);
+  if (pdu_size < request_min_size(pdu[0])) {
+    put_exception(response, pdu[0], MODBUS_SIM_EXCEPTION_ILLEGAL_DATA_VALUE);
+    return true;
+  }
+
+  switch (pdu[0]) {
+    case 0x01:
+      read_bits(sim->coils, pdu, pdu_size, response);
+      break;
+    case 0x02:
+      read_bits(sim->discrete_inputs, pdu, pdu_size, response);
+      break;
+    case 0x03:
+      handle_read_registers(sim->holding_registers, pdu, pdu_size, response);
+      break;
+    case 0x04:
+      handle_read_registers(sim->input_registers, pdu, pdu_size, response);
+      break;
+    case 0x05:
+      handle_write_coil(sim, pdu, pdu_size, response);
+      break;
+    case 0x06:
+      handle_write_register(sim, pdu, pdu_size, response);
+      break;
+    case 0x0F:
+      handle_write_coils(sim, pdu, pdu_size, response);
+      break;
+    case 0x10:
+      handle_write_registers(sim, pdu, pdu_size, response);
+      break;
+    case 0x16:
+      handle_mask_write_register(sim, pdu, pdu_size, response);
+      break;
+    case 0x17:
+      handle_read_write_registers(sim, pdu, pdu_size, response);
+      break;
+    default:
+      put_exception(response, pdu[0], MODBUS_SIM_EXCEPTION_ILLEGAL_FUNCTION);
+      break;
+  }
+  return true;
+}
+
+// Applies a scripted fault to a response, returning false if the slave should
+// stay silent.
+static bool apply_fault(const struct modbus_sim_step *const step, struct frame *const response) {
+  switch (step->fault) {
+    case MODBUS_SIM_FAULT_NONE:
+      put_crc16(response);
+      return true;
+    case MODBUS_SIM_FAULT_BAD_CRC:
+      put_crc16(response);
+      response->buffer[response->size - 1] ^= 0xFF;
+      return true;
+    case MODBUS_SIM_FAULT_FLIP_BIT:
+      put_crc16(response);
+      if (step->arg / 8 < response->size) {
+        response->buffer[step->arg / 8] ^= 1 << (step->arg % 8);
+      }
+      return true;
+    case MODBUS_SIM_FAULT_TRUNCATE:
+      put_crc16(response);
+      if (step->arg < response->size) {
+        response->size = step->arg;
+      }
+      return response->size > 0;
+    case MODBUS_SIM_FAULT_TRUNCATE_PDU:
+      response->size = step->arg + 2u < response->size ? response->size - step->arg : 2;
+      put_crc16(response);
+      return true;
+    case MODBUS_SIM_FAULT_EXCEPTION:
+      put_exception(response, response->buffer[1], step->arg);
+      put_crc16(response);
+      return true;
+    case MODBUS_SIM_FAULT_WRONG_SLAVE:
+      response->buffer[0] = step->arg;
+      put_crc16(response);
+      return true;
+    case MODBUS_SIM_FAULT_SILENCE:
+      return false;
+  }
+  return false;
+}
+
+static int sim_init(void *const ctx) {
+  struct modbus_sim *const sim = ctx;
+  sim->request_size = 0;
+  return 0;
+}
+
+static void sim_deinit(void *const ctx) {
+  (void)ctx;
+}
+
+static ssize_t sim_write(void *const ctx, const uint8_t *const buffer, const size_t count) {
+  struct modbus_sim *const sim = ctx;
+  const size_t available = MODBUS_SIM_FRAME_MAX - sim->request_size;
+  const size_t nbytes = count < available ? count : available;
+  memcpy(&sim->request[sim->request_size], buffer, nbytes);
+  sim->request_size += nbytes;
+  return nbytes;
+}
+
+// The master reading is the end of a transaction, so the slave processes the
+// request it has received and the simulated clock is advanced by the time the
+// transaction would take on the bus.
+static ssize_t sim_read(void *const ctx, uint8_t *const buffer, const size_t count) {
+  struct modbus_sim *const sim = ctx;
+
+  struct modbus_sim_step step = {0};
+  if (sim->script_index < sim->script_size) {
+    step = sim->script[sim->script_index++];
+  }
+  const uint32_t latency_us = step.latency_us != 0 ? step.latency_us : sim->latency_us;
+
+  ++sim->transactions;
+  sim->elapsed_us += frame_time_us(sim, sim->request_size);
+
+  struct frame response = {0};
+  const bool is_processed = process_request(sim, &response);
+  sim->request_size = 0;
+  if (!is_processed) {
+    ++sim->requests_ignored;
+    sim->elapsed_us += sim->timeout_us;
+    return 0;
+  }
+
+  if (!apply_fault(&step, &response) || latency_us >= sim->timeout_us) {
+    sim->elapsed_us += sim->timeout_us;
+    return 0;
+  }
+
+  sim->elapsed_us += latency_us + frame_time_us(sim, response.size);
+  const size_t nbytes = response.size < count ? response.size : count;
+  memcpy(buffer, response.buffer, nbytes);
+  return nbytes;
+}
+
+void modbus_sim_init(struct modbus_sim *const sim, const MYRIOTA_ModbusDeviceAddress address,
+  const uint32_t baud_rate) {
+  memset(sim, 0, sizeof(*sim));
+  sim->address = address;
+  sim->baud_rate = baud_rate;
+  sim->latency_us = 5000;
+  sim->timeout_us = 200000;
+}
+
+void modbus_sim_script(struct modbus_sim *const sim, const struct modbus_sim_step *const steps,
+  const size_t count) {
+  const size_t nsteps = count < MODBUS_SIM_SCRIPT_MAX ? count : MODBUS_SIM_SCRIPT_MAX;
+  memcpy(sim->script, steps, nsteps * sizeof(*steps));
+  sim->script_size = nsteps;
+  sim->script_index = 0;
+}
+
+MYRIOTA_ModbusSerialInterface modbus_sim_serial_interface(struct modbus_sim *const sim) {
+  const MYRIOTA_ModbusSerialInterface serial_interface = {
+    .ctx = sim,
+    .init = sim_init,
+    .deinit = sim_deinit,
+    .read = sim_read,
+    .write = sim_write,
+  };
+  return serial_interface;
+}
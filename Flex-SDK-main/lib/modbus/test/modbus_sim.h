@@ -0,0 +1,101 @@
+// Copyright (c) 2024, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A simulated Modbus RTU slave for exercising the Modbus driver on the host.
+// The simulator is exposed as a MYRIOTA_ModbusSerialInterface so the driver
+// talks to it exactly as it would to a serial port, and each transaction can
+// be scripted to misbehave like a slave on a noisy field bus.
+
+#ifndef MODBUS_SIM_H
+#define MODBUS_SIM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "myriota/modbus.h"
+
+#define MODBUS_SIM_FRAME_MAX 256
+#define MODBUS_SIM_REGISTER_COUNT 64
+#define MODBUS_SIM_BIT_COUNT 64
+#define MODBUS_SIM_SCRIPT_MAX 16
+
+enum modbus_sim_fault {
+  MODBUS_SIM_FAULT_NONE,
+  // Corrupt the CRC16 of the response.
+  MODBUS_SIM_FAULT_BAD_CRC,
+  // Flip bit `arg` of the response (counting from the first bit of the frame).
+  MODBUS_SIM_FAULT_FLIP_BIT,
+  // Only send the first `arg` bytes of the response.
+  MODBUS_SIM_FAULT_TRUNCATE,
+  // Drop `arg` bytes from the end of the response PDU and send a valid CRC16.
+  MODBUS_SIM_FAULT_TRUNCATE_PDU,
+  // Respond with exception code `arg`.
+  MODBUS_SIM_FAULT_EXCEPTION,
+  // Respond from slave address `arg`.
+  MODBUS_SIM_FAULT_WRONG_SLAVE,
+  // Don't respond at all.
+  MODBUS_SIM_FAULT_SILENCE,
+};
+
+struct modbus_sim_step {
+  enum modbus_sim_fault fault;
+  uint8_t arg;
+  // The time the slave takes to start responding, when zero the slave's
+  // default latency is used.
+  uint32_t latency_us;
+};
+
+struct modbus_sim {
+  MYRIOTA_ModbusDeviceAddress address;
+  uint32_t baud_rate;
+  // The default time the slave takes to start responding.
+  uint32_t latency_us;
+  // How long the master waits for a response before giving up.
+  uint32_t timeout_us;
+
+  uint16_t holding_registers[MODBUS_SIM_REGISTER_COUNT];
+  uint16_t input_registers[MODBUS_SIM_REGISTER_COUNT];
+  bool coils[MODBUS_SIM_BIT_COUNT];
+  bool discrete_inputs[MODBUS_SIM_BIT_COUNT];
+
+  struct modbus_sim_step script[MODBUS_SIM_SCRIPT_MAX];
+  size_t script_size;
+  size_t script_index;
+
+  uint8_t request[MODBUS_SIM_FRAME_MAX];
+  size_t request_size;
+
+  // Statistics
+  uint64_t elapsed_us;
+  uint32_t transactions;
+  uint32_t requests_ignored;
+};
+
+// Initializes a slave with the given address on a bus at the given baud rate.
+void modbus_sim_init(struct modbus_sim *const sim, const MYRIOTA_ModbusDeviceAddress address,
+  const uint32_t baud_rate);
+
+// Scripts the behaviour of the next `count` transactions, after which the
+// slave behaves normally.
+void modbus_sim_script(struct modbus_sim *const sim, const struct modbus_sim_step *const steps,
+  const size_t count);
+
+// Returns a serial interface which is connected to the slave.
+MYRIOTA_ModbusSerialInterface modbus_sim_serial_interface(struct modbus_sim *const sim);
+
+// Calculates a Modbus CRC16. This is deliberately independent of the driver's
+// table driven implementation.
+uint16_t modbus_sim_crc16(const uint8_t *const buffer, const size_t size);
+
+#endif /* MODBUS_SIM_H */
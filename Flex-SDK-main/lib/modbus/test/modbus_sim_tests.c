@@ -0,0 +1,367 @@
+// Copyright (c) 2024, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Exercises the Modbus driver against the simulated slave, covering both well
+// behaved transactions and the faults seen on noisy field buses.
+
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+/*
+ * `cmocka.h` must be included after standard the above library headers.
+ * NOTE: This comment has dual purpose:
+ * 1. Document the ordering requirement.
+ * 2. Prevent `clang-format` from reordering the headers.
+ */
+#include <cmocka.h>
+
+#include "modbus_sim.h"
+#include "myriota/modbus.h"
+
+#define SLAVE_ADDRESS 0x11
+#define ARRAY_SIZE(array) (sizeof(array) / sizeof(*array))
+
+struct test_context {
+  struct modbus_sim sim;
+  MYRIOTA_ModbusHandle handle;
+};
+
+static int setup_with_baud_rate(void **state, const uint32_t baud_rate) {
+  static struct test_context context;
+  modbus_sim_init(&context.sim, SLAVE_ADDRESS, baud_rate);
+  const MYRIOTA_ModbusInitOptions options = {
+    .framing_mode = MODBUS_FRAMING_MODE_RTU,
+    .serial_interface = modbus_sim_serial_interface(&context.sim),
+  };
+  context.handle = MYRIOTA_ModbusInit(options);
+  if (context.handle == 0 || MYRIOTA_ModbusEnable(context.handle) != MODBUS_SUCCESS) {
+    return -1;
+  }
+  *state = &context;
+  return 0;
+}
+
+static int setup(void **state) {
+  return setup_with_baud_rate(state, 9600);
+}
+
+static int teardown(void **state) {
+  const struct test_context *const context = *state;
+  MYRIOTA_ModbusDeinit(context->handle);
+  return 0;
+}
+
+// Reads two holding registers with the given fault injected into the response.
+static int read_with_fault(struct test_context *const context,
+  const struct modbus_sim_step step) {
+  modbus_sim_script(&context->sim, &step, 1);
+  uint8_t bytes[4] = {0};
+  return MYRIOTA_ModbusReadHoldingRegisters(context->handle, SLAVE_ADDRESS, 0x0000, 2, bytes);
+}
+
+static void test_crc16(void **state) {
+  (void)state;
+  // Example from section 6.2.2 of
+  // https://modbus.org/docs/Modbus_over_serial_line_V1_02.pdf.
+  const uint8_t frame[] = {0x02, 0x07};
+  assert_int_equal(modbus_sim_crc16(frame, sizeof(frame)), 0x1241);
+}
+
+static void test_read_registers(void **state) {
+  struct test_context *const context = *state;
+  context->sim.holding_registers[10] = 0x1234;
+  context->sim.holding_registers[11] = 0xABCD;
+  context->sim.input_registers[3] = 0x5A5A;
+
+  uint8_t bytes[4] = {0};
+  assert_int_equal(
+    MYRIOTA_ModbusReadHoldingRegisters(context->handle, SLAVE_ADDRESS, 10, 2, bytes),
+    MODBUS_SUCCESS);
+  const uint8_t expected[] = {0x12, 0x34, 0xAB, 0xCD};
+  assert_memory_equal(bytes, expected, sizeof(expected));
+
+  assert_int_equal(MYRIOTA_ModbusReadInputRegisters(context->handle, SLAVE_ADDRESS, 3, 1, bytes),
+    MODBUS_SUCCESS);
+  assert_int_equal(bytes[0], 0x5A);
+  assert_int_equal(bytes[1], 0x5A);
+}
+
+static void test_read_bits(void **state) {
+  struct test_context *const context = *state;
+  context->sim.coils[1] = true;
+  context->sim.coils[9] = true;
+  context->sim.discrete_inputs[0] = true;
+
+  uint8_t bytes[2] = {0};
+  assert_int_equal(MYRIOTA_ModbusReadCoils(context->handle, SLAVE_ADDRESS, 0, 10, bytes),
+    MODBUS_SUCCESS);
+  assert_int_equal(bytes[0], 0x02);
+  assert_int_equal(bytes[1], 0x02);
+
+  assert_int_equal(MYRIOTA_ModbusReadDiscreteInputs(context->handle, SLAVE_ADDRESS, 0, 3, bytes),
+    MODBUS_SUCCESS);
+  assert_int_equal(bytes[0], 0x01);
+}
+
+static void test_writes(void **state) {
+  struct test_context *const context = *state;
+  struct modbus_sim *const sim = &context->sim;
+  const MYRIOTA_ModbusHandle handle = context->handle;
+
+  // NOTE: Single writes take the word in Modbus byte order.
+  const uint16_t coil_on = 0x00FF;
+  assert_int_equal(MYRIOTA_ModbusWriteCoil(handle, SLAVE_ADDRESS, 5, coil_on), MODBUS_SUCCESS);
+  assert_true(sim->coils[5]);
+
+  const uint16_t word = 0x3412;
+  assert_int_equal(MYRIOTA_ModbusWriteHoldingRegister(handle, SLAVE_ADDRESS, 7, word),
+    MODBUS_SUCCESS);
+  assert_int_equal(sim->holding_registers[7], 0x1234);
+
+  const uint8_t coils[] = {0x05, 0x01};
+  assert_int_equal(MYRIOTA_ModbusWriteCoils(handle, SLAVE_ADDRESS, 20, 9, coils), MODBUS_SUCCESS);
+  assert_true(sim->coils[20]);
+  assert_false(sim->coils[21]);
+  assert_true(sim->coils[22]);
+  assert_true(sim->coils[28]);
+
+  const uint8_t registers[] = {0x00, 0x01, 0x00, 0x02};
+  assert_int_equal(MYRIOTA_ModbusWriteHoldingRegisters(handle, SLAVE_ADDRESS, 30, 2, registers),
+    MODBUS_SUCCESS);
+  assert_int_equal(sim->holding_registers[30], 0x0001);
+  assert_int_equal(sim->holding_registers[31], 0x0002);
+
+  // Example from section 6.16 of
+  // https://modbus.org/docs/Modbus_Application_Protocol_V1_1b.pdf.
+  sim->holding_registers[4] = 0x0012;
+  assert_int_equal(MYRIOTA_ModbusMaskWriteHoldingRegister(handle, SLAVE_ADDRESS, 4, 0x00F2, 0x0025),
+    MODBUS_SUCCESS);
+  assert_int_equal(sim->holding_registers[4], 0x0017);
+
+  uint8_t read_bytes[4] = {0};
+  const uint8_t write_bytes[] = {0xBE, 0xEF};
+  assert_int_equal(MYRIOTA_ModbusReadWriteHoldingRegisters(handle, SLAVE_ADDRESS, 30, 2,
+                     read_bytes, 31, 1, write_bytes),
+    MODBUS_SUCCESS);
+  const uint8_t expected[] = {0x00, 0x01, 0xBE, 0xEF};
+  assert_memory_equal(read_bytes, expected, sizeof(expected));
+}
+
+// Counts outside of what the request can carry are rejected before anything
+// is sent to the slave.
+static void test_bad_counts(void **state) {
+  struct test_context *const context = *state;
+  const MYRIOTA_ModbusHandle handle = context->handle;
+
+  uint8_t bytes[2 * 126] = {0};
+  assert_int_equal(MYRIOTA_ModbusReadCoils(handle, SLAVE_ADDRESS, 0, 0, bytes),
+    -MODBUS_ERROR_OVERFLOW);
+  assert_int_equal(MYRIOTA_ModbusReadHoldingRegisters(handle, SLAVE_ADDRESS, 0, 0, bytes),
+    -MODBUS_ERROR_OVERFLOW);
+  assert_int_equal(MYRIOTA_ModbusWriteCoils(handle, SLAVE_ADDRESS, 0, 0, bytes),
+    -MODBUS_ERROR_OVERFLOW);
+  assert_int_equal(MYRIOTA_ModbusWriteHoldingRegisters(handle, SLAVE_ADDRESS, 0, 0, bytes),
+    -MODBUS_ERROR_OVERFLOW);
+
+  const uint8_t write_bytes[2 * 122] = {0};
+  assert_int_equal(
+    MYRIOTA_ModbusReadWriteHoldingRegisters(handle, SLAVE_ADDRESS, 0, 0, bytes, 0, 1, write_bytes),
+    -MODBUS_ERROR_OVERFLOW);
+  assert_int_equal(
+    MYRIOTA_ModbusReadWriteHoldingRegisters(handle, SLAVE_ADDRESS, 0, 1, bytes, 0, 0, write_bytes),
+    -MODBUS_ERROR_OVERFLOW);
+  assert_int_equal(MYRIOTA_ModbusReadWriteHoldingRegisters(handle, SLAVE_ADDRESS, 0,
+                     126, bytes, 0, 1, write_bytes),
+    -MODBUS_ERROR_OVERFLOW);
+  assert_int_equal(MYRIOTA_ModbusReadWriteHoldingRegisters(handle, SLAVE_ADDRESS, 0, 1, bytes, 0,
+                     122, write_bytes),
+    -MODBUS_ERROR_OVERFLOW);
+  assert_int_equal(context->sim.transactions, 0);
+}
+
+static void test_bad_crc(void **state) {
+  const struct modbus_sim_step step = {.fault = MODBUS_SIM_FAULT_BAD_CRC};
+  assert_int_equal(read_with_fault(*state, step), -MODBUS_ERROR_INVALID_CRC16);
+}
+
+// A CRC16 detects every single bit error, so no flipped bit may go unnoticed.
+static void test_every_bit_flip_is_detected(void **state) {
+  // The response to reading two registers is 9 bytes long.
+  for (unsigned bit = 0; bit < 9 * 8; ++bit) {
+    const struct modbus_sim_step step = {.fault = MODBUS_SIM_FAULT_FLIP_BIT, .arg = bit};
+    assert_int_not_equal(read_with_fault(*state, step), MODBUS_SUCCESS);
+  }
+}
+
+static void test_truncated_frames(void **state) {
+  assert_int_equal(read_with_fault(*state,
+                     (struct modbus_sim_step){.fault = MODBUS_SIM_FAULT_TRUNCATE, .arg = 0}),
+    -MODBUS_ERROR_IO_FAILURE);
+  for (uint8_t size = 1; size < 4; ++size) {
+    const struct modbus_sim_step step = {.fault = MODBUS_SIM_FAULT_TRUNCATE, .arg = size};
+    assert_int_equal(read_with_fault(*state, step), -MODBUS_ERROR_MALFORMED_RESPONSE);
+  }
+  for (uint8_t size = 4; size < 9; ++size) {
+    const struct modbus_sim_step step = {.fault = MODBUS_SIM_FAULT_TRUNCATE, .arg = size};
+    assert_int_not_equal(read_with_fault(*state, step), MODBUS_SUCCESS);
+  }
+}
+
+static void test_truncated_payloads(void **state) {
+  struct test_context *const context = *state;
+
+  // Frames with a valid CRC16 but missing data, including no byte count.
+  for (uint8_t nbytes = 1; nbytes <= 5; ++nbytes) {
+    const struct modbus_sim_step step = {.fault = MODBUS_SIM_FAULT_TRUNCATE_PDU, .arg = nbytes};
+    assert_int_equal(read_with_fault(context, step), -MODBUS_ERROR_MALFORMED_RESPONSE);
+  }
+
+  const struct modbus_sim_step step = {.fault = MODBUS_SIM_FAULT_TRUNCATE_PDU, .arg = 1};
+  modbus_sim_script(&context->sim, &step, 1);
+  assert_int_equal(MYRIOTA_ModbusWriteHoldingRegister(context->handle, SLAVE_ADDRESS, 0, 0),
+    -MODBUS_ERROR_MALFORMED_RESPONSE);
+}
+
+static void test_exceptions(void **state) {
+  struct test_context *const context = *state;
+  assert_int_equal(read_with_fault(context, (struct modbus_sim_step){
+                                              .fault = MODBUS_SIM_FAULT_EXCEPTION,
+                                              .arg = MODBUS_ERROR_EXCEPTION_SLAVE_DEVICE_BUSY,
+                                            }),
+    -MODBUS_ERROR_EXCEPTION_SLAVE_DEVICE_BUSY);
+
+  // An exception code of zero must not be mistaken for success.
+  assert_int_equal(
+    read_with_fault(context, (struct modbus_sim_step){.fault = MODBUS_SIM_FAULT_EXCEPTION}),
+    -MODBUS_ERROR_MALFORMED_RESPONSE);
+
+  uint8_t bytes[2] = {0};
+  assert_int_equal(MYRIOTA_ModbusReadHoldingRegisters(context->handle, SLAVE_ADDRESS,
+                     MODBUS_SIM_REGISTER_COUNT, 1, bytes),
+    -MODBUS_ERROR_EXCEPTION_ILLEGAL_DATA_ADDRESS);
+
+  // An exception response missing its exception code.
+  const struct modbus_sim_step step = {.fault = MODBUS_SIM_FAULT_TRUNCATE_PDU, .arg = 1};
+  modbus_sim_script(&context->sim, &step, 1);
+  assert_int_equal(MYRIOTA_ModbusReadHoldingRegisters(context->handle, SLAVE_ADDRESS,
+                     MODBUS_SIM_REGISTER_COUNT, 1, bytes),
+    -MODBUS_ERROR_MALFORMED_RESPONSE);
+}
+
+static void test_wrong_slave(void **state) {
+  const struct modbus_sim_step step = {
+    .fault = MODBUS_SIM_FAULT_WRONG_SLAVE,
+    .arg = SLAVE_ADDRESS + 1,
+  };
+  assert_int_equal(read_with_fault(*state, step), -MODBUS_ERROR_RESPONSE_FROM_WRONG_SLAVE_ADDRESS);
+
+  // Requests for other slaves are ignored.
+  struct test_context *const context = *state;
+  uint8_t bytes[2] = {0};
+  assert_int_equal(
+    MYRIOTA_ModbusReadHoldingRegisters(context->handle, SLAVE_ADDRESS + 1, 0, 1, bytes),
+    -MODBUS_ERROR_IO_FAILURE);
+  assert_int_equal(context->sim.requests_ignored, 1);
+}
+
+static void test_timeouts(void **state) {
+  struct test_context *const context = *state;
+  assert_int_equal(
+    read_with_fault(context, (struct modbus_sim_step){.fault = MODBUS_SIM_FAULT_SILENCE}),
+    -MODBUS_ERROR_IO_FAILURE);
+
+  const struct modbus_sim_step slow = {.latency_us = context->sim.timeout_us};
+  assert_int_equal(read_with_fault(context, slow), -MODBUS_ERROR_IO_FAILURE);
+
+  const struct modbus_sim_step tolerable = {.latency_us = context->sim.timeout_us - 1};
+  assert_int_equal(read_with_fault(context, tolerable), MODBUS_SUCCESS);
+}
+
+// Recovers after a burst of faults without any state leaking between
+// transactions.
+static void test_recovery(void **state) {
+  struct test_context *const context = *state;
+  const struct modbus_sim_step steps[] = {
+    {.fault = MODBUS_SIM_FAULT_BAD_CRC},
+    {.fault = MODBUS_SIM_FAULT_TRUNCATE, .arg = 3},
+    {.fault = MODBUS_SIM_FAULT_SILENCE},
+  };
+  modbus_sim_script(&context->sim, steps, ARRAY_SIZE(steps));
+  context->sim.holding_registers[0] = 0x0102;
+
+  uint8_t bytes[2] = {0};
+  int result = -1;
+  int attempts = 0;
+  while (result != MODBUS_SUCCESS && attempts < 10) {
+    result = MYRIOTA_ModbusReadHoldingRegisters(context->handle, SLAVE_ADDRESS, 0, 1, bytes);
+    ++attempts;
+  }
+  assert_int_equal(result, MODBUS_SUCCESS);
+  assert_int_equal(attempts, ARRAY_SIZE(steps) + 1);
+  assert_int_equal(bytes[0], 0x01);
+  assert_int_equal(bytes[1], 0x02);
+}
+
+// Reports the simulated time taken by a typical transaction (reading 10
+// registers), which is dominated by the time on the wire at low baud rates.
+static void test_transaction_latency(void **state) {
+  (void)state;
+  const uint32_t baud_rates[] = {9600, 19200, 115200};
+  for (size_t i = 0; i < ARRAY_SIZE(baud_rates); ++i) {
+    void *context_state = NULL;
+    assert_int_equal(setup_with_baud_rate(&context_state, baud_rates[i]), 0);
+    struct test_context *const context = context_state;
+
+    const uint32_t transactions = 100;
+    uint8_t bytes[20] = {0};
+    for (uint32_t j = 0; j < transactions; ++j) {
+      assert_int_equal(
+        MYRIOTA_ModbusReadHoldingRegisters(context->handle, SLAVE_ADDRESS, 0, 10, bytes),
+        MODBUS_SUCCESS);
+    }
+
+    // 8 byte request and 25 byte response, each followed by 3.5 characters of
+    // silence, with 11 bits per character.
+    const uint64_t wire_us = (uint64_t)(8 + 25 + 7) * 11 * 1000000 / baud_rates[i];
+    const uint64_t mean_us = context->sim.elapsed_us / transactions;
+    printf("%lu baud: %lu us per transaction\n", (unsigned long)baud_rates[i],
+      (unsigned long)mean_us);
+    assert_in_range(mean_us, wire_us + context->sim.latency_us - 1,
+      wire_us + context->sim.latency_us + 1);
+
+    teardown(&context_state);
+  }
+}
+
+int main(void) {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_crc16),
+    cmocka_unit_test_setup_teardown(test_read_registers, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_read_bits, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_writes, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_bad_counts, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_bad_crc, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_every_bit_flip_is_detected, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_truncated_frames, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_truncated_payloads, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_exceptions, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_wrong_slave, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_timeouts, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_recovery, setup, teardown),
+    cmocka_unit_test(test_transaction_latency),
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,161 @@
+/// \file modbus_cache.h Myriota Modbus Register Cache
+// Copyright (c) 2024, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MYRIOTA_MODBUS_CACHE_H
+#define MYRIOTA_MODBUS_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "myriota/modbus.h"
+
+/** \defgroup ModbusCache Modbus Register Cache Library
+ * @brief Change-only reporting of Modbus register values
+ * \{
+ */
+
+/** The maximum number of points a register cache can hold. */
+#ifndef MYRIOTA_MODBUS_CACHE_POINTS_MAX
+#define MYRIOTA_MODBUS_CACHE_POINTS_MAX 8
+#endif
+
+/** Error codes for the register cache. */
+typedef enum {
+  MODBUS_CACHE_SUCCESS = 0,
+  MODBUS_CACHE_ERROR_INVALID_ARGUMENT = 0x40,
+  MODBUS_CACHE_ERROR_NO_VALUE,
+} MYRIOTA_ModbusCacheErrors;
+
+/** The type of register a point is read from. */
+typedef enum {
+  MODBUS_CACHE_REGISTER_HOLDING,
+  MODBUS_CACHE_REGISTER_INPUT,
+} MYRIOTA_ModbusCacheRegisterType;
+
+/**
+ * Configuration of a single point (i.e. 16 bit register) in the cache.
+ *
+ * \note A threshold of zero disables the corresponding trigger.
+ */
+typedef struct {
+  MYRIOTA_ModbusDeviceAddress slave;     ///< The address of the slave to read from.
+  MYRIOTA_ModbusCacheRegisterType type;  ///< The type of register to read.
+  MYRIOTA_ModbusDataAddress addr;        ///< The address of the register to read.
+  bool is_signed;                        ///< Interpret the register as a signed value.
+  uint16_t deadband;  ///< Report once the value moves this far from the last reported value.
+  uint16_t rate_of_change;  ///< Report once the value changes at least this much per minute.
+  uint32_t max_silence;     ///< Report at least once every this many seconds.
+} MYRIOTA_ModbusCachePoint;
+
+/** \cond INTERNAL_HIDDEN */
+typedef struct {
+  int32_t value;
+  int32_t reported_value;
+  time_t sampled_at;
+  time_t reported_at;
+  bool has_value;
+  bool has_reported;
+  bool is_triggered;
+} MYRIOTA_ModbusCachePointState;
+/** \endcond */
+
+/** A register cache instance. */
+typedef struct {
+  /** \cond INTERNAL_HIDDEN */
+  const MYRIOTA_ModbusCachePoint *points;
+  size_t count;
+  MYRIOTA_ModbusCachePointState states[MYRIOTA_MODBUS_CACHE_POINTS_MAX];
+  /** \endcond */
+} MYRIOTA_ModbusCache;
+
+/**
+ * Initializes a register cache.
+ *
+ * \note Points which are on the same slave, are of the same register type and
+ * have consecutive addresses are read in a single Modbus transaction, so list
+ * them next to each other.
+ *
+ * \param[out] cache The cache to initialize.
+ * \param[in] points The configuration of each point, which must outlive the cache.
+ * \param[in] count The number of points (at most MYRIOTA_MODBUS_CACHE_POINTS_MAX).
+ * \return 0 on success else < 0 on error.
+ */
+int MYRIOTA_ModbusCacheInit(MYRIOTA_ModbusCache *const cache,
+  const MYRIOTA_ModbusCachePoint *const points, const size_t count);
+
+/**
+ * Reads all points in the cache from their Modbus slaves.
+ *
+ * \note Points that fail to read keep their previous value.
+ *
+ * \param[in,out] cache The cache to update.
+ * \param[in] handle The handle for an enabled Modbus driver to read from.
+ * \param[in] now The current time in seconds.
+ * \return 0 on success else the Modbus error (< 0) of the last failed read.
+ */
+int MYRIOTA_ModbusCachePoll(MYRIOTA_ModbusCache *const cache, const MYRIOTA_ModbusHandle handle,
+  const time_t now);
+
+/**
+ * Records a new raw register value for a point.
+ *
+ * \param[in,out] cache The cache to update.
+ * \param[in] index The index of the point to update.
+ * \param[in] raw The raw register value.
+ * \param[in] now The time in seconds the value was sampled.
+ * \return 0 on success else < 0 on error.
+ */
+int MYRIOTA_ModbusCacheUpdate(MYRIOTA_ModbusCache *const cache, const size_t index,
+  const uint16_t raw, const time_t now);
+
+/**
+ * Evaluates which points need to be reported.
+ *
+ * A point is due when it has never been reported, has moved by at least its
+ * deadband since it was last reported, has changed faster than its rate of
+ * change since it was last reported, or has been silent for longer than its
+ * maximum silence.
+ *
+ * \param[in] cache The cache to evaluate.
+ * \param[in] now The current time in seconds.
+ * \return a bit mask where bit n is set when point n is due to be reported.
+ */
+uint32_t MYRIOTA_ModbusCacheEvaluate(const MYRIOTA_ModbusCache *const cache, const time_t now);
+
+/**
+ * Gets the latest value of a point.
+ *
+ * \param[in] cache The cache to get the value from.
+ * \param[in] index The index of the point.
+ * \param[out] value The latest value of the point.
+ * \return 0 on success else < 0 on error.
+ */
+int MYRIOTA_ModbusCacheValueGet(const MYRIOTA_ModbusCache *const cache, const size_t index,
+  int32_t *const value);
+
+/**
+ * Marks the latest value of every point as reported.
+ *
+ * \param[in,out] cache The cache to update.
+ * \param[in] now The time in seconds the values were reported.
+ */
+void MYRIOTA_ModbusCacheMarkReported(MYRIOTA_ModbusCache *const cache, const time_t now);
+
+/**
+ * \}
+ */
+
+#endif /* MYRIOTA_MODBUS_CACHE_H */
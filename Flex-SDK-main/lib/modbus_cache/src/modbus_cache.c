@@ -0,0 +1,365 @@
+// Copyright (c) 2024, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "myriota/modbus_cache.h"
+#include <string.h>
+
+#define MODBUS_CACHE_ARRAY_SIZE(array) (sizeof(array) / sizeof(*array))
+#define MODBUS_CACHE_SECONDS_PER_MINUTE 60
+
+static inline uint32_t abs_difference(const int32_t a, const int32_t b) {
+  return a > b ? (uint32_t)((int64_t)a - b) : (uint32_t)((int64_t)b - a);
+}
+
+static inline int32_t register_value(const MYRIOTA_ModbusCachePoint *const point,
+  const uint16_t raw) {
+  return point->is_signed ? (int32_t)(int16_t)raw : (int32_t)raw;
+}
+
+// Returns true if the point at index + 1 can be read in the same transaction
+// as the point at index.
+static bool is_contiguous(const MYRIOTA_ModbusCache *const cache, const size_t index) {
+  const MYRIOTA_ModbusCachePoint *const curr = &cache->points[index];
+  const MYRIOTA_ModbusCachePoint *const next = &cache->points[index + 1];
+  return next->slave == curr->slave && next->type == curr->type && next->addr == curr->addr + 1;
+}
+
+static int read_registers(const MYRIOTA_ModbusHandle handle,
+  const MYRIOTA_ModbusCachePoint *const point, const size_t count, uint8_t *const bytes) {
+  switch (point->type) {
+    case MODBUS_CACHE_REGISTER_HOLDING:
+      return MYRIOTA_ModbusReadHoldingRegisters(handle, point->slave, point->addr, count, bytes);
+    case MODBUS_CACHE_REGISTER_INPUT:
+      return MYRIOTA_ModbusReadInputRegisters(handle, point->slave, point->addr, count, bytes);
+  }
+  return -MODBUS_CACHE_ERROR_INVALID_ARGUMENT;
+}
+
+int MYRIOTA_ModbusCacheInit(MYRIOTA_ModbusCache *const cache,
+  const MYRIOTA_ModbusCachePoint *const points, const size_t count) {
+  if (cache == NULL || points == NULL || count == 0 || count > MYRIOTA_MODBUS_CACHE_POINTS_MAX) {
+    return -MODBUS_CACHE_ERROR_INVALID_ARGUMENT;
+  }
+
+  memset(cache, 0, sizeof(*cache));
+  cache->points = points;
+  cache->count = count;
+  return MODBUS_CACHE_SUCCESS;
+}
+
+int MYRIOTA_ModbusCachePoll(MYRIOTA_ModbusCache *const cache, const MYRIOTA_ModbusHandle handle,
+  const time_t now) {
+  int result = MODBUS_CACHE_SUCCESS;
+  size_t first = 0;
+  while (first < cache->count) {
+    // Coalesce runs of consecutive registers into a single read to minimize
+    // time on the bus (and therefore time the sensor needs to be powered).
+    size_t count = 1;
+    while (first + count < cache->count && is_contiguous(cache, first + count - 1)) {
+      ++count;
+    }
+
+    uint8_t bytes[MYRIOTA_MODBUS_CACHE_POINTS_MAX * 2] = {0};
+    const int read_result = read_registers(handle, &cache->points[first], count, bytes);
+    if (read_result == MODBUS_SUCCESS) {
+      for (size_t i = 0; i < count; ++i) {
+        const uint16_t raw = (uint16_t)bytes[i * 2] << 8 | bytes[i * 2 + 1];
+        MYRIOTA_ModbusCacheUpdate(cache, first + i, raw, now);
+      }
+    } else {
+      result = read_result;
+    }
+
+    first += count;
+  }
+
+  return result;
+}
+
+int MYRIOTA_ModbusCacheUpdate(MYRIOTA_ModbusCache *const cache, const size_t index,
+  const uint16_t raw, const time_t now) {
+  if (index >= cache->count) {
+    return -MODBUS_CACHE_ERROR_INVALID_ARGUMENT;
+  }
+
+  const MYRIOTA_ModbusCachePoint *const point = &cache->points[index];
+  MYRIOTA_ModbusCachePointState *const state = &cache->states[index];
+  const int32_t value = register_value(point, raw);
+
+  // NOTE: The rate of change is latched until the next report, otherwise a
+  // fast transient that settles before the next evaluation would be lost.
+  if (point->rate_of_change != 0 && state->has_value) {
+    const time_t elapsed = now > state->sampled_at ? now - state->sampled_at : 1;
+    const uint64_t change = (uint64_t)abs_difference(value, state->value) *
+                            MODBUS_CACHE_SECONDS_PER_MINUTE;
+    if (change >= (uint64_t)point->rate_of_change * (uint64_t)elapsed) {
+      state->is_triggered = true;
+    }
+  }
+
+  state->value = value;
+  state->sampled_at = now;
+  state->has_value = true;
+  return MODBUS_CACHE_SUCCESS;
+}
+
+uint32_t MYRIOTA_ModbusCacheEvaluate(const MYRIOTA_ModbusCache *const cache, const time_t now) {
+  uint32_t due = 0;
+  for (size_t i = 0; i < cache->count; ++i) {
+    const MYRIOTA_ModbusCachePoint *const point = &cache->points[i];
+    const MYRIOTA_ModbusCachePointState *const state = &cache->states[i];
+    if (!state->has_value) {
+      continue;
+    }
+
+    if (!state->has_reported || state->is_triggered ||
+        (point->deadband != 0 &&
+          abs_difference(state->value, state->reported_value) >= point->deadband) ||
+        (point->max_silence != 0 && now - state->reported_at >= (time_t)point->max_silence)) {
+      due |= 1UL << i;
+    }
+  }
+  return due;
+}
+
+int MYRIOTA_ModbusCacheValueGet(const MYRIOTA_ModbusCache *const cache, const size_t index,
+  int32_t *const value) {
+  if (index >= cache->count) {
+    return -MODBUS_CACHE_ERROR_INVALID_ARGUMENT;
+  }
+
+  const MYRIOTA_ModbusCachePointState *const state = &cache->states[index];
+  if (!state->has_value) {
+    return -MODBUS_CACHE_ERROR_NO_VALUE;
+  }
+
+  *value = state->value;
+  return MODBUS_CACHE_SUCCESS;
+}
+
+void MYRIOTA_ModbusCacheMarkReported(MYRIOTA_ModbusCache *const cache, const time_t now) {
+  for (size_t i = 0; i < cache->count; ++i) {
+    MYRIOTA_ModbusCachePointState *const state = &cache->states[i];
+    if (!state->has_value) {
+      continue;
+    }
+
+    state->reported_value = state->value;
+    state->reported_at = now;
+    state->has_reported = true;
+    state->is_triggered = false;
+  }
+}
+
+#ifdef MYRIOTA_MODBUS_CACHE_UNIT_TESTS
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#include <cmocka.h>
+
+// Fake Modbus slave, registers are indexed by address and reads are counted so
+// that coalescing can be verified.
+static uint16_t test_registers[16] = {0};
+static int test_read_result = MODBUS_SUCCESS;
+static int test_read_count = 0;
+
+static int test_read(const MYRIOTA_ModbusDataAddress addr, const size_t count,
+  uint8_t *const bytes) {
+  ++test_read_count;
+  if (test_read_result != MODBUS_SUCCESS) {
+    return test_read_result;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    bytes[i * 2] = test_registers[addr + i] >> 8;
+    bytes[i * 2 + 1] = test_registers[addr + i] & 0xFF;
+  }
+  return MODBUS_SUCCESS;
+}
+
+int MYRIOTA_ModbusReadHoldingRegisters(const MYRIOTA_ModbusHandle handle,
+  const MYRIOTA_ModbusDeviceAddress slave, const MYRIOTA_ModbusDataAddress addr,
+  const size_t count, uint8_t *const bytes) {
+  (void)handle;
+  (void)slave;
+  return test_read(addr, count, bytes);
+}
+
+int MYRIOTA_ModbusReadInputRegisters(const MYRIOTA_ModbusHandle handle,
+  const MYRIOTA_ModbusDeviceAddress slave, const MYRIOTA_ModbusDataAddress addr,
+  const size_t count, uint8_t *const bytes) {
+  (void)handle;
+  (void)slave;
+  return test_read(addr, count, bytes);
+}
+
+static int setup(void **state) {
+  (void)state;
+  memset(test_registers, 0, sizeof(test_registers));
+  test_read_result = MODBUS_SUCCESS;
+  test_read_count = 0;
+  return 0;
+}
+
+static void test_init(void **state) {
+  (void)state;
+  const MYRIOTA_ModbusCachePoint points[MYRIOTA_MODBUS_CACHE_POINTS_MAX + 1] = {0};
+  MYRIOTA_ModbusCache cache;
+  assert_int_equal(MYRIOTA_ModbusCacheInit(&cache, points, 0),
+    -MODBUS_CACHE_ERROR_INVALID_ARGUMENT);
+  assert_int_equal(MYRIOTA_ModbusCacheInit(&cache, points, MYRIOTA_MODBUS_CACHE_POINTS_MAX + 1),
+    -MODBUS_CACHE_ERROR_INVALID_ARGUMENT);
+  assert_int_equal(MYRIOTA_ModbusCacheInit(&cache, points, 1), MODBUS_CACHE_SUCCESS);
+
+  int32_t value = 0;
+  assert_int_equal(MYRIOTA_ModbusCacheValueGet(&cache, 0, &value), -MODBUS_CACHE_ERROR_NO_VALUE);
+  assert_int_equal(MYRIOTA_ModbusCacheValueGet(&cache, 1, &value),
+    -MODBUS_CACHE_ERROR_INVALID_ARGUMENT);
+  assert_int_equal(MYRIOTA_ModbusCacheEvaluate(&cache, 0), 0);
+}
+
+static void test_poll_coalesces_contiguous_registers(void **state) {
+  (void)state;
+  const MYRIOTA_ModbusCachePoint points[] = {
+    {.slave = 1, .type = MODBUS_CACHE_REGISTER_HOLDING, .addr = 0},
+    {.slave = 1, .type = MODBUS_CACHE_REGISTER_HOLDING, .addr = 1, .is_signed = true},
+    {.slave = 1, .type = MODBUS_CACHE_REGISTER_HOLDING, .addr = 2},
+    {.slave = 1, .type = MODBUS_CACHE_REGISTER_INPUT, .addr = 3},
+    {.slave = 2, .type = MODBUS_CACHE_REGISTER_INPUT, .addr = 4},
+  };
+  MYRIOTA_ModbusCache cache;
+  assert_int_equal(MYRIOTA_ModbusCacheInit(&cache, points, MODBUS_CACHE_ARRAY_SIZE(points)),
+    MODBUS_CACHE_SUCCESS);
+
+  test_registers[0] = 500;
+  test_registers[1] = 0xFF38;  // -200
+  test_registers[2] = 0xFF38;  // 65336
+  test_registers[3] = 3;
+  test_registers[4] = 4;
+  assert_int_equal(MYRIOTA_ModbusCachePoll(&cache, 1, 0), MODBUS_CACHE_SUCCESS);
+  assert_int_equal(test_read_count, 3);
+
+  int32_t value = 0;
+  assert_int_equal(MYRIOTA_ModbusCacheValueGet(&cache, 0, &value), MODBUS_CACHE_SUCCESS);
+  assert_int_equal(value, 500);
+  assert_int_equal(MYRIOTA_ModbusCacheValueGet(&cache, 1, &value), MODBUS_CACHE_SUCCESS);
+  assert_int_equal(value, -200);
+  assert_int_equal(MYRIOTA_ModbusCacheValueGet(&cache, 2, &value), MODBUS_CACHE_SUCCESS);
+  assert_int_equal(value, 65336);
+  assert_int_equal(MYRIOTA_ModbusCacheValueGet(&cache, 4, &value), MODBUS_CACHE_SUCCESS);
+  assert_int_equal(value, 4);
+}
+
+static void test_poll_failure_keeps_value(void **state) {
+  (void)state;
+  const MYRIOTA_ModbusCachePoint points[] = {{.slave = 1, .addr = 0}};
+  MYRIOTA_ModbusCache cache;
+  assert_int_equal(MYRIOTA_ModbusCacheInit(&cache, points, MODBUS_CACHE_ARRAY_SIZE(points)),
+    MODBUS_CACHE_SUCCESS);
+
+  test_registers[0] = 42;
+  assert_int_equal(MYRIOTA_ModbusCachePoll(&cache, 1, 0), MODBUS_CACHE_SUCCESS);
+  test_registers[0] = 43;
+  test_read_result = -MODBUS_ERROR_IO_FAILURE;
+  assert_int_equal(MYRIOTA_ModbusCachePoll(&cache, 1, 10), -MODBUS_ERROR_IO_FAILURE);
+
+  int32_t value = 0;
+  assert_int_equal(MYRIOTA_ModbusCacheValueGet(&cache, 0, &value), MODBUS_CACHE_SUCCESS);
+  assert_int_equal(value, 42);
+}
+
+static void test_deadband(void **state) {
+  (void)state;
+  const MYRIOTA_ModbusCachePoint points[] = {{.is_signed = true, .deadband = 10}};
+  MYRIOTA_ModbusCache cache;
+  assert_int_equal(MYRIOTA_ModbusCacheInit(&cache, points, MODBUS_CACHE_ARRAY_SIZE(points)),
+    MODBUS_CACHE_SUCCESS);
+
+  // The first value is always reported.
+  MYRIOTA_ModbusCacheUpdate(&cache, 0, 100, 0);
+  assert_int_equal(MYRIOTA_ModbusCacheEvaluate(&cache, 0), 0x1);
+  MYRIOTA_ModbusCacheMarkReported(&cache, 0);
+  assert_int_equal(MYRIOTA_ModbusCacheEvaluate(&cache, 0), 0);
+
+  // Drifting within the deadband is suppressed, even when accumulated over
+  // several samples.
+  MYRIOTA_ModbusCacheUpdate(&cache, 0, 105, 60);
+  assert_int_equal(MYRIOTA_ModbusCacheEvaluate(&cache, 60), 0);
+  MYRIOTA_ModbusCacheUpdate(&cache, 0, 91, 120);
+  assert_int_equal(MYRIOTA_ModbusCacheEvaluate(&cache, 120), 0);
+  MYRIOTA_ModbusCacheUpdate(&cache, 0, 90, 180);
+  assert_int_equal(MYRIOTA_ModbusCacheEvaluate(&cache, 180), 0x1);
+  MYRIOTA_ModbusCacheMarkReported(&cache, 180);
+
+  MYRIOTA_ModbusCacheUpdate(&cache, 0, (uint16_t)-5, 240);
+  assert_int_equal(MYRIOTA_ModbusCacheEvaluate(&cache, 240), 0x1);
+}
+
+static void test_rate_of_change(void **state) {
+  (void)state;
+  const MYRIOTA_ModbusCachePoint points[] = {{.rate_of_change = 10}};
+  MYRIOTA_ModbusCache cache;
+  assert_int_equal(MYRIOTA_ModbusCacheInit(&cache, points, MODBUS_CACHE_ARRAY_SIZE(points)),
+    MODBUS_CACHE_SUCCESS);
+
+  MYRIOTA_ModbusCacheUpdate(&cache, 0, 1000, 0);
+  MYRIOTA_ModbusCacheMarkReported(&cache, 0);
+
+  // 9 units per minute is below the trigger.
+  MYRIOTA_ModbusCacheUpdate(&cache, 0, 1018, 120);
+  assert_int_equal(MYRIOTA_ModbusCacheEvaluate(&cache, 120), 0);
+
+  // A fast transient is latched even after the value has returned.
+  MYRIOTA_ModbusCacheUpdate(&cache, 0, 1023, 150);
+  MYRIOTA_ModbusCacheUpdate(&cache, 0, 1018, 180);
+  assert_int_equal(MYRIOTA_ModbusCacheEvaluate(&cache, 180), 0x1);
+  MYRIOTA_ModbusCacheMarkReported(&cache, 180);
+  assert_int_equal(MYRIOTA_ModbusCacheEvaluate(&cache, 180), 0);
+}
+
+static void test_max_silence(void **state) {
+  (void)state;
+  const MYRIOTA_ModbusCachePoint points[] = {
+    {.deadband = 100, .max_silence = 3600},
+    {.deadband = 100},
+  };
+  MYRIOTA_ModbusCache cache;
+  assert_int_equal(MYRIOTA_ModbusCacheInit(&cache, points, MODBUS_CACHE_ARRAY_SIZE(points)),
+    MODBUS_CACHE_SUCCESS);
+
+  MYRIOTA_ModbusCacheUpdate(&cache, 0, 1, 0);
+  MYRIOTA_ModbusCacheUpdate(&cache, 1, 1, 0);
+  assert_int_equal(MYRIOTA_ModbusCacheEvaluate(&cache, 0), 0x3);
+  MYRIOTA_ModbusCacheMarkReported(&cache, 0);
+
+  MYRIOTA_ModbusCacheUpdate(&cache, 0, 2, 3599);
+  MYRIOTA_ModbusCacheUpdate(&cache, 1, 2, 3599);
+  assert_int_equal(MYRIOTA_ModbusCacheEvaluate(&cache, 3599), 0);
+  assert_int_equal(MYRIOTA_ModbusCacheEvaluate(&cache, 3600), 0x1);
+  MYRIOTA_ModbusCacheMarkReported(&cache, 3600);
+  assert_int_equal(MYRIOTA_ModbusCacheEvaluate(&cache, 7199), 0);
+}
+
+int main(void) {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test_setup_teardown(test_init, setup, NULL),
+    cmocka_unit_test_setup_teardown(test_poll_coalesces_contiguous_registers, setup, NULL),
+    cmocka_unit_test_setup_teardown(test_poll_failure_keeps_value, setup, NULL),
+    cmocka_unit_test_setup_teardown(test_deadband, setup, NULL),
+    cmocka_unit_test_setup_teardown(test_rate_of_change, setup, NULL),
+    cmocka_unit_test_setup_teardown(test_max_silence, setup, NULL),
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
+#endif
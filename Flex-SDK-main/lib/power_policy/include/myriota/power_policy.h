@@ -0,0 +1,177 @@
+/// \file power_policy.h Myriota Power Policy
+// Copyright (c) 2024, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef MYRIOTA_POWER_POLICY_H
+#define MYRIOTA_POWER_POLICY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** \defgroup PowerPolicy Power Policy Library
+ * @brief Battery aware scaling of sampling, sensor power and transmission
+ * \{
+ */
+
+/** The default battery voltage below which the power level is low. */
+#define MYRIOTA_POWER_POLICY_DEFAULT_LOW_MV 3400
+/** The default battery voltage below which the power level is critical. */
+#define MYRIOTA_POWER_POLICY_DEFAULT_CRITICAL_MV 3200
+/** The default voltage the battery must recover by before the level is raised. */
+#define MYRIOTA_POWER_POLICY_DEFAULT_HYSTERESIS_MV 100
+/** The default interval scale while the power level is low. */
+#define MYRIOTA_POWER_POLICY_DEFAULT_LOW_SCALE 2
+/** The default interval scale while the power level is critical. */
+#define MYRIOTA_POWER_POLICY_DEFAULT_CRITICAL_SCALE 4
+
+/** The power available to the application, from least to most. */
+typedef enum {
+  MYRIOTA_POWER_LEVEL_CRITICAL,  ///< The battery is nearly exhausted.
+  MYRIOTA_POWER_LEVEL_LOW,       ///< The battery is low or sagging, e.g. in the cold.
+  MYRIOTA_POWER_LEVEL_NORMAL,    ///< Running on a healthy battery.
+  MYRIOTA_POWER_LEVEL_EXTERNAL,  ///< Running on external power.
+} MYRIOTA_PowerLevel;
+
+/** The cost of a task, which determines the power levels it may run at. */
+typedef enum {
+  MYRIOTA_POWER_COST_LOW,     ///< E.g. sampling an input. Always allowed.
+  MYRIOTA_POWER_COST_MEDIUM,  ///< E.g. a GNSS fix or powering a sensor. Not allowed if critical.
+  MYRIOTA_POWER_COST_HIGH,    ///< E.g. sending an image. Only allowed on external power.
+} MYRIOTA_PowerCost;
+
+/** Configuration of the power policy. */
+typedef struct {
+  int32_t low_mv;          ///< The battery voltage below which the level is low.
+  int32_t critical_mv;     ///< The battery voltage below which the level is critical.
+  int32_t hysteresis_mv;   ///< The voltage the battery must recover by to raise the level.
+  uint8_t low_scale;       ///< The interval scale while the level is low.
+  uint8_t critical_scale;  ///< The interval scale while the level is critical.
+} MYRIOTA_PowerPolicyConfig;
+
+/** An initialiser for a configuration with the default thresholds and scales. */
+#define MYRIOTA_POWER_POLICY_DEFAULT_CONFIG                        \
+  {                                                                \
+    .low_mv = MYRIOTA_POWER_POLICY_DEFAULT_LOW_MV,                 \
+    .critical_mv = MYRIOTA_POWER_POLICY_DEFAULT_CRITICAL_MV,       \
+    .hysteresis_mv = MYRIOTA_POWER_POLICY_DEFAULT_HYSTERESIS_MV,   \
+    .low_scale = MYRIOTA_POWER_POLICY_DEFAULT_LOW_SCALE,           \
+    .critical_scale = MYRIOTA_POWER_POLICY_DEFAULT_CRITICAL_SCALE, \
+  }
+
+/** A power policy instance. */
+typedef struct {
+  /** \cond INTERNAL_HIDDEN */
+  MYRIOTA_PowerPolicyConfig config;
+  MYRIOTA_PowerLevel battery_level;
+  int32_t battery_mv;
+  bool is_external;
+  /** \endcond */
+} MYRIOTA_PowerPolicy;
+
+/**
+ * Initialises a power policy.
+ *
+ * The policy starts at MYRIOTA_POWER_LEVEL_NORMAL until the first update.
+ *
+ * \param[out] policy The policy to initialise.
+ * \param[in] config The policy configuration.
+ */
+void MYRIOTA_PowerPolicyInit(MYRIOTA_PowerPolicy *const policy,
+  const MYRIOTA_PowerPolicyConfig config);
+
+/**
+ * Updates the power level from a sample of the battery voltage and the
+ * external power state.
+ *
+ * The level drops as soon as the voltage is below a threshold, but is only
+ * raised once the voltage is above the threshold by the hysteresis, so a
+ * battery sagging under load or in the cold doesn't flip between levels.
+ *
+ * \param[in,out] policy The policy to update.
+ * \param[in] battery_mv The battery voltage in mV, or <= 0 if unknown (e.g. on
+ * external power) in which case the battery level is unchanged.
+ * \param[in] is_external true if running on external power.
+ * \return The updated power level.
+ */
+MYRIOTA_PowerLevel MYRIOTA_PowerPolicyUpdate(MYRIOTA_PowerPolicy *const policy,
+  const int32_t battery_mv, const bool is_external);
+
+/**
+ * Updates the external power state, e.g. from the external power handler.
+ *
+ * When external power is removed the level returns to the level of the last
+ * battery voltage sample.
+ *
+ * \param[in,out] policy The policy to update.
+ * \param[in] is_external true if running on external power.
+ * \return The updated power level.
+ */
+MYRIOTA_PowerLevel MYRIOTA_PowerPolicyExternalPowerSet(MYRIOTA_PowerPolicy *const policy,
+  const bool is_external);
+
+/**
+ * Gets the current power level.
+ *
+ * \param[in] policy The policy.
+ * \return The current power level.
+ */
+MYRIOTA_PowerLevel MYRIOTA_PowerPolicyLevelGet(const MYRIOTA_PowerPolicy *const policy);
+
+/**
+ * Gets the last battery voltage sample.
+ *
+ * \param[in] policy The policy.
+ * \return The battery voltage in mV, or 0 if it hasn't been sampled.
+ */
+int32_t MYRIOTA_PowerPolicyBatteryGet(const MYRIOTA_PowerPolicy *const policy);
+
+/**
+ * Checks whether a task of a given cost may run at the current power level.
+ *
+ * \param[in] policy The policy.
+ * \param[in] cost The cost of the task.
+ * \return true if the task may run.
+ */
+bool MYRIOTA_PowerPolicyIsAllowed(const MYRIOTA_PowerPolicy *const policy,
+  const MYRIOTA_PowerCost cost);
+
+/**
+ * Scales an interval (e.g. a sampling or GNSS fix interval) for the current
+ * power level. Intervals are stretched by the configured scale while the level
+ * is low or critical.
+ *
+ * \param[in] policy The policy.
+ * \param[in] interval The interval at the normal power level, in any unit.
+ * \return The scaled interval, saturated at UINT32_MAX.
+ */
+uint32_t MYRIOTA_PowerPolicyIntervalScale(const MYRIOTA_PowerPolicy *const policy,
+  const uint32_t interval);
+
+/**
+ * Scales a budget (e.g. the time a sensor is powered for or the number of read
+ * retries) for the current power level. Budgets are divided by the configured
+ * scale while the level is low or critical, but never below one.
+ *
+ * \param[in] policy The policy.
+ * \param[in] budget The budget at the normal power level, in any unit.
+ * \return The scaled budget.
+ */
+uint32_t MYRIOTA_PowerPolicyBudgetScale(const MYRIOTA_PowerPolicy *const policy,
+  const uint32_t budget);
+
+/**
+ * \}
+ */
+
+#endif /* MYRIOTA_POWER_POLICY_H */
@@ -0,0 +1,218 @@
+// Copyright (c) 2024, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "myriota/power_policy.h"
+
+// The level of a battery voltage without hysteresis.
+static MYRIOTA_PowerLevel battery_level(const MYRIOTA_PowerPolicyConfig *const config,
+  const int32_t battery_mv) {
+  if (battery_mv < config->critical_mv) {
+    return MYRIOTA_POWER_LEVEL_CRITICAL;
+  }
+  if (battery_mv < config->low_mv) {
+    return MYRIOTA_POWER_LEVEL_LOW;
+  }
+  return MYRIOTA_POWER_LEVEL_NORMAL;
+}
+
+static uint8_t level_scale(const MYRIOTA_PowerPolicy *const policy) {
+  switch (MYRIOTA_PowerPolicyLevelGet(policy)) {
+    case MYRIOTA_POWER_LEVEL_CRITICAL:
+      return policy->config.critical_scale;
+    case MYRIOTA_POWER_LEVEL_LOW:
+      return policy->config.low_scale;
+    default:
+      return 1;
+  }
+}
+
+void MYRIOTA_PowerPolicyInit(MYRIOTA_PowerPolicy *const policy,
+  const MYRIOTA_PowerPolicyConfig config) {
+  policy->config = config;
+  policy->battery_level = MYRIOTA_POWER_LEVEL_NORMAL;
+  policy->battery_mv = 0;
+  policy->is_external = false;
+}
+
+MYRIOTA_PowerLevel MYRIOTA_PowerPolicyUpdate(MYRIOTA_PowerPolicy *const policy,
+  const int32_t battery_mv, const bool is_external) {
+  if (battery_mv > 0) {
+    const MYRIOTA_PowerLevel current = policy->battery_level;
+    const MYRIOTA_PowerLevel level = battery_level(&policy->config, battery_mv);
+    if (level <= current) {
+      policy->battery_level = level;
+    } else {
+      // Only raise the level once the battery has recovered past the threshold.
+      const MYRIOTA_PowerLevel recovered =
+        battery_level(&policy->config, battery_mv - policy->config.hysteresis_mv);
+      if (recovered > current) {
+        policy->battery_level = recovered;
+      }
+    }
+    policy->battery_mv = battery_mv;
+  }
+  return MYRIOTA_PowerPolicyExternalPowerSet(policy, is_external);
+}
+
+MYRIOTA_PowerLevel MYRIOTA_PowerPolicyExternalPowerSet(MYRIOTA_PowerPolicy *const policy,
+  const bool is_external) {
+  policy->is_external = is_external;
+  return MYRIOTA_PowerPolicyLevelGet(policy);
+}
+
+MYRIOTA_PowerLevel MYRIOTA_PowerPolicyLevelGet(const MYRIOTA_PowerPolicy *const policy) {
+  return policy->is_external ? MYRIOTA_POWER_LEVEL_EXTERNAL : policy->battery_level;
+}
+
+int32_t MYRIOTA_PowerPolicyBatteryGet(const MYRIOTA_PowerPolicy *const policy) {
+  return policy->battery_mv;
+}
+
+bool MYRIOTA_PowerPolicyIsAllowed(const MYRIOTA_PowerPolicy *const policy,
+  const MYRIOTA_PowerCost cost) {
+  const MYRIOTA_PowerLevel level = MYRIOTA_PowerPolicyLevelGet(policy);
+  switch (cost) {
+    case MYRIOTA_POWER_COST_LOW:
+      return true;
+    case MYRIOTA_POWER_COST_MEDIUM:
+      return level > MYRIOTA_POWER_LEVEL_CRITICAL;
+    case MYRIOTA_POWER_COST_HIGH:
+      return level == MYRIOTA_POWER_LEVEL_EXTERNAL;
+  }
+  return false;
+}
+
+uint32_t MYRIOTA_PowerPolicyIntervalScale(const MYRIOTA_PowerPolicy *const policy,
+  const uint32_t interval) {
+  const uint64_t scaled = (uint64_t)interval * level_scale(policy);
+  return scaled > UINT32_MAX ? UINT32_MAX : scaled;
+}
+
+uint32_t MYRIOTA_PowerPolicyBudgetScale(const MYRIOTA_PowerPolicy *const policy,
+  const uint32_t budget) {
+  const uint8_t scale = level_scale(policy);
+  if (budget == 0 || scale == 0) {
+    return budget;
+  }
+  const uint32_t scaled = budget / scale;
+  return scaled == 0 ? 1 : scaled;
+}
+
+#ifdef MYRIOTA_POWER_POLICY_UNIT_TESTS
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+/*
+ * `cmocka.h` must be included after standard the above library headers.
+ * NOTE: This comment has dual purpose:
+ * 1. Document the ordering requirement.
+ * 2. Prevent `clang-format` from reordering the headers.
+ */
+#include <cmocka.h>
+
+static MYRIOTA_PowerPolicy test_policy;
+
+static int setup(void **state) {
+  (void)state;
+  const MYRIOTA_PowerPolicyConfig config = MYRIOTA_POWER_POLICY_DEFAULT_CONFIG;
+  MYRIOTA_PowerPolicyInit(&test_policy, config);
+  return 0;
+}
+
+static void test_levels(void **state) {
+  (void)state;
+  assert_int_equal(MYRIOTA_PowerPolicyLevelGet(&test_policy), MYRIOTA_POWER_LEVEL_NORMAL);
+  assert_int_equal(MYRIOTA_PowerPolicyUpdate(&test_policy, 3600, false),
+    MYRIOTA_POWER_LEVEL_NORMAL);
+  assert_int_equal(MYRIOTA_PowerPolicyUpdate(&test_policy, 3399, false), MYRIOTA_POWER_LEVEL_LOW);
+  assert_int_equal(MYRIOTA_PowerPolicyUpdate(&test_policy, 3100, false),
+    MYRIOTA_POWER_LEVEL_CRITICAL);
+  assert_int_equal(MYRIOTA_PowerPolicyBatteryGet(&test_policy), 3100);
+}
+
+static void test_hysteresis(void **state) {
+  (void)state;
+  MYRIOTA_PowerPolicyUpdate(&test_policy, 3350, false);
+  assert_int_equal(MYRIOTA_PowerPolicyLevelGet(&test_policy), MYRIOTA_POWER_LEVEL_LOW);
+
+  // Recovering just past the threshold isn't enough to raise the level.
+  assert_int_equal(MYRIOTA_PowerPolicyUpdate(&test_policy, 3450, false), MYRIOTA_POWER_LEVEL_LOW);
+  assert_int_equal(MYRIOTA_PowerPolicyUpdate(&test_policy, 3500, false),
+    MYRIOTA_POWER_LEVEL_NORMAL);
+
+  // Recovering from critical can be held back to low by the hysteresis.
+  MYRIOTA_PowerPolicyUpdate(&test_policy, 3000, false);
+  assert_int_equal(MYRIOTA_PowerPolicyUpdate(&test_policy, 3450, false), MYRIOTA_POWER_LEVEL_LOW);
+
+  // An unknown voltage leaves the level unchanged.
+  assert_int_equal(MYRIOTA_PowerPolicyUpdate(&test_policy, 0, false), MYRIOTA_POWER_LEVEL_LOW);
+}
+
+static void test_external_power(void **state) {
+  (void)state;
+  MYRIOTA_PowerPolicyUpdate(&test_policy, 3100, false);
+  assert_false(MYRIOTA_PowerPolicyIsAllowed(&test_policy, MYRIOTA_POWER_COST_HIGH));
+
+  // The voltage reads 0 on external power.
+  assert_int_equal(MYRIOTA_PowerPolicyUpdate(&test_policy, 0, true),
+    MYRIOTA_POWER_LEVEL_EXTERNAL);
+  assert_true(MYRIOTA_PowerPolicyIsAllowed(&test_policy, MYRIOTA_POWER_COST_HIGH));
+  assert_int_equal(MYRIOTA_PowerPolicyIntervalScale(&test_policy, 600), 600);
+
+  // Removing external power returns to the last battery level.
+  assert_int_equal(MYRIOTA_PowerPolicyExternalPowerSet(&test_policy, false),
+    MYRIOTA_POWER_LEVEL_CRITICAL);
+}
+
+static void test_allowed(void **state) {
+  (void)state;
+  MYRIOTA_PowerPolicyUpdate(&test_policy, 3600, false);
+  assert_true(MYRIOTA_PowerPolicyIsAllowed(&test_policy, MYRIOTA_POWER_COST_LOW));
+  assert_true(MYRIOTA_PowerPolicyIsAllowed(&test_policy, MYRIOTA_POWER_COST_MEDIUM));
+  assert_false(MYRIOTA_PowerPolicyIsAllowed(&test_policy, MYRIOTA_POWER_COST_HIGH));
+
+  MYRIOTA_PowerPolicyUpdate(&test_policy, 3100, false);
+  assert_true(MYRIOTA_PowerPolicyIsAllowed(&test_policy, MYRIOTA_POWER_COST_LOW));
+  assert_false(MYRIOTA_PowerPolicyIsAllowed(&test_policy, MYRIOTA_POWER_COST_MEDIUM));
+}
+
+static void test_scale(void **state) {
+  (void)state;
+  MYRIOTA_PowerPolicyUpdate(&test_policy, 3600, false);
+  assert_int_equal(MYRIOTA_PowerPolicyIntervalScale(&test_policy, 900), 900);
+  assert_int_equal(MYRIOTA_PowerPolicyBudgetScale(&test_policy, 3), 3);
+
+  MYRIOTA_PowerPolicyUpdate(&test_policy, 3300, false);
+  assert_int_equal(MYRIOTA_PowerPolicyIntervalScale(&test_policy, 900), 1800);
+  assert_int_equal(MYRIOTA_PowerPolicyBudgetScale(&test_policy, 3), 1);
+
+  MYRIOTA_PowerPolicyUpdate(&test_policy, 3100, false);
+  assert_int_equal(MYRIOTA_PowerPolicyIntervalScale(&test_policy, 900), 3600);
+  assert_int_equal(MYRIOTA_PowerPolicyIntervalScale(&test_policy, UINT32_MAX), UINT32_MAX);
+  assert_int_equal(MYRIOTA_PowerPolicyBudgetScale(&test_policy, 3), 1);
+  assert_int_equal(MYRIOTA_PowerPolicyBudgetScale(&test_policy, 0), 0);
+}
+
+int main(void) {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test_setup(test_levels, setup),
+    cmocka_unit_test_setup(test_hysteresis, setup),
+    cmocka_unit_test_setup(test_external_power, setup),
+    cmocka_unit_test_setup(test_allowed, setup),
+    cmocka_unit_test_setup(test_scale, setup),
+  };
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
+#endif
@@ -0,0 +1,153 @@
+/// \file pulse_profile.h Myriota Pulse Profile
+// Copyright (c) 2024, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MYRIOTA_PULSE_PROFILE_H
+#define MYRIOTA_PULSE_PROFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/** \defgroup PulseProfile Pulse Profile Library
+ * @brief Aggregation of pulse counts into a compact daily profile
+ * \{
+ */
+
+/** The number of slots (i.e. hours) in a daily profile. */
+#define MYRIOTA_PULSE_PROFILE_SLOTS 24
+/** The duration of each slot in seconds. */
+#define MYRIOTA_PULSE_PROFILE_SLOT_SECS 3600
+/** The number of bins in the rate histogram. */
+#define MYRIOTA_PULSE_PROFILE_HISTOGRAM_BINS 8
+/** The size of an encoded frame in bytes. */
+#define MYRIOTA_PULSE_PROFILE_FRAME_SIZE 20
+
+/** The first byte of an encoded summary frame. */
+#define MYRIOTA_PULSE_PROFILE_SUMMARY_FRAME_TYPE 0x07
+/** The first byte of an encoded slot frame. */
+#define MYRIOTA_PULSE_PROFILE_SLOTS_FRAME_TYPE 0x08
+
+/** A daily pulse profile. */
+typedef struct {
+  /** \cond INTERNAL_HIDDEN */
+  time_t start_time;
+  time_t last_time;
+  uint64_t last_count;
+  uint32_t total;
+  uint32_t min_rate;
+  uint32_t max_rate;
+  uint16_t samples;
+  uint16_t histogram[MYRIOTA_PULSE_PROFILE_HISTOGRAM_BINS];
+  uint32_t slots[MYRIOTA_PULSE_PROFILE_SLOTS];
+  /** \endcond */
+} MYRIOTA_PulseProfile;
+
+/**
+ * Starts a new profile.
+ *
+ * \param[out] profile The profile to start.
+ * \param[in] count The current value of the pulse counter.
+ * \param[in] now The current time in seconds.
+ */
+void MYRIOTA_PulseProfileStart(MYRIOTA_PulseProfile *const profile, const uint64_t count,
+  const time_t now);
+
+/**
+ * Adds a sample of the pulse counter to the profile.
+ *
+ * The pulses counted since the previous sample are added to the slot the
+ * sample falls in, and the rate over the sample (in pulses per hour) updates
+ * the minimum rate, maximum rate and rate histogram.
+ *
+ * \note Samples should be taken at least once per slot.
+ *
+ * \param[in,out] profile The profile to add the sample to.
+ * \param[in] count The current value of the pulse counter.
+ * \param[in] now The current time in seconds.
+ */
+void MYRIOTA_PulseProfileSample(MYRIOTA_PulseProfile *const profile, const uint64_t count,
+  const time_t now);
+
+/**
+ * Checks whether the profile covers a whole day.
+ *
+ * \param[in] profile The profile to check.
+ * \param[in] now The current time in seconds.
+ * \return true if the profile is complete and should be sent.
+ */
+bool MYRIOTA_PulseProfileIsComplete(const MYRIOTA_PulseProfile *const profile, const time_t now);
+
+/**
+ * Encodes the summary frame of a profile.
+ *
+ * | Byte  | Description                                                  |
+ * | ----- | ------------------------------------------------------------ |
+ * | 0     | MYRIOTA_PULSE_PROFILE_SUMMARY_FRAME_TYPE                     |
+ * | 1     | Sequence number                                              |
+ * | 2-5   | Start time (u32)                                             |
+ * | 6-9   | Total pulses (u32)                                           |
+ * | 10-12 | Minimum rate in pulses per hour (u24)                        |
+ * | 13-15 | Maximum rate in pulses per hour (u24)                        |
+ * | 16-19 | Rate histogram, 8 x 4 bit fractions (in 15ths) of samples    |
+ *
+ * Multi-byte fields are little endian. Histogram bin 0 (the low nibble of byte
+ * 16) holds samples with no pulses, and bin n > 0 holds samples with a rate in
+ * [8^(n - 1), 8^n) pulses per hour, where bin 7 is unbounded.
+ *
+ * \param[in] profile The profile to encode.
+ * \param[in] sequence The sequence number shared with the slot frame.
+ * \param[out] frame The buffer to encode to.
+ */
+void MYRIOTA_PulseProfileSummaryEncode(const MYRIOTA_PulseProfile *const profile,
+  const uint8_t sequence, uint8_t frame[MYRIOTA_PULSE_PROFILE_FRAME_SIZE]);
+
+/**
+ * Encodes the per slot pulse counts of a profile.
+ *
+ * | Byte | Description                                                   |
+ * | ---- | ------------------------------------------------------------- |
+ * | 0    | MYRIOTA_PULSE_PROFILE_SLOTS_FRAME_TYPE                        |
+ * | 1    | Sequence number (high nibble) and shift (low nibble)          |
+ * | 2-19 | 24 x 6 bit zigzag encoded deltas, least significant bit first |
+ *
+ * Each delta is the difference between a slot and the previous slot scaled
+ * down by 2^shift, where the first slot is relative to the mean slot count
+ * (the total from the summary frame divided by 24). The shift is the smallest
+ * that fits all of the deltas, and deltas are computed against the decoded
+ * value of the previous slot so that rounding errors don't accumulate.
+ *
+ * \param[in] profile The profile to encode.
+ * \param[in] sequence The sequence number shared with the summary frame.
+ * \param[out] frame The buffer to encode to.
+ */
+void MYRIOTA_PulseProfileSlotsEncode(const MYRIOTA_PulseProfile *const profile,
+  const uint8_t sequence, uint8_t frame[MYRIOTA_PULSE_PROFILE_FRAME_SIZE]);
+
+/**
+ * Decodes the per slot pulse counts encoded by MYRIOTA_PulseProfileSlotsEncode.
+ *
+ * \param[in] frame The slot frame to decode.
+ * \param[in] total The total pulses from the matching summary frame.
+ * \param[out] slots The decoded pulse count of each slot.
+ * \return 0 on success else < 0 if the frame isn't a slot frame.
+ */
+int MYRIOTA_PulseProfileSlotsDecode(const uint8_t frame[MYRIOTA_PULSE_PROFILE_FRAME_SIZE],
+  const uint32_t total, uint32_t slots[MYRIOTA_PULSE_PROFILE_SLOTS]);
+
+/**
+ * \}
+ */
+
+#endif /* MYRIOTA_PULSE_PROFILE_H */
@@ -0,0 +1,340 @@
+// Copyright (c) 2024, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "myriota/pulse_profile.h"
+#include <string.h>
+
+#define PULSE_PROFILE_SECS_PER_HOUR 3600
+#define PULSE_PROFILE_U24_MAX 0xFFFFFF
+#define PULSE_PROFILE_DELTA_BITS 6
+#define PULSE_PROFILE_DELTA_MIN (-(1 << (PULSE_PROFILE_DELTA_BITS - 1)))
+#define PULSE_PROFILE_DELTA_MAX ((1 << (PULSE_PROFILE_DELTA_BITS - 1)) - 1)
+#define PULSE_PROFILE_SHIFT_MAX 15
+#define PULSE_PROFILE_HISTOGRAM_SCALE 15
+
+static inline void pack_u24(uint8_t *const buffer, const uint32_t value) {
+  buffer[0] = value & 0xFF;
+  buffer[1] = (value >> 8) & 0xFF;
+  buffer[2] = (value >> 16) & 0xFF;
+}
+
+static inline void pack_u32(uint8_t *const buffer, const uint32_t value) {
+  pack_u24(buffer, value);
+  buffer[3] = value >> 24;
+}
+
+static inline uint32_t saturate_u24(const uint32_t value) {
+  return value > PULSE_PROFILE_U24_MAX ? PULSE_PROFILE_U24_MAX : value;
+}
+
+// Bin 0 holds a rate of zero, and bin n holds rates in [8^(n - 1), 8^n).
+static uint8_t histogram_bin(const uint32_t rate) {
+  uint8_t bin = 0;
+  for (uint32_t bound = 1; bin < MYRIOTA_PULSE_PROFILE_HISTOGRAM_BINS - 1 && rate >= bound;
+       bound *= 8) {
+    ++bin;
+  }
+  return bin;
+}
+
+static inline uint8_t zigzag_encode(const int32_t value) {
+  return (uint8_t)(((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+}
+
+static inline int32_t zigzag_decode(const uint8_t value) {
+  return (int32_t)(value >> 1) ^ -(int32_t)(value & 0x1);
+}
+
+// Divides by 2^shift, rounding to the nearest integer (halves away from zero).
+static inline int64_t scale_down(const int64_t value, const uint8_t shift) {
+  const int64_t half = shift > 0 ? (int64_t)1 << (shift - 1) : 0;
+  return value >= 0 ? (value + half) >> shift : -((-value + half) >> shift);
+}
+
+// Computes the quantized delta of each slot against the decoded value of the
+// previous slot, returning false if a delta doesn't fit at the given shift.
+static bool quantize_slots(const MYRIOTA_PulseProfile *const profile, const uint8_t shift,
+  int8_t deltas[MYRIOTA_PULSE_PROFILE_SLOTS]) {
+  bool fits = true;
+  int64_t previous = profile->total / MYRIOTA_PULSE_PROFILE_SLOTS;
+  for (size_t i = 0; i < MYRIOTA_PULSE_PROFILE_SLOTS; ++i) {
+    int64_t delta = scale_down((int64_t)profile->slots[i] - previous, shift);
+    if (delta < PULSE_PROFILE_DELTA_MIN || delta > PULSE_PROFILE_DELTA_MAX) {
+      fits = false;
+      delta = delta < PULSE_PROFILE_DELTA_MIN ? PULSE_PROFILE_DELTA_MIN : PULSE_PROFILE_DELTA_MAX;
+    }
+    deltas[i] = delta;
+    previous += delta * ((int64_t)1 << shift);
+  }
+  return fits;
+}
+
+void MYRIOTA_PulseProfileStart(MYRIOTA_PulseProfile *const profile, const uint64_t count,
+  const time_t now) {
+  memset(profile, 0, sizeof(*profile));
+  profile->start_time = now;
+  profile->last_time = now;
+  profile->last_count = count;
+  profile->min_rate = UINT32_MAX;
+}
+
+void MYRIOTA_PulseProfileSample(MYRIOTA_PulseProfile *const profile, const uint64_t count,
+  const time_t now) {
+  if (now <= profile->last_time) {
+    return;
+  }
+
+  // The counter only goes backwards if it has been reset, in which case every
+  // pulse counted since was counted after the previous sample.
+  const uint64_t delta = count >= profile->last_count ? count - profile->last_count : count;
+  const uint64_t elapsed = now - profile->last_time;
+  profile->last_count = count;
+  profile->last_time = now;
+
+  const uint64_t slot = (now - profile->start_time - 1) / MYRIOTA_PULSE_PROFILE_SLOT_SECS;
+  const size_t index = slot < MYRIOTA_PULSE_PROFILE_SLOTS ? slot : MYRIOTA_PULSE_PROFILE_SLOTS - 1;
+  const uint64_t slot_total = profile->slots[index] + delta;
+  profile->slots[index] = slot_total > UINT32_MAX ? UINT32_MAX : slot_total;
+  const uint64_t total = profile->total + delta;
+  profile->total = total > UINT32_MAX ? UINT32_MAX : total;
+
+  const uint64_t rate64 = (delta * PULSE_PROFILE_SECS_PER_HOUR + elapsed / 2) / elapsed;
+  const uint32_t rate = rate64 > UINT32_MAX ? UINT32_MAX : rate64;
+  profile->min_rate = rate < profile->min_rate ? rate : profile->min_rate;
+  profile->max_rate = rate > profile->max_rate ? rate : profile->max_rate;
+  ++profile->histogram[histogram_bin(rate)];
+  ++profile->samples;
+}
+
+bool MYRIOTA_PulseProfileIsComplete(const MYRIOTA_PulseProfile *const profile, const time_t now) {
+  return now - profile->start_time >=
+         (time_t)MYRIOTA_PULSE_PROFILE_SLOTS * MYRIOTA_PULSE_PROFILE_SLOT_SECS;
+}
+
+void MYRIOTA_PulseProfileSummaryEncode(const MYRIOTA_PulseProfile *const profile,
+  const uint8_t sequence, uint8_t frame[MYRIOTA_PULSE_PROFILE_FRAME_SIZE]) {
+  memset(frame, 0, MYRIOTA_PULSE_PROFILE_FRAME_SIZE);
+  frame[0] = MYRIOTA_PULSE_PROFILE_SUMMARY_FRAME_TYPE;
+  frame[1] = sequence;
+  pack_u32(&frame[2], (uint32_t)profile->start_time);
+  pack_u32(&frame[6], profile->total);
+  pack_u24(&frame[10], profile->samples > 0 ? saturate_u24(profile->min_rate) : 0);
+  pack_u24(&frame[13], saturate_u24(profile->max_rate));
+
+  for (size_t i = 0; i < MYRIOTA_PULSE_PROFILE_HISTOGRAM_BINS && profile->samples > 0; ++i) {
+    const uint8_t fraction =
+      (profile->histogram[i] * PULSE_PROFILE_HISTOGRAM_SCALE + profile->samples / 2) /
+      profile->samples;
+    frame[16 + i / 2] |= fraction << (4 * (i % 2));
+  }
+}
+
+void MYRIOTA_PulseProfileSlotsEncode(const MYRIOTA_PulseProfile *const profile,
+  const uint8_t sequence, uint8_t frame[MYRIOTA_PULSE_PROFILE_FRAME_SIZE]) {
+  int8_t deltas[MYRIOTA_PULSE_PROFILE_SLOTS] = {0};
+  uint8_t shift = 0;
+  while (!quantize_slots(profile, shift, deltas) && shift < PULSE_PROFILE_SHIFT_MAX) {
+    ++shift;
+  }
+
+  memset(frame, 0, MYRIOTA_PULSE_PROFILE_FRAME_SIZE);
+  frame[0] = MYRIOTA_PULSE_PROFILE_SLOTS_FRAME_TYPE;
+  frame[1] = (sequence << 4) | shift;
+  for (size_t i = 0; i < MYRIOTA_PULSE_PROFILE_SLOTS; ++i) {
+    const uint8_t value = zigzag_encode(deltas[i]);
+    for (size_t bit = 0; bit < PULSE_PROFILE_DELTA_BITS; ++bit) {
+      const size_t offset = i * PULSE_PROFILE_DELTA_BITS + bit;
+      frame[2 + offset / 8] |= ((value >> bit) & 0x1) << (offset % 8);
+    }
+  }
+}
+
+int MYRIOTA_PulseProfileSlotsDecode(const uint8_t frame[MYRIOTA_PULSE_PROFILE_FRAME_SIZE],
+  const uint32_t total, uint32_t slots[MYRIOTA_PULSE_PROFILE_SLOTS]) {
+  if (frame[0] != MYRIOTA_PULSE_PROFILE_SLOTS_FRAME_TYPE) {
+    return -1;
+  }
+
+  const uint8_t shift = frame[1] & 0x0F;
+  int64_t previous = total / MYRIOTA_PULSE_PROFILE_SLOTS;
+  for (size_t i = 0; i < MYRIOTA_PULSE_PROFILE_SLOTS; ++i) {
+    uint8_t value = 0;
+    for (size_t bit = 0; bit < PULSE_PROFILE_DELTA_BITS; ++bit) {
+      const size_t offset = i * PULSE_PROFILE_DELTA_BITS + bit;
+      value |= ((frame[2 + offset / 8] >> (offset % 8)) & 0x1) << bit;
+    }
+    previous += zigzag_decode(value) * ((int64_t)1 << shift);
+    slots[i] = previous < 0 ? 0 : previous > UINT32_MAX ? UINT32_MAX : previous;
+  }
+  return 0;
+}
+
+#ifdef MYRIOTA_PULSE_PROFILE_UNIT_TESTS
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+/*
+ * `cmocka.h` must be included after standard the above library headers.
+ * NOTE: This comment has dual purpose:
+ * 1. Document the ordering requirement.
+ * 2. Prevent `clang-format` from reordering the headers.
+ */
+#include <cmocka.h>
+
+#define TEST_START_TIME 1700000000
+#define TEST_SAMPLE_SECS 900
+
+// Samples a profile every 15 minutes for a day, where pulses_per_hour gives
+// the rate in each hour.
+static void sample_day(MYRIOTA_PulseProfile *const profile, uint64_t *const count,
+  const uint32_t pulses_per_hour[MYRIOTA_PULSE_PROFILE_SLOTS]) {
+  time_t now = TEST_START_TIME;
+  MYRIOTA_PulseProfileStart(profile, *count, now);
+  for (size_t hour = 0; hour < MYRIOTA_PULSE_PROFILE_SLOTS; ++hour) {
+    for (size_t i = 0; i < PULSE_PROFILE_SECS_PER_HOUR / TEST_SAMPLE_SECS; ++i) {
+      now += TEST_SAMPLE_SECS;
+      *count += pulses_per_hour[hour] / 4;
+      assert_false(MYRIOTA_PulseProfileIsComplete(profile, now - 1));
+      MYRIOTA_PulseProfileSample(profile, *count, now);
+    }
+  }
+  assert_true(MYRIOTA_PulseProfileIsComplete(profile, now));
+}
+
+static uint32_t unpack_u32(const uint8_t *const buffer) {
+  return buffer[0] | buffer[1] << 8 | buffer[2] << 16 | (uint32_t)buffer[3] << 24;
+}
+
+static uint32_t unpack_u24(const uint8_t *const buffer) {
+  return buffer[0] | buffer[1] << 8 | buffer[2] << 16;
+}
+
+static void test_summary(void **state) {
+  (void)state;
+  uint32_t rates[MYRIOTA_PULSE_PROFILE_SLOTS] = {0};
+  for (size_t hour = 6; hour < 18; ++hour) {
+    rates[hour] = 400;
+  }
+  rates[12] = 40000;
+
+  MYRIOTA_PulseProfile profile;
+  uint64_t count = 123456789;
+  sample_day(&profile, &count, rates);
+
+  uint8_t frame[MYRIOTA_PULSE_PROFILE_FRAME_SIZE];
+  MYRIOTA_PulseProfileSummaryEncode(&profile, 42, frame);
+  assert_int_equal(frame[0], MYRIOTA_PULSE_PROFILE_SUMMARY_FRAME_TYPE);
+  assert_int_equal(frame[1], 42);
+  assert_int_equal(unpack_u32(&frame[2]), TEST_START_TIME);
+  assert_int_equal(unpack_u32(&frame[6]), 11 * 400 + 40000);
+  assert_int_equal(unpack_u24(&frame[10]), 0);
+  assert_int_equal(unpack_u24(&frame[13]), 40000);
+
+  // 48 samples with no pulses, 44 at 400/h (bin 3) and 4 at 40000/h (bin 6).
+  assert_int_equal(frame[16] & 0x0F, 8);
+  assert_int_equal(frame[17] >> 4, 7);
+  assert_int_equal(frame[19] & 0x0F, 1);
+  assert_int_equal(frame[18], 0);
+}
+
+static void test_slots_round_trip(void **state) {
+  (void)state;
+  // A smooth daily profile fits without any loss.
+  uint32_t rates[MYRIOTA_PULSE_PROFILE_SLOTS] = {0};
+  for (size_t hour = 0; hour < MYRIOTA_PULSE_PROFILE_SLOTS; ++hour) {
+    rates[hour] = 400 + 40 * (hour < 12 ? hour : 24 - hour);
+  }
+
+  MYRIOTA_PulseProfile profile;
+  uint64_t count = 0;
+  sample_day(&profile, &count, rates);
+
+  uint8_t frame[MYRIOTA_PULSE_PROFILE_FRAME_SIZE];
+  MYRIOTA_PulseProfileSlotsEncode(&profile, 0x13, frame);
+  assert_int_equal(frame[0], MYRIOTA_PULSE_PROFILE_SLOTS_FRAME_TYPE);
+  assert_int_equal(frame[1] >> 4, 0x3);
+
+  uint32_t slots[MYRIOTA_PULSE_PROFILE_SLOTS] = {0};
+  assert_int_equal(MYRIOTA_PulseProfileSlotsDecode(frame, profile.total, slots), 0);
+  for (size_t hour = 0; hour < MYRIOTA_PULSE_PROFILE_SLOTS; ++hour) {
+    const uint32_t error = (uint32_t)1 << (frame[1] & 0x0F);
+    assert_in_range(slots[hour], rates[hour] - error / 2, rates[hour] + error / 2);
+  }
+}
+
+static void test_slots_bounded_error(void **state) {
+  (void)state;
+  // Large steps need a larger shift, but the error in each slot stays within
+  // half a quantization step.
+  uint32_t rates[MYRIOTA_PULSE_PROFILE_SLOTS] = {0};
+  for (size_t hour = 0; hour < MYRIOTA_PULSE_PROFILE_SLOTS; ++hour) {
+    rates[hour] = (hour % 3 == 0) ? 1000000 : 4 * hour;
+  }
+
+  MYRIOTA_PulseProfile profile;
+  uint64_t count = 0;
+  sample_day(&profile, &count, rates);
+
+  uint8_t frame[MYRIOTA_PULSE_PROFILE_FRAME_SIZE];
+  MYRIOTA_PulseProfileSlotsEncode(&profile, 0, frame);
+  const uint8_t shift = frame[1] & 0x0F;
+  assert_in_range(shift, 1, 15);
+
+  uint32_t slots[MYRIOTA_PULSE_PROFILE_SLOTS] = {0};
+  assert_int_equal(MYRIOTA_PulseProfileSlotsDecode(frame, profile.total, slots), 0);
+  for (size_t hour = 0; hour < MYRIOTA_PULSE_PROFILE_SLOTS; ++hour) {
+    const uint32_t half_step = (uint32_t)1 << (shift - 1);
+    const uint32_t low = rates[hour] > half_step ? rates[hour] - half_step : 0;
+    assert_in_range(slots[hour], low, rates[hour] + half_step);
+  }
+}
+
+static void test_counter_reset(void **state) {
+  (void)state;
+  MYRIOTA_PulseProfile profile;
+  MYRIOTA_PulseProfileStart(&profile, 1000, TEST_START_TIME);
+  MYRIOTA_PulseProfileSample(&profile, 1100, TEST_START_TIME + 1800);
+  MYRIOTA_PulseProfileSample(&profile, 50, TEST_START_TIME + 3600);
+  // Samples that don't move time forward are ignored.
+  MYRIOTA_PulseProfileSample(&profile, 60, TEST_START_TIME + 3600);
+  assert_int_equal(profile.total, 150);
+  assert_int_equal(profile.slots[0], 150);
+  assert_int_equal(profile.samples, 2);
+}
+
+static void test_histogram_bins(void **state) {
+  (void)state;
+  assert_int_equal(histogram_bin(0), 0);
+  assert_int_equal(histogram_bin(1), 1);
+  assert_int_equal(histogram_bin(7), 1);
+  assert_int_equal(histogram_bin(8), 2);
+  assert_int_equal(histogram_bin(63), 2);
+  assert_int_equal(histogram_bin(64), 3);
+  assert_int_equal(histogram_bin(262143), 6);
+  assert_int_equal(histogram_bin(262144), 7);
+  assert_int_equal(histogram_bin(UINT32_MAX), 7);
+}
+
+int main(void) {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_summary),
+    cmocka_unit_test(test_slots_round_trip),
+    cmocka_unit_test(test_slots_bounded_error),
+    cmocka_unit_test(test_counter_reset),
+    cmocka_unit_test(test_histogram_bins),
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
+#endif
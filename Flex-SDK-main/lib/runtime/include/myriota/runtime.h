@@ -0,0 +1,167 @@
+/// \file runtime.h Myriota Cooperative Runtime
+// Copyright (c) 2024, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef MYRIOTA_RUNTIME_H
+#define MYRIOTA_RUNTIME_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/** \defgroup Runtime Cooperative Runtime Library
+ * @brief Multiple tasks and shared sensor power dispatched from a single job
+ * \{
+ */
+
+/** The time returned by a task which shouldn't run again until rescheduled. */
+#define MYRIOTA_RUNTIME_NEVER ((time_t)-1)
+/** The delay before retrying tasks whose power rail failed to turn on. */
+#define MYRIOTA_RUNTIME_RAIL_RETRY_SECS 60
+
+/** Runtime errors. */
+typedef enum {
+  RUNTIME_SUCCESS = 0,
+  RUNTIME_ERROR_INVALID_TASK,
+} MYRIOTA_RuntimeErrors;
+
+/** The power rail a task needs, e.g. to power an external sensor. */
+typedef enum {
+  MYRIOTA_RUNTIME_RAIL_NONE,  ///< The task doesn't need a power rail.
+  MYRIOTA_RUNTIME_RAIL_5V,    ///< The task needs 5V, e.g. FLEX_POWER_OUT_5V.
+  MYRIOTA_RUNTIME_RAIL_12V,   ///< The task needs 12V, e.g. FLEX_POWER_OUT_12V.
+  MYRIOTA_RUNTIME_RAIL_24V,   ///< The task needs 24V, e.g. FLEX_POWER_OUT_24V.
+  MYRIOTA_RUNTIME_RAIL_COUNT,
+} MYRIOTA_RuntimeRail;
+
+/**
+ * A task function, which works like a FLEX_ScheduledJob.
+ *
+ * \param[in] ctx The context the task was added with.
+ * \param[in] now The time of the wakeup the task is run in.
+ * \return The time the task should next run, or MYRIOTA_RUNTIME_NEVER.
+ */
+typedef time_t (*MYRIOTA_RuntimeTaskFn)(void *const ctx, const time_t now);
+
+/** A task record, which is owned by the application and must outlive the runtime. */
+typedef struct MYRIOTA_RuntimeTask {
+  /** \cond INTERNAL_HIDDEN */
+  MYRIOTA_RuntimeTaskFn run;
+  void *ctx;
+  time_t deadline;
+  MYRIOTA_RuntimeRail rail;
+  bool is_scheduled;
+  bool is_due;
+  struct MYRIOTA_RuntimeTask *next;
+  /** \endcond */
+} MYRIOTA_RuntimeTask;
+
+/** Application hooks controlling the power rails. */
+typedef struct {
+  /** User defined data context passed to the hooks. */
+  void *ctx;
+  /**
+   * Turns a rail on and waits for it to settle, e.g. with FLEX_PowerOutInit
+   * and FLEX_DelayMs. Returns < 0 on error.
+   */
+  int (*rail_on)(void *const ctx, const MYRIOTA_RuntimeRail rail);
+  /** Turns the rail off, e.g. with FLEX_PowerOutDeinit. */
+  void (*rail_off)(void *const ctx);
+} MYRIOTA_RuntimeInterface;
+
+/** A runtime instance. */
+typedef struct {
+  /** \cond INTERNAL_HIDDEN */
+  MYRIOTA_RuntimeInterface interface;
+  uint32_t coalesce_secs;
+  MYRIOTA_RuntimeTask *tasks;
+  /** \endcond */
+} MYRIOTA_Runtime;
+
+/**
+ * Initialises a runtime with no tasks.
+ *
+ * \param[out] runtime The runtime to initialise.
+ * \param[in] interface The application hooks.
+ * \param[in] coalesce_secs Tasks due within this many seconds of a wakeup are
+ * run early in that wakeup rather than waking the device again.
+ */
+void MYRIOTA_RuntimeInit(MYRIOTA_Runtime *const runtime,
+  const MYRIOTA_RuntimeInterface interface, const uint32_t coalesce_secs);
+
+/**
+ * Adds a task to the runtime.
+ *
+ * \param[in,out] runtime The runtime.
+ * \param[out] task The task record to add, which must not already be added.
+ * \param[in] run The task function.
+ * \param[in] ctx User defined data context passed to the task function.
+ * \param[in] rail The power rail the task needs.
+ * \param[in] when The time to first run the task, e.g. FLEX_ASAP().
+ * \return 0 on success else < 0 on error.
+ */
+int MYRIOTA_RuntimeTaskAdd(MYRIOTA_Runtime *const runtime, MYRIOTA_RuntimeTask *const task,
+  const MYRIOTA_RuntimeTaskFn run, void *const ctx, const MYRIOTA_RuntimeRail rail,
+  const time_t when);
+
+/**
+ * Reschedules a task, e.g. from an event handler.
+ *
+ * \note The job dispatching the runtime must be rescheduled afterwards, see
+ * MYRIOTA_RuntimeNextGet.
+ *
+ * \param[in,out] runtime The runtime.
+ * \param[in,out] task The task to reschedule.
+ * \param[in] when The time to run the task, or MYRIOTA_RUNTIME_NEVER.
+ */
+void MYRIOTA_RuntimeTaskSchedule(MYRIOTA_Runtime *const runtime, MYRIOTA_RuntimeTask *const task,
+  const time_t when);
+
+/**
+ * Runs the tasks which are due, and those due within the coalescing window.
+ *
+ * Tasks needing no power rail run first. Then, for each rail needed, the rail
+ * is turned on once, all of the tasks needing it run, and it is turned off, so
+ * sensors on the same rail share a single power on and settling time. If a
+ * rail fails to turn on its tasks are retried after
+ * MYRIOTA_RUNTIME_RAIL_RETRY_SECS. Tasks run in deadline order within each
+ * group.
+ *
+ * \note The order is by group first, so a task needing no rail runs before a
+ * task needing a rail in the same wakeup even if its deadline is later. A task
+ * which uses the results of tasks on a rail should be scheduled more than the
+ * coalescing window after them. A task rescheduled while the tasks run, e.g.
+ * by an earlier task, only runs in this wakeup if its new time is due.
+ *
+ * \param[in,out] runtime The runtime.
+ * \param[in] now The current time in seconds.
+ * \return The time of the next task, or MYRIOTA_RUNTIME_NEVER if there are no
+ * scheduled tasks.
+ */
+time_t MYRIOTA_RuntimeDispatch(MYRIOTA_Runtime *const runtime, const time_t now);
+
+/**
+ * Gets the time of the next task.
+ *
+ * \param[in] runtime The runtime.
+ * \return The time of the next task, or MYRIOTA_RUNTIME_NEVER if there are no
+ * scheduled tasks.
+ */
+time_t MYRIOTA_RuntimeNextGet(const MYRIOTA_Runtime *const runtime);
+
+/**
+ * \}
+ */
+
+#endif /* MYRIOTA_RUNTIME_H */
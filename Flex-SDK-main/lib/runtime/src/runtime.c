@@ -0,0 +1,319 @@
+// Copyright (c) 2024, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "myriota/runtime.h"
+#include <stddef.h>
+
+// Scheduled tasks are kept in a list sorted by deadline, and tasks which will
+// never run are left out of the list.
+static void task_remove(MYRIOTA_Runtime *const runtime, MYRIOTA_RuntimeTask *const task) {
+  for (MYRIOTA_RuntimeTask **link = &runtime->tasks; *link != NULL; link = &(*link)->next) {
+    if (*link == task) {
+      *link = task->next;
+      break;
+    }
+  }
+  task->next = NULL;
+  task->is_scheduled = false;
+}
+
+// Tasks with the same deadline keep the order they were scheduled in.
+static void task_insert(MYRIOTA_Runtime *const runtime, MYRIOTA_RuntimeTask *const task,
+  const time_t when) {
+  task->deadline = when;
+  if (when == MYRIOTA_RUNTIME_NEVER) {
+    return;
+  }
+  MYRIOTA_RuntimeTask **link = &runtime->tasks;
+  while (*link != NULL && (*link)->deadline <= when) {
+    link = &(*link)->next;
+  }
+  task->next = *link;
+  *link = task;
+  task->is_scheduled = true;
+}
+
+// Returns the first due task needing a rail, in deadline order.
+static MYRIOTA_RuntimeTask *task_due_find(const MYRIOTA_Runtime *const runtime,
+  const MYRIOTA_RuntimeRail rail) {
+  for (MYRIOTA_RuntimeTask *task = runtime->tasks; task != NULL; task = task->next) {
+    if (task->is_due && task->rail == rail) {
+      return task;
+    }
+  }
+  return NULL;
+}
+
+void MYRIOTA_RuntimeInit(MYRIOTA_Runtime *const runtime,
+  const MYRIOTA_RuntimeInterface interface, const uint32_t coalesce_secs) {
+  runtime->interface = interface;
+  runtime->coalesce_secs = coalesce_secs;
+  runtime->tasks = NULL;
+}
+
+int MYRIOTA_RuntimeTaskAdd(MYRIOTA_Runtime *const runtime, MYRIOTA_RuntimeTask *const task,
+  const MYRIOTA_RuntimeTaskFn run, void *const ctx, const MYRIOTA_RuntimeRail rail,
+  const time_t when) {
+  if (run == NULL || rail >= MYRIOTA_RUNTIME_RAIL_COUNT) {
+    return -RUNTIME_ERROR_INVALID_TASK;
+  }
+  task->run = run;
+  task->ctx = ctx;
+  task->rail = rail;
+  task->is_due = false;
+  task->is_scheduled = false;
+  task->next = NULL;
+  task_insert(runtime, task, when);
+  return RUNTIME_SUCCESS;
+}
+
+void MYRIOTA_RuntimeTaskSchedule(MYRIOTA_Runtime *const runtime, MYRIOTA_RuntimeTask *const task,
+  const time_t when) {
+  if (task->is_scheduled) {
+    task_remove(runtime, task);
+  }
+  // A task due in the running dispatch is only run there if its new time is.
+  task->is_due = false;
+  task_insert(runtime, task, when);
+}
+
+time_t MYRIOTA_RuntimeDispatch(MYRIOTA_Runtime *const runtime, const time_t now) {
+  const time_t window = now + runtime->coalesce_secs;
+  for (MYRIOTA_RuntimeTask *task = runtime->tasks; task != NULL && task->deadline <= window;
+       task = task->next) {
+    task->is_due = true;
+  }
+
+  for (MYRIOTA_RuntimeRail rail = MYRIOTA_RUNTIME_RAIL_NONE; rail < MYRIOTA_RUNTIME_RAIL_COUNT;
+       ++rail) {
+    bool is_on = false;
+    bool is_failed = false;
+    MYRIOTA_RuntimeTask *task;
+    while ((task = task_due_find(runtime, rail)) != NULL) {
+      task->is_due = false;
+      task_remove(runtime, task);
+
+      if (rail != MYRIOTA_RUNTIME_RAIL_NONE && !is_on && !is_failed) {
+        is_on = runtime->interface.rail_on == NULL ||
+                runtime->interface.rail_on(runtime->interface.ctx, rail) >= 0;
+        is_failed = !is_on;
+      }
+      if (is_failed) {
+        task_insert(runtime, task, now + MYRIOTA_RUNTIME_RAIL_RETRY_SECS);
+        continue;
+      }
+      // The task may have rescheduled itself, but the time it returns wins.
+      MYRIOTA_RuntimeTaskSchedule(runtime, task, task->run(task->ctx, now));
+    }
+    if (is_on && runtime->interface.rail_off != NULL) {
+      runtime->interface.rail_off(runtime->interface.ctx);
+    }
+  }
+
+  return MYRIOTA_RuntimeNextGet(runtime);
+}
+
+time_t MYRIOTA_RuntimeNextGet(const MYRIOTA_Runtime *const runtime) {
+  return runtime->tasks != NULL ? runtime->tasks->deadline : MYRIOTA_RUNTIME_NEVER;
+}
+
+#ifdef MYRIOTA_RUNTIME_UNIT_TESTS
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+/*
+ * `cmocka.h` must be included after standard the above library headers.
+ * NOTE: This comment has dual purpose:
+ * 1. Document the ordering requirement.
+ * 2. Prevent `clang-format` from reordering the headers.
+ */
+#include <cmocka.h>
+
+#define TEST_START_TIME 1700000000
+#define TEST_COALESCE_SECS 30
+#define TEST_EVENTS_MAX 16
+
+// A task which records when it ran and runs again after its period.
+struct test_task {
+  MYRIOTA_RuntimeTask task;
+  char name;
+  time_t period;
+};
+
+static MYRIOTA_Runtime test_runtime;
+// Task names, and rails turned on ('5', '1' for 12V, '2' for 24V) or off ('-').
+static char test_events[TEST_EVENTS_MAX + 1];
+static size_t test_event_count;
+static int test_rail_result;
+
+static void test_event(const char event) {
+  assert_true(test_event_count < TEST_EVENTS_MAX);
+  test_events[test_event_count++] = event;
+  test_events[test_event_count] = '\0';
+}
+
+static time_t test_run(void *const ctx, const time_t now) {
+  struct test_task *const task = ctx;
+  test_event(task->name);
+  return task->period > 0 ? now + task->period : MYRIOTA_RUNTIME_NEVER;
+}
+
+static int test_rail_on(void *const ctx, const MYRIOTA_RuntimeRail rail) {
+  (void)ctx;
+  test_event("-512"[rail]);
+  return test_rail_result;
+}
+
+static void test_rail_off(void *const ctx) {
+  (void)ctx;
+  test_event('-');
+}
+
+static void test_add(struct test_task *const task, const char name, const time_t period,
+  const MYRIOTA_RuntimeRail rail, const time_t when) {
+  task->name = name;
+  task->period = period;
+  assert_int_equal(
+    MYRIOTA_RuntimeTaskAdd(&test_runtime, &task->task, test_run, task, rail, when), 0);
+}
+
+static int setup(void **state) {
+  (void)state;
+  const MYRIOTA_RuntimeInterface interface = {
+    .ctx = NULL,
+    .rail_on = test_rail_on,
+    .rail_off = test_rail_off,
+  };
+  MYRIOTA_RuntimeInit(&test_runtime, interface, TEST_COALESCE_SECS);
+  test_event_count = 0;
+  test_events[0] = '\0';
+  test_rail_result = 0;
+  return 0;
+}
+
+static void test_deadlines(void **state) {
+  (void)state;
+  const time_t now = TEST_START_TIME;
+  struct test_task a, b, c;
+  assert_int_equal(MYRIOTA_RuntimeNextGet(&test_runtime), MYRIOTA_RUNTIME_NEVER);
+  test_add(&a, 'a', 600, MYRIOTA_RUNTIME_RAIL_NONE, now + 100);
+  test_add(&b, 'b', 300, MYRIOTA_RUNTIME_RAIL_NONE, now);
+  test_add(&c, 'c', 0, MYRIOTA_RUNTIME_RAIL_NONE, now);
+  assert_int_equal(MYRIOTA_RuntimeTaskAdd(&test_runtime, &a.task, NULL, NULL,
+                     MYRIOTA_RUNTIME_RAIL_NONE, now),
+    -RUNTIME_ERROR_INVALID_TASK);
+  assert_int_equal(MYRIOTA_RuntimeNextGet(&test_runtime), now);
+
+  // Due tasks run in deadline order, and c never runs again.
+  assert_int_equal(MYRIOTA_RuntimeDispatch(&test_runtime, now), now + 100);
+  assert_string_equal(test_events, "bc");
+  assert_int_equal(MYRIOTA_RuntimeDispatch(&test_runtime, now + 100), now + 300);
+  assert_int_equal(MYRIOTA_RuntimeDispatch(&test_runtime, now + 300), now + 600);
+  assert_string_equal(test_events, "bcab");
+
+  // A task can be rescheduled, e.g. from an event handler.
+  MYRIOTA_RuntimeTaskSchedule(&test_runtime, &c.task, now + 400);
+  assert_int_equal(MYRIOTA_RuntimeNextGet(&test_runtime), now + 400);
+  MYRIOTA_RuntimeTaskSchedule(&test_runtime, &c.task, MYRIOTA_RUNTIME_NEVER);
+  MYRIOTA_RuntimeTaskSchedule(&test_runtime, &a.task, MYRIOTA_RUNTIME_NEVER);
+  MYRIOTA_RuntimeTaskSchedule(&test_runtime, &b.task, MYRIOTA_RUNTIME_NEVER);
+  assert_int_equal(MYRIOTA_RuntimeNextGet(&test_runtime), MYRIOTA_RUNTIME_NEVER);
+}
+
+static void test_coalesce(void **state) {
+  (void)state;
+  const time_t now = TEST_START_TIME;
+  struct test_task a, b, c;
+  test_add(&a, 'a', 3600, MYRIOTA_RUNTIME_RAIL_NONE, now);
+  test_add(&b, 'b', 3600, MYRIOTA_RUNTIME_RAIL_NONE, now + TEST_COALESCE_SECS);
+  test_add(&c, 'c', 3600, MYRIOTA_RUNTIME_RAIL_NONE, now + TEST_COALESCE_SECS + 1);
+
+  // b is close enough to run in the same wakeup, but c isn't.
+  assert_int_equal(MYRIOTA_RuntimeDispatch(&test_runtime, now), now + TEST_COALESCE_SECS + 1);
+  assert_string_equal(test_events, "ab");
+}
+
+static void test_rails(void **state) {
+  (void)state;
+  const time_t now = TEST_START_TIME;
+  struct test_task a, b, c, d, e;
+  test_add(&a, 'a', 60, MYRIOTA_RUNTIME_RAIL_12V, now);
+  test_add(&b, 'b', 60, MYRIOTA_RUNTIME_RAIL_24V, now);
+  test_add(&c, 'c', 60, MYRIOTA_RUNTIME_RAIL_NONE, now);
+  test_add(&d, 'd', 60, MYRIOTA_RUNTIME_RAIL_12V, now + 10);
+  test_add(&e, 'e', 60, MYRIOTA_RUNTIME_RAIL_5V, now + 3600);
+
+  // Tasks without a rail run first, then each rail is turned on once for all
+  // of its tasks. The 5V rail isn't needed yet.
+  assert_int_equal(MYRIOTA_RuntimeDispatch(&test_runtime, now), now + 60);
+  assert_string_equal(test_events, "c1ad-2b-");
+}
+
+static void test_rail_failure(void **state) {
+  (void)state;
+  const time_t now = TEST_START_TIME;
+  struct test_task a, b, c;
+  test_add(&a, 'a', 600, MYRIOTA_RUNTIME_RAIL_24V, now);
+  test_add(&b, 'b', 600, MYRIOTA_RUNTIME_RAIL_24V, now);
+  test_add(&c, 'c', 600, MYRIOTA_RUNTIME_RAIL_NONE, now);
+
+  // The rail is only tried once and its tasks are retried later.
+  test_rail_result = -1;
+  assert_int_equal(
+    MYRIOTA_RuntimeDispatch(&test_runtime, now), now + MYRIOTA_RUNTIME_RAIL_RETRY_SECS);
+  assert_string_equal(test_events, "c2");
+
+  test_rail_result = 0;
+  assert_int_equal(MYRIOTA_RuntimeDispatch(&test_runtime, now + MYRIOTA_RUNTIME_RAIL_RETRY_SECS),
+    now + 600);
+  assert_string_equal(test_events, "c22ab-");
+}
+
+static time_t test_postpone(void *const ctx, const time_t now) {
+  struct test_task *const task = ctx;
+  test_event('p');
+  MYRIOTA_RuntimeTaskSchedule(&test_runtime, &task->task, now + 3600);
+  return MYRIOTA_RUNTIME_NEVER;
+}
+
+static void test_reschedule_due(void **state) {
+  (void)state;
+  const time_t now = TEST_START_TIME;
+  struct test_task a, b;
+  test_add(&a, 'a', 60, MYRIOTA_RUNTIME_RAIL_12V, now);
+  b.name = 'b';
+  assert_int_equal(MYRIOTA_RuntimeTaskAdd(&test_runtime, &b.task, test_postpone, &a,
+                     MYRIOTA_RUNTIME_RAIL_NONE, now),
+    0);
+
+  // a was due, but is postponed before its rail group runs.
+  assert_int_equal(MYRIOTA_RuntimeDispatch(&test_runtime, now), now + 3600);
+  assert_string_equal(test_events, "p");
+  assert_int_equal(MYRIOTA_RuntimeDispatch(&test_runtime, now + 3600), now + 3660);
+  assert_string_equal(test_events, "p1a-");
+}
+
+int main(void) {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test_setup(test_deadlines, setup),
+    cmocka_unit_test_setup(test_coalesce, setup),
+    cmocka_unit_test_setup(test_rails, setup),
+    cmocka_unit_test_setup(test_rail_failure, setup),
+    cmocka_unit_test_setup(test_reschedule_due, setup),
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
+#endif
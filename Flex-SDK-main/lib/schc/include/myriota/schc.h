@@ -0,0 +1,110 @@
+/// \file schc.h Myriota SCHC Fragmentation Codec
+// Copyright (c) 2024, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef MYRIOTA_SCHC_H
+#define MYRIOTA_SCHC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** \defgroup SCHC SCHC Fragmentation Codec
+ * @brief RFC 8724 No-ACK fragment encoding, decoding and RCS
+ *
+ * The same source is built into applications and loaded by the server's
+ * Python binding, so both sides share one definition of the fragment layout.
+ * \{
+ */
+
+/** The size of a fragment, the size of a message. */
+#define MYRIOTA_SCHC_MTU 20
+/** The size of the Reassembly Check Sequence carried by the final fragment. */
+#define MYRIOTA_SCHC_RCS_SIZE 4
+/** The FCN of the final fragment (All-1). */
+#define MYRIOTA_SCHC_FCN_ALL1 0x3F
+/** The FCN of the first fragment. Each following fragment has the next lower FCN. */
+#define MYRIOTA_SCHC_FCN_FIRST 62
+/** The largest rule ID, which is 2 bits. */
+#define MYRIOTA_SCHC_RULE_ID_MAX 3
+/** The payload size of a fragment other than the final. */
+#define MYRIOTA_SCHC_FRAGMENT_PAYLOAD_SIZE (MYRIOTA_SCHC_MTU - 1)
+/** The payload size of the final fragment. */
+#define MYRIOTA_SCHC_FINAL_PAYLOAD_SIZE (MYRIOTA_SCHC_MTU - 1 - MYRIOTA_SCHC_RCS_SIZE)
+/** The maximum number of fragments of a datagram, FCN 62 to 0 and the final. */
+#define MYRIOTA_SCHC_FRAGMENTS_MAX (MYRIOTA_SCHC_FCN_FIRST + 2)
+/** The maximum size of a datagram. */
+#define MYRIOTA_SCHC_DATAGRAM_MAX                                                  \
+  ((MYRIOTA_SCHC_FRAGMENTS_MAX - 1) * MYRIOTA_SCHC_FRAGMENT_PAYLOAD_SIZE +         \
+   MYRIOTA_SCHC_FINAL_PAYLOAD_SIZE)
+
+/** A decoded fragment. */
+typedef struct {
+  uint8_t rule_id;
+  /** The FCN, #MYRIOTA_SCHC_FCN_ALL1 for the final fragment. */
+  uint8_t fcn;
+  /** The RCS of the datagram if the final fragment, else 0. */
+  uint32_t rcs;
+  /** The payload, including any padding, within the decoded packet. */
+  const uint8_t *payload;
+  size_t payload_size;
+} MYRIOTA_SCHCFragment;
+
+/**
+ * Updates a CRC-32 (IEEE 802.3, as zlib) with data. Start with a crc of 0, the
+ * result of the whole datagram is its RCS.
+ * @param[in] crc the CRC of the preceding data.
+ * @param[in] data the data.
+ * @param[in] size the size of the data.
+ * @returns the CRC of the preceding data and data.
+ */
+uint32_t MYRIOTA_SCHCCrc32(uint32_t crc, const uint8_t *data, size_t size);
+
+/**
+ * Returns the number of fragments a datagram is sent as.
+ * @param[in] datagram_size the size of the datagram.
+ * @returns the number of fragments, or 0 if larger than
+ *   #MYRIOTA_SCHC_DATAGRAM_MAX.
+ */
+size_t MYRIOTA_SCHCFragmentCount(size_t datagram_size);
+
+/**
+ * Encodes a fragment of a datagram. Fragments are zero padded to the MTU.
+ * @param[in] rule_id the rule ID, up to #MYRIOTA_SCHC_RULE_ID_MAX.
+ * @param[in] datagram the datagram.
+ * @param[in] datagram_size the size of the datagram.
+ * @param[in] index the index of the fragment, from 0.
+ * @param[out] packet the encoded fragment.
+ * @param[out] payload_size if not NULL, the size of the datagram in the fragment.
+ * @returns true if encoded, false if the rule ID, datagram size or index is invalid.
+ */
+bool MYRIOTA_SCHCFragmentEncode(uint8_t rule_id, const uint8_t *datagram,
+                                size_t datagram_size, size_t index,
+                                uint8_t packet[MYRIOTA_SCHC_MTU], size_t *payload_size);
+
+/**
+ * Decodes a fragment. The payload refers to the packet.
+ * @param[in] packet the packet.
+ * @param[in] size the size of the packet.
+ * @param[out] fragment the decoded fragment.
+ * @returns true if decoded, false if the packet is too short.
+ */
+bool MYRIOTA_SCHCFragmentDecode(const uint8_t *packet, size_t size,
+                                MYRIOTA_SCHCFragment *fragment);
+
+/**
+ * \}
+ */
+
+#endif /* MYRIOTA_SCHC_H */
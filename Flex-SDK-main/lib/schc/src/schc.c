@@ -0,0 +1,221 @@
+// Copyright (c) 2024, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "myriota/schc.h"
+#include <string.h>
+
+// Reflected CRC-32 a nibble at a time, 64 bytes of table rather than 1 KiB
+static const uint32_t crc32_nibble_table[16] = {
+  0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4,
+  0x4DB26158, 0x5005713C, 0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+  0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+};
+
+uint32_t MYRIOTA_SCHCCrc32(uint32_t crc, const uint8_t *const data, const size_t size) {
+  crc = ~crc;
+  for (size_t i = 0; i < size; i++) {
+    crc ^= data[i];
+    crc = (crc >> 4) ^ crc32_nibble_table[crc & 0x0F];
+    crc = (crc >> 4) ^ crc32_nibble_table[crc & 0x0F];
+  }
+  return ~crc;
+}
+
+size_t MYRIOTA_SCHCFragmentCount(const size_t datagram_size) {
+  if (datagram_size > MYRIOTA_SCHC_DATAGRAM_MAX) {
+    return 0;
+  }
+  if (datagram_size <= MYRIOTA_SCHC_FINAL_PAYLOAD_SIZE) {
+    return 1;
+  }
+  const size_t before_final = datagram_size - MYRIOTA_SCHC_FINAL_PAYLOAD_SIZE;
+  return 1 + (before_final + MYRIOTA_SCHC_FRAGMENT_PAYLOAD_SIZE - 1) /
+                 MYRIOTA_SCHC_FRAGMENT_PAYLOAD_SIZE;
+}
+
+bool MYRIOTA_SCHCFragmentEncode(const uint8_t rule_id, const uint8_t *const datagram,
+                                const size_t datagram_size, const size_t index,
+                                uint8_t packet[MYRIOTA_SCHC_MTU], size_t *const payload_size) {
+  const size_t count = MYRIOTA_SCHCFragmentCount(datagram_size);
+  if (rule_id > MYRIOTA_SCHC_RULE_ID_MAX || index >= count) {
+    return false;
+  }
+
+  // Fragment i starts at byte i * 19, so only the last two can be short
+  const size_t offset = index * MYRIOTA_SCHC_FRAGMENT_PAYLOAD_SIZE;
+  const size_t remaining = datagram_size > offset ? datagram_size - offset : 0;
+  size_t header_size = 1;
+  size_t size;
+  memset(packet, 0, MYRIOTA_SCHC_MTU);
+  if (index == count - 1) {
+    const uint32_t rcs = MYRIOTA_SCHCCrc32(0, datagram, datagram_size);
+    packet[0] = rule_id << 6 | MYRIOTA_SCHC_FCN_ALL1;
+    packet[1] = rcs >> 24;
+    packet[2] = (rcs >> 16) & 0xFF;
+    packet[3] = (rcs >> 8) & 0xFF;
+    packet[4] = rcs & 0xFF;
+    header_size += MYRIOTA_SCHC_RCS_SIZE;
+    size = remaining;
+  } else {
+    packet[0] = rule_id << 6 | (MYRIOTA_SCHC_FCN_FIRST - index);
+    size = remaining < MYRIOTA_SCHC_FRAGMENT_PAYLOAD_SIZE ? remaining
+                                                          : MYRIOTA_SCHC_FRAGMENT_PAYLOAD_SIZE;
+  }
+  memcpy(&packet[header_size], &datagram[offset], size);
+  if (payload_size) {
+    *payload_size = size;
+  }
+  return true;
+}
+
+bool MYRIOTA_SCHCFragmentDecode(const uint8_t *const packet, const size_t size,
+                                MYRIOTA_SCHCFragment *const fragment) {
+  if (size < 1) {
+    return false;
+  }
+  fragment->rule_id = packet[0] >> 6;
+  fragment->fcn = packet[0] & MYRIOTA_SCHC_FCN_ALL1;
+  fragment->rcs = 0;
+  size_t header_size = 1;
+  if (fragment->fcn == MYRIOTA_SCHC_FCN_ALL1) {
+    if (size < 1 + MYRIOTA_SCHC_RCS_SIZE) {
+      return false;
+    }
+    fragment->rcs = (uint32_t)packet[1] << 24 | (uint32_t)packet[2] << 16 |
+                    (uint32_t)packet[3] << 8 | packet[4];
+    header_size += MYRIOTA_SCHC_RCS_SIZE;
+  }
+  fragment->payload = &packet[header_size];
+  fragment->payload_size = size - header_size;
+  return true;
+}
+
+#ifdef MYRIOTA_SCHC_UNIT_TESTS
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+/*
+ * `cmocka.h` must be included after standard the above library headers.
+ * NOTE: This comment has dual purpose:
+ * 1. Document the ordering requirement.
+ * 2. Prevent `clang-format` from reordering the headers.
+ */
+#include <cmocka.h>
+
+#define TEST_LINE_MAX (2 * MYRIOTA_SCHC_DATAGRAM_MAX + 64)
+
+static size_t test_hex_decode(const char *hex, uint8_t *const data, const size_t size) {
+  size_t length = 0;
+  if (strcmp(hex, "-") == 0) {
+    return 0;
+  }
+  while (hex[0] && hex[1]) {
+    unsigned int byte;
+    assert_int_equal(sscanf(hex, "%2x", &byte), 1);
+    assert_true(length < size);
+    data[length++] = byte;
+    hex += 2;
+  }
+  return length;
+}
+
+// Checks the vectors shared with the server's Python binding
+static void test_golden_vectors(void **state) {
+  (void)state;
+  FILE *const file = fopen(MYRIOTA_SCHC_GOLDEN_VECTORS, "r");
+  assert_non_null(file);
+
+  static char line[TEST_LINE_MAX];
+  static char hex[TEST_LINE_MAX];
+  static uint8_t datagram[MYRIOTA_SCHC_DATAGRAM_MAX];
+  size_t datagram_size = 0;
+  int crcs = 0, fragments = 0;
+  while (fgets(line, sizeof(line), file)) {
+    unsigned int crc, rule_id, index, count;
+    uint8_t expected[MYRIOTA_SCHC_MTU], packet[MYRIOTA_SCHC_MTU];
+    if (sscanf(line, "crc %s %x", hex, &crc) == 2) {
+      const size_t size = test_hex_decode(hex, datagram, sizeof(datagram));
+      assert_int_equal(MYRIOTA_SCHCCrc32(0, datagram, size), crc);
+      crcs++;
+    } else if (sscanf(line, "datagram %s %u", hex, &count) == 2) {
+      datagram_size = test_hex_decode(hex, datagram, sizeof(datagram));
+      assert_int_equal(MYRIOTA_SCHCFragmentCount(datagram_size), count);
+    } else if (sscanf(line, "fragment %u %u %s", &rule_id, &index, hex) == 3) {
+      assert_int_equal(test_hex_decode(hex, expected, sizeof(expected)), MYRIOTA_SCHC_MTU);
+      size_t payload_size;
+      assert_true(MYRIOTA_SCHCFragmentEncode(rule_id, datagram, datagram_size, index, packet,
+                                             &payload_size));
+      assert_memory_equal(packet, expected, MYRIOTA_SCHC_MTU);
+
+      MYRIOTA_SCHCFragment fragment;
+      assert_true(MYRIOTA_SCHCFragmentDecode(packet, sizeof(packet), &fragment));
+      assert_int_equal(fragment.rule_id, rule_id);
+      assert_memory_equal(fragment.payload, &datagram[index * MYRIOTA_SCHC_FRAGMENT_PAYLOAD_SIZE],
+                          payload_size);
+      fragments++;
+    }
+  }
+  fclose(file);
+  assert_true(crcs > 0);
+  assert_true(fragments > 0);
+}
+
+static void test_crc_incremental(void **state) {
+  (void)state;
+  const uint8_t data[] = "123456789";
+  const uint32_t crc = MYRIOTA_SCHCCrc32(0, data, 4);
+  assert_int_equal(MYRIOTA_SCHCCrc32(crc, &data[4], 5), 0xCBF43926);
+}
+
+static void test_fragment_count(void **state) {
+  (void)state;
+  assert_int_equal(MYRIOTA_SCHCFragmentCount(0), 1);
+  assert_int_equal(MYRIOTA_SCHCFragmentCount(15), 1);
+  assert_int_equal(MYRIOTA_SCHCFragmentCount(16), 2);
+  assert_int_equal(MYRIOTA_SCHCFragmentCount(34), 2);
+  // 35 bytes don't fit in 19 + 15, so the final fragment carries no payload
+  assert_int_equal(MYRIOTA_SCHCFragmentCount(35), 3);
+  assert_int_equal(MYRIOTA_SCHCFragmentCount(711), 38);
+  assert_int_equal(MYRIOTA_SCHCFragmentCount(MYRIOTA_SCHC_DATAGRAM_MAX), MYRIOTA_SCHC_FRAGMENTS_MAX);
+  assert_int_equal(MYRIOTA_SCHCFragmentCount(MYRIOTA_SCHC_DATAGRAM_MAX + 1), 0);
+}
+
+static void test_invalid(void **state) {
+  (void)state;
+  const uint8_t datagram[20] = {0};
+  uint8_t packet[MYRIOTA_SCHC_MTU];
+  assert_false(MYRIOTA_SCHCFragmentEncode(4, datagram, sizeof(datagram), 0, packet, NULL));
+  assert_false(MYRIOTA_SCHCFragmentEncode(1, datagram, sizeof(datagram), 2, packet, NULL));
+  assert_true(MYRIOTA_SCHCFragmentEncode(1, datagram, sizeof(datagram), 1, packet, NULL));
+
+  MYRIOTA_SCHCFragment fragment;
+  assert_false(MYRIOTA_SCHCFragmentDecode(packet, 0, &fragment));
+  assert_false(MYRIOTA_SCHCFragmentDecode(packet, MYRIOTA_SCHC_RCS_SIZE, &fragment));
+  assert_true(MYRIOTA_SCHCFragmentDecode(packet, 1 + MYRIOTA_SCHC_RCS_SIZE, &fragment));
+  assert_int_equal(fragment.fcn, MYRIOTA_SCHC_FCN_ALL1);
+  assert_int_equal(fragment.payload_size, 0);
+}
+
+int main(void) {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_golden_vectors),
+    cmocka_unit_test(test_crc_incremental),
+    cmocka_unit_test(test_fragment_count),
+    cmocka_unit_test(test_invalid),
+  };
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
+#endif
@@ -0,0 +1,211 @@
+/// \file serial_io.h Myriota Serial IO
+// Copyright (c) 2024, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MYRIOTA_SERIAL_IO_H
+#define MYRIOTA_SERIAL_IO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/** \defgroup SerialIO Serial IO Library
+ * @brief Buffered serial receive with framing
+ * \{
+ */
+
+/** The size of the receive buffer of the serial driver in bytes. */
+#define MYRIOTA_SERIAL_IO_DRIVER_BUFFER_SIZE 50
+
+/** Error codes for the serial IO library. */
+typedef enum {
+  SERIAL_IO_SUCCESS = 0,
+  SERIAL_IO_ERROR_IO_FAILURE,
+  SERIAL_IO_ERROR_TIMEOUT,
+  SERIAL_IO_ERROR_OVERFLOW,
+} MYRIOTA_SerialIOErrors;
+
+/**
+ * Read function for the serial device, which must not block.
+ *
+ * \param[in,out] ctx The user defined data context used by the serial interface.
+ * \param[out] buffer The buffer for filling with bytes read by the serial device.
+ * \param[in] count The total size of the buffer in bytes.
+ * \return the number of bytes read (0 if none are waiting) on success, else < 0 on error.
+ */
+typedef ssize_t (*MYRIOTA_SerialIOInterfaceReadFn_t)(void *const ctx, uint8_t *const buffer,
+  const size_t count);
+
+/** Interface for the serial device used by the serial IO library. */
+typedef struct {
+  /** User defined data context to be used by the read function. */
+  void *ctx;
+  /** Serial device read function. */
+  MYRIOTA_SerialIOInterfaceReadFn_t read;
+  /** Returns the current time in milliseconds, e.g. FLEX_TickGet. */
+  uint32_t (*tick_get)(void);
+  /** Sleeps for a number of milliseconds, e.g. FLEX_DelayMs. */
+  void (*delay_ms)(const uint32_t ms);
+} MYRIOTA_SerialIOInterface;
+
+/** A serial IO instance. */
+typedef struct {
+  /** \cond INTERNAL_HIDDEN */
+  MYRIOTA_SerialIOInterface interface;
+  uint8_t *buffer;
+  size_t size;
+  size_t head;
+  size_t count;
+  uint32_t last_rx_tick;
+  uint32_t wait_slice_ms;
+  /** \endcond */
+} MYRIOTA_SerialIO;
+
+/**
+ * Finds a frame at the start of the received data.
+ *
+ * \param[in] option The framer specific option.
+ * \param[in] io The serial IO instance, for MYRIOTA_SerialIOAvailable and
+ * MYRIOTA_SerialIOPeek.
+ * \param[in] idle_ms The time since data was last received.
+ * \param[out] offset The offset of the frame's payload.
+ * \param[out] length The length of the frame's payload.
+ * \return the number of bytes in the frame including any header or delimiter,
+ * or 0 if a complete frame hasn't been received.
+ */
+typedef size_t (*MYRIOTA_SerialIOFramerFn_t)(const uint32_t option,
+  const MYRIOTA_SerialIO *const io, const uint32_t idle_ms, size_t *const offset,
+  size_t *const length);
+
+/** A framer, which splits the received data into frames. */
+typedef struct {
+  /** The framing function. */
+  MYRIOTA_SerialIOFramerFn_t frame;
+  /** The framer specific option passed to the framing function. */
+  uint32_t option;
+} MYRIOTA_SerialIOFramer;
+
+/**
+ * Initializes a serial IO instance.
+ *
+ * \param[out] io The instance to initialize.
+ * \param[in] interface The serial device interface.
+ * \param[in] baud_rate The baud rate of the serial device, used to sleep for
+ * as long as possible without the serial driver's buffer overflowing.
+ * \param[in] buffer The receive ring buffer.
+ * \param[in] size The size of the receive ring buffer, which limits the size
+ * of a frame.
+ */
+void MYRIOTA_SerialIOInit(MYRIOTA_SerialIO *const io, const MYRIOTA_SerialIOInterface interface,
+  const uint32_t baud_rate, uint8_t *const buffer, const size_t size);
+
+/**
+ * Moves all data waiting in the serial driver into the receive buffer.
+ *
+ * \param[in,out] io The serial IO instance.
+ * \return the number of bytes received on success else < 0 on error.
+ */
+ssize_t MYRIOTA_SerialIOPoll(MYRIOTA_SerialIO *const io);
+
+/**
+ * Sleeps until data is received or the timeout expires.
+ *
+ * \param[in,out] io The serial IO instance.
+ * \param[in] timeout_ms The maximum time to wait.
+ * \return 0 if data is available else < 0 on timeout or error.
+ */
+int MYRIOTA_SerialIOWait(MYRIOTA_SerialIO *const io, const uint32_t timeout_ms);
+
+/**
+ * Gets the number of bytes in the receive buffer.
+ *
+ * \param[in] io The serial IO instance.
+ * \return the number of bytes in the receive buffer.
+ */
+size_t MYRIOTA_SerialIOAvailable(const MYRIOTA_SerialIO *const io);
+
+/**
+ * Gets a byte from the receive buffer without removing it.
+ *
+ * \param[in] io The serial IO instance.
+ * \param[in] index The index of the byte, which must be less than
+ * MYRIOTA_SerialIOAvailable.
+ * \return the byte.
+ */
+uint8_t MYRIOTA_SerialIOPeek(const MYRIOTA_SerialIO *const io, const size_t index);
+
+/**
+ * Removes bytes from the receive buffer.
+ *
+ * \param[in,out] io The serial IO instance.
+ * \param[out] buffer The buffer to copy the bytes to, or NULL to discard them.
+ * \param[in] count The maximum number of bytes to remove.
+ * \return the number of bytes removed.
+ */
+size_t MYRIOTA_SerialIORead(MYRIOTA_SerialIO *const io, uint8_t *const buffer, const size_t count);
+
+/**
+ * Discards all received data, including data waiting in the serial driver.
+ *
+ * \param[in,out] io The serial IO instance.
+ */
+void MYRIOTA_SerialIOFlush(MYRIOTA_SerialIO *const io);
+
+/**
+ * Waits for a frame and reads its payload.
+ *
+ * \param[in,out] io The serial IO instance.
+ * \param[in] framer The framer to use.
+ * \param[out] buffer The buffer to copy the payload to.
+ * \param[in] count The size of the buffer.
+ * \param[in] timeout_ms The maximum time to wait for the frame.
+ * \return the length of the payload on success else < 0 on error.
+ * \retval -SERIAL_IO_ERROR_TIMEOUT: no complete frame was received in time
+ * \retval -SERIAL_IO_ERROR_OVERFLOW: the frame didn't fit in the receive
+ * buffer or the payload didn't fit in the buffer, and has been discarded
+ */
+ssize_t MYRIOTA_SerialIOReadFrame(MYRIOTA_SerialIO *const io,
+  const MYRIOTA_SerialIOFramer framer, uint8_t *const buffer, const size_t count,
+  const uint32_t timeout_ms);
+
+/**
+ * Creates a framer for frames ending with a delimiter, which isn't included in
+ * the payload.
+ *
+ * \param[in] delimiter The delimiter, e.g. '\\n'.
+ * \return the framer.
+ */
+MYRIOTA_SerialIOFramer MYRIOTA_SerialIOLineFramer(const uint8_t delimiter);
+
+/**
+ * Creates a framer for frames starting with a single byte payload length.
+ *
+ * \return the framer.
+ */
+MYRIOTA_SerialIOFramer MYRIOTA_SerialIOLengthFramer(void);
+
+/**
+ * Creates a framer for frames ending with a period of silence, such as Modbus
+ * RTU, which needs 3.5 character times of silence.
+ *
+ * \param[in] baud_rate The baud rate of the serial device.
+ * \return the framer.
+ */
+MYRIOTA_SerialIOFramer MYRIOTA_SerialIOSilenceFramer(const uint32_t baud_rate);
+
+/**
+ * \}
+ */
+
+#endif /* MYRIOTA_SERIAL_IO_H */
@@ -0,0 +1,443 @@
+// Copyright (c) 2024, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "myriota/serial_io.h"
+#include <string.h>
+
+// Start, 8 data and stop bits.
+#define SERIAL_IO_BITS_PER_CHAR 10
+// Modbus RTU counts 11 bits per character, and uses a fixed silence above
+// 19200 baud.
+#define SERIAL_IO_SILENCE_BITS_PER_CHAR 11
+#define SERIAL_IO_SILENCE_CHARS_X2 7
+#define SERIAL_IO_SILENCE_FIXED_BAUD_RATE 19200
+#define SERIAL_IO_SILENCE_FIXED_US 1750
+// Allow for the millisecond resolution of the tick.
+#define SERIAL_IO_SILENCE_MARGIN_MS 1
+
+static inline uint32_t min_u32(const uint32_t a, const uint32_t b) {
+  return a < b ? a : b;
+}
+
+static inline uint32_t div_ceil(const uint32_t a, const uint32_t b) {
+  return (a + b - 1) / b;
+}
+
+void MYRIOTA_SerialIOInit(MYRIOTA_SerialIO *const io, const MYRIOTA_SerialIOInterface interface,
+  const uint32_t baud_rate, uint8_t *const buffer, const size_t size) {
+  memset(io, 0, sizeof(*io));
+  io->interface = interface;
+  io->buffer = buffer;
+  io->size = size;
+  io->last_rx_tick = interface.tick_get();
+  // Sleep for as long as it takes to half fill the serial driver's buffer, so
+  // that it is drained before it overflows.
+  io->wait_slice_ms = (MYRIOTA_SERIAL_IO_DRIVER_BUFFER_SIZE / 2) * SERIAL_IO_BITS_PER_CHAR * 1000 /
+                      (baud_rate > 0 ? baud_rate : 1);
+  if (io->wait_slice_ms == 0) {
+    io->wait_slice_ms = 1;
+  }
+}
+
+ssize_t MYRIOTA_SerialIOPoll(MYRIOTA_SerialIO *const io) {
+  size_t received = 0;
+  // The free space wraps around at most once, so at most two reads are needed
+  // unless more data arrives while reading.
+  while (io->count < io->size) {
+    const size_t tail = (io->head + io->count) % io->size;
+    const size_t contiguous = tail >= io->head ? io->size - tail : io->head - tail;
+    const ssize_t result = io->interface.read(io->interface.ctx, &io->buffer[tail], contiguous);
+    if (result < 0) {
+      return -SERIAL_IO_ERROR_IO_FAILURE;
+    }
+    io->count += result;
+    received += result;
+    if ((size_t)result < contiguous) {
+      break;
+    }
+  }
+
+  if (received > 0) {
+    io->last_rx_tick = io->interface.tick_get();
+  }
+  return received;
+}
+
+int MYRIOTA_SerialIOWait(MYRIOTA_SerialIO *const io, const uint32_t timeout_ms) {
+  const uint32_t start = io->interface.tick_get();
+  for (;;) {
+    const ssize_t result = MYRIOTA_SerialIOPoll(io);
+    if (result < 0) {
+      return result;
+    }
+    if (io->count > 0) {
+      return SERIAL_IO_SUCCESS;
+    }
+
+    const uint32_t elapsed = io->interface.tick_get() - start;
+    if (elapsed >= timeout_ms) {
+      return -SERIAL_IO_ERROR_TIMEOUT;
+    }
+    io->interface.delay_ms(min_u32(io->wait_slice_ms, timeout_ms - elapsed));
+  }
+}
+
+size_t MYRIOTA_SerialIOAvailable(const MYRIOTA_SerialIO *const io) {
+  return io->count;
+}
+
+uint8_t MYRIOTA_SerialIOPeek(const MYRIOTA_SerialIO *const io, const size_t index) {
+  return io->buffer[(io->head + index) % io->size];
+}
+
+size_t MYRIOTA_SerialIORead(MYRIOTA_SerialIO *const io, uint8_t *const buffer, const size_t count) {
+  const size_t total = count < io->count ? count : io->count;
+  size_t copied = 0;
+  while (copied < total) {
+    const size_t contiguous = io->size - io->head;
+    const size_t chunk = total - copied < contiguous ? total - copied : contiguous;
+    if (buffer != NULL) {
+      memcpy(&buffer[copied], &io->buffer[io->head], chunk);
+    }
+    io->head = (io->head + chunk) % io->size;
+    io->count -= chunk;
+    copied += chunk;
+  }
+  return total;
+}
+
+void MYRIOTA_SerialIOFlush(MYRIOTA_SerialIO *const io) {
+  do {
+    io->head = 0;
+    io->count = 0;
+  } while (MYRIOTA_SerialIOPoll(io) > 0);
+  io->head = 0;
+  io->count = 0;
+}
+
+ssize_t MYRIOTA_SerialIOReadFrame(MYRIOTA_SerialIO *const io,
+  const MYRIOTA_SerialIOFramer framer, uint8_t *const buffer, const size_t count,
+  const uint32_t timeout_ms) {
+  const uint32_t start = io->interface.tick_get();
+  for (;;) {
+    const ssize_t result = MYRIOTA_SerialIOPoll(io);
+    if (result < 0) {
+      return result;
+    }
+
+    const uint32_t now = io->interface.tick_get();
+    size_t offset = 0;
+    size_t length = 0;
+    const size_t consumed = framer.frame(framer.option, io, now - io->last_rx_tick, &offset,
+      &length);
+    if (consumed > 0) {
+      if (length > count) {
+        MYRIOTA_SerialIORead(io, NULL, consumed);
+        return -SERIAL_IO_ERROR_OVERFLOW;
+      }
+      MYRIOTA_SerialIORead(io, NULL, offset);
+      MYRIOTA_SerialIORead(io, buffer, length);
+      MYRIOTA_SerialIORead(io, NULL, consumed - offset - length);
+      return length;
+    }
+
+    if (io->count == io->size) {
+      MYRIOTA_SerialIOFlush(io);
+      return -SERIAL_IO_ERROR_OVERFLOW;
+    }
+
+    const uint32_t elapsed = now - start;
+    if (elapsed >= timeout_ms) {
+      return -SERIAL_IO_ERROR_TIMEOUT;
+    }
+    io->interface.delay_ms(min_u32(io->wait_slice_ms, timeout_ms - elapsed));
+  }
+}
+
+static size_t line_frame(const uint32_t option, const MYRIOTA_SerialIO *const io,
+  const uint32_t idle_ms, size_t *const offset, size_t *const length) {
+  (void)idle_ms;
+  for (size_t i = 0; i < io->count; ++i) {
+    if (MYRIOTA_SerialIOPeek(io, i) == option) {
+      *offset = 0;
+      *length = i;
+      return i + 1;
+    }
+  }
+  return 0;
+}
+
+static size_t length_frame(const uint32_t option, const MYRIOTA_SerialIO *const io,
+  const uint32_t idle_ms, size_t *const offset, size_t *const length) {
+  (void)option;
+  (void)idle_ms;
+  if (io->count == 0) {
+    return 0;
+  }
+  const size_t payload_length = MYRIOTA_SerialIOPeek(io, 0);
+  if (io->count < 1 + payload_length) {
+    return 0;
+  }
+  *offset = 1;
+  *length = payload_length;
+  return 1 + payload_length;
+}
+
+static size_t silence_frame(const uint32_t option, const MYRIOTA_SerialIO *const io,
+  const uint32_t idle_ms, size_t *const offset, size_t *const length) {
+  if (io->count == 0 || idle_ms < option) {
+    return 0;
+  }
+  *offset = 0;
+  *length = io->count;
+  return io->count;
+}
+
+MYRIOTA_SerialIOFramer MYRIOTA_SerialIOLineFramer(const uint8_t delimiter) {
+  return (MYRIOTA_SerialIOFramer){.frame = line_frame, .option = delimiter};
+}
+
+MYRIOTA_SerialIOFramer MYRIOTA_SerialIOLengthFramer(void) {
+  return (MYRIOTA_SerialIOFramer){.frame = length_frame, .option = 0};
+}
+
+MYRIOTA_SerialIOFramer MYRIOTA_SerialIOSilenceFramer(const uint32_t baud_rate) {
+  uint32_t silence_us = SERIAL_IO_SILENCE_FIXED_US;
+  if (baud_rate > 0 && baud_rate <= SERIAL_IO_SILENCE_FIXED_BAUD_RATE) {
+    silence_us =
+      div_ceil(SERIAL_IO_SILENCE_CHARS_X2 * SERIAL_IO_SILENCE_BITS_PER_CHAR * 500000, baud_rate);
+  }
+  return (MYRIOTA_SerialIOFramer){
+    .frame = silence_frame,
+    .option = div_ceil(silence_us, 1000) + SERIAL_IO_SILENCE_MARGIN_MS,
+  };
+}
+
+#ifdef MYRIOTA_SERIAL_IO_UNIT_TESTS
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+/*
+ * `cmocka.h` must be included after standard the above library headers.
+ * NOTE: This comment has dual purpose:
+ * 1. Document the ordering requirement.
+ * 2. Prevent `clang-format` from reordering the headers.
+ */
+#include <cmocka.h>
+
+#define TEST_BUFFER_SIZE 16
+#define TEST_BAUD_RATE 9600
+
+// A serial device which receives a scripted stream of bytes, each arriving at
+// a given time, on a simulated clock which only advances when sleeping.
+struct test_serial {
+  const uint8_t *data;
+  const uint32_t *arrival_ms;
+  size_t length;
+  size_t position;
+  size_t reads;
+  size_t delays;
+  bool fail;
+};
+
+static struct test_serial test_serial;
+static uint32_t test_tick;
+
+static ssize_t test_read(void *const ctx, uint8_t *const buffer, const size_t count) {
+  struct test_serial *const serial = ctx;
+  ++serial->reads;
+  if (serial->fail) {
+    return -1;
+  }
+  size_t copied = 0;
+  while (copied < count && serial->position < serial->length &&
+         serial->arrival_ms[serial->position] <= test_tick) {
+    buffer[copied++] = serial->data[serial->position++];
+  }
+  return copied;
+}
+
+static uint32_t test_tick_get(void) {
+  return test_tick;
+}
+
+static void test_delay_ms(const uint32_t ms) {
+  ++test_serial.delays;
+  test_tick += ms;
+}
+
+static const MYRIOTA_SerialIOInterface test_interface = {
+  .ctx = &test_serial,
+  .read = test_read,
+  .tick_get = test_tick_get,
+  .delay_ms = test_delay_ms,
+};
+
+static uint8_t test_buffer[TEST_BUFFER_SIZE];
+static MYRIOTA_SerialIO test_io;
+
+// Bytes arriving at the given time spaced one character apart at 9600 baud.
+static void test_stream(const uint8_t *const data, uint32_t *const arrival_ms, const size_t length,
+  const uint32_t start_ms) {
+  for (size_t i = 0; i < length; ++i) {
+    arrival_ms[i] = start_ms + i * SERIAL_IO_BITS_PER_CHAR * 1000 / TEST_BAUD_RATE;
+  }
+  test_serial.data = data;
+  test_serial.arrival_ms = arrival_ms;
+  test_serial.length = length;
+  test_serial.position = 0;
+}
+
+static int setup(void **state) {
+  (void)state;
+  memset(&test_serial, 0, sizeof(test_serial));
+  test_tick = 1000;
+  MYRIOTA_SerialIOInit(&test_io, test_interface, TEST_BAUD_RATE, test_buffer, sizeof(test_buffer));
+  return 0;
+}
+
+static void test_line_framer(void **state) {
+  (void)state;
+  static const uint8_t data[] = "HELLO\nWORLD\n";
+  uint32_t arrival_ms[sizeof(data) - 1];
+  test_stream(data, arrival_ms, sizeof(data) - 1, 1100);
+
+  const MYRIOTA_SerialIOFramer framer = MYRIOTA_SerialIOLineFramer('\n');
+  uint8_t frame[TEST_BUFFER_SIZE];
+  assert_int_equal(MYRIOTA_SerialIOReadFrame(&test_io, framer, frame, sizeof(frame), 2000), 5);
+  assert_memory_equal(frame, "HELLO", 5);
+  assert_int_equal(MYRIOTA_SerialIOReadFrame(&test_io, framer, frame, sizeof(frame), 2000), 5);
+  assert_memory_equal(frame, "WORLD", 5);
+
+  // Sleeping in slices rather than polling every byte.
+  assert_in_range(test_serial.delays, 1, 10);
+  assert_int_equal(MYRIOTA_SerialIOAvailable(&test_io), 0);
+}
+
+static void test_length_framer(void **state) {
+  (void)state;
+  static const uint8_t data[] = {3, 'a', 'b', 'c', 0, 2, 'd'};
+  uint32_t arrival_ms[sizeof(data)];
+  test_stream(data, arrival_ms, sizeof(data), 1000);
+
+  const MYRIOTA_SerialIOFramer framer = MYRIOTA_SerialIOLengthFramer();
+  uint8_t frame[TEST_BUFFER_SIZE];
+  assert_int_equal(MYRIOTA_SerialIOReadFrame(&test_io, framer, frame, sizeof(frame), 100), 3);
+  assert_memory_equal(frame, "abc", 3);
+  assert_int_equal(MYRIOTA_SerialIOReadFrame(&test_io, framer, frame, sizeof(frame), 100), 0);
+  // The last frame is incomplete.
+  assert_int_equal(MYRIOTA_SerialIOReadFrame(&test_io, framer, frame, sizeof(frame), 100),
+    -SERIAL_IO_ERROR_TIMEOUT);
+  assert_int_equal(MYRIOTA_SerialIOAvailable(&test_io), 2);
+}
+
+static void test_silence_framer(void **state) {
+  (void)state;
+  static const uint8_t data[] = {0x01, 0x03, 0x04, 0x00, 0x01, 0x00, 0x02, 0xAB, 0xCD};
+  uint32_t arrival_ms[sizeof(data)];
+  test_stream(data, arrival_ms, sizeof(data), 1050);
+
+  // 3.5 characters at 9600 baud is 4.01ms.
+  const MYRIOTA_SerialIOFramer framer = MYRIOTA_SerialIOSilenceFramer(TEST_BAUD_RATE);
+  assert_int_equal(framer.option, 6);
+  assert_int_equal(MYRIOTA_SerialIOSilenceFramer(115200).option, 3);
+
+  uint8_t frame[TEST_BUFFER_SIZE];
+  assert_int_equal(MYRIOTA_SerialIOReadFrame(&test_io, framer, frame, sizeof(frame), 2000),
+    sizeof(data));
+  assert_memory_equal(frame, data, sizeof(data));
+  // The frame ends shortly after the last byte rather than at the timeout. The
+  // end of the data is only seen when polling, so this can take two slices.
+  assert_in_range(test_tick, arrival_ms[sizeof(data) - 1] + framer.option,
+    arrival_ms[sizeof(data) - 1] + 2 * test_io.wait_slice_ms);
+}
+
+static void test_timeout(void **state) {
+  (void)state;
+  assert_int_equal(MYRIOTA_SerialIOWait(&test_io, 500), -SERIAL_IO_ERROR_TIMEOUT);
+  assert_int_equal(test_tick, 1500);
+  assert_int_equal(test_serial.delays, div_ceil(500, test_io.wait_slice_ms));
+
+  static const uint8_t data[] = {'x'};
+  uint32_t arrival_ms[sizeof(data)];
+  test_stream(data, arrival_ms, sizeof(data), 1600);
+  assert_int_equal(MYRIOTA_SerialIOWait(&test_io, 500), SERIAL_IO_SUCCESS);
+  assert_in_range(test_tick, 1600, 1600 + test_io.wait_slice_ms);
+
+  test_serial.fail = true;
+  assert_int_equal(MYRIOTA_SerialIOWait(&test_io, 500), -SERIAL_IO_ERROR_IO_FAILURE);
+}
+
+static void test_overflow(void **state) {
+  (void)state;
+  static const uint8_t data[] = "THIS LINE IS TOO LONG\nOK\n";
+  uint32_t arrival_ms[sizeof(data) - 1];
+  test_stream(data, arrival_ms, sizeof(data) - 1, 1000);
+  test_tick = 2000;
+
+  const MYRIOTA_SerialIOFramer framer = MYRIOTA_SerialIOLineFramer('\n');
+  uint8_t frame[TEST_BUFFER_SIZE];
+  assert_int_equal(MYRIOTA_SerialIOReadFrame(&test_io, framer, frame, sizeof(frame), 100),
+    -SERIAL_IO_ERROR_OVERFLOW);
+  // The rest of the long line is flushed with it.
+  assert_int_equal(MYRIOTA_SerialIOReadFrame(&test_io, framer, frame, sizeof(frame), 100),
+    -SERIAL_IO_ERROR_TIMEOUT);
+
+  // A payload too big for the caller's buffer is discarded.
+  static const uint8_t short_data[] = "TOOBIG\nOK\n";
+  uint32_t short_arrival_ms[sizeof(short_data) - 1];
+  test_stream(short_data, short_arrival_ms, sizeof(short_data) - 1, 1000);
+  assert_int_equal(MYRIOTA_SerialIOReadFrame(&test_io, framer, frame, 4, 100),
+    -SERIAL_IO_ERROR_OVERFLOW);
+  assert_int_equal(MYRIOTA_SerialIOReadFrame(&test_io, framer, frame, 4, 100), 2);
+  assert_memory_equal(frame, "OK", 2);
+}
+
+static void test_ring_wrap(void **state) {
+  (void)state;
+  static const uint8_t data[] = "0123456789abcdefghij";
+  uint32_t arrival_ms[sizeof(data) - 1];
+  test_stream(data, arrival_ms, sizeof(data) - 1, 0);
+
+  // Fill the buffer in a single bulk read, leaving the rest in the driver.
+  assert_int_equal(MYRIOTA_SerialIOPoll(&test_io), TEST_BUFFER_SIZE);
+  assert_int_equal(test_serial.reads, 1);
+  uint8_t out[TEST_BUFFER_SIZE];
+  assert_int_equal(MYRIOTA_SerialIORead(&test_io, out, 10), 10);
+  assert_memory_equal(out, "0123456789", 10);
+
+  // The rest wraps around the end of the buffer.
+  assert_int_equal(MYRIOTA_SerialIOPoll(&test_io), 4);
+  assert_int_equal(MYRIOTA_SerialIOAvailable(&test_io), 10);
+  assert_int_equal(MYRIOTA_SerialIOPeek(&test_io, 9), 'j');
+  assert_int_equal(MYRIOTA_SerialIORead(&test_io, out, sizeof(out)), 10);
+  assert_memory_equal(out, "abcdefghij", 10);
+
+  MYRIOTA_SerialIOFlush(&test_io);
+  assert_int_equal(MYRIOTA_SerialIOAvailable(&test_io), 0);
+}
+
+int main(void) {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test_setup(test_line_framer, setup),
+    cmocka_unit_test_setup(test_length_framer, setup),
+    cmocka_unit_test_setup(test_silence_framer, setup),
+    cmocka_unit_test_setup(test_timeout, setup),
+    cmocka_unit_test_setup(test_overflow, setup),
+    cmocka_unit_test_setup(test_ring_wrap, setup),
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
+#endif
@@ -0,0 +1,152 @@
+/// \file uplink_stats.h Myriota Uplink Statistics
+// Copyright (c) 2024, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef MYRIOTA_UPLINK_STATS_H
+#define MYRIOTA_UPLINK_STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/** \defgroup UplinkStats Uplink Statistics Library
+ * @brief Counters of uplink usage for tuning fragmentation and schedules
+ * \{
+ */
+
+/** The size of an encoded frame in bytes. */
+#define MYRIOTA_UPLINK_STATS_FRAME_SIZE 20
+/** The first byte of an encoded frame. */
+#define MYRIOTA_UPLINK_STATS_FRAME_TYPE 0x0D
+/** The minimum free queue slots value when the queue hasn't been sampled. */
+#define MYRIOTA_UPLINK_STATS_SLOTS_UNKNOWN 0xFF
+
+/** Uplink counters. */
+typedef struct {
+  uint32_t sent;           ///< Messages scheduled successfully.
+  uint32_t failures;       ///< Messages which failed to schedule.
+  uint32_t deferrals;      ///< Messages held back by the message quota.
+  uint32_t payload_bytes;  ///< Bytes of payload scheduled.
+  uint32_t padding_bytes;  ///< Bytes of padding scheduled, i.e. wasted.
+  uint32_t transfers;      ///< Fragmented transfers (e.g. images) completed.
+} MYRIOTA_UplinkStatsCounters;
+
+/** An uplink statistics instance. */
+typedef struct {
+  /** \cond INTERNAL_HIDDEN */
+  MYRIOTA_UplinkStatsCounters totals;
+  MYRIOTA_UplinkStatsCounters window;
+  time_t window_start;
+  uint8_t min_slots_free;
+  /** \endcond */
+} MYRIOTA_UplinkStats;
+
+/**
+ * Initialises uplink statistics.
+ *
+ * \param[out] stats The statistics to initialise.
+ * \param[in] totals The totals to continue from, e.g. restored from persistent
+ * diagnostics, or NULL to start from zero.
+ * \param[in] now The current time in seconds, which starts the first window.
+ */
+void MYRIOTA_UplinkStatsInit(MYRIOTA_UplinkStats *const stats,
+  const MYRIOTA_UplinkStatsCounters *const totals, const time_t now);
+
+/**
+ * Records a message scheduled successfully.
+ *
+ * \param[in,out] stats The statistics.
+ * \param[in] payload_size The bytes of the message carrying data or headers.
+ * \param[in] padding_size The bytes of the message which are padding.
+ * \param[in] slots_free The free queue slots after scheduling, e.g. from
+ * FLEX_MessageSlotsFree, or < 0 if unknown.
+ */
+void MYRIOTA_UplinkStatsSent(MYRIOTA_UplinkStats *const stats, const size_t payload_size,
+  const size_t padding_size, const int slots_free);
+
+/**
+ * Records a message which failed to schedule.
+ *
+ * \param[in,out] stats The statistics.
+ */
+void MYRIOTA_UplinkStatsFailed(MYRIOTA_UplinkStats *const stats);
+
+/**
+ * Records a message held back by the message quota.
+ *
+ * \param[in,out] stats The statistics.
+ */
+void MYRIOTA_UplinkStatsDeferred(MYRIOTA_UplinkStats *const stats);
+
+/**
+ * Records a completed fragmented transfer, e.g. the last fragment of an image.
+ *
+ * \param[in,out] stats The statistics.
+ */
+void MYRIOTA_UplinkStatsTransferComplete(MYRIOTA_UplinkStats *const stats);
+
+/**
+ * Gets the totals since the statistics were initialised, including the
+ * totals they were initialised with.
+ *
+ * \param[in] stats The statistics.
+ * \return The totals.
+ */
+const MYRIOTA_UplinkStatsCounters *MYRIOTA_UplinkStatsTotalsGet(
+  const MYRIOTA_UplinkStats *const stats);
+
+/**
+ * Checks whether the current window is long enough to be reported.
+ *
+ * \param[in] stats The statistics.
+ * \param[in] interval The reporting interval in seconds, where 0 disables reports.
+ * \param[in] now The current time in seconds.
+ * \return true if a report is due.
+ */
+bool MYRIOTA_UplinkStatsIsReportDue(const MYRIOTA_UplinkStats *const stats,
+  const uint32_t interval, const time_t now);
+
+/**
+ * Encodes the counters of the current window and starts a new window.
+ *
+ * | Byte  | Description                                                  |
+ * | ----- | ------------------------------------------------------------ |
+ * | 0     | MYRIOTA_UPLINK_STATS_FRAME_TYPE                              |
+ * | 1     | Sequence number                                              |
+ * | 2-5   | Window start time (u32)                                      |
+ * | 6-7   | Messages sent (u16)                                          |
+ * | 8-9   | Messages failed (u16)                                        |
+ * | 10-11 | Messages deferred by the quota (u16)                         |
+ * | 12-14 | Payload bytes (u24)                                          |
+ * | 15-16 | Padding bytes (u16)                                          |
+ * | 17    | Minimum free queue slots, 0xFF if not sampled                |
+ * | 18-19 | Transfers completed (u16)                                    |
+ *
+ * Multi-byte fields are little endian and saturate at their maximum. The
+ * window ends when the frame is encoded, so the next window starts at \p now.
+ *
+ * \param[in,out] stats The statistics.
+ * \param[in] sequence The sequence number of the frame.
+ * \param[in] now The current time in seconds.
+ * \param[out] frame The buffer to encode to.
+ */
+void MYRIOTA_UplinkStatsEncode(MYRIOTA_UplinkStats *const stats, const uint8_t sequence,
+  const time_t now, uint8_t frame[MYRIOTA_UPLINK_STATS_FRAME_SIZE]);
+
+/**
+ * \}
+ */
+
+#endif /* MYRIOTA_UPLINK_STATS_H */
@@ -0,0 +1,216 @@
+// Copyright (c) 2024, Myriota Pty Ltd, All Rights Reserved
+// SPDX-License-Identifier: BSD-3-Clause-Attribution
+//
+// This file is licensed under the BSD with attribution  (the "License"); you
+// may not use these files except in compliance with the License.
+//
+// You may obtain a copy of the License here:
+// LICENSE-BSD-3-Clause-Attribution.txt and at
+// https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "myriota/uplink_stats.h"
+#include <string.h>
+
+#define UPLINK_STATS_U16_MAX 0xFFFF
+#define UPLINK_STATS_U24_MAX 0xFFFFFF
+
+static inline void pack_u16(uint8_t *const buffer, const uint32_t value) {
+  const uint32_t saturated = value > UPLINK_STATS_U16_MAX ? UPLINK_STATS_U16_MAX : value;
+  buffer[0] = saturated & 0xFF;
+  buffer[1] = saturated >> 8;
+}
+
+static inline void pack_u24(uint8_t *const buffer, const uint32_t value) {
+  const uint32_t saturated = value > UPLINK_STATS_U24_MAX ? UPLINK_STATS_U24_MAX : value;
+  buffer[0] = saturated & 0xFF;
+  buffer[1] = (saturated >> 8) & 0xFF;
+  buffer[2] = saturated >> 16;
+}
+
+static inline void pack_u32(uint8_t *const buffer, const uint32_t value) {
+  buffer[0] = value & 0xFF;
+  buffer[1] = (value >> 8) & 0xFF;
+  buffer[2] = (value >> 16) & 0xFF;
+  buffer[3] = value >> 24;
+}
+
+// Counters saturate rather than wrap, so a long deployment doesn't appear idle.
+static inline void add(uint32_t *const counter, const uint32_t value) {
+  *counter = *counter > UINT32_MAX - value ? UINT32_MAX : *counter + value;
+}
+
+static void start_window(MYRIOTA_UplinkStats *const stats, const time_t now) {
+  memset(&stats->window, 0, sizeof(stats->window));
+  stats->window_start = now;
+  stats->min_slots_free = MYRIOTA_UPLINK_STATS_SLOTS_UNKNOWN;
+}
+
+void MYRIOTA_UplinkStatsInit(MYRIOTA_UplinkStats *const stats,
+  const MYRIOTA_UplinkStatsCounters *const totals, const time_t now) {
+  if (totals != NULL) {
+    stats->totals = *totals;
+  } else {
+    memset(&stats->totals, 0, sizeof(stats->totals));
+  }
+  start_window(stats, now);
+}
+
+void MYRIOTA_UplinkStatsSent(MYRIOTA_UplinkStats *const stats, const size_t payload_size,
+  const size_t padding_size, const int slots_free) {
+  add(&stats->totals.sent, 1);
+  add(&stats->window.sent, 1);
+  add(&stats->totals.payload_bytes, payload_size);
+  add(&stats->window.payload_bytes, payload_size);
+  add(&stats->totals.padding_bytes, padding_size);
+  add(&stats->window.padding_bytes, padding_size);
+  if (slots_free >= 0 && slots_free < stats->min_slots_free) {
+    stats->min_slots_free = slots_free;
+  }
+}
+
+void MYRIOTA_UplinkStatsFailed(MYRIOTA_UplinkStats *const stats) {
+  add(&stats->totals.failures, 1);
+  add(&stats->window.failures, 1);
+}
+
+void MYRIOTA_UplinkStatsDeferred(MYRIOTA_UplinkStats *const stats) {
+  add(&stats->totals.deferrals, 1);
+  add(&stats->window.deferrals, 1);
+}
+
+void MYRIOTA_UplinkStatsTransferComplete(MYRIOTA_UplinkStats *const stats) {
+  add(&stats->totals.transfers, 1);
+  add(&stats->window.transfers, 1);
+}
+
+const MYRIOTA_UplinkStatsCounters *MYRIOTA_UplinkStatsTotalsGet(
+  const MYRIOTA_UplinkStats *const stats) {
+  return &stats->totals;
+}
+
+bool MYRIOTA_UplinkStatsIsReportDue(const MYRIOTA_UplinkStats *const stats,
+  const uint32_t interval, const time_t now) {
+  return interval != 0 && now - stats->window_start >= (time_t)interval;
+}
+
+void MYRIOTA_UplinkStatsEncode(MYRIOTA_UplinkStats *const stats, const uint8_t sequence,
+  const time_t now, uint8_t frame[MYRIOTA_UPLINK_STATS_FRAME_SIZE]) {
+  const MYRIOTA_UplinkStatsCounters *const window = &stats->window;
+  frame[0] = MYRIOTA_UPLINK_STATS_FRAME_TYPE;
+  frame[1] = sequence;
+  pack_u32(&frame[2], stats->window_start);
+  pack_u16(&frame[6], window->sent);
+  pack_u16(&frame[8], window->failures);
+  pack_u16(&frame[10], window->deferrals);
+  pack_u24(&frame[12], window->payload_bytes);
+  pack_u16(&frame[15], window->padding_bytes);
+  frame[17] = stats->min_slots_free;
+  pack_u16(&frame[18], window->transfers);
+  start_window(stats, now);
+}
+
+#ifdef MYRIOTA_UPLINK_STATS_UNIT_TESTS
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+/*
+ * `cmocka.h` must be included after standard the above library headers.
+ * NOTE: This comment has dual purpose:
+ * 1. Document the ordering requirement.
+ * 2. Prevent `clang-format` from reordering the headers.
+ */
+#include <cmocka.h>
+
+#define TEST_START_TIME 1700000000
+#define TEST_WEEK_SECS (7 * 24 * 3600)
+
+static uint32_t unpack_u16(const uint8_t *const buffer) {
+  return buffer[0] | buffer[1] << 8;
+}
+
+static void test_counters(void **state) {
+  (void)state;
+  const MYRIOTA_UplinkStatsCounters restored = {.sent = 100, .padding_bytes = UINT32_MAX - 1};
+  MYRIOTA_UplinkStats stats;
+  MYRIOTA_UplinkStatsInit(&stats, &restored, TEST_START_TIME);
+
+  MYRIOTA_UplinkStatsSent(&stats, 20, 0, 7);
+  MYRIOTA_UplinkStatsSent(&stats, 16, 4, 5);
+  MYRIOTA_UplinkStatsSent(&stats, 20, 0, -1);
+  MYRIOTA_UplinkStatsFailed(&stats);
+  MYRIOTA_UplinkStatsDeferred(&stats);
+  MYRIOTA_UplinkStatsDeferred(&stats);
+  MYRIOTA_UplinkStatsTransferComplete(&stats);
+
+  const MYRIOTA_UplinkStatsCounters *const totals = MYRIOTA_UplinkStatsTotalsGet(&stats);
+  assert_int_equal(totals->sent, 103);
+  assert_int_equal(totals->failures, 1);
+  assert_int_equal(totals->deferrals, 2);
+  assert_int_equal(totals->payload_bytes, 56);
+  assert_int_equal(totals->padding_bytes, UINT32_MAX);
+  assert_int_equal(totals->transfers, 1);
+}
+
+static void test_report(void **state) {
+  (void)state;
+  MYRIOTA_UplinkStats stats;
+  MYRIOTA_UplinkStatsInit(&stats, NULL, TEST_START_TIME);
+  MYRIOTA_UplinkStatsSent(&stats, 16, 4, 5);
+  MYRIOTA_UplinkStatsFailed(&stats);
+
+  assert_false(MYRIOTA_UplinkStatsIsReportDue(&stats, TEST_WEEK_SECS, TEST_START_TIME + 3600));
+  assert_false(MYRIOTA_UplinkStatsIsReportDue(&stats, 0, TEST_START_TIME + TEST_WEEK_SECS));
+  const time_t now = TEST_START_TIME + TEST_WEEK_SECS;
+  assert_true(MYRIOTA_UplinkStatsIsReportDue(&stats, TEST_WEEK_SECS, now));
+
+  uint8_t frame[MYRIOTA_UPLINK_STATS_FRAME_SIZE];
+  MYRIOTA_UplinkStatsEncode(&stats, 3, now, frame);
+  assert_int_equal(frame[0], MYRIOTA_UPLINK_STATS_FRAME_TYPE);
+  assert_int_equal(frame[1], 3);
+  assert_int_equal(unpack_u16(&frame[2]) | unpack_u16(&frame[4]) << 16, TEST_START_TIME);
+  assert_int_equal(unpack_u16(&frame[6]), 1);
+  assert_int_equal(unpack_u16(&frame[8]), 1);
+  assert_int_equal(unpack_u16(&frame[10]), 0);
+  assert_int_equal(frame[12] | frame[13] << 8 | frame[14] << 16, 16);
+  assert_int_equal(unpack_u16(&frame[15]), 4);
+  assert_int_equal(frame[17], 5);
+  assert_int_equal(unpack_u16(&frame[18]), 0);
+
+  // The next window is empty, but the totals carry on.
+  assert_false(MYRIOTA_UplinkStatsIsReportDue(&stats, TEST_WEEK_SECS, now + 1));
+  MYRIOTA_UplinkStatsEncode(&stats, 4, now + TEST_WEEK_SECS, frame);
+  assert_int_equal(unpack_u16(&frame[6]), 0);
+  assert_int_equal(frame[17], MYRIOTA_UPLINK_STATS_SLOTS_UNKNOWN);
+  assert_int_equal(MYRIOTA_UplinkStatsTotalsGet(&stats)->sent, 1);
+}
+
+static void test_saturation(void **state) {
+  (void)state;
+  MYRIOTA_UplinkStats stats;
+  MYRIOTA_UplinkStatsInit(&stats, NULL, TEST_START_TIME);
+  for (uint32_t i = 0; i < UPLINK_STATS_U16_MAX + 10; ++i) {
+    MYRIOTA_UplinkStatsDeferred(&stats);
+  }
+  MYRIOTA_UplinkStatsSent(&stats, UPLINK_STATS_U24_MAX + 10, 0, 0);
+
+  uint8_t frame[MYRIOTA_UPLINK_STATS_FRAME_SIZE];
+  MYRIOTA_UplinkStatsEncode(&stats, 0, TEST_START_TIME, frame);
+  assert_int_equal(unpack_u16(&frame[10]), UPLINK_STATS_U16_MAX);
+  assert_int_equal(frame[12] | frame[13] << 8 | frame[14] << 16, UPLINK_STATS_U24_MAX);
+  assert_int_equal(frame[17], 0);
+}
+
+int main(void) {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_counters),
+    cmocka_unit_test(test_report),
+    cmocka_unit_test(test_saturation),
+  };
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
+#endif
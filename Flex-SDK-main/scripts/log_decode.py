@@ -0,0 +1,176 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+# Copyright (c) 2024, Myriota Pty Ltd, All Rights Reserved
+# SPDX-License-Identifier: BSD-3-Clause-Attribution
+#
+# This file is licensed under the BSD with attribution  (the "License"); you
+# may not use these files except in compliance with the License.
+#
+# You may obtain a copy of the License here:
+# LICENSE-BSD-3-Clause-Attribution.txt and at
+# https://spdx.org/licenses/BSD-3-Clause-Attribution.html
+#
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""Decodes the tokenised log records written by the Myriota log library.
+
+Records are flushed by the device as lines of "~L" followed by the record in
+hex. The token at the start of each record is the address of its format string
+in the ".myriota_log" section of the application ELF, which isn't loaded onto
+the device. Other lines are passed through unchanged.
+"""
+
+import re
+import struct
+import sys
+
+LOG_SECTION = ".myriota_log"
+LINE_PREFIX = "~L"
+DROPPED_TOKEN = 0
+LEVEL_NAMES = {"1": "ERROR", "2": "WARN", "3": "INFO", "4": "DEBUG"}
+
+_FORMAT_RE = re.compile(r"(\d):(.*?):(\d+):(.*)", re.DOTALL)
+_SPEC_RE = re.compile(r"%([-+ 0#]*)(\d*)(?:hh|h|ll|l)?([diuxXcH%])")
+
+
+def read_log_formats(elf_filename):
+    """Returns a dictionary of token to format string from an ELF."""
+    with open(elf_filename, "rb") as elf_file:
+        elf = elf_file.read()
+    if elf[:4] != b"\x7fELF":
+        raise ValueError("%s is not an ELF file" % elf_filename)
+    is_64 = elf[4] == 2
+    endian = "<" if elf[5] == 1 else ">"
+    if is_64:
+        shoff, = struct.unpack_from(endian + "Q", elf, 0x28)
+        shentsize, shnum, shstrndx = struct.unpack_from(endian + "HHH", elf, 0x3A)
+        header_format = endian + "IIQQQQIIQQ"
+    else:
+        shoff, = struct.unpack_from(endian + "I", elf, 0x20)
+        shentsize, shnum, shstrndx = struct.unpack_from(endian + "HHH", elf, 0x2E)
+        header_format = endian + "IIIIIIIIII"
+    sections = [
+        struct.unpack_from(header_format, elf, shoff + i * shentsize)
+        for i in range(shnum)
+    ]
+    names_offset = sections[shstrndx][4]
+
+    formats = {}
+    for name, _, _, address, offset, size, _, _, _, _ in sections:
+        name_end = elf.index(b"\0", names_offset + name)
+        if elf[names_offset + name : name_end].decode("ascii") != LOG_SECTION:
+            continue
+        data = elf[offset : offset + size]
+        start = 0
+        while start < len(data):
+            end = data.find(b"\0", start)
+            if end < 0:
+                end = len(data)
+            if end > start:
+                formats[address + start] = data[start:end].decode("utf-8", "replace")
+            start = end + 1
+    return formats
+
+
+def _varint(record, index):
+    value = 0
+    shift = 0
+    while index < len(record):
+        byte = record[index]
+        index += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value & 0xFFFFFFFF, index
+    raise ValueError("truncated varint")
+
+
+def format_record(format_string, record, index):
+    """Formats the arguments of a record starting at index."""
+    state = {"index": index}
+
+    def replace(match):
+        flags, width, conversion = match.groups()
+        if conversion == "%":
+            return "%"
+        if conversion == "H":
+            data = record[state["index"] :]
+            state["index"] = len(record)
+            return " ".join("%02X" % byte for byte in data)
+        value, state["index"] = _varint(record, state["index"])
+        if conversion in "di" and value & 0x80000000:
+            value -= 1 << 32
+        if conversion == "u":
+            conversion = "d"
+        return ("%" + flags + width + conversion) % value
+
+    return _SPEC_RE.sub(replace, format_string)
+
+
+class LogDecoder:
+    """Decodes lines of log records using the format strings from an ELF."""
+
+    def __init__(self, formats):
+        self.formats = formats
+
+    @classmethod
+    def from_elf(cls, elf_filename):
+        return cls(read_log_formats(elf_filename))
+
+    def decode_record(self, record):
+        token, index = _varint(record, 0)
+        if token == DROPPED_TOKEN:
+            count, _ = _varint(record, index)
+            return "[LOG] %d records dropped" % count
+        format_string = self.formats.get(token)
+        if format_string is None:
+            return "[LOG] unknown token 0x%X: %s" % (token, record.hex().upper())
+        match = _FORMAT_RE.match(format_string)
+        if match is None:
+            return format_record(format_string, record, index)
+        level, filename, line, message = match.groups()
+        return "[%s] %s:%s: %s" % (
+            LEVEL_NAMES.get(level, level),
+            filename,
+            line,
+            format_record(message, record, index),
+        )
+
+    def decode_line(self, line):
+        """Returns the line decoded if it is a log record else unchanged."""
+        stripped = line.rstrip("\r\n")
+        if not stripped.startswith(LINE_PREFIX):
+            return line
+        try:
+            record = bytes.fromhex(stripped[len(LINE_PREFIX) :])
+            return self.decode_record(record) + line[len(stripped) :]
+        except ValueError:
+            return line
+
+
+def main():
+    import argparse
+
+    parser = argparse.ArgumentParser(
+        description="Decode Myriota tokenised log output",
+    )
+    parser.add_argument("elf", help="application ELF FILE the log was written by", metavar="FILE")
+    parser.add_argument(
+        "input",
+        nargs="?",
+        help="FILE of captured output to decode, defaults to stdin",
+        metavar="FILE",
+    )
+    args = parser.parse_args()
+
+    decoder = LogDecoder.from_elf(args.elf)
+    input_file = open(args.input) if args.input else sys.stdin
+    with input_file:
+        for line in input_file:
+            sys.stdout.write(decoder.decode_line(line))
+            sys.stdout.flush()
+
+
+if __name__ == "__main__":
+    main()
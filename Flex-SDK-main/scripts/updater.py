@@ -797,6 +797,14 @@ def main():
         help="listen to serial port",
     )
 
+    parser.add_argument(
+        "-e",
+        "--elf",
+        dest="elf_name",
+        help="decode tokenised log output of the listened port with the application ELF FILE",
+        metavar="FILE",
+    )
+
     parser.add_argument(
         "-x",
         "--debug",
@@ -817,12 +825,23 @@ def main():
 
     args = parser.parse_args()
 
+    module_output = stdoutprint
+    if args.elf_name is not None:
+        from log_decode import LogDecoder
+
+        decoder = LogDecoder.from_elf(args.elf_name)
+
+        def decoded_output(line, end="\n"):
+            stdoutprint(decoder.decode_line(line), end=end)
+
+        module_output = decoded_output
+
     global updater
     updater = MyriotaModuleUpdate(
         connect_msg=stdoutprint,
         update_msg=stdoutprint,
         tx_progress=tx_progress,
-        module_output=stdoutprint,
+        module_output=module_output,
     )
 
     if args.list_ports_flag:
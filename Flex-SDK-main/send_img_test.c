@@ -6,14 +6,16 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "flex.h"
+#include "myriota/downlink.h"
+#include "myriota/log.h"
+#include "myriota/power_policy.h"
+#include "myriota/schc.h"
+#include "myriota/uplink_stats.h"
 
 #define APPLICATION_NAME "SCHC Image Sender"
 
-// configuracion SCHC para identificador de 6-bit
-#define MTU_SIZE 20                   // tamano maximo de paquete en bytes
+// configuracion SCHC, el formato de fragmentos esta en lib/schc
 #define RULE_ID 0x01                  // rule ID (2 bits)
-#define FCN_ALL1 0x3F                 // identificador para fragmento final (6 bits = 63 = All-1)
-#define MAX_FRAGMENTS 64              // maximo fragmentos permitidos (6 bits = 0-63)
 #define MAX_MESSAGES_PER_DAY 20       // limite diario de mensajes (conservador)
 
 // configuracion de imagen
@@ -21,12 +23,67 @@
 #define FRAGMENTS_PER_SESSION 20      // enviar 20 fragmentos por sesion (usar limite diario completo)
 #define HOURS_BETWEEN_SESSIONS 24     // esperar 24 horas entre sesiones (una vez por dia)
 
+// configuracion remota: valores por defecto arriba, modificables por downlink o FlexAssist
+#define CONF_HOURS_BETWEEN_SESSIONS FLEX_DIAG_CONF_ID_USER_0
+#define CONF_FRAGMENTS_PER_SESSION FLEX_DIAG_CONF_ID_USER_1
+#define CONF_STATS_REPORT_DAYS FLEX_DIAG_CONF_ID_USER_2
+
+// estadisticas de enlace visibles en FlexAssist, los totales persisten tras un reset
+#define STATS_REPORT_DAYS 7           // enviar estadisticas cada 7 dias (0 = desactivado)
+#define DIAG_MESSAGES_SENT FLEX_DIAG_CONF_ID_USER_3
+#define DIAG_SEND_FAILURES FLEX_DIAG_CONF_ID_USER_4
+#define DIAG_QUOTA_DEFERRALS FLEX_DIAG_CONF_ID_USER_5
+#define DIAG_PAYLOAD_BYTES FLEX_DIAG_CONF_ID_USER_6
+#define DIAG_PADDING_BYTES FLEX_DIAG_CONF_ID_USER_7
+#define DIAG_IMAGES_SENT FLEX_DIAG_CONF_ID_USER_8
+#define DIAG_SLOTS_FREE FLEX_DIAG_CONF_ID_USER_9
+
+// clang-format off
+FLEX_DIAG_CONF_TABLE_BEGIN()
+  FLEX_DIAG_CONF_TABLE_U32_ADD(CONF_HOURS_BETWEEN_SESSIONS, "Hours Between Sessions", HOURS_BETWEEN_SESSIONS, FLEX_DIAG_CONF_TYPE_CONF),
+  FLEX_DIAG_CONF_TABLE_U32_ADD(CONF_FRAGMENTS_PER_SESSION, "Fragments Per Session", FRAGMENTS_PER_SESSION, FLEX_DIAG_CONF_TYPE_CONF),
+  FLEX_DIAG_CONF_TABLE_U32_ADD(CONF_STATS_REPORT_DAYS, "Stats Report Days", STATS_REPORT_DAYS, FLEX_DIAG_CONF_TYPE_CONF),
+  FLEX_DIAG_CONF_TABLE_U32_ADD(DIAG_MESSAGES_SENT, "Messages Sent", 0, FLEX_DIAG_CONF_TYPE_PERSIST_DIAG),
+  FLEX_DIAG_CONF_TABLE_U32_ADD(DIAG_SEND_FAILURES, "Send Failures", 0, FLEX_DIAG_CONF_TYPE_PERSIST_DIAG),
+  FLEX_DIAG_CONF_TABLE_U32_ADD(DIAG_QUOTA_DEFERRALS, "Quota Deferrals", 0, FLEX_DIAG_CONF_TYPE_PERSIST_DIAG),
+  FLEX_DIAG_CONF_TABLE_U32_ADD(DIAG_PAYLOAD_BYTES, "Payload Bytes", 0, FLEX_DIAG_CONF_TYPE_PERSIST_DIAG),
+  FLEX_DIAG_CONF_TABLE_U32_ADD(DIAG_PADDING_BYTES, "Padding Bytes", 0, FLEX_DIAG_CONF_TYPE_PERSIST_DIAG),
+  FLEX_DIAG_CONF_TABLE_U32_ADD(DIAG_IMAGES_SENT, "Images Sent", 0, FLEX_DIAG_CONF_TYPE_PERSIST_DIAG),
+  FLEX_DIAG_CONF_TABLE_I32_ADD(DIAG_SLOTS_FREE, "Queue Slots Free", 0, FLEX_DIAG_CONF_TYPE_DIAG),
+FLEX_DIAG_CONF_TABLE_END();
+// clang-format on
+
+// rangos permitidos para comandos downlink, otros IDs no se pueden modificar
+static const MYRIOTA_DownlinkConfLimit downlink_limits[] = {
+    {.id = CONF_HOURS_BETWEEN_SESSIONS, .min = 1, .max = 7 * 24},
+    {.id = CONF_FRAGMENTS_PER_SESSION, .min = 1, .max = MAX_MESSAGES_PER_DAY},
+    {.id = CONF_STATS_REPORT_DAYS, .min = 0, .max = 90},
+};
+static MYRIOTA_Downlink downlink;
+
 // seguimiento de mensajes
 static uint16_t messages_sent_today = 0;
 static uint16_t current_fragment = 0;
 static bool transmission_complete = false;
 static uint16_t last_reset_day = 0;  // rastrear que dia reseteamos el contador por ultima vez
 
+// politica de energia: las imagenes solo se envian con alimentacion externa
+static MYRIOTA_PowerPolicy power_policy;
+
+// contadores de enlace: mensajes, fallos, cuota, bytes de relleno
+static MYRIOTA_UplinkStats uplink_stats;
+static uint8_t stats_sequence = 0;
+
+// leer un valor de configuracion, usando el valor por defecto si falla
+static uint32_t conf_get(const FLEX_DiagConfID id, const uint32_t default_value) {
+    uint32_t value = default_value;
+    if (FLEX_DiagConfValueRead(id, &value) != FLEX_SUCCESS) {
+        printf("Error leyendo configuración %d, usando %lu\n", id, (unsigned long)default_value);
+        value = default_value;
+    }
+    return value;
+}
+
 // datos de imagen embebidos
 // esto es un placeholder - necesitas convertir tu imagen a un arreglo C
 static const uint8_t compressed_image[711] = {
@@ -77,23 +134,6 @@ static const uint8_t compressed_image[711] = {
     0x08, 0x23, 0xB6, 0x58, 0x1F, 0xFF, 0xD9,  // Offset 02C0
 };
 
-//CRC-32 
-static uint32_t calculate_crc32(const uint8_t *data, uint16_t length) {
-    uint32_t crc = 0xFFFFFFFF;
-    
-    for (uint16_t i = 0; i < length; i++) {
-        crc ^= data[i];
-        for (uint8_t j = 0; j < 8; j++) {
-            if (crc & 1) {
-                crc = (crc >> 1) ^ 0xEDB88320;  // polinomio CRC-32
-            } else {
-                crc >>= 1;
-            }
-        }
-    }
-    return ~crc;
-}
-
 // verificar si podemos enviar mensajes hoy y resetear contador si es nuevo dia
 static bool can_send_messages_today(void) {
     time_t now = FLEX_TimeGet();
@@ -118,72 +158,78 @@ static bool can_send_messages_today(void) {
     return messages_sent_today < MAX_MESSAGES_PER_DAY;
 }
 
-// enviar fragmento SCHC con FCN de 6-bit 
-static int send_image_fragment(uint16_t fragment_num, uint16_t total_fragments, 
-                              const uint8_t *data, uint8_t data_len) {
-    uint8_t packet[MTU_SIZE];
-    memset(packet, 0, MTU_SIZE);
-    
-    bool is_final = (fragment_num == total_fragments - 1);
-    uint8_t fcn;
-    
-    if (is_final) {
-        // fragmento final siempre usa identificador 63 (patron All-1 para 6 bits)
-        fcn = FCN_ALL1;
+// publicar los totales en los diagnosticos para verlos en FlexAssist
+static void uplink_stats_publish(const int slots_free) {
+    const MYRIOTA_UplinkStatsCounters *const totals = MYRIOTA_UplinkStatsTotalsGet(&uplink_stats);
+    FLEX_DiagConfValueWrite(DIAG_MESSAGES_SENT, &totals->sent);
+    FLEX_DiagConfValueWrite(DIAG_SEND_FAILURES, &totals->failures);
+    FLEX_DiagConfValueWrite(DIAG_QUOTA_DEFERRALS, &totals->deferrals);
+    FLEX_DiagConfValueWrite(DIAG_PAYLOAD_BYTES, &totals->payload_bytes);
+    FLEX_DiagConfValueWrite(DIAG_PADDING_BYTES, &totals->padding_bytes);
+    FLEX_DiagConfValueWrite(DIAG_IMAGES_SENT, &totals->transfers);
+    const int32_t slots = slots_free;
+    FLEX_DiagConfValueWrite(DIAG_SLOTS_FREE, &slots);
+}
+
+// restaurar los totales persistidos para continuar contando tras un reset
+static void uplink_stats_restore(void) {
+    MYRIOTA_UplinkStatsCounters totals = {0};
+    FLEX_DiagConfValueRead(DIAG_MESSAGES_SENT, &totals.sent);
+    FLEX_DiagConfValueRead(DIAG_SEND_FAILURES, &totals.failures);
+    FLEX_DiagConfValueRead(DIAG_QUOTA_DEFERRALS, &totals.deferrals);
+    FLEX_DiagConfValueRead(DIAG_PAYLOAD_BYTES, &totals.payload_bytes);
+    FLEX_DiagConfValueRead(DIAG_PADDING_BYTES, &totals.padding_bytes);
+    FLEX_DiagConfValueRead(DIAG_IMAGES_SENT, &totals.transfers);
+    MYRIOTA_UplinkStatsInit(&uplink_stats, &totals, FLEX_TimeGet());
+}
+
+// programar un mensaje contando envios, fallos y bytes de relleno
+static int uplink_send(const uint8_t *const message, const size_t size, const size_t padding) {
+    const int result = FLEX_MessageSchedule(message, size);
+    const int slots_free = FLEX_MessageSlotsFree();
+    if (result == FLEX_SUCCESS) {
+        messages_sent_today++;
+        MYRIOTA_UplinkStatsSent(&uplink_stats, size - padding, padding, slots_free);
     } else {
-        // orden fijo: fragmento 0 = 62, fragmento 1 = 61, fragmento 2 = 60, etc.
-        // FCN siempre comienza en 62 y disminuye, sin importar total de fragmentos
-        fcn = 62 - fragment_num;
-        
-        // verificacion de seguridad: identificador debe estar en rango 0-62 para fragmentos normales
-        if (fcn > 62) {
-            printf("ERROR: Demasiados fragmentos para identificador de 6-bit! Fragmento %d necesitaría identificador %d\n", 
-                   fragment_num, fcn);
-            return -1;
-        }
+        MYRIOTA_UplinkStatsFailed(&uplink_stats);
     }
+    uplink_stats_publish(slots_free);
+    return result;
+}
+
+// registrar un envio retenido por el limite diario
+static void uplink_deferred(void) {
+    MYRIOTA_UplinkStatsDeferred(&uplink_stats);
+    uplink_stats_publish(FLEX_MessageSlotsFree());
+}
+
+// enviar fragmento SCHC con FCN de 6-bit
+// orden fijo: fragmento 0 = 62, fragmento 1 = 61, etc., el final siempre usa 63 (All-1)
+static int send_image_fragment(uint16_t fragment_num) {
+    uint8_t packet[MYRIOTA_SCHC_MTU];
+    size_t payload_size;
     
-    if (is_final) {
-        // fragmento final: RuleID(2)|FCN(6)|RCS(32)|payload|padding
-        uint32_t rcs = calculate_crc32(compressed_image, IMAGE_SIZE);
-        
-        // empacar: RuleID(2) + FCN(6) en byte 0, luego RCS(32) en bytes 1-4
-        packet[0] = (RULE_ID << 6) | (fcn & 0x3F);  // RuleID(2) + FCN[5:0]
-        packet[1] = (rcs >> 24) & 0xFF;  // RCS[31:24]
-        packet[2] = (rcs >> 16) & 0xFF;  // RCS[23:16]
-        packet[3] = (rcs >> 8) & 0xFF;   // RCS[15:8]
-        packet[4] = rcs & 0xFF;          // RCS[7:0]
-        
-        // copiar payload comenzando desde byte 5
-        uint8_t payload_space = MTU_SIZE - 5;  // 15 bytes para payload
-        uint8_t copy_len = (data_len <= payload_space) ? data_len : payload_space;
-        memcpy(&packet[5], data, copy_len);
-        
-        printf("Fragmento final %d: identificador=%d (All-1), RCS=0x%08lX, carga útil=%d bytes\n", 
-               fragment_num, fcn, (unsigned long)rcs, copy_len);
-    } else {
-        // fragmento normal: RuleID(2)|FCN(6)|payload
-        packet[0] = (RULE_ID << 6) | (fcn & 0x3F);  // RuleID(2) + FCN[5:0]
-        
-        // copiar payload comenzando desde byte 1
-        uint8_t payload_space = MTU_SIZE - 1;  // 19 bytes para payload
-        uint8_t copy_len = (data_len <= payload_space) ? data_len : payload_space;
-        memcpy(&packet[1], data, copy_len);
-        
-        printf("Fragmento %d: identificador=%d, carga útil=%d bytes\n", 
-               fragment_num, fcn, copy_len);
+    if (!MYRIOTA_SCHCFragmentEncode(RULE_ID, compressed_image, IMAGE_SIZE, fragment_num,
+                                    packet, &payload_size)) {
+        MYRIOTA_LOG_ERROR("Fragmento %u fuera de rango", fragment_num);
+        return -1;
     }
     
-    // imprimir el paquete binario exacto que se envia
-    printf("Paquete binario (20 bytes): ");
-    for (int i = 0; i < MTU_SIZE; i++) {
-        printf("%02X ", packet[i]);
+    MYRIOTA_SCHCFragment fragment;
+    MYRIOTA_SCHCFragmentDecode(packet, sizeof(packet), &fragment);
+    if (fragment.fcn == MYRIOTA_SCHC_FCN_ALL1) {
+        MYRIOTA_LOG_INFO("Fragmento final %u: identificador=%u (All-1), RCS=0x%08X, carga útil=%u bytes",
+                         fragment_num, fragment.fcn, fragment.rcs, payload_size);
+    } else {
+        MYRIOTA_LOG_INFO("Fragmento %u: identificador=%u, carga útil=%u bytes",
+                         fragment_num, fragment.fcn, payload_size);
     }
-    printf("\n");
     
-    printf("FLEX convertirá este binario a hex para transmisión satelital\n");
+    // registrar el paquete binario exacto que se envia, se decodifica en el host
+    MYRIOTA_LOG_BYTES("Paquete binario (20 bytes): %H", packet, MYRIOTA_SCHC_MTU);
     
-    return FLEX_MessageSchedule(packet, MTU_SIZE);
+    // el resto del espacio de carga util es relleno
+    return uplink_send(packet, MYRIOTA_SCHC_MTU, fragment.payload_size - payload_size);
 }
 
 // enviar lote de fragmentos de imagen
@@ -194,15 +240,17 @@ static void send_image_batch(void) {
     }
     
     // calcular fragmentos totales necesarios (FCN de 6-bit permite max 64 fragmentos: 0-63)
-    uint16_t fragments_needed = (IMAGE_SIZE + 18) / 19;  // 19 bytes por fragmento normal
+    const uint16_t fragments_needed = MYRIOTA_SCHCFragmentCount(IMAGE_SIZE);
     
     // verificar si cabe en FCN de 6-bit (max 64 fragmentos)
-    if (fragments_needed > MAX_FRAGMENTS) {
+    if (fragments_needed == 0) {
         printf("ERROR: Demasiados fragmentos para identificador de 6-bit (máx 63 fragmentos)\n");
         return;
     }
     
     uint16_t fragments_sent_this_session = 0;
+    const uint32_t fragments_per_session = conf_get(CONF_FRAGMENTS_PER_SESSION,
+                                                    FRAGMENTS_PER_SESSION);
     
     printf("=== SESIÓN DE TRANSMISIÓN DE IMAGEN (identificador de 6-bit) ===\n");
     printf("Tamaño de imagen: %d bytes\n", IMAGE_SIZE);
@@ -212,43 +260,35 @@ static void send_image_batch(void) {
     
     // enviar fragmentos en lotes
     while (current_fragment < fragments_needed && 
-           fragments_sent_this_session < FRAGMENTS_PER_SESSION &&
+           fragments_sent_this_session < fragments_per_session &&
            messages_sent_today < MAX_MESSAGES_PER_DAY) {
         
-        bool is_final = (current_fragment == fragments_needed - 1);
-        uint16_t offset = current_fragment * 19;  // 19 bytes por fragmento
-        uint8_t payload_size;
-        
-        if (is_final) {
-            // fragmento final - limitado por overhead de CRC (5 bytes: 1 header + 4 CRC)
-            uint16_t remaining = IMAGE_SIZE - offset;
-            payload_size = (remaining <= 15) ? remaining : 15;  // 15 bytes max para final
-        } else {
-            // fragmento normal (1 byte header)
-            uint16_t remaining = IMAGE_SIZE - offset;
-            payload_size = (remaining >= 19) ? 19 : remaining;
-        }
-        
-        int result = send_image_fragment(current_fragment, fragments_needed,
-                                       &compressed_image[offset], payload_size);
+        int result = send_image_fragment(current_fragment);
+        // volcar el registro una vez encolado el fragmento, fuera de la codificacion
+        MYRIOTA_LogFlush();
         
         if (result == 0) {
-            printf("Fragmento %d enviado exitosamente\n", current_fragment);
+            MYRIOTA_LOG_DEBUG("Fragmento %u enviado exitosamente", current_fragment);
             current_fragment++;
             fragments_sent_this_session++;
-            messages_sent_today++;
             
             if (current_fragment >= fragments_needed) {
                 transmission_complete = true;
+                MYRIOTA_UplinkStatsTransferComplete(&uplink_stats);
+                uplink_stats_publish(FLEX_MessageSlotsFree());
                 printf("=== TRANSMISIÓN DE IMAGEN COMPLETA ===\n");
                 break;
             }
         } else {
-            printf("Falló el envío del fragmento %d\n", current_fragment);
+            MYRIOTA_LOG_WARN("Falló el envío del fragmento %u", current_fragment);
             break;
         }
     }
     
+    if (!transmission_complete && messages_sent_today >= MAX_MESSAGES_PER_DAY) {
+        uplink_deferred();
+    }
+
     printf("Sesión completa: enviados %d fragmentos\n", fragments_sent_this_session);
     printf("Progreso: %d/%d fragmentos (%d%%)\n", 
            current_fragment, fragments_needed, 
@@ -256,12 +296,68 @@ static void send_image_batch(void) {
     printf("Mensajes enviados hoy: %d/%d\n", messages_sent_today, MAX_MESSAGES_PER_DAY);
 }
 
+// enviar estadisticas de enlace si el periodo configurado ha pasado
+static void send_stats_if_due(void) {
+    const uint32_t report_days = conf_get(CONF_STATS_REPORT_DAYS, STATS_REPORT_DAYS);
+    const time_t now = FLEX_TimeGet();
+    if (!MYRIOTA_UplinkStatsIsReportDue(&uplink_stats, report_days * 86400, now)) {
+        return;
+    }
+    if (!can_send_messages_today()) {
+        uplink_deferred();
+        return;
+    }
+    uint8_t frame[MYRIOTA_UPLINK_STATS_FRAME_SIZE];
+    MYRIOTA_UplinkStatsEncode(&uplink_stats, stats_sequence++, now, frame);
+    if (uplink_send(frame, sizeof(frame), 0) == FLEX_SUCCESS) {
+        printf("Estadísticas de enlace enviadas\n");
+    }
+}
+
+// actualizar politica de energia con el voltaje de bateria y el estado de alimentacion externa
+static void power_policy_update(void) {
+    bool is_external = false;
+    int32_t battery_mv = 0;
+    if (FLEX_IsOnExternalPower(&is_external) != FLEX_SUCCESS) {
+        return;
+    }
+    if (!is_external && FLEX_GetBatteryVoltage(&battery_mv) != FLEX_SUCCESS) {
+        battery_mv = 0;
+    }
+    MYRIOTA_PowerPolicyUpdate(&power_policy, battery_mv, is_external);
+}
+
+static time_t send_image_session(void);
+
+// al conectar alimentacion externa reanudar la transmision inmediatamente
+static void on_external_power(const bool *const is_external) {
+    MYRIOTA_PowerPolicyExternalPowerSet(&power_policy, *is_external);
+    if (*is_external) {
+        FLEX_JobSchedule(send_image_session, FLEX_ASAP());
+    }
+}
+
 // funcion principal de transmision
 static time_t send_image_session(void) {
+    const uint32_t hours_between_sessions = conf_get(CONF_HOURS_BETWEEN_SESSIONS,
+                                                     HOURS_BETWEEN_SESSIONS);
+
+    // las estadisticas son de bajo costo, se envian aunque no haya alimentacion externa
+    send_stats_if_due();
+
+    // enviar imagenes es de alto costo, solo con alimentacion externa
+    power_policy_update();
+    if (!MYRIOTA_PowerPolicyIsAllowed(&power_policy, MYRIOTA_POWER_COST_HIGH)) {
+        printf("Sin alimentación externa (batería %ld mV), transmisión pospuesta\n",
+               (long)MYRIOTA_PowerPolicyBatteryGet(&power_policy));
+        return FLEX_HoursFromNow(hours_between_sessions);
+    }
+
     // verificar limite diario con reset automatico
     if (!can_send_messages_today()) {
         printf("Límite diario de mensajes alcanzado (%d/%d)\n", 
                messages_sent_today, MAX_MESSAGES_PER_DAY);
+        uplink_deferred();
         return FLEX_HoursFromNow(24);  // intentar manana de nuevo
     }
     
@@ -273,33 +369,90 @@ static time_t send_image_session(void) {
         // no resetear messages_sent_today aqui - dejar que reset diario lo maneje
     }
     
-    // enviar lote de fragmentos
+    // enviar lote de fragmentos y volcar el registro al terminar la sesion
     send_image_batch();
+    MYRIOTA_LogFlush();
     
-    printf("Próxima sesión en %d horas\n", HOURS_BETWEEN_SESSIONS);
+    printf("Próxima sesión en %lu horas\n", (unsigned long)hours_between_sessions);
     printf("=================================\n\n");
     
     // programar siguiente sesion
-    return FLEX_HoursFromNow(HOURS_BETWEEN_SESSIONS);
+    return FLEX_HoursFromNow(hours_between_sessions);
+}
+
+// enviar el acuse del ultimo comando downlink, cuenta para el limite diario
+static time_t send_downlink_ack(void) {
+    uint8_t frame[MYRIOTA_DOWNLINK_ACK_FRAME_SIZE];
+    if (!MYRIOTA_DownlinkAckGet(&downlink, frame)) {
+        return FLEX_Never();
+    }
+    if (!can_send_messages_today()) {
+        printf("Límite diario alcanzado, acuse de comando %d descartado\n", frame[1]);
+        uplink_deferred();
+        return FLEX_Never();
+    }
+    if (uplink_send(frame, sizeof(frame), 0) == FLEX_SUCCESS) {
+        printf("Acuse de comando %d enviado (resultado %d)\n", frame[1], frame[3]);
+    }
+    return FLEX_Never();
+}
+
+static int downlink_conf_read(void *const ctx, const uint8_t id, uint32_t *const value) {
+    (void)ctx;
+    return FLEX_DiagConfValueRead(id, value);
+}
+
+static int downlink_conf_write(void *const ctx, const uint8_t id, const uint32_t value) {
+    (void)ctx;
+    return FLEX_DiagConfValueWrite(id, &value);
+}
+
+// acciones bajo demanda: solo se programa el trabajo, no se ejecuta en el handler
+static int downlink_trigger(void *const ctx, const uint8_t action) {
+    (void)ctx;
+    if (action != MYRIOTA_DOWNLINK_ACTION_IMAGE) {
+        return -1;
+    }
+    FLEX_JobSchedule(send_image_session, FLEX_ASAP());
+    return 0;
+}
+
+// recibir comandos downlink para reconfigurar el dispositivo remotamente
+static void on_message_received(uint8_t *const message, const int size) {
+    if (message == NULL || size <= 0) {
+        return;
+    }
+    const int result = MYRIOTA_DownlinkProcess(&downlink, message, size);
+    printf("Comando downlink recibido (%d bytes), resultado %d\n", size, result);
+    // un comando repetido vuelve a poner en cola el acuse anterior
+    FLEX_JobSchedule(send_downlink_ack, FLEX_ASAP());
+}
+
+// escribir las lineas del registro tokenizado en la consola de depuracion
+static void log_output(const char *const line) {
+    printf("%s", line);
 }
 
 void FLEX_AppInit() {
+    MYRIOTA_LogInit(log_output);
     printf("%s\n", APPLICATION_NAME);
     printf("=== configuracion identificador de 6-BIT ===\n");
     printf("Tamaño de imagen: %d bytes\n", IMAGE_SIZE);
-    printf("Tamaño MTU: %d bytes\n", MTU_SIZE);
-    printf("Máximo de fragmentos (identificador de 6-bit): %d (0-63)\n", MAX_FRAGMENTS);
-    printf("Identificador de fragmento final: %d (All-1)\n", FCN_ALL1);
-    printf("Fragmentos por sesión: %d\n", FRAGMENTS_PER_SESSION);
-    printf("Horas entre sesiones: %d\n", HOURS_BETWEEN_SESSIONS);
+    printf("Tamaño MTU: %d bytes\n", MYRIOTA_SCHC_MTU);
+    printf("Máximo de fragmentos (identificador de 6-bit): %d (0-63)\n", MYRIOTA_SCHC_FRAGMENTS_MAX);
+    printf("Identificador de fragmento final: %d (All-1)\n", MYRIOTA_SCHC_FCN_ALL1);
+    printf("Fragmentos por sesión: %lu\n",
+           (unsigned long)conf_get(CONF_FRAGMENTS_PER_SESSION, FRAGMENTS_PER_SESSION));
+    printf("Horas entre sesiones: %lu\n",
+           (unsigned long)conf_get(CONF_HOURS_BETWEEN_SESSIONS, HOURS_BETWEEN_SESSIONS));
     
     // calcular y mostrar requerimientos de fragmentos
-    uint16_t fragments_needed = (IMAGE_SIZE + 18) / 19;
+    const uint16_t fragments_needed = MYRIOTA_SCHCFragmentCount(IMAGE_SIZE);
     printf("Fragmentos requeridos para esta imagen: %d\n", fragments_needed);
     
-    if (fragments_needed > MAX_FRAGMENTS) {
-        printf("ERROR: ¡La imagen requiere %d fragmentos pero identificador de 6-bit solo permite %d!\n",
-               fragments_needed, MAX_FRAGMENTS);
+    if (fragments_needed == 0) {
+        printf("ERROR: ¡La imagen supera %d bytes, el máximo de %d fragmentos con identificador de 6-bit!\n",
+               MYRIOTA_SCHC_DATAGRAM_MAX, MYRIOTA_SCHC_FRAGMENTS_MAX);
         printf("Considera reducir el tamaño de imagen o usar fragmentos más grandes.\n");
         return;
     }
@@ -310,6 +463,25 @@ void FLEX_AppInit() {
     time_t now = FLEX_TimeGet();
     last_reset_day = (uint16_t)(now / 86400);
     printf("Inicializado en día %d\n", last_reset_day);
+
+    // continuar los contadores de enlace desde los diagnosticos persistentes
+    uplink_stats_restore();
+
+    // inicializar politica de energia y suscribirse a cambios de alimentacion externa
+    const MYRIOTA_PowerPolicyConfig power_config = MYRIOTA_POWER_POLICY_DEFAULT_CONFIG;
+    MYRIOTA_PowerPolicyInit(&power_policy, power_config);
+    FLEX_OnExternalPowerHandlerSet(on_external_power);
+
+    // inicializar comandos downlink para cambiar la cadencia sin reflashear
+    const MYRIOTA_DownlinkInterface downlink_interface = {
+        .ctx = NULL,
+        .conf_read = downlink_conf_read,
+        .conf_write = downlink_conf_write,
+        .trigger = downlink_trigger,
+    };
+    MYRIOTA_DownlinkInit(&downlink, downlink_interface, downlink_limits,
+                         sizeof(downlink_limits) / sizeof(*downlink_limits));
+    FLEX_MessageReceiveHandlerModify(on_message_received, FLEX_HANDLER_MODIFY_ADD);
     
     printf("Iniciando transmisión de imagen con identificador de 6-bit...\n\n");
     
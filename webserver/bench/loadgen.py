@@ -0,0 +1,341 @@
+#!/usr/bin/env python3
+"""
+Webhook Load Generator
+Sends Myriota webhook messages to a local server at a fixed rate and reports
+throughput, latency percentiles, ingest drain time and storage growth
+
+Messages are either replayed from stored records (the raw_data of each saved
+packet, from sensor folders or JSON files) or synthesised for a fleet of
+virtual terminals sending temperature, battery and SCHC image fragments.
+Requests are scheduled open loop: latency is measured from when a request was
+due, so a slow server shows up as latency rather than a lower send rate.
+
+Usage:
+    loadgen.py --terminals 200 --rate 50 --duration 60
+    loadgen.py --replay ../flasksv/sensor_data/flex_5e92a51c --rate 20
+"""
+
+import argparse
+import glob
+import http.client
+import json
+import math
+import os
+import queue
+import random
+import sys
+import threading
+import time
+import urllib.parse
+import uuid
+from typing import Dict, List, Optional
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "flasksv"))
+from packet_store import PacketStore, SEGMENTS_DIRNAME
+from schc_codec import encode_fragments
+
+DEFAULT_URL = "http://localhost:5000"
+DEFAULT_DATA_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "flasksv", "sensor_data")
+PERCENTILES = (50, 90, 99, 99.9)
+# Share of synthetic packets of each kind
+SYNTHETIC_MIX = {"temperature": 0.6, "battery": 0.2, "schc": 0.2}
+SCHC_RULE_ID = 0x01
+SCHC_IMAGE_BYTES = 200
+
+def load_replay_bodies(paths: List[str]) -> List[Dict]:
+    """Load the webhook bodies of stored records from JSON files and sensor folders"""
+    bodies = []
+    for path in paths:
+        files = [path] if os.path.isfile(path) else glob.glob(
+            os.path.join(path, "**", "*.json"), recursive=True)
+        for filepath in sorted(files):
+            try:
+                with open(filepath, 'r', encoding='utf-8') as file:
+                    record = json.load(file)
+            except (OSError, ValueError) as e:
+                print(f"   ⚠️  Skipping {filepath}: {e}")
+                continue
+            bodies.append(record.get('raw_data', record))
+
+        # Records saved since the packet store was added, read only as the
+        # server may be appending to them
+        for segments in glob.glob(os.path.join(path, "**", SEGMENTS_DIRNAME), recursive=True):
+            sensor_path = os.path.dirname(os.path.abspath(segments))
+            device_path, sensor_id = os.path.split(sensor_path)
+            base_dir, device_id = os.path.split(device_path)
+            store = PacketStore(base_dir, read_only=True)
+            for _, _, record in store.range(device_id, sensor_id):
+                bodies.append(record.get('raw_data', record))
+            store.close()
+
+    # Only Myriota messages can be replayed to /myriota
+    return [body for body in bodies if isinstance(body, dict) and 'Data' in body]
+
+class Fleet:
+    """Virtual terminals producing synthetic Myriota messages"""
+
+    def __init__(self, terminals: int, packets_per_message: int, seed: int):
+        self.random = random.Random(seed)
+        self.terminals = [f"bench{i:08x}" for i in range(terminals)]
+        self.packets_per_message = packets_per_message
+        self.lock = threading.Lock()
+        # Fragments still to be sent of each terminal's current image
+        self.fragments = {}
+
+    def _packet(self, terminal_id: str) -> str:
+        kind = self.random.choices(list(SYNTHETIC_MIX), weights=list(SYNTHETIC_MIX.values()))[0]
+        if kind == "temperature":
+            return "01" + int(self.random.gauss(220, 40)).to_bytes(2, 'big', signed=True).hex()
+        if kind == "battery":
+            return "04" + self.random.randint(3300, 4200).to_bytes(2, 'big').hex()
+        pending = self.fragments.get(terminal_id)
+        if not pending:
+            image = bytes(self.random.getrandbits(8) for _ in range(SCHC_IMAGE_BYTES))
+            pending = self.fragments[terminal_id] = encode_fragments(SCHC_RULE_ID, image)
+        return pending.pop(0).hex()
+
+    def message(self) -> Dict:
+        with self.lock:
+            terminal_id = self.random.choice(self.terminals)
+            now_ms = int(time.time() * 1000)
+            packets = [{"Timestamp": now_ms, "TerminalId": terminal_id, "Value": self._packet(terminal_id)}
+                       for _ in range(self.packets_per_message)]
+        return {
+            "Timestamp": int(time.time()),
+            "Id": str(uuid.uuid4()),
+            "Data": json.dumps({"Packets": packets}),
+            "EndpointRef": "loadgen",
+        }
+
+class Replay:
+    """Recorded messages, sent round robin with fresh Ids unless kept"""
+
+    def __init__(self, bodies: List[Dict], keep_ids: bool):
+        self.bodies = bodies
+        self.keep_ids = keep_ids
+        self.next = 0
+        self.lock = threading.Lock()
+
+    def message(self) -> Dict:
+        with self.lock:
+            body = self.bodies[self.next % len(self.bodies)]
+            self.next += 1
+        return body if self.keep_ids else dict(body, Id=str(uuid.uuid4()))
+
+class Client:
+    """A keep-alive connection to the server, reopened when it closes"""
+
+    def __init__(self, url: str, timeout: float):
+        parsed = urllib.parse.urlsplit(url)
+        self.connection_class = (http.client.HTTPSConnection if parsed.scheme == "https"
+                                 else http.client.HTTPConnection)
+        self.netloc = parsed.netloc
+        self.timeout = timeout
+        self.connection = None
+
+    def request(self, method: str, path: str, body: Optional[bytes] = None):
+        if self.connection is None:
+            self.connection = self.connection_class(self.netloc, timeout=self.timeout)
+        try:
+            self.connection.request(method, path, body=body,
+                                    headers={"Content-Type": "application/json"})
+            response = self.connection.getresponse()
+            data = response.read()
+        except (OSError, http.client.HTTPException):
+            self.connection.close()
+            self.connection = None
+            raise
+        if response.will_close:
+            self.connection.close()
+            self.connection = None
+        return response.status, data
+
+def storage_kind(root: str, name: str) -> str:
+    """What a file in the data folder holds"""
+    parts = root.split(os.sep)
+    if SEGMENTS_DIRNAME in parts:
+        return "packet_store"
+    if "series" in parts:
+        return "series"
+    if ".db" in name:
+        return "databases"
+    return "other"
+
+def storage_sizes(path: str) -> Dict[str, int]:
+    """Bytes used in the data folder by kind of file"""
+    sizes = {"packet_store": 0, "series": 0, "databases": 0, "other": 0}
+    for root, _, files in os.walk(path):
+        for name in files:
+            try:
+                sizes[storage_kind(root, name)] += os.path.getsize(os.path.join(root, name))
+            except OSError:
+                pass
+    return sizes
+
+def percentile(values: List[float], p: float) -> Optional[float]:
+    """Nearest rank percentile of sorted values"""
+    if not values:
+        return None
+    rank = max(1, math.ceil(p / 100 * len(values)))
+    return values[rank - 1]
+
+def run_load(url: str, source, rate: float, duration: float, concurrency: int, timeout: float) -> Dict:
+    """Send messages at rate per second for duration seconds, returning the results"""
+    due = queue.Queue()
+    lock = threading.Lock()
+    latencies, service_times, statuses, errors = [], [], {}, []
+
+    def worker():
+        client = Client(url, timeout)
+        while True:
+            scheduled = due.get()
+            if scheduled is None:
+                return
+            body = json.dumps(source.message()).encode('utf-8')
+            sent = time.perf_counter()
+            try:
+                status, _ = client.request("POST", "/myriota", body)
+            except (OSError, http.client.HTTPException) as e:
+                status = None
+                with lock:
+                    errors.append(str(e))
+            finished = time.perf_counter()
+            with lock:
+                statuses[status] = statuses.get(status, 0) + 1
+                if status is not None and status < 500:
+                    latencies.append(finished - scheduled)
+                    service_times.append(finished - sent)
+
+    threads = [threading.Thread(target=worker, daemon=True) for _ in range(concurrency)]
+    for thread in threads:
+        thread.start()
+
+    # Open loop: requests are due every 1 / rate seconds whatever the server does
+    start = time.perf_counter()
+    count = int(rate * duration)
+    for i in range(count):
+        scheduled = start + i / rate
+        delay = scheduled - time.perf_counter()
+        if delay > 0:
+            time.sleep(delay)
+        due.put(scheduled)
+    for _ in threads:
+        due.put(None)
+    for thread in threads:
+        thread.join()
+    elapsed = time.perf_counter() - start
+
+    latencies.sort()
+    service_times.sort()
+    answered = sum(n for status, n in statuses.items() if status is not None and status < 500)
+    return {
+        "requested": count,
+        "rate": rate,
+        "elapsed_secs": round(elapsed, 3),
+        "throughput": round(answered / elapsed, 2) if elapsed else None,
+        "statuses": {str(status): n for status, n in sorted(statuses.items(), key=str)},
+        "errors": errors[:10],
+        "latency_ms": {f"p{p:g}": round(percentile(latencies, p) * 1000, 2)
+                       for p in PERCENTILES if latencies},
+        "latency_max_ms": round(latencies[-1] * 1000, 2) if latencies else None,
+        "service_ms": {f"p{p:g}": round(percentile(service_times, p) * 1000, 2)
+                       for p in PERCENTILES if service_times},
+    }
+
+def wait_for_drain(url: str, timeout: float) -> Optional[float]:
+    """Wait for the ingest queue to empty, returning how long it took or None"""
+    client = Client(url, 10)
+    start = time.perf_counter()
+    while time.perf_counter() - start < timeout:
+        try:
+            status, data = client.request("GET", "/api/ingest")
+        except (OSError, http.client.HTTPException):
+            return None
+        if status != 200:
+            return None
+        stats = json.loads(data)
+        if stats.get("pending", 0) == 0 and stats.get("processing", 0) == 0:
+            return time.perf_counter() - start
+        time.sleep(0.2)
+    return None
+
+def main():
+    """Main load generation function"""
+    parser = argparse.ArgumentParser(description="Myriota webhook load generator")
+    parser.add_argument("--url", default=DEFAULT_URL, help="server URL")
+    parser.add_argument("--replay", nargs="+", metavar="PATH",
+                        help="JSON files or sensor_data folders to replay instead of a synthetic fleet")
+    parser.add_argument("--keep-ids", action="store_true",
+                        help="replay messages with their recorded Ids, which the server drops as duplicates")
+    parser.add_argument("--terminals", type=int, default=100, help="virtual terminals")
+    parser.add_argument("--packets", type=int, default=1, help="packets per synthetic message")
+    parser.add_argument("--rate", type=float, default=20, help="messages per second")
+    parser.add_argument("--duration", type=float, default=30, help="seconds to send for")
+    parser.add_argument("--concurrency", type=int, default=16, help="connections sending at once")
+    parser.add_argument("--timeout", type=float, default=30, help="request timeout in seconds")
+    parser.add_argument("--drain-timeout", type=float, default=300,
+                        help="seconds to wait for queued messages to be processed (0 to skip)")
+    parser.add_argument("--data-dir", default=DEFAULT_DATA_DIR, help="server data folder, for storage growth")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--json", metavar="FILE", help="also write the results to FILE")
+    args = parser.parse_args()
+
+    print("🚀 Webhook Load Generator")
+    print("=" * 50)
+
+    if args.replay:
+        bodies = load_replay_bodies(args.replay)
+        if not bodies:
+            print("❌ No Myriota messages found to replay!")
+            return 1
+        source = Replay(bodies, args.keep_ids)
+        print(f"📂 Replaying {len(bodies)} recorded messages")
+    else:
+        source = Fleet(args.terminals, args.packets, args.seed)
+        print(f"🛰️  Simulating {args.terminals} terminals, {args.packets} packets per message")
+    print(f"🎯 {args.rate:g} messages/s for {args.duration:g} s to {args.url}")
+
+    storage_before = storage_sizes(args.data_dir) if os.path.isdir(args.data_dir) else None
+    results = run_load(args.url, source, args.rate, args.duration, args.concurrency, args.timeout)
+    if args.drain_timeout > 0:
+        drain = wait_for_drain(args.url, args.drain_timeout)
+        results["drain_secs"] = round(drain, 3) if drain is not None else None
+        if drain is not None:
+            accepted = results["statuses"].get("202", 0)
+            results["ingest_throughput"] = round(accepted / (results["elapsed_secs"] + drain), 2)
+    if storage_before is not None:
+        storage_after = storage_sizes(args.data_dir)
+        results["storage_growth_by_kind"] = {
+            kind: storage_after[kind] - storage_before[kind] for kind in storage_after}
+        growth = sum(results["storage_growth_by_kind"].values())
+        results["storage_growth_bytes"] = growth
+        if results["requested"]:
+            results["storage_bytes_per_message"] = round(growth / results["requested"], 1)
+
+    print("\n📊 Results:")
+    print(f"   - Requests: {results['requested']} in {results['elapsed_secs']} s")
+    print(f"   - Throughput: {results['throughput']} answered/s")
+    print(f"   - Status codes: {results['statuses']}")
+    for error in results["errors"]:
+        print(f"   ❌ {error}")
+    print(f"   - Latency (ms, from due time): {results['latency_ms']} max {results['latency_max_ms']}")
+    print(f"   - Service time (ms, from send): {results['service_ms']}")
+    if "drain_secs" in results:
+        if results["drain_secs"] is None:
+            print("   ⚠️  Ingest queue didn't drain (or /api/ingest unavailable)")
+        else:
+            print(f"   - Ingest queue drained {results['drain_secs']} s after sending, "
+                  f"{results['ingest_throughput']} messages/s end to end")
+    if "storage_growth_bytes" in results:
+        print(f"   - Storage growth: {results['storage_growth_bytes']} bytes, "
+              f"{results.get('storage_bytes_per_message')} per message")
+        print(f"     {results['storage_growth_by_kind']}")
+
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump(dict(results, args=vars(args)), f, indent=2)
+        print(f"💾 Results written to {args.json}")
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -3,60 +3,48 @@
 SCHC NO-ACK Defragmentation Script
 Reads JSON files from FlexSense sensor data and reconstructs fragmented messages
 Based on RFC 8724 - Static Context Header Compression and Fragmentation
+
+Fragments are grouped into datagrams in the order they were received, as the
+server does (see flasksv/schc.py), so a device's folder can hold any number of
+them. Usage: defrag.py [sensor folder]
 """
 
 import json
 import os
+import sys
 import glob
-from typing import List, Dict, Optional, Tuple
-import struct
+from typing import Dict, Iterator, List
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "flasksv"))
+from metadata_index import legacy_received
+from packet_store import PacketStore, SEGMENTS_DIRNAME, record_filename
+from schc import group_fragments
+from schc_codec import FCN_ALL1, decode_fragment
 
-# SCHC Configuration (matching sender)
-RULE_ID = 0x01
-FCN_FINAL = 0x3F  # 111111 (6 bits)
-MTU_SIZE = 20
+# The fragment layout (matching sender) is in Flex-SDK-main/lib/schc
+DEFAULT_SENSOR_PATH = "flasksv/sensor_data/flex_5e92a51c/sensor_generic"
 
 class SCHCFragment:
     """Represents a SCHC fragment"""
-    def __init__(self, hex_value: str, filename: str, timestamp: str):
+    def __init__(self, hex_value: str, filename: str, received: float):
         self.hex_value = hex_value
         self.filename = filename
-        self.timestamp = timestamp
+        self.received = received
         self.raw_bytes = bytes.fromhex(hex_value)
         
-        # Parse header
-        self.rule_id = (self.raw_bytes[0] >> 6) & 0x03  # Upper 2 bits
-        self.fcn = self.raw_bytes[0] & 0x3F  # Lower 6 bits
-        self.is_final = (self.fcn == FCN_FINAL)
-        
-        if self.is_final:
-            # Final fragment: RuleID(2)|FCN(6)|RCS(32)|payload
-            self.rcs = struct.unpack('>I', self.raw_bytes[1:5])[0]  # Big-endian 32-bit
-            self.payload_start = 5
-            self.payload = self.raw_bytes[5:]
-        else:
-            # Normal fragment: RuleID(2)|FCN(6)|payload
-            self.rcs = None
-            self.payload_start = 1
-            self.payload = self.raw_bytes[1:]
+        # Parse header: RuleID(2)|FCN(6), then RCS(32) if final, then payload
+        fragment = decode_fragment(self.raw_bytes)
+        if fragment is None:
+            raise ValueError(f"fragment too short: {hex_value}")
+        self.rule_id = fragment["rule_id"]
+        self.fcn = fragment["fcn"]
+        self.is_final = (self.fcn == FCN_ALL1)
+        self.rcs = fragment["rcs"]
+        self.payload = fragment["payload"]
             
     def __repr__(self):
         return f"SCHCFragment(fcn={self.fcn}, final={self.is_final}, rcs={self.rcs}, payload_len={len(self.payload)})"
 
-def calculate_crc32(data: bytes) -> int:
-    """Calculate CRC-32 as used in SCHC (matching sender implementation)"""
-    crc = 0xFFFFFFFF
-    
-    for byte in data:
-        crc ^= byte
-        for _ in range(8):
-            if crc & 1:
-                crc = (crc >> 1) ^ 0xEDB88320  # CRC-32 polynomial
-            else:
-                crc >>= 1
-    
-    return (~crc) & 0xFFFFFFFF
-
 def read_json_files(directory_path: str) -> List[Dict]:
     """Read all JSON files from the specified directory"""
     json_files = []
@@ -70,11 +58,29 @@ def read_json_files(directory_path: str) -> List[Dict]:
                 data = json.load(file)
                 data['_filepath'] = filepath
                 data['_filename'] = os.path.basename(filepath)
+                data['_received'] = legacy_received(directory_path, data['_filename'])
                 json_files.append(data)
                 print(f"   ✅ Loaded: {os.path.basename(filepath)}")
         except Exception as e:
             print(f"   ❌ Error loading {filepath}: {e}")
     
+    # Packets received since the packet store was added are kept in segments
+    if os.path.isdir(os.path.join(directory_path, SEGMENTS_DIRNAME)):
+        sensor_path = os.path.abspath(directory_path)
+        device_path, sensor_id = os.path.split(sensor_path)
+        base_dir, device_id = os.path.split(device_path)
+        # Read only, so a server appending to the same segments isn't disturbed
+        store = PacketStore(base_dir, read_only=True)
+        for sequence, received, data in store.range(device_id, sensor_id):
+            data['_filepath'] = store.record_path(device_id, sensor_id, sequence)
+            data['_filename'] = record_filename(sequence)
+            data['_received'] = received
+            json_files.append(data)
+        print(f"   ✅ Loaded {store.count(device_id, sensor_id)} stored records")
+        store.close()
+    
+    # Fragments are grouped in the order they were received
+    json_files.sort(key=lambda data: (data['_received'], data['_filename']))
     print(f"📁 Found {len(json_files)} JSON files")
     return json_files
 
@@ -104,7 +110,7 @@ def extract_fragments(json_files: List[Dict]) -> List[SCHCFragment]:
                     fragment = SCHCFragment(
                         hex_value=hex_value,
                         filename=json_data['_filename'],
-                        timestamp=json_data.get('timestamp', '')
+                        received=json_data['_received']
                     )
                     fragments.append(fragment)
                     print(f"   📦 Fragment FCN={fragment.fcn} from {fragment.filename}")
@@ -115,114 +121,28 @@ def extract_fragments(json_files: List[Dict]) -> List[SCHCFragment]:
     print(f"🔢 Total fragments extracted: {len(fragments)}")
     return fragments
 
-def validate_and_sort_fragments(fragments: List[SCHCFragment]) -> Tuple[List[SCHCFragment], bool]:
-    """Validate fragment completeness and sort them by FCN"""
-    print("\n🔍 Validating fragments...")
-    
-    if not fragments:
-        print("   ❌ No fragments found!")
-        return [], False
-    
-    # Find final fragment
-    final_fragment = None
-    normal_fragments = []
-    
-    for fragment in fragments:
-        if fragment.is_final:
-            if final_fragment is None:
-                final_fragment = fragment
-                print(f"   🏁 Final fragment found: FCN={fragment.fcn}, RCS=0x{fragment.rcs:08X}")
-            else:
-                print(f"   ⚠️  Multiple final fragments found!")
-        else:
-            normal_fragments.append(fragment)
-    
-    if final_fragment is None:
-        print("   ❌ No final fragment found - cannot determine expected fragment count")
-        return [], False
-    
-    # Sort normal fragments by FCN
-    normal_fragments.sort(key=lambda f: f.fcn)
-    
-    # Validate sequence
-    expected_fcn = 0
-    missing_fragments = []
-    
-    for fragment in normal_fragments:
-        if fragment.fcn != expected_fcn:
-            # Check for missing fragments
-            while expected_fcn < fragment.fcn:
-                missing_fragments.append(expected_fcn)
-                expected_fcn += 1
-        expected_fcn += 1
-    
-    if missing_fragments:
-        print(f"   ❌ Missing fragments with FCN: {missing_fragments}")
-        return [], False
-    
-    # Create sorted list: normal fragments + final fragment
-    sorted_fragments = normal_fragments + [final_fragment]
-    
-    print(f"   ✅ Fragment sequence is complete")
-    print(f"   📋 Fragment order: {[f.fcn for f in sorted_fragments]}")
-    
-    return sorted_fragments, True
-
-def reassemble_message(fragments: List[SCHCFragment]) -> Optional[str]:
-    """Reassemble the original message from fragments"""
-    print("\n🔧 Reassembling message...")
-    
-    if not fragments:
-        print("   ❌ No fragments to reassemble")
-        return None
-    
-    # Concatenate payloads
-    full_payload = bytearray()
-    
-    for i, fragment in enumerate(fragments):
-        payload_to_add = fragment.payload
-        
-        # Remove null padding from payload
-        while payload_to_add and payload_to_add[-1] == 0:
-            payload_to_add = payload_to_add[:-1]
-        
-        full_payload.extend(payload_to_add)
-        print(f"   📦 Added {len(payload_to_add)} bytes from fragment FCN={fragment.fcn}")
-    
-    print(f"   🔗 Total payload length: {len(full_payload)} bytes")
-    
-    # Find final fragment for CRC verification
-    final_fragment = None
-    for fragment in fragments:
-        if fragment.is_final:
-            final_fragment = fragment
-            break
-    
-    if final_fragment:
-        # Calculate CRC of the reassembled payload
-        calculated_crc = calculate_crc32(bytes(full_payload))
-        expected_crc = final_fragment.rcs
-        
+def group_datagrams(device_id: str, fragments: List[SCHCFragment]) -> Iterator[Dict]:
+    """Group fragments into datagrams and check each one's CRC"""
+    print("\n🔧 Grouping fragments into datagrams...")
+    
+    frames = ((fragment.received, fragment.raw_bytes) for fragment in fragments)
+    for datagram in group_fragments(device_id, frames):
+        print(f"\n   📨 Datagram of rule {datagram['rule_id']}: {datagram['status']}, "
+              f"{datagram['fragments']} fragments, {datagram['length']} bytes")
+        if datagram['duplicates']:
+            print(f"   ♻️  Ignored {datagram['duplicates']} duplicate fragments")
+        if datagram['missing_fcns']:
+            print(f"   ❌ Missing fragments with FCN: {datagram['missing_fcns']}")
+        if not datagram['final_received']:
+            print("   ❌ No final fragment found")
         print(f"   🔐 CRC verification:")
-        print(f"      Expected: 0x{expected_crc:08X}")
-        print(f"      Calculated: 0x{calculated_crc:08X}")
-        
-        if calculated_crc == expected_crc:
+        print(f"      Expected: {datagram['rcs']}")
+        print(f"      Calculated: {datagram['calculated_crc']}")
+        if datagram['crc_ok']:
             print("   ✅ CRC verification PASSED")
         else:
-            print("   ❌ CRC verification FAILED - message may be corrupted")
-            return None
-    
-    # Convert to string (assuming it's text)
-    try:
-        message = full_payload.decode('utf-8').rstrip('\x00')
-        print(f"   📝 Decoded message: \"{message}\"")
-        return message
-    except UnicodeDecodeError:
-        print("   ⚠️  Message is not valid UTF-8, showing as hex:")
-        hex_message = full_payload.hex()
-        print(f"   📝 Hex message: {hex_message}")
-        return hex_message
+            print("   ❌ CRC verification FAILED - datagram is incomplete or corrupted")
+        yield datagram
 
 def main():
     """Main defragmentation function"""
@@ -230,7 +150,8 @@ def main():
     print("=" * 50)
     
     # Path to sensor data
-    sensor_data_path = "flasksv/sensor_data/flex_5e92a51c/sensor_generic"
+    sensor_data_path = sys.argv[1] if len(sys.argv) > 1 else DEFAULT_SENSOR_PATH
+    device_id = os.path.basename(os.path.dirname(os.path.abspath(sensor_data_path)))
     
     if not os.path.exists(sensor_data_path):
         print(f"❌ Error: Directory not found: {sensor_data_path}")
@@ -251,27 +172,24 @@ def main():
         print("❌ No fragments extracted!")
         return
     
-    # Step 3: Validate and sort fragments
-    sorted_fragments, is_valid = validate_and_sort_fragments(fragments)
-    if not is_valid:
-        print("❌ Fragment validation failed!")
-        return
-    
-    # Step 4: Reassemble message
-    message = reassemble_message(sorted_fragments)
+    # Step 3: Group fragments into datagrams and reassemble them
+    datagrams = list(group_datagrams(device_id, fragments))
+    messages = [datagram for datagram in datagrams if datagram['crc_ok']]
     
-    if message:
+    if messages:
         print("\n🎉 SUCCESS!")
         print("=" * 50)
-        print(f"📄 Reconstructed message:")
-        print(f'   "{message}"')
+        for datagram in messages:
+            message = datagram.get('text', datagram['payload_hex'])
+            print(f"📄 Reconstructed message:")
+            print(f'   "{message}"')
         print(f"📊 Statistics:")
-        print(f"   - Total fragments: {len(sorted_fragments)}")
-        print(f"   - Message length: {len(message)} characters")
+        print(f"   - Total fragments: {len(fragments)}")
+        print(f"   - Datagrams reconstructed: {len(messages)} of {len(datagrams)}")
         print(f"   - Files processed: {len(json_files)}")
     else:
         print("\n❌ FAILED!")
-        print("Could not reconstruct the message.")
+        print("Could not reconstruct any message.")
 
 if __name__ == "__main__":
     main()
@@ -1,9 +1,17 @@
-from flask import Flask, request, render_template, jsonify, send_file
+from flask import Flask, request, render_template, jsonify
 from datetime import datetime
+import base64
 import os
 import json
 import urllib.parse
 import shutil
+import threading
+import time
+from packet_store import PacketStore, record_filename
+from metadata_index import MetadataIndex
+from ingest_queue import IngestQueue, IngestWorkers
+from schc import SCHCReassembler
+from timeseries import TimeSeriesStore
 
 app = Flask(__name__)
 
@@ -18,31 +26,194 @@ app.config['PREFERRED_URL_SCHEME'] = 'https'
 BASE_DATA_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "sensor_data")
 os.makedirs(BASE_DATA_DIR, exist_ok=True)
 
+# Packets are appended to per sensor segment files (see packet_store.py).
+# Sensor folders may also hold data_<timestamp>.json files saved one per packet
+# before the store was added, which are still listed and served.
+packet_store = PacketStore(BASE_DATA_DIR)
+# Counts, time ranges and listings are served from the metadata index, which is
+# updated whenever data is saved or deleted rather than rescanning the tree
+metadata_index = MetadataIndex(BASE_DATA_DIR, packet_store)
+# Decoded readings are also appended to per metric time series with hourly and
+# daily rollups (see timeseries.py), which /api/series queries
+series_store = TimeSeriesStore(BASE_DATA_DIR)
+SERIES_METRICS = {
+    "temperature": ["temperature_celsius"],
+    "humidity": ["humidity_percent"],
+    "pressure": ["pressure_pa"],
+    "battery": ["battery_mv"],
+    "gps": ["latitude", "longitude"],
+    "uplink_stats": ["messages_sent", "messages_failed", "messages_deferred",
+                     "payload_bytes", "padding_bytes", "min_slots_free",
+                     "transfers_completed", "padding_ratio"],
+}
+# Sensor listings are paged, newest first
+SENSOR_PAGE_SIZE = 100
+SENSOR_PAGE_MAX = 1000
+# Records never change once saved, so browsers and proxies may cache them
+RECORD_MAX_AGE_SECS = 24 * 3600
+# Threads processing queued webhook messages
+INGEST_WORKERS = 4
+# SCHC fragments are reassembled as they are received, and the datagrams saved
+# to the device's schc_datagram sensor (see schc.py)
+schc_reassembler = SCHCReassembler(BASE_DATA_DIR)
+SCHC_DATAGRAM_SENSOR = "schc_datagram"
+SCHC_EXPIRE_INTERVAL_SECS = 60
+
 def organize_sensor_data(device_id, sensor_id, data):
-    """Organize incoming sensor data into proper folder structure"""
-    timestamp = datetime.now().strftime("%Y%m%d_%H%M%S_%f")
+    """Append incoming sensor data to the device sensor's packet store"""
+    return organize_sensor_batch([(device_id, sensor_id, data)])[0]
+
+def organize_sensor_batch(items, received=None, keys=None):
+    """
+    Append the (device_id, sensor_id, data) of several packets to the packet
+    store and index them together, returning their record paths. Given the
+    same receive time and a key per packet, a batch stored again after a
+    failure doesn't duplicate the packets stored by the first attempt.
+    """
+    received = time.time() if received is None else received
+    # Use sensor_id directly as the sensor folder, without "sensor" prefix
+    items = [(device_id, sensor_id or "temporal_sensor", data)
+             for device_id, sensor_id, data in items]
+    sequences = packet_store.append_batch([
+        (device_id, sensor_id, data, received) for device_id, sensor_id, data in items], keys)
+    metadata_index.records_added([
+        (device_id, sensor_id, record_filename(sequence), received, data)
+        for (device_id, sensor_id, data), sequence in zip(items, sequences)])
+    series_store.append_batch(series_readings(items, received))
     
-    # Create device folder if it doesn't exist
-    device_folder = os.path.join(BASE_DATA_DIR, device_id)
-    os.makedirs(device_folder, exist_ok=True)
+    filepaths = []
+    for (device_id, sensor_id, _), sequence in zip(items, sequences):
+        filepath = packet_store.record_path(device_id, sensor_id, sequence)
+        print(f"✔️ Datos guardados en: {filepath}")
+        filepaths.append(filepath)
+    return filepaths
+
+def series_readings(items, received):
+    """The (device_id, sensor_id, metric, time, value) readings decoded from packets"""
+    readings = []
+    for device_id, sensor_id, data in items:
+        decoded = data.get("decoded_data") if isinstance(data, dict) else None
+        if not isinstance(decoded, dict):
+            continue
+        for metric in SERIES_METRICS.get(sensor_id, []):
+            value = decoded.get(metric)
+            if isinstance(value, (int, float)) and not isinstance(value, bool):
+                readings.append((device_id, sensor_id, metric, received, value))
+    return readings
+
+def format_received(received):
+    return datetime.fromtimestamp(received).strftime("%Y-%m-%d %H:%M:%S") if received else None
+
+def encode_cursor(received, name):
+    """Opaque cursor of the last record of a listing page"""
+    return base64.urlsafe_b64encode(json.dumps([received, name]).encode()).decode()
+
+def decode_cursor(cursor):
+    try:
+        received, name = json.loads(base64.urlsafe_b64decode(cursor.encode()))
+        return float(received), str(name)
+    except (ValueError, TypeError):
+        raise ValueError("cursor inválido")
+
+def parse_time_arg(value):
+    """A time filter given as unix seconds or an ISO date, or None"""
+    if not value:
+        return None
+    try:
+        return float(value)
+    except ValueError:
+        return datetime.fromisoformat(value).timestamp()
+
+def sensor_page_args(args):
+    """Return the (limit, cursor, start, end) of a listing request"""
+    limit = min(max(int(args.get("limit", SENSOR_PAGE_SIZE)), 1), SENSOR_PAGE_MAX)
+    return limit, args.get("cursor"), parse_time_arg(args.get("start")), parse_time_arg(args.get("end"))
+
+def list_sensor_files(device_id, sensor_id, limit=SENSOR_PAGE_SIZE, cursor=None, start=None, end=None):
+    """
+    List a page of the stored records and legacy JSON files of a sensor
+    received in [start, end), newest first, returning (files, next_cursor)
+    """
+    after = decode_cursor(cursor) if cursor else None
+    records = metadata_index.sensor_records_page(device_id, sensor_id, limit + 1, after, start, end)
+    next_cursor = encode_cursor(records[limit - 1][1], records[limit - 1][0]) if len(records) > limit else None
+    files = [{
+        'name': name,
+        'path': os.path.join(BASE_DATA_DIR, device_id, sensor_id, name),
+        'timestamp': format_received(received),
+        'received': received
+    } for name, received in records[:limit]]
+    return files, next_cursor
+
+def split_data_path(filepath):
+    """Return the (device_id, sensor_id, filename) of a path in a sensor folder, or None"""
+    relative = os.path.relpath(os.path.abspath(filepath), os.path.abspath(BASE_DATA_DIR))
+    parts = relative.split(os.sep)
+    return tuple(parts) if len(parts) == 3 else None
+
+def load_data_file(filepath):
+    """Load a stored record by its virtual path, or a legacy JSON file"""
+    record = packet_store.parse_record_path(filepath)
+    if record:
+        return packet_store.get(*record)
+    if not os.path.exists(filepath):
+        return None
+    with open(filepath, 'r') as f:
+        return json.load(f)
+
+def record_validators(filepath):
+    """
+    Return the (etag, last_modified) of a stored record or legacy JSON file,
+    or None if it doesn't exist. A record's is its index entry, so checking
+    a cached copy doesn't read the record.
+    """
+    record = packet_store.parse_record_path(filepath)
+    if record:
+        entry = packet_store.stat(*record)
+        if entry is None:
+            return None
+        offset, received = entry
+        return f"{record[2]:x}-{offset:x}-{received:x}", received
+    if not os.path.isfile(filepath):
+        return None
+    stat = os.stat(filepath)
+    return f"{stat.st_mtime_ns:x}-{stat.st_size:x}", stat.st_mtime
+
+def record_response(filepath, download=False):
+    """
+    Serve a record or legacy JSON file with an ETag and Last-Modified, as 304
+    if the client's copy is current. Returns None if it doesn't exist.
+    """
+    validators = record_validators(filepath)
+    if validators is None:
+        return None
+    etag, last_modified = validators
+    response = app.response_class(mimetype='application/json')
+    response.set_etag(etag)
+    response.last_modified = last_modified
+    response.cache_control.public = True
+    response.cache_control.max_age = RECORD_MAX_AGE_SECS
+    response = response.make_conditional(request)
+    if response.status_code == 304:
+        return response
     
-    # Determine sensor folder - use sensor_id directly without "sensor" prefix
-    if sensor_id:
-        sensor_folder = os.path.join(device_folder, sensor_id)
+    if download:
+        data = load_data_file(filepath)
+        payload = json.dumps(data, indent=2).encode('utf-8') if data is not None else None
+        response.headers['Content-Disposition'] = \
+            f'attachment; filename="{os.path.basename(filepath)}"'
     else:
-        sensor_folder = os.path.join(device_folder, "temporal_sensor")
-    
-    os.makedirs(sensor_folder, exist_ok=True)
-    
-    # Save data
-    filename = f"data_{timestamp}.json"
-    filepath = os.path.join(sensor_folder, filename)
-    
-    with open(filepath, 'w') as f:
-        json.dump(data, f, indent=2)
-    
-    print(f"✔️ Datos guardados en: {filepath}")
-    return filepath
+        # Served as stored, without parsing
+        record = packet_store.parse_record_path(filepath)
+        if record:
+            payload = packet_store.get_payload(*record)
+        else:
+            with open(filepath, 'rb') as f:
+                payload = f.read()
+    if payload is None:
+        return None
+    response.set_data(payload)
+    return response
 
 def parse_flexsense_data(terminal_id, hex_value):
     """
@@ -58,7 +229,8 @@ def parse_flexsense_data(terminal_id, hex_value):
             # Simple sensor type detection based on first byte
             sensor_mapping = {
                 "01": "temperature", "02": "humidity", "03": "pressure",
-                "04": "battery", "05": "gps", "06": "accelerometer"
+                "04": "battery", "05": "gps", "06": "accelerometer",
+                "0c": "downlink_ack", "0d": "uplink_stats"
             }
             sensor_id = sensor_mapping.get(first_byte, "sensor_generic")
         else:
@@ -70,9 +242,318 @@ def parse_flexsense_data(terminal_id, hex_value):
         print(f"Error analizando datos FlexSense: {e}")
         return f"flex_{terminal_id}", "sensor_error"
 
-def decode_sensor_value(hex_value, sensor_type):
+GNSS_ANCHOR_FILENAME = "gnss_anchor.json"
+GNSS_TRACK_FLAG = 0x80
+GNSS_POINT_UNUSED = -32768
+
+def load_gnss_anchor(device_id):
+    """Load the last GNSS anchor received from a device"""
+    anchor_path = os.path.join(BASE_DATA_DIR, device_id, GNSS_ANCHOR_FILENAME)
+    if not os.path.exists(anchor_path):
+        return None
+    with open(anchor_path, 'r') as f:
+        return json.load(f)
+
+def save_gnss_anchor(device_id, anchor):
+    """Persist the last GNSS anchor so later track frames can be decoded"""
+    device_folder = os.path.join(BASE_DATA_DIR, device_id)
+    os.makedirs(device_folder, exist_ok=True)
+    with open(os.path.join(device_folder, GNSS_ANCHOR_FILENAME), 'w') as f:
+        json.dump(anchor, f, indent=2)
+
+def decode_gnss_frame(byte_data, device_id, changes=None):
+    """
+    Decode a GNSS track library frame (see Flex-SDK-main/lib/gnss_track).
+    Anchor frames carry an absolute location, track frames carry points
+    relative to the anchor with the matching sequence number. A new anchor is
+    added to changes, to be saved once the frame is stored.
+    """
+    decoded = {}
+    if len(byte_data) < 20:
+        decoded["error"] = "insufficient_data"
+        return decoded
+
+    sequence = byte_data[1] & ~GNSS_TRACK_FLAG
+    decoded["anchor_sequence"] = sequence
+
+    if not byte_data[1] & GNSS_TRACK_FLAG:
+        anchor = {
+            "sequence": sequence,
+            "latitude": int.from_bytes(byte_data[2:6], 'little', signed=True) / 1e7,
+            "longitude": int.from_bytes(byte_data[6:10], 'little', signed=True) / 1e7,
+            "fix_time": int.from_bytes(byte_data[10:14], 'little'),
+        }
+        decoded["frame"] = "anchor"
+        decoded.update(anchor)
+        decoded["interval_minutes"] = int.from_bytes(byte_data[14:16], 'little')
+        decoded["moving"] = bool(byte_data[16])
+        if device_id and changes is not None:
+            changes.gnss_anchors[device_id] = anchor
+        return decoded
+
+    decoded["frame"] = "track"
+    anchor = changes.gnss_anchors.get(device_id) if changes is not None else None
+    if device_id and anchor is None:
+        anchor = load_gnss_anchor(device_id)
+    if not anchor or anchor["sequence"] != sequence:
+        # The anchor was lost or hasn't arrived yet, so the points can't be placed
+        decoded["error"] = "anchor_mismatch"
+        return decoded
+
+    points = []
+    for offset in range(2, 20, 6):
+        dlat = int.from_bytes(byte_data[offset:offset + 2], 'little', signed=True)
+        if dlat == GNSS_POINT_UNUSED:
+            continue
+        dlon = int.from_bytes(byte_data[offset + 2:offset + 4], 'little', signed=True)
+        minutes = int.from_bytes(byte_data[offset + 4:offset + 6], 'little')
+        points.append({
+            "latitude": round(anchor["latitude"] + dlat / 1e5, 7),
+            "longitude": round(anchor["longitude"] + dlon / 1e5, 7),
+            "fix_time": anchor["fix_time"] + minutes * 60,
+        })
+    decoded["points"] = points
+    return decoded
+
+DOWNLINK_COMMANDS_FILENAME = "downlink_commands.json"
+DOWNLINK_COMMAND_CONF_SET = 0x01
+DOWNLINK_COMMAND_TRIGGER = 0x02
+DOWNLINK_CONF_MAX = 3
+DOWNLINK_CONF_UNUSED = 0xFF
+DOWNLINK_NO_ACTION = 0xFF
+# Configuration IDs (FLEX_DIAG_CONF_ID_USER_n) are defined by each firmware
+# application, so names are looked up in the table of the application recorded
+# for the device
+DOWNLINK_APPLICATIONS = {
+    "send_img_test": {
+        "hours_between_sessions": 0,
+        "fragments_per_session": 1,
+        "stats_report_days": 2,
+    },
+    "modbus": {
+        "poll_interval_mins": 2,
+    },
+}
+DEVICE_APPLICATION_FILENAME = "application.json"
+DOWNLINK_ACTIONS = {"reading": 0, "image": 1}
+DOWNLINK_RESULTS = [
+    "success", "invalid_frame", "unknown_command", "invalid_conf",
+    "unsupported", "io_failure", "duplicate",
+]
+
+# A device's command queue is changed by request threads and by the ingest
+# workers decoding acknowledgements, so each load, change and save is done
+# holding the device's lock
+downlink_locks = {}
+downlink_locks_guard = threading.Lock()
+
+def downlink_commands_lock(device_id):
+    """The lock of a device's downlink command queue"""
+    with downlink_locks_guard:
+        return downlink_locks.setdefault(device_id, threading.Lock())
+
+def load_downlink_commands(device_id):
+    """Load the downlink command queue of a device"""
+    commands_path = os.path.join(BASE_DATA_DIR, device_id, DOWNLINK_COMMANDS_FILENAME)
+    if not os.path.exists(commands_path):
+        return []
+    with open(commands_path, 'r') as f:
+        return json.load(f)
+
+def save_downlink_commands(device_id, commands):
+    """
+    Persist the downlink command queue of a device, replacing the file so
+    that readers never see it half written
+    """
+    device_folder = os.path.join(BASE_DATA_DIR, device_id)
+    os.makedirs(device_folder, exist_ok=True)
+    commands_path = os.path.join(device_folder, DOWNLINK_COMMANDS_FILENAME)
+    with open(commands_path + ".tmp", 'w') as f:
+        json.dump(commands, f, indent=2)
+    os.replace(commands_path + ".tmp", commands_path)
+
+def load_device_application(device_id):
+    """The firmware application recorded for a device, or None"""
+    application_path = os.path.join(BASE_DATA_DIR, device_id, DEVICE_APPLICATION_FILENAME)
+    if not os.path.exists(application_path):
+        return None
+    with open(application_path, 'r') as f:
+        return json.load(f).get("application")
+
+def save_device_application(device_id, application):
+    """Record the firmware application of a device"""
+    if application not in DOWNLINK_APPLICATIONS:
+        raise ValueError(f"unknown application {application}")
+    device_folder = os.path.join(BASE_DATA_DIR, device_id)
+    os.makedirs(device_folder, exist_ok=True)
+    application_path = os.path.join(device_folder, DEVICE_APPLICATION_FILENAME)
+    with open(application_path + ".tmp", 'w') as f:
+        json.dump({"application": application,
+                   "updated_at": datetime.now().isoformat()}, f, indent=2)
+    os.replace(application_path + ".tmp", application_path)
+
+def downlink_conf_id(name, application):
+    """
+    The configuration ID of a conf_set value, given by its numeric ID or by
+    a name the device's application defines. Raises ValueError otherwise.
+    """
+    if isinstance(name, int) or str(name).isdigit():
+        return int(name)
+    if application is None:
+        raise ValueError(f"{name} requires the device's application to be set, "
+                         f"or give the numeric configuration id")
+    conf_id = DOWNLINK_APPLICATIONS[application].get(name)
+    if conf_id is None:
+        raise ValueError(f"{application} has no configuration value {name}")
+    return conf_id
+
+def encode_downlink_command(command, sequence, application=None):
+    """
+    Encode a downlink library command (see Flex-SDK-main/lib/downlink) for a
+    device running application. Raises ValueError if the command is invalid.
+    """
+    command_type = command.get("type")
+    if command_type == "conf_set":
+        values = command.get("values") or {}
+        if not 0 < len(values) <= DOWNLINK_CONF_MAX:
+            raise ValueError(f"conf_set requires 1 to {DOWNLINK_CONF_MAX} values")
+        payload = bytes([DOWNLINK_COMMAND_CONF_SET, sequence])
+        for name, value in values.items():
+            conf_id = downlink_conf_id(name, application)
+            if not 0 <= conf_id < DOWNLINK_CONF_UNUSED:
+                raise ValueError(f"invalid configuration id {name}")
+            value = int(value)
+            if not 0 <= value <= 0xFFFFFFFF:
+                raise ValueError(f"value of {name} out of range")
+            payload += bytes([conf_id]) + value.to_bytes(4, 'little')
+        return payload
+    if command_type == "trigger":
+        action = command.get("action")
+        action_id = DOWNLINK_ACTIONS.get(action, action)
+        if not isinstance(action_id, int) or not 0 <= action_id <= 0xFF:
+            raise ValueError(f"invalid action {action}")
+        return bytes([DOWNLINK_COMMAND_TRIGGER, sequence, action_id])
+    raise ValueError(f"unknown command type {command_type}")
+
+def queue_downlink_command(device_id, command):
+    """Encode a command and add it to the device's queue"""
+    with downlink_commands_lock(device_id):
+        commands = load_downlink_commands(device_id)
+        sequence = (commands[-1]["sequence"] + 1) % 256 if commands else 0
+        payload = encode_downlink_command(command, sequence, load_device_application(device_id))
+        entry = {
+            "sequence": sequence,
+            "command": command,
+            "payload_hex": payload.hex(),
+            "status": "queued",
+            "queued_at": datetime.now().isoformat(),
+        }
+        commands.append(entry)
+        save_downlink_commands(device_id, commands)
+    return entry
+
+def decode_downlink_ack(byte_data, device_id, changes=None):
+    """
+    Decode a downlink acknowledgement frame. The status of the matching
+    queued command is updated once the frame is stored, see changes.
+    """
+    decoded = {}
+    if len(byte_data) < 20:
+        decoded["error"] = "insufficient_data"
+        return decoded
+
+    sequence = byte_data[1]
+    result = byte_data[3]
+    decoded["sequence"] = sequence
+    decoded["command"] = byte_data[2]
+    decoded["result"] = DOWNLINK_RESULTS[result] if result < len(DOWNLINK_RESULTS) else result
+    decoded["values"] = {
+        str(byte_data[offset]): int.from_bytes(byte_data[offset + 1:offset + 5], 'little')
+        for offset in range(4, 19, 5) if byte_data[offset] != DOWNLINK_CONF_UNUSED
+    }
+    if byte_data[19] != DOWNLINK_NO_ACTION:
+        decoded["action"] = byte_data[19]
+
+    if device_id and changes is not None:
+        changes.downlink_acks.append((device_id, sequence, result, decoded["result"]))
+    return decoded
+
+def acknowledge_downlink_command(device_id, sequence, result, result_name):
+    """Update the status of the queued or sent command an acknowledgement is for"""
+    with downlink_commands_lock(device_id):
+        commands = load_downlink_commands(device_id)
+        for entry in reversed(commands):
+            if entry["sequence"] == sequence and entry["status"] in ("queued", "sent"):
+                entry["status"] = "acknowledged" if result == 0 else "failed"
+                entry["result"] = result_name
+                entry["acknowledged_at"] = datetime.now().isoformat()
+                save_downlink_commands(device_id, commands)
+                break
+
+def decode_uplink_stats(byte_data):
+    """
+    Decode an uplink statistics frame (see Flex-SDK-main/lib/uplink_stats).
+    """
+    decoded = {}
+    if len(byte_data) < 20:
+        decoded["error"] = "insufficient_data"
+        return decoded
+
+    decoded["sequence"] = byte_data[1]
+    decoded["window_start"] = int.from_bytes(byte_data[2:6], 'little')
+    decoded["messages_sent"] = int.from_bytes(byte_data[6:8], 'little')
+    decoded["messages_failed"] = int.from_bytes(byte_data[8:10], 'little')
+    decoded["messages_deferred"] = int.from_bytes(byte_data[10:12], 'little')
+    decoded["payload_bytes"] = int.from_bytes(byte_data[12:15], 'little')
+    decoded["padding_bytes"] = int.from_bytes(byte_data[15:17], 'little')
+    if byte_data[17] != 0xFF:
+        decoded["min_slots_free"] = byte_data[17]
+    decoded["transfers_completed"] = int.from_bytes(byte_data[18:20], 'little')
+    scheduled = decoded["payload_bytes"] + decoded["padding_bytes"]
+    if scheduled:
+        decoded["padding_ratio"] = round(decoded["padding_bytes"] / scheduled, 4)
+    return decoded
+
+class DeviceChanges:
+    """
+    Device state changed by the frames of a message: GNSS anchors, downlink
+    command acknowledgements and SCHC sessions. Frames are decoded against
+    these, and they are saved only once the frames' records are stored, so a
+    message retried after a failure decodes the same way.
+    """
+
+    def __init__(self):
+        self.gnss_anchors = {}
+        self.downlink_acks = []
+        self.schc_sessions = {}
+
+    def schc_apply(self, device_id, byte_data, received):
+        """Apply a frame to the device's staged SCHC sessions"""
+        if device_id not in self.schc_sessions:
+            self.schc_sessions[device_id] = schc_reassembler.stage(device_id)
+        return schc_reassembler.apply(device_id, self.schc_sessions[device_id], byte_data, received)
+
+    def commit(self):
+        # Each of these can be applied again, and SCHC sessions are saved last
+        # as a retry after they are saved would find the datagrams closed
+        for device_id, anchor in self.gnss_anchors.items():
+            save_gnss_anchor(device_id, anchor)
+        for ack in self.downlink_acks:
+            acknowledge_downlink_command(*ack)
+        for device_id in list(self.schc_sessions):
+            schc_reassembler.commit(device_id, self.schc_sessions.pop(device_id))
+
+    def release(self):
+        for device_id in self.schc_sessions:
+            schc_reassembler.release(device_id)
+
+def decode_sensor_value(hex_value, sensor_type, device_id=None, changes=None):
     """
-    Attempt to decode sensor values from hex data
+    Attempt to decode sensor values from hex data.
+    device_id is needed for frames which depend on earlier frames (gps) or
+    update device state (downlink_ack). Decoding doesn't change device state:
+    the changes are collected in changes, a DeviceChanges, to be saved once
+    the frames are stored.
     """
     try:
         if not hex_value or len(hex_value) < 4:
@@ -101,6 +582,15 @@ def decode_sensor_value(hex_value, sensor_type):
             # Example: battery voltage in mV
             voltage_raw = int.from_bytes(byte_data[1:3], 'big')
             decoded["battery_mv"] = voltage_raw
+
+        elif sensor_type == "gps":
+            decoded.update(decode_gnss_frame(byte_data, device_id, changes))
+
+        elif sensor_type == "downlink_ack":
+            decoded.update(decode_downlink_ack(byte_data, device_id, changes))
+
+        elif sensor_type == "uplink_stats":
+            decoded.update(decode_uplink_stats(byte_data))
             
         return decoded
         
@@ -137,10 +627,13 @@ def delete_device_data(device_id):
     """Delete all data for a device including folders"""
     try:
         import shutil
+        packet_store.close(device_id)
+        series_store.close(device_id)
         device_path = os.path.join(BASE_DATA_DIR, device_id)
         if os.path.exists(device_path):
             shutil.rmtree(device_path)
             print(f"Datos de dispositivo eliminados: {device_path}")
+        metadata_index.device_deleted(device_id)
         return True
     except Exception as e:
         print(f"Error eliminando dispositivo {device_id}: {e}")
@@ -150,10 +643,13 @@ def delete_sensor_data(device_id, sensor_id):
     """Delete all data for a specific sensor"""
     try:
         import shutil
+        packet_store.close(device_id)
+        series_store.close(device_id)
         sensor_path = os.path.join(BASE_DATA_DIR, device_id, sensor_id)
         if os.path.exists(sensor_path):
             shutil.rmtree(sensor_path)
             print(f"Datos de sensor eliminados: {sensor_path}")
+            metadata_index.sensor_deleted(device_id, sensor_id)
             return True
         return False
     except Exception as e:
@@ -165,8 +661,11 @@ def rename_device(old_device_id, new_device_id):
     try:
         old_path = os.path.join(BASE_DATA_DIR, old_device_id)
         new_path = os.path.join(BASE_DATA_DIR, new_device_id)
+        packet_store.close(old_device_id)
+        series_store.close(old_device_id)
         if os.path.exists(old_path):
             os.rename(old_path, new_path)
+            metadata_index.device_renamed(old_device_id, new_device_id)
             print(f"Dispositivo renombrado: {old_device_id} -> {new_device_id}")
         return True
     except Exception as e:
@@ -174,10 +673,20 @@ def rename_device(old_device_id, new_device_id):
         return False
 
 def delete_json_file(filepath):
-    """Delete a specific JSON file"""
+    """Delete a stored record or a specific JSON file"""
     try:
+        location = split_data_path(filepath)
+        record = packet_store.parse_record_path(filepath)
+        if record:
+            if packet_store.delete(*record):
+                metadata_index.record_deleted(*location)
+                print(f"Registro eliminado: {filepath}")
+                return True
+            return False
         if os.path.exists(filepath):
             os.remove(filepath)
+            if location:
+                metadata_index.record_deleted(*location)
             print(f"Archivo eliminado: {filepath}")
             return True
         return False
@@ -189,52 +698,39 @@ def delete_json_file(filepath):
 @app.route("/")
 def dashboard():
     """Main dashboard showing devices and recent data"""
-    devices = {}
-    if os.path.exists(BASE_DATA_DIR):
-        for device_name in os.listdir(BASE_DATA_DIR):
-            device_path = os.path.join(BASE_DATA_DIR, device_name)
-            if os.path.isdir(device_path):
-                sensors = []
-                for sensor_name in os.listdir(device_path):
-                    sensor_path = os.path.join(device_path, sensor_name)
-                    if os.path.isdir(sensor_path):
-                        # Count files in sensor folder
-                        file_count = len([f for f in os.listdir(sensor_path) 
-                                        if f.endswith('.json')])
-                        sensors.append({
-                            'name': sensor_name,
-                            'file_count': file_count
-                        })
-                devices[device_name] = sensors
+    devices = metadata_index.devices()
+    for sensors in devices.values():
+        for sensor in sensors:
+            sensor['last_seen'] = format_received(sensor['last_received'])
     
     return render_template('dashboard_simple.html', devices=devices)
 
 @app.route("/device/<device_id>/sensor/<sensor_id>")
 def view_sensor_data(device_id, sensor_id):
-    """View data files for a specific sensor"""
-    sensor_path = os.path.join(BASE_DATA_DIR, device_id, sensor_id)
-    files = []
-    
-    if os.path.exists(sensor_path):
-        for filename in sorted(os.listdir(sensor_path), reverse=True):
-            if filename.endswith('.json'):
-                filepath = os.path.join(sensor_path, filename)
-                # Extract timestamp from filename
-                timestamp_str = filename.replace('data_', '').replace('.json', '')
-                try:
-                    timestamp = datetime.strptime(timestamp_str, "%Y%m%d_%H%M%S_%f")
-                    formatted_time = timestamp.strftime("%Y-%m-%d %H:%M:%S")
-                except:
-                    formatted_time = timestamp_str
-                
-                files.append({
-                    'name': filename,
-                    'path': filepath,
-                    'timestamp': formatted_time
-                })
+    """View a page of data files for a specific sensor"""
+    try:
+        limit, cursor, start, end = sensor_page_args(request.args)
+        files, next_cursor = list_sensor_files(device_id, sensor_id, limit, cursor, start, end)
+    except ValueError as e:
+        return f"Parámetro inválido: {e}", 400
+    summary = metadata_index.sensor_summary(device_id, sensor_id)
     
     return render_template('sensor_data_simple.html', 
-                         device_id=device_id, sensor_id=sensor_id, files=files)
+                         device_id=device_id, sensor_id=sensor_id, files=files,
+                         record_count=summary['record_count'],
+                         last_seen=format_received(summary['last_received']),
+                         next_cursor=next_cursor, cursor=cursor,
+                         start=request.args.get('start', ''), end=request.args.get('end', ''))
+
+@app.route("/api/device/<device_id>/sensor/<sensor_id>/records")
+def list_sensor_records(device_id, sensor_id):
+    """A page of a sensor's records, newest first, and the cursor of the next page"""
+    try:
+        limit, cursor, start, end = sensor_page_args(request.args)
+        files, next_cursor = list_sensor_files(device_id, sensor_id, limit, cursor, start, end)
+    except ValueError as e:
+        return jsonify({"status": "error", "message": str(e)}), 400
+    return jsonify({"records": files, "next_cursor": next_cursor})
 
 @app.route("/api/file")
 def get_file_content():
@@ -253,94 +749,224 @@ def get_file_content():
         if not absolute_file.startswith(absolute_base):
             return jsonify({"error": "Access denied"}), 403
         
-        if not os.path.exists(normalized_path):
+        response = record_response(normalized_path)
+        if response is None:
             return jsonify({"error": "File not found"}), 404
-        
-        with open(normalized_path, 'r') as f:
-            data = json.load(f)
-        
-        return jsonify(data)
+        return response
     except Exception as e:
         return jsonify({"error": str(e)}), 500
 
-# Myriota HTTP POST endpoint
-@app.route("/myriota", methods=["POST"])
-def receive_myriota_data():
-    """Myriota satellite network HTTP POST endpoint"""
+def split_myriota_message(data):
+    """
+    Validate a Myriota message and split it into one message per terminal, each
+    with only that terminal's packets, returning (terminal_id, message) pairs
+    """
+    if not isinstance(data, dict):
+        raise ValueError("el mensaje no es un objeto JSON")
+    if "Data" not in data:
+        return [(data.get("TerminalId") or "", data)]
+    
+    # TerminalId is nested in the Data field, which is a JSON string
     try:
-        data = request.get_json()
-        print(f"📡 Datos Myriota Recibidos: {json.dumps(data, indent=2)}")
+        data_content = json.loads(data["Data"])
+    except (TypeError, json.JSONDecodeError) as e:
+        raise ValueError(f"Data no es JSON válido: {e}")
+    if not isinstance(data_content, dict):
+        raise ValueError("Data no es un objeto JSON")
+    packets = data_content.get("Packets") or []
+    if not isinstance(packets, list) or not all(isinstance(p, dict) for p in packets):
+        raise ValueError("Packets no es una lista de paquetes")
+    if not packets:
+        return [(data.get("TerminalId") or "", data)]
+    
+    terminals = {}
+    for packet in packets:
+        terminal_id = packet.get("TerminalId") or data.get("TerminalId") or ""
+        terminals.setdefault(terminal_id, []).append(packet)
+    return [
+        (terminal_id, dict(data, Data=json.dumps(dict(data_content, Packets=terminal_packets))))
+        for terminal_id, terminal_packets in terminals.items()
+    ]
+
+def process_myriota_message(data, message_id=None, enqueued=None):
+    """
+    Decode and save the packets of a queued Myriota message. Packets are all
+    decoded first, then stored keyed on (message_id, packet index) with the
+    enqueue time as their receive time, and only then is device state saved,
+    so a message retried after a failure is neither duplicated nor lost.
+    """
+    received = time.time() if enqueued is None else enqueued
+    changes = DeviceChanges()
+    try:
+        return store_myriota_message(data, message_id, received, changes)
+    finally:
+        changes.release()
+
+def store_myriota_message(data, message_id, received, changes):
+    """Decode a Myriota message's packets against changes, then store them"""
+    # Extract Myriota-specific fields - TerminalId is nested in Data field.
+    # A message can carry several packets (e.g. a backlog flushed after a
+    # satellite pass), and every one of them is saved.
+    data_content = None
+    packets = []
+    
+    # Check if Data field exists and contains the nested JSON
+    if "Data" in data:
+        data_content = json.loads(data["Data"])
+        packets = data_content.get("Packets") or []
+    
+    # Fallback to direct fields if there's no nested data
+    if not packets and "TerminalId" in data and "Value" in data:
+        packets = [{"TerminalId": data["TerminalId"], "Value": data["Value"]}]
+    
+    # Records are keyed on the message and the packet they came from, which
+    # a retry decodes the same
+    items = []
+    keys = []
+    for index, packet in enumerate(packets):
+        terminal_id = packet.get("TerminalId") or data.get("TerminalId")
+        hex_value = packet.get("Value")
+        if not terminal_id or not hex_value:
+            continue
         
-        # Extract Myriota-specific fields - TerminalId is nested in Data field
-        terminal_id = None
-        hex_value = None
+        device_id, sensor_id = parse_flexsense_data(terminal_id, hex_value)
         
-        # Check if Data field exists and contains the nested JSON
-        if "Data" in data:
-            try:
-                # Parse the nested JSON string in the Data field
-                data_content = json.loads(data["Data"])
-                print(f"📦 Contenido de Datos Analizados: {json.dumps(data_content, indent=2)}")
-                
-                # Extract from Packets array
-                if "Packets" in data_content and len(data_content["Packets"]) > 0:
-                    packet = data_content["Packets"][0]  # Take first packet
-                    terminal_id = packet.get("TerminalId")
-                    hex_value = packet.get("Value")
-                    print(f"🔍 Extraído - TerminalId: {terminal_id}, Value: {hex_value}")
-            except json.JSONDecodeError as e:
-                print(f"❌ Error analizando JSON anidado de Datos: {e}")
+        # Decode sensor data, in packet order as some frames depend on
+        # earlier frames of the same device
+        decoded_data = decode_sensor_value(hex_value, sensor_id, device_id, changes)
         
-        # Fallback to direct fields if nested parsing failed
-        if not terminal_id and "TerminalId" in data:
-            terminal_id = data["TerminalId"]
-        if not hex_value and "Value" in data:
-            hex_value = data["Value"]
+        # Each record keeps only its own packet, so that defrag.py sees
+        # every fragment once
+        raw_data = dict(data)
+        if data_content is not None:
+            raw_data["Data"] = json.dumps(dict(data_content, Packets=[packet]))
         
-        if terminal_id and hex_value:
-            device_id, sensor_id = parse_flexsense_data(terminal_id, hex_value)
-            
-            # Decode sensor data
-            decoded_data = decode_sensor_value(hex_value, sensor_id)
-            
-            # Enhance data with Myriota metadata
-            enhanced_data = {
-                "source": "myriota",
-                "timestamp": datetime.now().isoformat(),
-                "terminal_id": terminal_id,
-                "device_id": device_id,
-                "sensor_id": sensor_id,
-                "raw_data": data,
-                "decoded_data": decoded_data
-            }
-        else:
-            # Generic handling for other data formats
-            device_id, sensor_id = extract_device_sensor_info(data)
-            if not device_id or device_id == "unknown_device":
-                device_id = "myriota_generic_device"
-            
-            enhanced_data = {
-                "source": "myriota_generic",
-                "timestamp": datetime.now().isoformat(),
-                "device_id": device_id,
-                "sensor_id": sensor_id or "general_data",
-                "raw_data": data
-            }
+        # Enhance data with Myriota metadata
+        enhanced_data = {
+            "source": "myriota",
+            "timestamp": datetime.fromtimestamp(received).isoformat(),
+            "packet_timestamp": packet.get("Timestamp", data.get("Timestamp")),
+            "terminal_id": terminal_id,
+            "device_id": device_id,
+            "sensor_id": sensor_id,
+            "raw_data": raw_data,
+            "decoded_data": decoded_data
+        }
+        items.append((device_id, sensor_id, enhanced_data))
+        keys.append(f"{message_id}:{index}")
         
-        # Auto-create device and save data
-        filepath = organize_sensor_data(device_id, sensor_id or "general_data", enhanced_data)
+        # Fragments are applied to the device's SCHC session, and a datagram
+        # they complete is saved after them
+        if sensor_id == "sensor_generic" and "decode_error" not in decoded_data:
+            fragment, datagrams = changes.schc_apply(device_id, bytes.fromhex(hex_value), received)
+            if fragment:
+                decoded_data["schc"] = {"rule_id": fragment["rule_id"], "fcn": fragment["fcn"]}
+            datagram_items = schc_datagram_items(datagrams, received)
+            items += datagram_items
+            keys += [f"{message_id}:{index}:{n}" for n in range(len(datagram_items))]
+    
+    if not items:
+        # Generic handling for other data formats
+        device_id, sensor_id = extract_device_sensor_info(data)
+        if not device_id or device_id == "unknown_device":
+            device_id = "myriota_generic_device"
         
-        return jsonify({
-            "status": "success",
-            "message": "Data received and saved",
+        enhanced_data = {
+            "source": "myriota_generic",
+            "timestamp": datetime.fromtimestamp(received).isoformat(),
             "device_id": device_id,
             "sensor_id": sensor_id or "general_data",
-            "filepath": filepath
-        }), 200
-        
+            "raw_data": data
+        }
+        items.append((device_id, sensor_id or "general_data", enhanced_data))
+        keys.append(f"{message_id}:0")
+    
+    # Auto-create devices and save all packets in one batch, then the device
+    # state they changed
+    filepaths = organize_sensor_batch(items, received, keys if message_id else None)
+    changes.commit()
+    print(f"📦 Mensaje Myriota procesado: {len(filepaths)} paquetes guardados")
+    return filepaths
+
+def schc_datagram_items(datagrams, received=None):
+    """Records of reassembled SCHC datagrams, for organize_sensor_batch"""
+    received = time.time() if received is None else received
+    items = []
+    for datagram in datagrams:
+        print(f"🧩 Datagrama SCHC de {datagram['device_id']}: {datagram['status']}, "
+              f"{datagram['length']} bytes, CRC {'correcto' if datagram['crc_ok'] else 'incorrecto'}")
+        items.append((datagram["device_id"], SCHC_DATAGRAM_SENSOR, {
+            "source": "schc",
+            "timestamp": datetime.fromtimestamp(received).isoformat(),
+            "device_id": datagram["device_id"],
+            "sensor_id": SCHC_DATAGRAM_SENSOR,
+            "decoded_data": datagram
+        }))
+    return items
+
+def expire_schc_sessions():
+    """Save the datagrams of SCHC sessions which timed out"""
+    schc_reassembler.expire(lambda datagrams: organize_sensor_batch(schc_datagram_items(datagrams)))
+
+def run_ingest_maintenance():
+    """Periodic work of the ingest workers"""
+    expire_schc_sessions()
+    ingest_queue.prune_seen()
+
+# Queued messages are processed by these workers, see ingest_queue.py
+ingest_queue = IngestQueue(BASE_DATA_DIR)
+ingest_workers = IngestWorkers(ingest_queue, {"myriota": process_myriota_message},
+                               count=INGEST_WORKERS, idle=run_ingest_maintenance,
+                               idle_secs=SCHC_EXPIRE_INTERVAL_SECS)
+ingest_workers.start()
+
+# Myriota HTTP POST endpoint
+@app.route("/myriota", methods=["POST"])
+def receive_myriota_data():
+    """
+    Myriota satellite network HTTP POST endpoint. Messages are validated and
+    queued, and decoded and saved by the ingest workers after answering.
+    A message whose Id was already received is acknowledged and dropped.
+    """
+    data = request.get_json(silent=True)
+    message_key = f"myriota:{data['Id']}" if isinstance(data, dict) and data.get("Id") else None
+    if message_key and ingest_queue.seen(message_key):
+        return myriota_duplicate_response(data)
+    try:
+        messages = split_myriota_message(data)
+    except ValueError as e:
+        print(f"❌ Mensaje Myriota inválido: {e}")
+        return jsonify({"status": "error", "message": str(e)}), 400
+    
+    try:
+        message_ids = ingest_queue.enqueue(
+            [("myriota", terminal_id, message) for terminal_id, message in messages],
+            key=message_key)
     except Exception as e:
-        print(f"❌ Error procesando datos Myriota: {e}")
+        print(f"❌ Error encolando datos Myriota: {e}")
         return jsonify({"status": "error", "message": str(e)}), 500
+    if message_ids is None:
+        return myriota_duplicate_response(data)
+    
+    print(f"📡 Mensaje Myriota encolado: {len(messages)} terminales, ids {message_ids}")
+    return jsonify({
+        "status": "accepted",
+        "message": "Datos recibidos, en cola de procesamiento",
+        "message_ids": message_ids
+    }), 202
+
+def myriota_duplicate_response(data):
+    """Acknowledge a repeated message, so that it isn't retried again"""
+    print(f"♻️ Mensaje Myriota repetido ignorado: {data['Id']}")
+    return jsonify({
+        "status": "duplicate",
+        "message": "Mensaje ya recibido"
+    }), 200
+
+@app.route("/api/ingest")
+def ingest_status():
+    """Ingest queue length, oldest pending message age and recent failures"""
+    return jsonify(dict(ingest_queue.stats(), failures=ingest_queue.failures()))
 
 # Generic HTTP POST endpoint
 @app.route("/data", methods=["POST"])
@@ -377,6 +1003,11 @@ def receive_http_data():
         print(f"❌ Error procesando datos HTTP: {e}")
         return jsonify({"status": "error", "message": str(e)}), 500
 
+@app.route("/api/devices")
+def list_devices():
+    """Per sensor record counts, time ranges and last values of every device"""
+    return jsonify(metadata_index.devices())
+
 @app.route("/api/device/<device_id>", methods=["DELETE"])
 def delete_device(device_id):
     """Delete a device and all its data"""
@@ -405,6 +1036,103 @@ def delete_sensor(device_id, sensor_id):
     else:
         return jsonify({"status": "error", "message": "Error al eliminar sensor"}), 500
 
+@app.route("/api/device/<device_id>/schc")
+def list_schc_sessions(device_id):
+    """Open SCHC reassembly sessions of a device and their missing fragments"""
+    return jsonify(schc_reassembler.sessions(device_id))
+
+@app.route("/api/series")
+def query_series():
+    """
+    Readings of a device sensor metric in [start, end) (unix seconds, by
+    default the last day), bucketed by step seconds or into up to points
+    buckets. Without a metric, lists the device's metrics.
+    """
+    device_id = request.args.get("device_id")
+    if not device_id:
+        return jsonify({"status": "error", "message": "Se requiere device_id"}), 400
+    sensor_id = request.args.get("sensor_id")
+    metric = request.args.get("metric")
+    if not sensor_id or not metric:
+        try:
+            return jsonify(series_store.metrics(device_id))
+        except ValueError as e:
+            return jsonify({"status": "error", "message": f"Parámetro inválido: {e}"}), 400
+    
+    try:
+        end = float(request.args.get("end", time.time()))
+        start = float(request.args.get("start", end - 86400))
+        step = request.args.get("step")
+        step = int(step) if step is not None else None
+        points = int(request.args.get("points", 500))
+    except ValueError as e:
+        return jsonify({"status": "error", "message": f"Parámetro inválido: {e}"}), 400
+    if end <= start or (step is not None and step < 0) or points < 1:
+        return jsonify({"status": "error", "message": "Rango o paso inválido"}), 400
+    
+    try:
+        result = series_store.query(device_id, sensor_id, metric, start, end, step, points)
+    except ValueError as e:
+        return jsonify({"status": "error", "message": f"Parámetro inválido: {e}"}), 400
+    if result is None:
+        return jsonify({"status": "error", "message": "Serie no encontrada"}), 404
+    return jsonify(result)
+
+@app.route("/api/device/<device_id>/commands", methods=["GET"])
+def list_downlink_commands(device_id):
+    """List the downlink commands of a device, optionally filtered by status"""
+    commands = load_downlink_commands(device_id)
+    status = request.args.get("status")
+    if status:
+        commands = [entry for entry in commands if entry["status"] == status]
+    return jsonify(commands)
+
+@app.route("/api/device/<device_id>/commands", methods=["POST"])
+def queue_downlink_command_endpoint(device_id):
+    """Queue a downlink command to throttle, boost or trigger a device"""
+    command = request.get_json(silent=True)
+    if not command:
+        return jsonify({"status": "error", "message": "Se requiere comando JSON"}), 400
+    try:
+        entry = queue_downlink_command(device_id, command)
+    except (ValueError, TypeError) as e:
+        return jsonify({"status": "error", "message": str(e)}), 400
+    return jsonify({"status": "success", "command": entry}), 201
+
+@app.route("/api/device/<device_id>/application", methods=["GET"])
+def get_device_application(device_id):
+    """The firmware application of a device and the configuration values it names"""
+    application = load_device_application(device_id)
+    return jsonify({
+        "application": application,
+        "conf_ids": DOWNLINK_APPLICATIONS.get(application, {}),
+        "applications": sorted(DOWNLINK_APPLICATIONS)
+    })
+
+@app.route("/api/device/<device_id>/application", methods=["POST"])
+def set_device_application(device_id):
+    """Record the firmware application of a device, for naming conf_set values"""
+    application = (request.get_json(silent=True) or {}).get("application")
+    try:
+        save_device_application(device_id, application)
+    except ValueError as e:
+        return jsonify({"status": "error", "message": str(e)}), 400
+    return jsonify({"status": "success", "application": application,
+                    "conf_ids": DOWNLINK_APPLICATIONS[application]})
+
+@app.route("/api/device/<device_id>/commands/<int:sequence>/sent", methods=["POST"])
+def mark_downlink_command_sent(device_id, sequence):
+    """Mark a queued command as handed to the satellite network"""
+    with downlink_commands_lock(device_id):
+        commands = load_downlink_commands(device_id)
+        for entry in reversed(commands):
+            if entry["sequence"] == sequence and entry["status"] == "queued":
+                entry["status"] = "sent"
+                entry["sent_at"] = datetime.now().isoformat()
+                save_downlink_commands(device_id, commands)
+                return jsonify({"status": "success", "command": entry})
+    return jsonify({"status": "error", "message": "Comando no encontrado"}), 404
+
 @app.route("/api/file/delete", methods=["POST", "DELETE"])
 def delete_file():
     """Delete a specific JSON file"""
@@ -446,14 +1174,13 @@ def download_file():
     if not absolute_file.startswith(absolute_base):
         return jsonify({"error": "Acceso denegado"}), 403
     
-    if not os.path.exists(normalized_path):
-        return jsonify({"error": "Archivo no encontrado"}), 404
-    
     try:
-        return send_file(normalized_path, as_attachment=True, 
-                        download_name=os.path.basename(normalized_path))
+        response = record_response(normalized_path, download=True)
     except Exception as e:
         return jsonify({"error": str(e)}), 500
+    if response is None:
+        return jsonify({"error": "Archivo no encontrado"}), 404
+    return response
 
 if __name__ == "__main__":
     print(" Iniciando Gestor de Datos FlexSense")
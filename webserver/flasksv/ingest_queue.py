@@ -0,0 +1,293 @@
+"""
+Durable queue of received messages waiting to be processed.
+
+Webhook endpoints validate a message, enqueue it and answer straight away, so
+their latency doesn't depend on decoding and storage however many devices a
+satellite pass delivers at once. Messages are kept in
+sensor_data/ingest_queue.db (SQLite in WAL mode) until a worker has processed
+them, so none are lost if the server stops.
+
+Each message has a partition, the terminal it came from. Workers never process
+two messages of the same partition at once and take them oldest first, since
+decoding some frames depends on earlier frames of the same device. Workers are
+threads of the server process, as the packet store and device state files are
+owned by a single process. A message which fails is retried up to MAX_ATTEMPTS
+times and then kept as failed, so handlers must be idempotent: they're given
+the message's id and enqueue time, which are the same on every attempt.
+
+Webhooks can deliver a message more than once, e.g. retried after an outage.
+A message enqueued with a key (the Myriota message Id) records it in the seen
+table in the same transaction, and a later message with that key is dropped.
+A bloom filter of the seen keys answers for new keys without a query, so only
+replays (and the filter's rare false positives) cost a lookup. Keys are kept
+for SEEN_RETENTION_SECS.
+"""
+
+import hashlib
+import json
+import math
+import os
+import sqlite3
+import threading
+import time
+import traceback
+
+QUEUE_FILENAME = "ingest_queue.db"
+MAX_ATTEMPTS = 5
+RETRY_DELAY_SECS = 10
+POLL_SECS = 1.0
+SEEN_RETENTION_SECS = 30 * 24 * 3600
+BLOOM_CAPACITY = 1000000
+BLOOM_ERROR_RATE = 0.01
+
+SCHEMA = """
+CREATE TABLE IF NOT EXISTS messages (
+    id INTEGER PRIMARY KEY AUTOINCREMENT,
+    kind TEXT NOT NULL,
+    partition TEXT NOT NULL,
+    payload TEXT NOT NULL,
+    enqueued REAL NOT NULL,
+    state TEXT NOT NULL DEFAULT 'pending',
+    attempts INTEGER NOT NULL DEFAULT 0,
+    not_before REAL NOT NULL DEFAULT 0,
+    error TEXT
+);
+CREATE INDEX IF NOT EXISTS messages_by_state ON messages (state, id);
+CREATE TABLE IF NOT EXISTS seen (
+    key TEXT PRIMARY KEY,
+    received REAL NOT NULL
+) WITHOUT ROWID;
+CREATE INDEX IF NOT EXISTS seen_by_time ON seen (received);
+"""
+
+
+class BloomFilter:
+    """Set of strings with no false negatives and error_rate false positives up to capacity"""
+
+    def __init__(self, capacity, error_rate):
+        self.size = math.ceil(-capacity * math.log(error_rate) / math.log(2) ** 2)
+        self.hashes = max(1, round(self.size / capacity * math.log(2)))
+        self.bits = bytearray((self.size + 7) // 8)
+        self.count = 0
+        self.lock = threading.Lock()
+
+    def _positions(self, key):
+        digest = hashlib.blake2b(key.encode("utf-8"), digest_size=16).digest()
+        first = int.from_bytes(digest[:8], "little")
+        second = int.from_bytes(digest[8:], "little") | 1
+        return ((first + i * second) % self.size for i in range(self.hashes))
+
+    def add(self, key):
+        with self.lock:
+            for position in self._positions(key):
+                self.bits[position >> 3] |= 1 << (position & 7)
+            self.count += 1
+
+    def __contains__(self, key):
+        return all(self.bits[position >> 3] & (1 << (position & 7))
+                   for position in self._positions(key))
+
+
+class IngestQueue:
+    """SQLite queue of messages, one connection per thread"""
+
+    def __init__(self, base_dir):
+        self.path = os.path.join(base_dir, QUEUE_FILENAME)
+        self.local = threading.local()
+        self.available = threading.Condition()
+        with self.connection() as db:
+            db.executescript(SCHEMA)
+            # Messages being processed when the server stopped are processed again
+            db.execute("UPDATE messages SET state = 'pending' WHERE state = 'processing'")
+        self.bloom = self._load_bloom()
+        self.duplicates = 0
+
+    def connection(self):
+        db = getattr(self.local, "db", None)
+        if db is None:
+            db = sqlite3.connect(self.path, timeout=30, isolation_level=None)
+            db.row_factory = sqlite3.Row
+            db.execute("PRAGMA journal_mode=WAL")
+            db.execute("PRAGMA synchronous=NORMAL")
+            self.local.db = db
+        return db
+
+    def _load_bloom(self):
+        bloom = BloomFilter(BLOOM_CAPACITY, BLOOM_ERROR_RATE)
+        for row in self.connection().execute("SELECT key FROM seen"):
+            bloom.add(row["key"])
+        return bloom
+
+    def seen(self, key):
+        """Whether a message with this key was enqueued"""
+        if key not in self.bloom:
+            return False
+        row = self.connection().execute("SELECT 1 FROM seen WHERE key = ?", (key,)).fetchone()
+        if row is not None:
+            self.duplicates += 1
+        return row is not None
+
+    def enqueue(self, messages, key=None):
+        """
+        Add (kind, partition, payload) messages in one transaction, returning
+        their ids, or None without adding them if key was enqueued before
+        """
+        db = self.connection()
+        now = time.time()
+        ids = []
+        db.execute("BEGIN IMMEDIATE")
+        try:
+            if key is not None:
+                cursor = db.execute("INSERT OR IGNORE INTO seen VALUES (?, ?)", (key, now))
+                if cursor.rowcount == 0:
+                    db.execute("ROLLBACK")
+                    self.duplicates += 1
+                    return None
+            for kind, partition, payload in messages:
+                cursor = db.execute(
+                    "INSERT INTO messages (kind, partition, payload, enqueued) VALUES (?, ?, ?, ?)",
+                    (kind, partition, json.dumps(payload), now))
+                ids.append(cursor.lastrowid)
+            db.execute("COMMIT")
+        except BaseException:
+            db.execute("ROLLBACK")
+            raise
+        if key is not None:
+            self.bloom.add(key)
+        with self.available:
+            self.available.notify_all()
+        return ids
+
+    def prune_seen(self, now=None):
+        """Forget keys older than the retention, rebuilding a saturated bloom filter"""
+        now = time.time() if now is None else now
+        self.connection().execute(
+            "DELETE FROM seen WHERE received < ?", (now - SEEN_RETENTION_SECS,))
+        if self.bloom.count > BLOOM_CAPACITY:
+            self.bloom = self._load_bloom()
+
+    def claim(self):
+        """
+        Take the oldest pending message whose partition isn't being processed,
+        returning (id, kind, payload, enqueued) or None
+        """
+        db = self.connection()
+        db.execute("BEGIN IMMEDIATE")
+        try:
+            row = db.execute(
+                """SELECT id, kind, payload, enqueued FROM messages
+                   WHERE state = 'pending' AND not_before <= ?
+                       AND partition NOT IN (
+                           SELECT partition FROM messages WHERE state = 'processing')
+                       AND id = (SELECT MIN(id) FROM messages AS m
+                           WHERE m.partition = messages.partition AND m.state = 'pending')
+                   ORDER BY id LIMIT 1""",
+                (time.time(),)).fetchone()
+            if row is not None:
+                db.execute(
+                    "UPDATE messages SET state = 'processing', attempts = attempts + 1 WHERE id = ?",
+                    (row["id"],))
+            db.execute("COMMIT")
+        except BaseException:
+            db.execute("ROLLBACK")
+            raise
+        if row is None:
+            return None
+        return row["id"], row["kind"], json.loads(row["payload"]), row["enqueued"]
+
+    def done(self, message_id):
+        self.connection().execute("DELETE FROM messages WHERE id = ?", (message_id,))
+        with self.available:
+            self.available.notify_all()
+
+    def failed(self, message_id, error):
+        """Retry a message later, or keep it as failed once out of attempts"""
+        self.connection().execute(
+            """UPDATE messages SET
+                   state = CASE WHEN attempts >= ? THEN 'failed' ELSE 'pending' END,
+                   not_before = ?, error = ?
+               WHERE id = ?""",
+            (MAX_ATTEMPTS, time.time() + RETRY_DELAY_SECS, error, message_id))
+        with self.available:
+            self.available.notify_all()
+
+    def wait(self, timeout=POLL_SECS):
+        """Wait for messages to be enqueued or finished"""
+        with self.available:
+            self.available.wait(timeout)
+
+    def stats(self):
+        """Return the number of messages in each state and the oldest pending age"""
+        db = self.connection()
+        stats = {"pending": 0, "processing": 0, "failed": 0}
+        for row in db.execute("SELECT state, COUNT(*) AS count FROM messages GROUP BY state"):
+            stats[row["state"]] = row["count"]
+        oldest = db.execute(
+            "SELECT MIN(enqueued) FROM messages WHERE state != 'failed'").fetchone()[0]
+        stats["oldest_age_secs"] = round(time.time() - oldest, 1) if oldest else None
+        stats["duplicates_dropped"] = self.duplicates
+        return stats
+
+    def failures(self, limit=50):
+        """Return the most recent failed messages"""
+        rows = self.connection().execute(
+            """SELECT id, kind, partition, enqueued, attempts, error FROM messages
+               WHERE state = 'failed' ORDER BY id DESC LIMIT ?""", (limit,)).fetchall()
+        return [dict(row) for row in rows]
+
+
+class IngestWorkers:
+    """
+    Threads processing queued messages with a handler per message kind,
+    called with (payload, message_id, enqueued). idle is called by one of them
+    every idle_secs, for periodic work.
+    """
+
+    def __init__(self, queue, handlers, count=4, idle=None, idle_secs=60):
+        self.queue = queue
+        self.handlers = handlers
+        self.count = count
+        self.idle = idle
+        self.idle_secs = idle_secs
+        self.idle_lock = threading.Lock()
+        self.idle_last = time.time()
+        self.threads = []
+
+    def start(self):
+        if self.threads:
+            return
+        for i in range(self.count):
+            thread = threading.Thread(target=self.run, name=f"ingest-{i}", daemon=True)
+            thread.start()
+            self.threads.append(thread)
+
+    def run(self):
+        while True:
+            self.run_idle()
+            message = self.queue.claim()
+            if message is None:
+                self.queue.wait()
+                continue
+            self.process(*message)
+
+    def run_idle(self):
+        if self.idle is None or time.time() - self.idle_last < self.idle_secs:
+            return
+        if not self.idle_lock.acquire(blocking=False):
+            return
+        try:
+            self.idle_last = time.time()
+            self.idle()
+        except Exception as e:
+            print(f"❌ Error en tarea periódica de ingesta: {e}")
+        finally:
+            self.idle_lock.release()
+
+    def process(self, message_id, kind, payload, enqueued):
+        try:
+            self.handlers[kind](payload, message_id, enqueued)
+        except Exception as e:
+            print(f"❌ Error procesando mensaje {message_id} ({kind}): {e}")
+            self.queue.failed(message_id, traceback.format_exc())
+        else:
+            self.queue.done(message_id)
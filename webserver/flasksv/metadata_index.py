@@ -0,0 +1,262 @@
+"""
+Metadata index of the stored sensor data.
+
+Kept in sensor_data/metadata.db (SQLite in WAL mode, so page loads can read
+while a packet is being saved) and updated as packets are saved or deleted, so
+the dashboard and sensor listings are queries rather than walks of the data
+tree. Holds the records of each sensor with their receive time, and per sensor
+record counts, time ranges and the last value received. If the database is
+missing it is rebuilt from the data tree once.
+"""
+
+import json
+import os
+import sqlite3
+import threading
+from datetime import datetime
+
+from packet_store import record_filename
+
+INDEX_FILENAME = "metadata.db"
+
+SCHEMA = """
+CREATE TABLE IF NOT EXISTS sensors (
+    device_id TEXT NOT NULL,
+    sensor_id TEXT NOT NULL,
+    record_count INTEGER NOT NULL DEFAULT 0,
+    first_received REAL,
+    last_received REAL,
+    last_value TEXT,
+    PRIMARY KEY (device_id, sensor_id)
+);
+CREATE TABLE IF NOT EXISTS records (
+    device_id TEXT NOT NULL,
+    sensor_id TEXT NOT NULL,
+    name TEXT NOT NULL,
+    received REAL NOT NULL,
+    PRIMARY KEY (device_id, sensor_id, name)
+);
+-- Ordered as listings are, so a page is a range of the index
+CREATE INDEX IF NOT EXISTS records_by_received ON records (device_id, sensor_id, received, name);
+"""
+
+# Steps bringing an index of an older version (PRAGMA user_version) up to
+# date, run once in order
+MIGRATIONS = [
+    # 1: records_by_time was superseded by records_by_received
+    "DROP INDEX IF EXISTS records_by_time;",
+]
+
+
+def last_value_of(data):
+    """The value shown for a sensor's last record: its decoded data if any"""
+    if not isinstance(data, dict):
+        return data
+    return data.get("decoded_data") or data.get("raw_data")
+
+
+def legacy_received(sensor_path, filename):
+    """Receive time of a data_<timestamp>.json file saved before the packet store"""
+    timestamp_str = filename.replace('data_', '').replace('.json', '')
+    try:
+        return datetime.strptime(timestamp_str, "%Y%m%d_%H%M%S_%f").timestamp()
+    except ValueError:
+        return os.path.getmtime(os.path.join(sensor_path, filename))
+
+
+class MetadataIndex:
+    """SQLite index of devices, sensors and records, one connection per thread"""
+
+    def __init__(self, base_dir, packet_store):
+        self.base_dir = base_dir
+        self.packet_store = packet_store
+        self.path = os.path.join(base_dir, INDEX_FILENAME)
+        self.local = threading.local()
+        is_new = not os.path.exists(self.path)
+        with self.connection() as db:
+            db.executescript(SCHEMA)
+            version = db.execute("PRAGMA user_version").fetchone()[0]
+            for migration in MIGRATIONS[version:]:
+                db.executescript(migration)
+            db.execute(f"PRAGMA user_version = {len(MIGRATIONS)}")
+        if is_new:
+            self.rebuild()
+
+    def connection(self):
+        db = getattr(self.local, "db", None)
+        if db is None:
+            db = sqlite3.connect(self.path, timeout=30)
+            db.row_factory = sqlite3.Row
+            db.execute("PRAGMA journal_mode=WAL")
+            db.execute("PRAGMA synchronous=NORMAL")
+            self.local.db = db
+        return db
+
+    def record_added(self, device_id, sensor_id, name, received, data=None):
+        """Index a saved record"""
+        self.records_added([(device_id, sensor_id, name, received, data)])
+
+    def records_added(self, records):
+        """Index (device_id, sensor_id, name, received, data) records in one transaction"""
+        with self.connection() as db:
+            for device_id, sensor_id, name, received, data in records:
+                self._add(db, device_id, sensor_id, name, received, data)
+
+    def _add(self, db, device_id, sensor_id, name, received, data):
+        value = json.dumps(last_value_of(data)) if data is not None else None
+        cursor = db.execute(
+            "INSERT OR IGNORE INTO records VALUES (?, ?, ?, ?)",
+            (device_id, sensor_id, name, received))
+        if cursor.rowcount == 0:
+            return
+        db.execute(
+            """INSERT INTO sensors VALUES (?, ?, 1, ?, ?, ?)
+               ON CONFLICT (device_id, sensor_id) DO UPDATE SET
+                   record_count = record_count + 1,
+                   first_received = COALESCE(
+                       MIN(first_received, excluded.first_received), excluded.first_received),
+                   last_value = CASE
+                       WHEN last_received IS NULL OR excluded.last_received >= last_received
+                       THEN excluded.last_value ELSE last_value END,
+                   last_received = COALESCE(
+                       MAX(last_received, excluded.last_received), excluded.last_received)""",
+            (device_id, sensor_id, received, received, value))
+
+    def record_deleted(self, device_id, sensor_id, name):
+        """
+        Remove a deleted record, updating its sensor's count, time range and
+        last value, which is reloaded from the newest remaining record
+        """
+        with self.connection() as db:
+            cursor = db.execute(
+                "DELETE FROM records WHERE device_id = ? AND sensor_id = ? AND name = ?",
+                (device_id, sensor_id, name))
+            if cursor.rowcount == 0:
+                return
+            newest = db.execute(
+                """SELECT name FROM records WHERE device_id = ? AND sensor_id = ?
+                   ORDER BY received DESC, name DESC LIMIT 1""",
+                (device_id, sensor_id)).fetchone()
+            data = self.load_record(device_id, sensor_id, newest["name"]) if newest else None
+            db.execute(
+                """UPDATE sensors SET
+                       record_count = record_count - 1,
+                       first_received = (SELECT MIN(received) FROM records
+                           WHERE device_id = ?1 AND sensor_id = ?2),
+                       last_received = (SELECT MAX(received) FROM records
+                           WHERE device_id = ?1 AND sensor_id = ?2),
+                       last_value = ?3
+                   WHERE device_id = ?1 AND sensor_id = ?2""",
+                (device_id, sensor_id,
+                 json.dumps(last_value_of(data)) if data is not None else None))
+
+    def sensor_deleted(self, device_id, sensor_id):
+        with self.connection() as db:
+            db.execute("DELETE FROM records WHERE device_id = ? AND sensor_id = ?",
+                       (device_id, sensor_id))
+            db.execute("DELETE FROM sensors WHERE device_id = ? AND sensor_id = ?",
+                       (device_id, sensor_id))
+
+    def device_deleted(self, device_id):
+        with self.connection() as db:
+            db.execute("DELETE FROM records WHERE device_id = ?", (device_id,))
+            db.execute("DELETE FROM sensors WHERE device_id = ?", (device_id,))
+
+    def device_renamed(self, old_device_id, new_device_id):
+        with self.connection() as db:
+            db.execute("UPDATE records SET device_id = ? WHERE device_id = ?",
+                       (new_device_id, old_device_id))
+            db.execute("UPDATE sensors SET device_id = ? WHERE device_id = ?",
+                       (new_device_id, old_device_id))
+
+    def devices(self):
+        """Return {device_id: [sensor summary]} for the dashboard"""
+        devices = {}
+        rows = self.connection().execute(
+            "SELECT * FROM sensors ORDER BY device_id, sensor_id").fetchall()
+        for row in rows:
+            devices.setdefault(row["device_id"], []).append({
+                "name": row["sensor_id"],
+                "file_count": row["record_count"],
+                "first_received": row["first_received"],
+                "last_received": row["last_received"],
+                "last_value": json.loads(row["last_value"]) if row["last_value"] else None,
+            })
+        return devices
+
+    def sensor_summary(self, device_id, sensor_id):
+        """Return the record count and first and last receive times of a sensor"""
+        row = self.connection().execute(
+            """SELECT record_count, first_received, last_received FROM sensors
+               WHERE device_id = ? AND sensor_id = ?""",
+            (device_id, sensor_id)).fetchone()
+        if row is None:
+            return {"record_count": 0, "first_received": None, "last_received": None}
+        return dict(row)
+
+    def sensor_records_page(self, device_id, sensor_id, limit, after=None, start=None, end=None):
+        """
+        Return up to limit (name, received) of a sensor's records received in
+        [start, end), newest first, following the (received, name) of the last
+        record of the previous page
+        """
+        conditions = ["device_id = ?", "sensor_id = ?"]
+        params = [device_id, sensor_id]
+        if start is not None:
+            conditions.append("received >= ?")
+            params.append(start)
+        if end is not None:
+            conditions.append("received < ?")
+            params.append(end)
+        if after is not None:
+            conditions.append("(received, name) < (?, ?)")
+            params += list(after)
+        rows = self.connection().execute(
+            f"""SELECT name, received FROM records WHERE {" AND ".join(conditions)}
+                ORDER BY received DESC, name DESC LIMIT ?""",
+            params + [limit]).fetchall()
+        return [(row["name"], row["received"]) for row in rows]
+
+    def rebuild(self):
+        """Rebuild the index from the packet store and legacy JSON files"""
+        with self.connection() as db:
+            db.execute("DELETE FROM records")
+            db.execute("DELETE FROM sensors")
+        if not os.path.isdir(self.base_dir):
+            return
+        for device_id in os.listdir(self.base_dir):
+            device_path = os.path.join(self.base_dir, device_id)
+            if not os.path.isdir(device_path):
+                continue
+            for sensor_id in os.listdir(device_path):
+                sensor_path = os.path.join(device_path, sensor_id)
+                if not os.path.isdir(sensor_path):
+                    continue
+                records = [
+                    (record_filename(sequence), received)
+                    for sequence, received in self.packet_store.entries(device_id, sensor_id)
+                ]
+                records += [
+                    (filename, legacy_received(sensor_path, filename))
+                    for filename in os.listdir(sensor_path) if filename.endswith('.json')
+                ]
+                records.sort(key=lambda record: record[1])
+                # Only the newest record is loaded, for the sensor's last value
+                self.records_added([
+                    (device_id, sensor_id, name, received,
+                     self.load_record(device_id, sensor_id, name) if i == len(records) - 1
+                     else None)
+                    for i, (name, received) in enumerate(records)
+                ])
+        print(f"Índice de metadatos reconstruido: {self.path}")
+
+    def load_record(self, device_id, sensor_id, name):
+        record = self.packet_store.parse_record_path(
+            os.path.join(self.base_dir, device_id, sensor_id, name))
+        if record:
+            return self.packet_store.get(*record)
+        try:
+            with open(os.path.join(self.base_dir, device_id, sensor_id, name), 'r') as f:
+                return json.load(f)
+        except (OSError, ValueError):
+            return None
@@ -0,0 +1,464 @@
+"""
+Log-structured packet store.
+
+Each stream (the packets of one sensor of one device) is kept in
+sensor_data/<device_id>/<sensor_id>/segments as append-only segment files of
+length-prefixed records, rather than one JSON file per packet:
+
+    segment_<first sequence>.log     records: length (u32) | crc32 (u32) | JSON
+    segment_<first sequence>.idx     one entry per record: offset (u32) | time (u32)
+
+Index times are receive times truncated to whole seconds, so time ranges are
+resolved to the second (metadata.db keeps the exact receive times). They are
+taken from the wall clock, so they aren't necessarily in sequence order.
+
+Appending writes one record and one index entry, and reading a record by its
+sequence number is one index lookup and one read, however long the history.
+Once the active segment reaches SEGMENT_MAX_BYTES it is sealed and compressed
+to segment_<first sequence>.log.gz, and a new segment is started. Deleted
+records are listed in a tombstones file rather than rewriting segments.
+
+Records can be appended with a key, e.g. the queued message and packet they
+came from, which is kept in the record's KEY_FIELD. A record whose key was
+appended already at the same time isn't appended again, so a batch can be
+retried after a failure without duplicating the records the first attempt
+saved.
+
+A store opened read only, e.g. by offline tools while the server is running,
+recovers the active segments in memory without truncating them, rewriting
+their indexes or opening them for appending, so it never changes the files.
+"""
+
+import bisect
+import gzip
+import json
+import os
+import re
+import shutil
+import struct
+import threading
+import time
+import zlib
+
+SEGMENTS_DIRNAME = "segments"
+SEGMENT_PREFIX = "segment_"
+SEGMENT_SUFFIX = ".log"
+COMPRESSED_SUFFIX = ".log.gz"
+INDEX_SUFFIX = ".idx"
+TOMBSTONES_FILENAME = "tombstones"
+SEGMENT_MAX_BYTES = 1024 * 1024
+# Decompressed sealed segments kept in memory for reads
+SEGMENT_CACHE_SIZE = 4
+
+RECORD_HEADER = struct.Struct("<II")
+INDEX_ENTRY = struct.Struct("<II")
+TOMBSTONE = struct.Struct("<Q")
+
+# Field holding the key of records appended with one
+KEY_FIELD = "ingest_key"
+
+# Records are addressed by the app with a virtual file name in the sensor folder
+RECORD_FILENAME_RE = re.compile(r"^record_(\d+)\.json$")
+
+
+def record_filename(sequence):
+    """Virtual file name of a record, used by the web interface"""
+    return f"record_{sequence:010d}.json"
+
+
+def encode_record(record):
+    payload = json.dumps(record, separators=(",", ":")).encode("utf-8")
+    return RECORD_HEADER.pack(len(payload), zlib.crc32(payload)) + payload
+
+
+def decode_record(buffer, offset):
+    """Decode the record at offset, or return None if it is torn or corrupt"""
+    if offset + RECORD_HEADER.size > len(buffer):
+        return None, offset
+    length, crc = RECORD_HEADER.unpack_from(buffer, offset)
+    start = offset + RECORD_HEADER.size
+    payload = bytes(buffer[start:start + length])
+    if len(payload) != length or zlib.crc32(payload) != crc:
+        return None, offset
+    return payload, start + length
+
+
+class Stream:
+    """The segments of one device sensor"""
+
+    def __init__(self, path, segment_max_bytes, fsync, read_only=False):
+        self.path = path
+        self.segment_max_bytes = segment_max_bytes
+        self.fsync = fsync
+        self.read_only = read_only
+        self.cache = {}
+        self.log_file = None
+        self.index_file = None
+        if not read_only:
+            os.makedirs(path, exist_ok=True)
+
+        # The indexes of sealed segments are kept in memory, and the last base
+        # is the active segment
+        self.bases = sorted(
+            int(name[len(SEGMENT_PREFIX):-len(INDEX_SUFFIX)])
+            for name in os.listdir(path)
+            if name.startswith(SEGMENT_PREFIX) and name.endswith(INDEX_SUFFIX)
+        )
+        self.indexes = {}
+        for base in self.bases[:-1]:
+            with open(self._path(base, INDEX_SUFFIX), "rb") as f:
+                self.indexes[base] = f.read()
+        if not self.bases:
+            self.bases.append(0)
+        self._open_active(self.bases[-1])
+
+        self.deleted = set()
+        tombstones_path = os.path.join(path, TOMBSTONES_FILENAME)
+        if os.path.exists(tombstones_path):
+            with open(tombstones_path, "rb") as f:
+                data = f.read()
+            usable = len(data) - len(data) % TOMBSTONE.size
+            self.deleted = {entry[0] for entry in TOMBSTONE.iter_unpack(data[:usable])}
+
+    def _path(self, base, suffix):
+        return os.path.join(self.path, f"{SEGMENT_PREFIX}{base:010d}{suffix}")
+
+    def _open_active(self, base):
+        """
+        Open the active segment for appending, recovering from a torn write. A
+        read only stream only recovers the index in memory.
+        """
+        log_path = self._path(base, SEGMENT_SUFFIX)
+        index_path = self._path(base, INDEX_SUFFIX)
+        if not os.path.exists(log_path) and os.path.exists(log_path + ".gz"):
+            # Sealed but the next segment wasn't started before a crash
+            with open(index_path, "rb") as f:
+                self.indexes[base] = f.read()
+            base += len(self.indexes[base]) // INDEX_ENTRY.size
+            self.bases.append(base)
+            log_path = self._path(base, SEGMENT_SUFFIX)
+            index_path = self._path(base, INDEX_SUFFIX)
+
+        data = b""
+        if os.path.exists(log_path):
+            with open(log_path, "rb") as f:
+                data = f.read()
+        index = bytearray()
+        if os.path.exists(index_path):
+            with open(index_path, "rb") as f:
+                index = bytearray(f.read())
+        index = index[:len(index) - len(index) % INDEX_ENTRY.size]
+
+        # Keep the indexed records that are intact, then index any records
+        # written after the last index entry, and drop a trailing partial record.
+        # Those records were written by the last append, so they are given the
+        # time the log was last written rather than the recovery time.
+        end = 0
+        last_timestamp = 0
+        valid = bytearray()
+        for offset, timestamp in INDEX_ENTRY.iter_unpack(bytes(index)):
+            payload, next_offset = decode_record(data, offset)
+            if payload is None or offset != end:
+                break
+            valid += INDEX_ENTRY.pack(offset, timestamp)
+            end = next_offset
+            last_timestamp = timestamp
+        if os.path.exists(log_path):
+            last_timestamp = max(last_timestamp, int(os.path.getmtime(log_path)))
+        while True:
+            payload, next_offset = decode_record(data, end)
+            if payload is None:
+                break
+            valid += INDEX_ENTRY.pack(end, last_timestamp)
+            end = next_offset
+
+        self.active_base = base
+        self.active_index = valid
+        self.active_size = end
+        if self.read_only:
+            return
+
+        with open(log_path, "ab") as f:
+            f.truncate(end)
+        with open(index_path, "wb") as f:
+            f.write(valid)
+        self.log_file = open(log_path, "ab")
+        self.index_file = open(index_path, "ab")
+
+    def _seal(self):
+        """Compress the active segment and start a new one"""
+        base = self.active_base
+        self.log_file.close()
+        self.index_file.close()
+        log_path = self._path(base, SEGMENT_SUFFIX)
+        with open(log_path, "rb") as source, gzip.open(log_path + ".gz", "wb") as target:
+            shutil.copyfileobj(source, target)
+        os.remove(log_path)
+        self.indexes[base] = bytes(self.active_index)
+
+        next_base = base + len(self.active_index) // INDEX_ENTRY.size
+        self.bases.append(next_base)
+        self._open_active(next_base)
+
+    def close(self):
+        if self.log_file is not None:
+            self.log_file.close()
+            self.index_file.close()
+
+    def count(self):
+        return self.active_base + len(self.active_index) // INDEX_ENTRY.size
+
+    def append(self, records):
+        """Append (record, timestamp) pairs, syncing once, and return their sequence numbers"""
+        sequences = []
+        entries = bytearray()
+        for record, timestamp in records:
+            data = encode_record(record)
+            entries += INDEX_ENTRY.pack(self.active_size, int(timestamp))
+            self.log_file.write(data)
+            self.active_size += len(data)
+            sequences.append(self.count() + len(entries) // INDEX_ENTRY.size - 1)
+            if self.active_size >= self.segment_max_bytes:
+                self._sync(entries)
+                entries = bytearray()
+                self._seal()
+        self._sync(entries)
+        return sequences
+
+    def _sync(self, entries):
+        # Records are written before their index entries, so a crash in between
+        # leaves records which are re-indexed on open
+        self.log_file.flush()
+        self.index_file.write(entries)
+        self.index_file.flush()
+        if self.fsync:
+            os.fsync(self.log_file.fileno())
+            os.fsync(self.index_file.fileno())
+        self.active_index += entries
+
+    def _locate(self, sequence):
+        """Return the segment base and index bytes holding a sequence number"""
+        if not 0 <= sequence < self.count():
+            return None, None
+        base = self.bases[bisect.bisect_right(self.bases, sequence) - 1]
+        index = self.active_index if base == self.active_base else self.indexes[base]
+        return base, index
+
+    def _sealed_data(self, base):
+        if base not in self.cache:
+            if len(self.cache) >= SEGMENT_CACHE_SIZE:
+                self.cache.pop(next(iter(self.cache)))
+            with gzip.open(self._path(base, COMPRESSED_SUFFIX), "rb") as f:
+                self.cache[base] = f.read()
+        return self.cache[base]
+
+    def entry(self, sequence):
+        """Return the (offset, timestamp) index entry of a sequence number"""
+        base, index = self._locate(sequence)
+        if base is None:
+            return None
+        return INDEX_ENTRY.unpack_from(index, (sequence - base) * INDEX_ENTRY.size)
+
+    def read(self, sequence):
+        payload = self.read_payload(sequence)
+        return json.loads(payload) if payload is not None else None
+
+    def read_payload(self, sequence):
+        """Return the JSON bytes of a record, or None if deleted or corrupt"""
+        if sequence in self.deleted:
+            return None
+        base, index = self._locate(sequence)
+        if base is None:
+            return None
+        offset, _ = INDEX_ENTRY.unpack_from(index, (sequence - base) * INDEX_ENTRY.size)
+        if base == self.active_base:
+            with open(self._path(base, SEGMENT_SUFFIX), "rb") as f:
+                f.seek(offset)
+                length, crc = RECORD_HEADER.unpack(f.read(RECORD_HEADER.size))
+                payload = f.read(length)
+            if zlib.crc32(payload) != crc:
+                return None
+        else:
+            payload, _ = decode_record(self._sealed_data(base), offset)
+        return payload
+
+    def find_keys(self, keys, timestamp):
+        """
+        Return {key: sequence} of the records holding one of keys, looking back
+        from the last record through those appended at or after timestamp
+        """
+        found = {}
+        since = int(timestamp)
+        for sequence in range(self.count() - 1, -1, -1):
+            if len(found) == len(keys) or self.entry(sequence)[1] < since:
+                break
+            payload = self.read_payload(sequence)
+            key = json.loads(payload).get(KEY_FIELD) if payload is not None else None
+            if key in keys:
+                found[key] = sequence
+        return found
+
+    def delete(self, sequence):
+        if sequence in self.deleted or not 0 <= sequence < self.count():
+            return False
+        with open(os.path.join(self.path, TOMBSTONES_FILENAME), "ab") as f:
+            f.write(TOMBSTONE.pack(sequence))
+        self.deleted.add(sequence)
+        return True
+
+
+class PacketStore:
+    """Append-only packet storage for every device sensor under a base directory"""
+
+    def __init__(self, base_dir, segment_max_bytes=SEGMENT_MAX_BYTES, fsync=False,
+                 read_only=False):
+        self.base_dir = base_dir
+        self.segment_max_bytes = segment_max_bytes
+        self.fsync = fsync
+        self.read_only = read_only
+        self.streams = {}
+        self.lock = threading.RLock()
+
+    def stream_path(self, device_id, sensor_id):
+        return os.path.join(self.base_dir, device_id, sensor_id, SEGMENTS_DIRNAME)
+
+    def _stream(self, device_id, sensor_id, create=False):
+        key = (device_id, sensor_id)
+        stream = self.streams.get(key)
+        if stream is None:
+            path = self.stream_path(device_id, sensor_id)
+            if not create and not os.path.isdir(path):
+                return None
+            stream = Stream(path, self.segment_max_bytes, self.fsync, self.read_only)
+            self.streams[key] = stream
+        return stream
+
+    def append(self, device_id, sensor_id, record, timestamp=None):
+        """Append a record and return its sequence number"""
+        return self.append_batch([(device_id, sensor_id, record, timestamp)])[0]
+
+    def append_batch(self, items, keys=None):
+        """
+        Append (device_id, sensor_id, record, timestamp) items, e.g. the packets
+        of one webhook, writing and syncing each stream once. Returns the
+        sequence number of each item. If keys are given, one per item, an item
+        whose key was appended at the same timestamp isn't appended again and
+        the sequence of the existing record is returned.
+        """
+        if self.read_only:
+            raise ValueError("packet store is read only")
+        with self.lock:
+            grouped = {}
+            for position, (device_id, sensor_id, record, timestamp) in enumerate(items):
+                if timestamp is None:
+                    timestamp = time.time()
+                key = keys[position] if keys else None
+                if key is not None:
+                    record = dict(record, **{KEY_FIELD: key})
+                grouped.setdefault((device_id, sensor_id), []).append(
+                    (position, record, timestamp, key))
+            sequences = [None] * len(items)
+            for (device_id, sensor_id), group in grouped.items():
+                stream = self._stream(device_id, sensor_id, create=True)
+                group_keys = {key for _, _, _, key in group if key is not None}
+                if group_keys:
+                    found = stream.find_keys(
+                        group_keys, min(timestamp for _, _, timestamp, _ in group))
+                    for position, _, _, key in group:
+                        if key in found:
+                            sequences[position] = found[key]
+                    group = [item for item in group if item[3] not in found]
+                appended = stream.append([(record, timestamp) for _, record, timestamp, _ in group])
+                for (position, _, _, _), sequence in zip(group, appended):
+                    sequences[position] = sequence
+            return sequences
+
+    def get(self, device_id, sensor_id, sequence):
+        """Return a record, or None if it doesn't exist or was deleted"""
+        with self.lock:
+            stream = self._stream(device_id, sensor_id)
+            return stream.read(sequence) if stream else None
+
+    def get_payload(self, device_id, sensor_id, sequence):
+        """Return a record's JSON bytes as stored, without parsing them"""
+        with self.lock:
+            stream = self._stream(device_id, sensor_id)
+            return stream.read_payload(sequence) if stream else None
+
+    def stat(self, device_id, sensor_id, sequence):
+        """
+        Return the (offset, timestamp) index entry of a record, or None if it
+        doesn't exist or was deleted. Records never change once appended, so
+        this identifies a record's content without reading it.
+        """
+        with self.lock:
+            stream = self._stream(device_id, sensor_id)
+            if stream is None or sequence in stream.deleted:
+                return None
+            return stream.entry(sequence)
+
+    def count(self, device_id, sensor_id):
+        """Return the number of records which haven't been deleted"""
+        with self.lock:
+            stream = self._stream(device_id, sensor_id)
+            return stream.count() - len(stream.deleted) if stream else 0
+
+    def entries(self, device_id, sensor_id, reverse=False):
+        """Return the (sequence, timestamp) of each record which hasn't been deleted"""
+        with self.lock:
+            stream = self._stream(device_id, sensor_id)
+            if stream is None:
+                return []
+            sequences = range(stream.count())
+            if reverse:
+                sequences = reversed(sequences)
+            return [
+                (sequence, stream.entry(sequence)[1])
+                for sequence in sequences if sequence not in stream.deleted
+            ]
+
+    def range(self, device_id, sensor_id, start_time=None, end_time=None):
+        """
+        Yield the (sequence, timestamp, record) of records received in
+        [start, end), in sequence order, comparing their whole second times
+        """
+        for sequence, timestamp in self.entries(device_id, sensor_id):
+            if start_time is not None and timestamp < start_time:
+                continue
+            # Times aren't ordered if the clock was stepped back, so every
+            # entry is checked
+            if end_time is not None and timestamp >= end_time:
+                continue
+            record = self.get(device_id, sensor_id, sequence)
+            if record is not None:
+                yield sequence, timestamp, record
+
+    def delete(self, device_id, sensor_id, sequence):
+        """Mark a record as deleted"""
+        if self.read_only:
+            raise ValueError("packet store is read only")
+        with self.lock:
+            stream = self._stream(device_id, sensor_id)
+            return stream.delete(sequence) if stream else False
+
+    def close(self, device_id=None):
+        """Close open segments, e.g. before a device folder is renamed or deleted"""
+        with self.lock:
+            for key in list(self.streams):
+                if device_id is None or key[0] == device_id:
+                    self.streams.pop(key).close()
+
+    def record_path(self, device_id, sensor_id, sequence):
+        """Virtual path of a record in its sensor folder"""
+        return os.path.join(self.base_dir, device_id, sensor_id, record_filename(sequence))
+
+    def parse_record_path(self, path):
+        """Return the (device_id, sensor_id, sequence) of a virtual record path, or None"""
+        relative = os.path.relpath(os.path.abspath(path), os.path.abspath(self.base_dir))
+        parts = relative.split(os.sep)
+        if len(parts) != 3:
+            return None
+        match = RECORD_FILENAME_RE.match(parts[2])
+        if not match:
+            return None
+        return parts[0], parts[1], int(match.group(1))
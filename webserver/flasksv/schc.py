@@ -0,0 +1,394 @@
+"""
+SCHC NO-ACK reassembly of the fragments sent by send_img_test.c, both online as
+fragments are received and offline by defrag.py.
+
+Fragments are RuleID(2)|FCN(6)|payload. The first fragment of a datagram has
+FCN 62 and each following one the next lower FCN. The final fragment has FCN
+63 (All-1) and carries the RCS, the CRC-32 of the datagram, before its payload,
+which is zero padded to the MTU.
+
+A device sends many datagrams over time with the same rule, and fragments can
+arrive out of order or more than once. Fragments are grouped into one session
+per device and rule, in the order they arrive:
+
+- A fragment with the FCN of one already received but other data, one arriving
+  SESSION_TIMEOUT_SECS after the previous fragment, or one arriving
+  FINAL_GRACE_SECS after the final fragment starts a new session.
+- Otherwise a fragment with the same FCN and payload as one already received
+  is a duplicate, and is ignored.
+- A session completes once the final fragment and every fragment from FCN 62
+  down to the lowest received have arrived and the RCS matches, as the last
+  fragments before the final can only be missed by the CRC. The next fragment
+  starts a new session even if it repeats the completed datagram's bytes, as
+  when a device sends the same image again, unless it is a late copy: one
+  repeating a fragment of the completed datagram before the time that datagram
+  took (at most FINAL_GRACE_SECS) has passed since the fragment first arrived.
+  A fragment sent again can't arrive that soon. Late copies are ignored.
+
+A session which doesn't complete is closed as restarted, or timed out if no
+fragment arrives for SESSION_TIMEOUT_SECS. Either way its datagram is returned
+with the CRC result. Each fragment costs the same however many a device has
+sent, so grouping is linear in the number of fragments.
+
+Online, sessions are kept in sensor_data/{device_id}/schc_sessions.json so
+that a datagram sent over several days survives restarts. They are only saved
+once the records of the fragments and of the datagrams they closed are stored,
+so a message which fails to store is reassembled again when it is retried. Fragments are
+decoded and checked by the codec shared with the devices (schc_codec.py).
+"""
+
+import json
+import os
+import sys
+import threading
+import time
+
+from schc_codec import (FCN_ALL1, FCN_FIRST, FINAL_PAYLOAD_SIZE, FRAGMENT_PAYLOAD_SIZE,
+                        crc32, decode_fragment, encode_fragments)
+
+SESSIONS_FILENAME = "schc_sessions.json"
+
+# Rules used by devices for fragmented datagrams
+RULE_IDS = {0x01}
+SESSION_TIMEOUT_SECS = 3 * 24 * 3600
+# Fragments delivered out of order can follow the final fragment
+FINAL_GRACE_SECS = 12 * 3600
+
+
+def parse_fragment(byte_data):
+    """
+    Parse a fragment, returning {rule_id, fcn, payload, rcs} or None if the
+    frame isn't a fragment of a known rule
+    """
+    fragment = decode_fragment(byte_data) if byte_data else None
+    if fragment is None or fragment["rule_id"] not in RULE_IDS:
+        return None
+    return fragment
+
+
+def missing_fcns(fcns):
+    """The FCNs missing between FCN_FIRST and the lowest received"""
+    if not fcns:
+        return []
+    return [fcn for fcn in range(FCN_FIRST, min(fcns) - 1, -1) if fcn not in fcns]
+
+
+def reassemble(fragments, final):
+    """
+    Reassemble a datagram from {fcn: payload} and the final fragment, returning
+    (datagram, crc_ok). The datagram is the start of the fragment payloads, and
+    its padding can't be told apart from trailing zeros of the datagram, so the
+    CRC decides where it ends. It can end up to 3 bytes before the final
+    fragment, whose payload is then empty.
+    """
+    body = b"".join(fragments[fcn] for fcn in sorted(fragments, reverse=True))
+    payload = final["payload"] if final else b""
+    stripped = (body + payload).rstrip(b"\0")
+    if final:
+        padded = body + payload
+        length = max(len(stripped), len(body) - (FRAGMENT_PAYLOAD_SIZE - FINAL_PAYLOAD_SIZE - 1))
+        crc = crc32(padded[:length])
+        for length in range(length, len(padded) + 1):
+            if crc == final["rcs"]:
+                return padded[:length], True
+            crc = crc32(padded[length:length + 1], crc)
+    return stripped, False
+
+
+def new_session(received):
+    return {"started": received, "updated": received, "fragments": {}, "final": None,
+            "duplicates": 0}
+
+
+def decode_session(session):
+    """Return the {fcn: payload} and final fragment of a session"""
+    fragments = {int(fcn): bytes.fromhex(payload)
+                 for fcn, payload in session["fragments"].items()}
+    final = session["final"]
+    if final is not None:
+        final = {"rcs": final["rcs"], "payload": bytes.fromhex(final["payload"])}
+    return fragments, final
+
+
+def is_complete(session):
+    if session["final"] is None or missing_fcns([int(f) for f in session["fragments"]]):
+        return False
+    _, crc_ok = reassemble(*decode_session(session))
+    return crc_ok
+
+
+def holds_fragment(session, fcn, payload_hex, rcs):
+    """Whether a session holds a fragment"""
+    if fcn == str(FCN_ALL1):
+        final = session["final"]
+        return final is not None and final["payload"] == payload_hex and final["rcs"] == rcs
+    return session["fragments"].get(fcn) == payload_hex
+
+
+def previous_of(session):
+    """What the session after a completed one keeps to recognise late copies of its fragments"""
+    return {"fragments": session["fragments"], "final": session["final"],
+            "received": session.get("received", {}), "started": session["started"],
+            "completed": session["updated"]}
+
+
+def is_copy(previous, fcn, payload_hex, rcs, received):
+    """
+    Whether a fragment is a late copy of one of the previous datagram's. Sent
+    again, a fragment can't arrive before the time the previous datagram took
+    has passed since it first arrived, and copies are expected within
+    FINAL_GRACE_SECS.
+    """
+    if previous is None or fcn not in previous["received"]:
+        return False
+    window = min(FINAL_GRACE_SECS, previous["completed"] - previous["started"])
+    return (received - previous["received"][fcn] < window and
+            holds_fragment(previous, fcn, payload_hex, rcs))
+
+
+def apply_fragment(sessions, fragment, received, timeout_secs=SESSION_TIMEOUT_SECS):
+    """
+    Apply a parsed fragment to the session of its rule in sessions, a dict of
+    rule ID (as a string) to session. Returns the (rule_id, session, status) of
+    sessions closed by it. A completed session is kept, marked complete, until
+    the next fragment which isn't a late copy of one of its own starts a new
+    session.
+    """
+    key = str(fragment["rule_id"])
+    fcn = str(fragment["fcn"])
+    payload_hex = fragment["payload"].hex()
+    closed = []
+
+    session = sessions.get(key)
+    previous = None
+    if session is not None and session.get("complete"):
+        previous = previous_of(session)
+        if is_copy(previous, fcn, payload_hex, fragment["rcs"], received):
+            session["duplicates"] = session.get("duplicates", 0) + 1
+            return closed
+        session = None
+    elif session is not None:
+        previous = session.get("previous")
+        final = session["final"]
+        if fragment["fcn"] == FCN_ALL1:
+            received_before = final is not None
+            conflicts = received_before and (
+                final["payload"] != payload_hex or final["rcs"] != fragment["rcs"])
+        else:
+            received_before = fcn in session["fragments"]
+            conflicts = received_before and session["fragments"][fcn] != payload_hex
+        if received - session["updated"] >= timeout_secs:
+            closed.append((fragment["rule_id"], session, "timeout"))
+            session = None
+        elif is_copy(previous, fcn, payload_hex, fragment["rcs"], received):
+            session["duplicates"] = session.get("duplicates", 0) + 1
+            return closed
+        elif conflicts or (final is not None and
+                           received - final.get("received", session["updated"]) >= FINAL_GRACE_SECS):
+            closed.append((fragment["rule_id"], session, "restarted"))
+            session = None
+        elif received_before:
+            session["duplicates"] = session.get("duplicates", 0) + 1
+            session["updated"] = max(session["updated"], received)
+            return closed
+    if session is None:
+        session = sessions[key] = new_session(received)
+        if previous is not None:
+            session["previous"] = previous
+
+    session["updated"] = max(session["updated"], received)
+    session.setdefault("received", {}).setdefault(fcn, received)
+    if fragment["fcn"] == FCN_ALL1:
+        session["final"] = {"rcs": fragment["rcs"], "payload": payload_hex, "received": received}
+    else:
+        session["fragments"][fcn] = payload_hex
+
+    if is_complete(session):
+        session["complete"] = True
+        closed.append((fragment["rule_id"], session, "complete"))
+    return closed
+
+
+def session_result(device_id, rule_id, session, status):
+    """The datagram of a closed session, with its CRC result"""
+    fragments, final = decode_session(session)
+    datagram, crc_ok = reassemble(fragments, final)
+    result = {
+        "device_id": device_id,
+        "rule_id": rule_id,
+        "status": status,
+        "crc_ok": crc_ok,
+        "rcs": f"0x{final['rcs']:08X}" if final else None,
+        "calculated_crc": f"0x{crc32(datagram):08X}",
+        "fragments": len(fragments) + (final is not None),
+        "duplicates": session.get("duplicates", 0),
+        "missing_fcns": missing_fcns(list(fragments)),
+        "final_received": final is not None,
+        "first_fragment_received": session["started"],
+        "last_fragment_received": session["updated"],
+        "length": len(datagram),
+        "payload_hex": datagram.hex(),
+    }
+    try:
+        result["text"] = datagram.decode('utf-8')
+    except UnicodeDecodeError:
+        pass
+    return result
+
+
+def group_fragments(device_id, frames, timeout_secs=SESSION_TIMEOUT_SECS):
+    """
+    Group a device's (received, byte_data) frames, in the order received, into
+    datagrams. Frames which aren't fragments are skipped. Yields the result of
+    each session as it closes, then those left open as incomplete.
+    """
+    sessions = {}
+    for received, byte_data in frames:
+        fragment = parse_fragment(byte_data)
+        if fragment is None:
+            continue
+        for rule_id, session, status in apply_fragment(sessions, fragment, received, timeout_secs):
+            yield session_result(device_id, rule_id, session, status)
+    for key, session in sessions.items():
+        if not session.get("complete"):
+            yield session_result(device_id, int(key), session, "incomplete")
+
+
+class SCHCReassembler:
+    """Per device and rule reassembly sessions, persisted in the device folders"""
+
+    def __init__(self, base_dir, timeout_secs=SESSION_TIMEOUT_SECS):
+        self.base_dir = base_dir
+        self.timeout_secs = timeout_secs
+        self.lock = threading.Lock()
+        # Devices whose sessions are loaded for fragments to be applied
+        self.staged = set()
+
+    def _sessions_path(self, device_id):
+        return os.path.join(self.base_dir, device_id, SESSIONS_FILENAME)
+
+    def _load(self, device_id):
+        path = self._sessions_path(device_id)
+        if not os.path.exists(path):
+            return {}
+        with open(path, 'r') as f:
+            return json.load(f)
+
+    def _save(self, device_id, sessions):
+        path = self._sessions_path(device_id)
+        if not sessions:
+            if os.path.exists(path):
+                os.remove(path)
+            return
+        os.makedirs(os.path.dirname(path), exist_ok=True)
+        with open(path + ".tmp", 'w') as f:
+            json.dump(sessions, f, indent=2)
+        os.replace(path + ".tmp", path)
+
+    def stage(self, device_id):
+        """
+        Load a device's sessions for fragments to be applied to them with
+        apply(). expire() leaves the device alone until they are saved with
+        commit() or dropped with release().
+        """
+        with self.lock:
+            self.staged.add(device_id)
+            return self._load(device_id)
+
+    def apply(self, device_id, sessions, byte_data, received=None):
+        """
+        Apply a frame to a device's staged sessions. Returns (fragment,
+        datagrams) where fragment is the parsed fragment or None if the frame
+        isn't one, and datagrams those completed or abandoned because of it.
+        """
+        fragment = parse_fragment(byte_data)
+        if fragment is None:
+            return None, []
+        received = time.time() if received is None else received
+        closed = apply_fragment(sessions, fragment, received, self.timeout_secs)
+        return fragment, [session_result(device_id, *c) for c in closed]
+
+    def commit(self, device_id, sessions):
+        """Save a device's staged sessions"""
+        with self.lock:
+            self._save(device_id, sessions)
+            self.staged.discard(device_id)
+
+    def release(self, device_id):
+        """Drop a device's staged sessions, leaving those saved unchanged"""
+        with self.lock:
+            self.staged.discard(device_id)
+
+    def expire(self, save, now=None):
+        """
+        Drop sessions without fragments for the timeout, passing the datagrams
+        of those which didn't complete to save first. If save raises, the
+        sessions are kept and expired again by the next call.
+        """
+        now = time.time() if now is None else now
+        if not os.path.isdir(self.base_dir):
+            return
+        with self.lock:
+            for device_id in os.listdir(self.base_dir):
+                if device_id in self.staged or not os.path.exists(self._sessions_path(device_id)):
+                    continue
+                sessions = self._load(device_id)
+                datagrams = []
+                for key in list(sessions):
+                    if now - sessions[key]["updated"] < self.timeout_secs:
+                        continue
+                    session = sessions.pop(key)
+                    if not session.get("complete"):
+                        datagrams.append(session_result(device_id, int(key), session, "timeout"))
+                if datagrams:
+                    save(datagrams)
+                self._save(device_id, sessions)
+
+    def sessions(self, device_id):
+        """Return the open sessions of a device with their missing fragments"""
+        with self.lock:
+            sessions = self._load(device_id)
+        return {
+            key: {
+                "started": session["started"],
+                "updated": session["updated"],
+                "fragments": len(session["fragments"]) + (session["final"] is not None),
+                "duplicates": session.get("duplicates", 0),
+                "final_received": session["final"] is not None,
+                "missing_fcns": missing_fcns([int(f) for f in session["fragments"]]),
+            }
+            for key, session in sessions.items() if not session.get("complete")
+        }
+
+
+def check_resend(datagram_size=711, fragments_per_day=20, sends=2):
+    """
+    Group the same datagram sent several times back to back at the device's
+    fragment rate, each fragment also arriving again an hour later, and raise
+    ValueError unless every send completes with the datagram. Returns the
+    number of datagrams checked.
+    """
+    datagram = bytes((i * 7 + 3) % 256 for i in range(datagram_size))
+    spacing = 24 * 3600 / fragments_per_day
+    frames = []
+    for packet in encode_fragments(1, datagram) * sends:
+        received = len(frames) / 2 * spacing
+        frames += [(received, packet), (received + 3600, packet)]
+    frames.sort(key=lambda frame: frame[0])
+    results = list(group_fragments("check", frames))
+    statuses = [result["status"] for result in results]
+    if statuses != ["complete"] * sends:
+        raise ValueError(f"sessions closed as {statuses}")
+    for result in results:
+        if bytes.fromhex(result["payload_hex"]) != datagram or not result["crc_ok"]:
+            raise ValueError("datagram not reassembled")
+    return len(results)
+
+
+if __name__ == "__main__":
+    try:
+        count = check_resend()
+    except ValueError as e:
+        print(f"❌ Reensamblado SCHC: {e}")
+        sys.exit(1)
+    print(f"✅ Reensamblado SCHC: {count} datagramas repetidos completos")
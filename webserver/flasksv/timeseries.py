@@ -0,0 +1,417 @@
+"""
+Columnar time-series store of decoded sensor readings.
+
+Each series (one metric of one sensor of a device, e.g. temperature_celsius of
+the temperature sensor) is kept in
+sensor_data/<device_id>/<sensor_id>/series/<metric>/:
+
+    active_<first point>.ts    points being appended: time (i64 ms) | value (f64)
+    chunk_<first point>.tsz    sealed points: header, then zlib compressed
+                               delta encoded times and zlib compressed values
+    rollup_3600.log            hourly and daily aggregates of every point:
+    rollup_86400.log           bucket (i64 s) | count (u32) | sum | min | max
+
+The active file is sealed into a chunk of sorted, separately compressed time
+and value columns once it holds CHUNK_POINTS points. Rollups are appended an
+entry per bucket changed, the last entry of a bucket winning, and kept in
+memory so range queries at 1h or 1d steps never read the points. If the
+rollups don't account for every point after a crash they are rebuilt from the
+points when the series is opened.
+
+A point with the time and value of one already in the series is only appended
+if the batch holds it more times than the series, so a batch appended again
+after a failure (with the same receive times) doesn't count its points twice.
+Batches newer than the last point, the usual case, are appended without
+reading the series.
+
+Queries only open series named by the device's metrics, and a series which
+isn't being appended to is opened read only for the query, without truncating
+its active file, rewriting its rollups or being kept open.
+"""
+
+import array
+import bisect
+import collections
+import math
+import os
+import struct
+import threading
+import zlib
+
+SERIES_DIRNAME = "series"
+ACTIVE_PREFIX = "active_"
+ACTIVE_SUFFIX = ".ts"
+CHUNK_PREFIX = "chunk_"
+CHUNK_SUFFIX = ".tsz"
+ROLLUP_PREFIX = "rollup_"
+ROLLUP_SUFFIX = ".log"
+CHUNK_POINTS = 4096
+ROLLUP_RESOLUTIONS = (3600, 86400)
+# Points returned by a query without a step, and buckets chosen by default
+RAW_POINTS_MAX = 10000
+DEFAULT_POINTS = 500
+
+POINT = struct.Struct("<qd")
+CHUNK_HEADER = struct.Struct("<4sIqqI")
+CHUNK_MAGIC = b"TSZ1"
+ROLLUP_ENTRY = struct.Struct("<qIddd")
+
+
+def encode_chunk(points):
+    """Encode sorted (ms, value) points as a chunk"""
+    times = array.array("q", [ms for ms, _ in points])
+    deltas = array.array("q", [times[0]] + [b - a for a, b in zip(times, times[1:])])
+    values = array.array("d", [value for _, value in points])
+    times_blob = zlib.compress(deltas.tobytes())
+    return (CHUNK_HEADER.pack(CHUNK_MAGIC, len(points), times[0], times[-1], len(times_blob))
+            + times_blob + zlib.compress(values.tobytes()))
+
+
+def decode_chunk_header(data):
+    """Return (count, first ms, last ms, times size) of a chunk"""
+    magic, count, first, last, times_size = CHUNK_HEADER.unpack_from(data)
+    if magic != CHUNK_MAGIC:
+        raise ValueError("not a time-series chunk")
+    return count, first, last, times_size
+
+
+def decode_chunk(data):
+    count, _, _, times_size = decode_chunk_header(data)
+    start = CHUNK_HEADER.size
+    deltas = array.array("q", zlib.decompress(data[start:start + times_size]))
+    values = array.array("d", zlib.decompress(data[start + times_size:]))
+    times = []
+    ms = 0
+    for delta in deltas:
+        ms += delta
+        times.append(ms)
+    return list(zip(times, values))[:count]
+
+
+class Series:
+    """The chunks and rollups of one metric"""
+
+    def __init__(self, path, read_only=False):
+        self.path = path
+        self.read_only = read_only
+        self.active_file = None
+        if not read_only:
+            os.makedirs(path, exist_ok=True)
+
+        # Sealed chunks by first point, with their time ranges
+        self.chunks = {}
+        actives = []
+        for name in os.listdir(path):
+            if name.startswith(CHUNK_PREFIX) and name.endswith(CHUNK_SUFFIX):
+                base = int(name[len(CHUNK_PREFIX):-len(CHUNK_SUFFIX)])
+                with open(os.path.join(path, name), "rb") as f:
+                    count, first, last, _ = decode_chunk_header(f.read(CHUNK_HEADER.size))
+                self.chunks[base] = (count, first, last)
+            elif name.startswith(ACTIVE_PREFIX) and name.endswith(ACTIVE_SUFFIX):
+                actives.append(int(name[len(ACTIVE_PREFIX):-len(ACTIVE_SUFFIX)]))
+        self.sealed_count = sum(count for count, _, _ in self.chunks.values())
+
+        # An active file already sealed before a crash is dropped, and a
+        # partial point written by one is truncated. A read only series only
+        # ignores them.
+        active_path = self._active_path(self.sealed_count)
+        size = os.path.getsize(active_path) if os.path.exists(active_path) else 0
+        self.active_count = size // POINT.size
+        if not read_only:
+            for base in actives:
+                if base != self.sealed_count:
+                    os.remove(self._active_path(base))
+            with open(active_path, "ab") as f:
+                f.truncate(size - size % POINT.size)
+            self.active_file = open(active_path, "ab")
+        self.last_ms = max([last for _, _, last in self.chunks.values()]
+                           + [ms for ms, _ in self._active_points()], default=None)
+
+        self.rollups = {}
+        self.rollup_files = {}
+        for resolution in ROLLUP_RESOLUTIONS:
+            self._open_rollup(resolution)
+
+    def _active_path(self, base):
+        return os.path.join(self.path, f"{ACTIVE_PREFIX}{base:010d}{ACTIVE_SUFFIX}")
+
+    def _chunk_path(self, base):
+        return os.path.join(self.path, f"{CHUNK_PREFIX}{base:010d}{CHUNK_SUFFIX}")
+
+    def _rollup_path(self, resolution):
+        return os.path.join(self.path, f"{ROLLUP_PREFIX}{resolution}{ROLLUP_SUFFIX}")
+
+    def count(self):
+        return self.sealed_count + self.active_count
+
+    def _open_rollup(self, resolution):
+        path = self._rollup_path(resolution)
+        buckets = {}
+        entries = 0
+        if os.path.exists(path):
+            with open(path, "rb") as f:
+                data = f.read()
+            usable = len(data) - len(data) % ROLLUP_ENTRY.size
+            for bucket, count, total, low, high in ROLLUP_ENTRY.iter_unpack(data[:usable]):
+                buckets[bucket] = [count, total, low, high]
+                entries += 1
+        if sum(aggregate[0] for aggregate in buckets.values()) != self.count():
+            buckets = {}
+            for ms, value in self.points():
+                self._aggregate(buckets, resolution, ms, value)
+            entries = None
+        self.rollups[resolution] = (sorted(buckets), buckets)
+        if self.read_only:
+            return
+        # Rewritten when rebuilt or mostly superseded entries
+        if entries is None or entries > 2 * len(buckets) + CHUNK_POINTS:
+            with open(path + ".tmp", "wb") as f:
+                for bucket in sorted(buckets):
+                    f.write(ROLLUP_ENTRY.pack(bucket, *buckets[bucket]))
+            os.replace(path + ".tmp", path)
+        self.rollup_files[resolution] = open(path, "ab")
+
+    @staticmethod
+    def _aggregate(buckets, resolution, ms, value):
+        bucket = ms // 1000 // resolution * resolution
+        aggregate = buckets.get(bucket)
+        if aggregate is None:
+            buckets[bucket] = [1, value, value, value]
+        else:
+            aggregate[0] += 1
+            aggregate[1] += value
+            aggregate[2] = min(aggregate[2], value)
+            aggregate[3] = max(aggregate[3], value)
+        return bucket
+
+    def close(self):
+        if self.active_file is not None:
+            self.active_file.close()
+        for f in self.rollup_files.values():
+            f.close()
+
+    def _new_points(self, points):
+        """The points of a batch which aren't in the series already"""
+        first = min(ms for ms, _ in points)
+        if self.last_ms is None or first > self.last_ms:
+            return points
+        existing = collections.Counter(
+            self.points(first, max(ms for ms, _ in points) + 1))
+        new = []
+        for point in points:
+            if existing[point]:
+                existing[point] -= 1
+            else:
+                new.append(point)
+        return new
+
+    def append(self, points):
+        """Append (ms, value) points, then the rollup entries they changed"""
+        points = self._new_points(points) if points else []
+        if not points:
+            return
+        last = max(ms for ms, _ in points)
+        self.last_ms = last if self.last_ms is None else max(self.last_ms, last)
+        for ms, value in points:
+            self.active_file.write(POINT.pack(ms, value))
+            self.active_count += 1
+            if self.active_count >= CHUNK_POINTS:
+                self._seal()
+        self.active_file.flush()
+
+        for resolution, (keys, buckets) in self.rollups.items():
+            changed = set()
+            for ms, value in points:
+                bucket = self._aggregate(buckets, resolution, ms, value)
+                if bucket not in changed:
+                    changed.add(bucket)
+                    if not keys or bucket > keys[-1]:
+                        keys.append(bucket)
+                    else:
+                        position = bisect.bisect_left(keys, bucket)
+                        if keys[position] != bucket:
+                            keys.insert(position, bucket)
+            rollup_file = self.rollup_files[resolution]
+            rollup_file.write(b"".join(
+                ROLLUP_ENTRY.pack(bucket, *buckets[bucket]) for bucket in sorted(changed)))
+            rollup_file.flush()
+
+    def _seal(self):
+        """Compress the active points into a chunk and start a new active file"""
+        self.active_file.close()
+        base = self.sealed_count
+        points = sorted(self._active_points())
+        with open(self._chunk_path(base) + ".tmp", "wb") as f:
+            f.write(encode_chunk(points))
+        os.replace(self._chunk_path(base) + ".tmp", self._chunk_path(base))
+        self.chunks[base] = (len(points), points[0][0], points[-1][0])
+        self.sealed_count += len(points)
+        self.active_count = 0
+        os.remove(self._active_path(base))
+        self.active_file = open(self._active_path(self.sealed_count), "ab")
+
+    def _active_points(self):
+        if not self.active_count:
+            return []
+        with open(self._active_path(self.sealed_count), "rb") as f:
+            data = f.read(self.active_count * POINT.size)
+        return list(POINT.iter_unpack(data))
+
+    def points(self, start_ms=None, end_ms=None):
+        """Return the (ms, value) points in [start, end), in time order"""
+        points = []
+        for base, (_, first, last) in sorted(self.chunks.items()):
+            if (start_ms is not None and last < start_ms) or (end_ms is not None and first >= end_ms):
+                continue
+            with open(self._chunk_path(base), "rb") as f:
+                points += decode_chunk(f.read())
+        points += self._active_points()
+        points = [
+            (ms, value) for ms, value in points
+            if (start_ms is None or ms >= start_ms) and (end_ms is None or ms < end_ms)
+        ]
+        points.sort(key=lambda point: point[0])
+        return points
+
+    def buckets(self, resolution, start, end):
+        """Return the (bucket, count, sum, min, max) rollups of buckets in [start, end)"""
+        keys, buckets = self.rollups[resolution]
+        first = bisect.bisect_left(keys, start // resolution * resolution)
+        last = bisect.bisect_left(keys, end)
+        return [(bucket, *buckets[bucket]) for bucket in keys[first:last]]
+
+
+class TimeSeriesStore:
+    """Time series of every device sensor metric under a base directory"""
+
+    def __init__(self, base_dir):
+        self.base_dir = base_dir
+        self.series = {}
+        self.lock = threading.RLock()
+
+    def series_path(self, device_id, sensor_id, metric):
+        return os.path.join(self.base_dir, device_id, sensor_id, SERIES_DIRNAME, metric)
+
+    @staticmethod
+    def check_name(name):
+        """Raise ValueError unless name is a single path component"""
+        if not name or name in (os.curdir, os.pardir) or "/" in name or "\\" in name:
+            raise ValueError(f"invalid series name {name!r}")
+
+    def _series(self, device_id, sensor_id, metric):
+        """The series appended to, opened and kept open on first use"""
+        key = (device_id, sensor_id, metric)
+        series = self.series.get(key)
+        if series is None:
+            series = Series(self.series_path(device_id, sensor_id, metric))
+            self.series[key] = series
+        return series
+
+    def append_batch(self, items):
+        """Append (device_id, sensor_id, metric, timestamp, value) readings"""
+        with self.lock:
+            grouped = {}
+            for device_id, sensor_id, metric, timestamp, value in items:
+                grouped.setdefault((device_id, sensor_id, metric), []).append(
+                    (int(round(timestamp * 1000)), float(value)))
+            for (device_id, sensor_id, metric), points in grouped.items():
+                self._series(device_id, sensor_id, metric).append(points)
+
+    def metrics(self, device_id):
+        """Return {sensor_id: [metric]} of the series of a device"""
+        self.check_name(device_id)
+        device_path = os.path.join(self.base_dir, device_id)
+        metrics = {}
+        if not os.path.isdir(device_path):
+            return metrics
+        for sensor_id in sorted(os.listdir(device_path)):
+            series_path = os.path.join(device_path, sensor_id, SERIES_DIRNAME)
+            if os.path.isdir(series_path):
+                metrics[sensor_id] = sorted(os.listdir(series_path))
+        return metrics
+
+    def query(self, device_id, sensor_id, metric, start, end, step=None, points=DEFAULT_POINTS):
+        """
+        Return the readings of a metric in [start, end) (unix seconds) in buckets
+        of step seconds, with their count, mean, min and max, or the readings
+        themselves if step is 0. Without a step, one giving up to points
+        buckets is chosen. Buckets are aligned to multiples of the step, so
+        the range is widened to whole buckets, and steps which are multiples
+        of an hour or a day are answered from the rollups. Returns None if
+        the device has no such series and raises ValueError if a name isn't a
+        single path component.
+        """
+        for name in (sensor_id, metric):
+            self.check_name(name)
+        if step is None:
+            step = max(1, math.ceil((end - start) / max(points, 1)))
+            for resolution in ROLLUP_RESOLUTIONS:
+                if step > resolution / 2:
+                    step = math.ceil(step / resolution) * resolution
+        if step:
+            start = start // step * step
+            end = math.ceil(end / step) * step
+        result = {
+            "device_id": device_id,
+            "sensor_id": sensor_id,
+            "metric": metric,
+            "start": start,
+            "end": end,
+            "step": step,
+        }
+        with self.lock:
+            # The series being appended to if open, else a read only one
+            # closed after the query
+            series = self.series.get((device_id, sensor_id, metric))
+            opened = None
+            if series is None:
+                if metric not in self.metrics(device_id).get(sensor_id, []):
+                    return None
+                series = opened = Series(
+                    self.series_path(device_id, sensor_id, metric), read_only=True)
+            try:
+                if step == 0:
+                    readings = series.points(int(start * 1000), int(end * 1000))
+                    result["resolution"] = "raw"
+                    result["truncated"] = len(readings) > RAW_POINTS_MAX
+                    result["points"] = [
+                        {"t": ms / 1000, "value": value}
+                        for ms, value in readings[:RAW_POINTS_MAX]]
+                    return result
+                resolutions = [r for r in ROLLUP_RESOLUTIONS if step % r == 0]
+                if resolutions:
+                    resolution = resolutions[-1]
+                    aggregates = series.buckets(resolution, int(start), int(end))
+                else:
+                    resolution = "raw"
+                    aggregates = [
+                        (ms / 1000, 1, value, value, value)
+                        for ms, value in series.points(int(start * 1000), int(end * 1000))]
+            finally:
+                if opened is not None:
+                    opened.close()
+
+        buckets = {}
+        for t, count, total, low, high in aggregates:
+            bucket = t // step * step
+            aggregate = buckets.get(bucket)
+            if aggregate is None:
+                buckets[bucket] = [count, total, low, high]
+            else:
+                aggregate[0] += count
+                aggregate[1] += total
+                aggregate[2] = min(aggregate[2], low)
+                aggregate[3] = max(aggregate[3], high)
+        result["resolution"] = resolution
+        result["points"] = [
+            {"t": bucket, "count": count, "mean": total / count, "min": low, "max": high}
+            for bucket, (count, total, low, high) in sorted(buckets.items())
+        ]
+        return result
+
+    def close(self, device_id=None):
+        """Close open series, e.g. before a device folder is renamed or deleted"""
+        with self.lock:
+            for key in list(self.series):
+                if device_id is None or key[0] == device_id:
+                    self.series.pop(key).close()